@@ -0,0 +1,41 @@
+#ifndef EMULATOR_ARDUINO_H
+#define EMULATOR_ARDUINO_H
+
+// The part of the Arduino API the display modules use, on the emulator's virtual clock.
+//
+// Time only moves when the emulator advances it (or a module calls delay()), so the display logic runs as
+// fast as the host allows. digitalWrite() and the SPI transfers are routed to the emulated MAX6921.
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <ctype.h>
+#include <algorithm>
+
+using std::min;
+using std::max;
+
+#define HIGH 1
+#define LOW 0
+#define OUTPUT 1
+#define INPUT 0
+#define PROGMEM
+#define pgm_read_byte(address) (*(const uint8_t*)(address))
+
+#define constrain(value, low, high) ((value) < (low) ? (low) : ((value) > (high) ? (high) : (value)))
+
+unsigned long micros();
+unsigned long millis();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+long random(long howBig);
+long random(long howSmall, long howBig);
+void randomSeed(unsigned long seed);
+uint32_t esp_random();
+
+#endif
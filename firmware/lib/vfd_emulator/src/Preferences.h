@@ -0,0 +1,32 @@
+#ifndef EMULATOR_PREFERENCES_H
+#define EMULATOR_PREFERENCES_H
+
+#include <Arduino.h>
+
+// NVS key/value storage in host memory, shared by every Preferences object like the flash is. Only the blob
+// calls the modules under test use are provided. Nothing is kept between runs.
+
+class Preferences {
+private:
+  char name[16];
+  bool opened;
+  bool readOnly;
+
+public:
+  Preferences() : opened(false), readOnly(false) { name[0] = '\0'; }
+
+  bool begin(const char* name, bool readOnly = false, const char* partitionLabel = nullptr);
+  void end() { opened = false; }
+
+  bool isKey(const char* key);
+  bool remove(const char* key);
+  bool clear();
+  size_t putBytes(const char* key, const void* value, size_t length);
+  size_t getBytesLength(const char* key);
+  size_t getBytes(const char* key, void* buffer, size_t maxLength);
+};
+
+// Empties the storage of every namespace, e.g. between test cases
+void hostClearPreferences();
+
+#endif
@@ -0,0 +1,32 @@
+#ifndef EMULATOR_SPI_H
+#define EMULATOR_SPI_H
+
+#include <Arduino.h>
+
+#define MSBFIRST 1
+#define SPI_MODE0 0
+
+class SPISettings {
+public:
+  uint32_t clock;
+
+  SPISettings(uint32_t clock = 1000000, uint8_t bitOrder = MSBFIRST, uint8_t dataMode = SPI_MODE0) : clock(clock) {}
+};
+
+// Each transfer takes the time the bits need at the transaction's clock
+class SPIClass {
+private:
+  uint32_t clock;
+
+public:
+  SPIClass() : clock(1000000) {}
+
+  void begin(int8_t sck = -1, int8_t miso = -1, int8_t mosi = -1, int8_t ss = -1) {}
+  void beginTransaction(const SPISettings& settings) { clock = settings.clock; }
+  void endTransaction() {}
+  uint8_t transfer(uint8_t data);
+};
+
+extern SPIClass SPI;
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef EMULATOR_WIFIUDP_H
+#define EMULATOR_WIFIUDP_H
+
+#include <Arduino.h>
+#include <vector>
+
+// UDP receive side on the host: packets handed to hostSendUdp() queue up for the WiFiUDP bound to their port
+// and are read one per parsePacket(), as on the device. Sending is not emulated.
+
+class WiFiUDP {
+private:
+  uint16_t port;
+  std::vector<uint8_t> packet;                   // Packet taken by the last parsePacket()
+  size_t readOffset;
+
+public:
+  WiFiUDP() : port(0), readOffset(0) {}
+
+  uint8_t begin(uint16_t port);
+  void stop();
+
+  // Takes the next queued packet and returns its size, 0 if there is none
+  int parsePacket();
+  int available() const { return (int)(packet.size() - readOffset); }
+  int read(uint8_t* buffer, size_t length);
+};
+
+// Queues a packet as if it had arrived on port
+void hostSendUdp(uint16_t port, const uint8_t* data, size_t length);
+size_t hostPendingUdp(uint16_t port);
+void hostClearUdp();
+
+#endif
@@ -0,0 +1,360 @@
+// Host emulator of the VFD clock's display.
+//
+// Runs the firmware's multiplexer (MAX6921::refreshDisplay) and one of its renderers on a virtual clock,
+// feeds the emulated tube with the exact pin writes and SPI bytes, and shows the segment brightness measured
+// over the last --window milliseconds in the terminal, as a PNG, or as a brightness matrix that can be kept
+// as a golden file and compared on later runs. One simulated second takes a few milliseconds.
+//
+// The unit tests (pio test -e native) link this library for its Arduino shim and bring their own main(), so the
+// program is left out of their build.
+
+#ifndef PIO_UNIT_TESTING
+
+#include <Arduino.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "host.h"
+#include "vfdtube.h"
+#include "max6921.h"
+#include "clockrenderer.h"
+#include "marquee.h"
+
+#define EMULATOR_DIN_PIN 10                      // The XIAO ESP32-C3 wiring; only LOAD matters to the tube
+#define EMULATOR_CLK_PIN 8
+#define EMULATOR_LOAD_PIN 5
+#define EMULATOR_MAX_STALLS 4
+
+enum Scene {
+  SCENE_CLOCK,
+  SCENE_TEXT,
+  SCENE_MARQUEE,
+};
+
+struct Stall {
+  uint32_t periodUs;                             // The loop blocks for durationUs once every periodUs
+  uint32_t durationUs;
+  uint64_t nextUs;
+};
+
+struct Options {
+  Scene scene;
+  const char* text;
+  uint8_t hour, minute, second;
+  uint32_t runMs;
+  uint32_t windowMs;
+  uint8_t brightness;
+  uint8_t digitLevels[NUM_DIGITS];
+  uint32_t loopUs;                               // Time every loop pass costs besides the multiplex
+  Stall stalls[EMULATOR_MAX_STALLS];
+  uint8_t stallCount;
+  bool terminal;
+  bool color;
+  const char* pngPath;
+  uint8_t pngScale;
+  const char* matrixPath;
+  const char* expectPath;
+  double tolerance;
+  bool help;
+};
+
+static void usage(FILE* out)
+{
+  fprintf(out,
+    "usage: vfd_emulator [options]\n"
+    "  --clock HH:MM:SS         show the clock from this time (default 12:34:56)\n"
+    "  --text TEXT              show static text\n"
+    "  --marquee TEXT           scroll text\n"
+    "  --ms N                   simulated run time in ms (default 2000)\n"
+    "  --window N               measure the last N ms of the run (default 200)\n"
+    "  --brightness N           global brightness 0-255 (default 255)\n"
+    "  --digit POS:LEVEL        brightness of one digit, position 1-%d from the left (repeatable)\n"
+    "  --loop-us N              time each loop pass takes besides the multiplex (default 0)\n"
+    "  --stall PERIOD_MS:US     block the loop for US microseconds every PERIOD_MS (repeatable)\n"
+    "  --png FILE [--scale N]   write the tube as a PNG (scale default 4)\n"
+    "  --matrix FILE            write the brightness matrix (- for stdout)\n"
+    "  --expect FILE            compare with a golden matrix, exit 1 on a mismatch\n"
+    "  --tolerance X            allowed difference per segment (default 0.02)\n"
+    "  --no-terminal            do not draw the tube in the terminal\n"
+    "  --no-color               draw it without ANSI colours\n"
+    "  --help                   show this help\n",
+    NUM_DIGITS);
+}
+
+static bool parsePair(const char* text, unsigned long& first, unsigned long& second)
+{
+  char* end;
+  first = strtoul(text, &end, 10);
+  if (end == text || *end != ':') return false;
+  const char* rest = end + 1;
+  second = strtoul(rest, &end, 10);
+  return end != rest && *end == '\0';
+}
+
+static bool parseOptions(int argc, char** argv, Options& options)
+{
+  options.scene = SCENE_CLOCK;
+  options.text = "";
+  options.hour = 12;
+  options.minute = 34;
+  options.second = 56;
+  options.runMs = 2000;
+  options.windowMs = 200;
+  options.brightness = MAX6921_MAX_BRIGHTNESS;
+  memset(options.digitLevels, MAX6921_MAX_BRIGHTNESS, sizeof(options.digitLevels));
+  options.loopUs = 0;
+  options.stallCount = 0;
+  options.terminal = true;
+  options.color = true;
+  options.pngPath = nullptr;
+  options.pngScale = 4;
+  options.matrixPath = nullptr;
+  options.expectPath = nullptr;
+  options.tolerance = 0.02;
+  options.help = false;
+
+  for (int i = 1; i < argc; i++) {
+    const char* arg = argv[i];
+    if (strcmp(arg, "--help") == 0 || strcmp(arg, "-h") == 0) {
+      options.help = true;
+      return true;
+    }
+
+    const char* value = i + 1 < argc ? argv[i + 1] : nullptr;
+    bool takesValue = strcmp(arg, "--no-terminal") != 0 && strcmp(arg, "--no-color") != 0;
+    if (takesValue && !value) {
+      fprintf(stderr, "%s needs a value\n", arg);
+      return false;
+    }
+
+    unsigned long first, second;
+    if (strcmp(arg, "--clock") == 0) {
+      unsigned hour, minute, sec;
+      if (sscanf(value, "%u:%u:%u", &hour, &minute, &sec) != 3 || hour > 23 || minute > 59 || sec > 59) {
+        fprintf(stderr, "invalid time: %s\n", value);
+        return false;
+      }
+      options.scene = SCENE_CLOCK;
+      options.hour = hour;
+      options.minute = minute;
+      options.second = sec;
+    }
+    else if (strcmp(arg, "--text") == 0) {
+      options.scene = SCENE_TEXT;
+      options.text = value;
+    }
+    else if (strcmp(arg, "--marquee") == 0) {
+      options.scene = SCENE_MARQUEE;
+      options.text = value;
+    }
+    else if (strcmp(arg, "--ms") == 0) {
+      options.runMs = strtoul(value, nullptr, 10);
+    }
+    else if (strcmp(arg, "--window") == 0) {
+      options.windowMs = strtoul(value, nullptr, 10);
+    }
+    else if (strcmp(arg, "--brightness") == 0) {
+      options.brightness = min(strtoul(value, nullptr, 10), (unsigned long)MAX6921_MAX_BRIGHTNESS);
+    }
+    else if (strcmp(arg, "--digit") == 0) {
+      if (!parsePair(value, first, second) || first < 1 || first > NUM_DIGITS || second > MAX6921_MAX_BRIGHTNESS) {
+        fprintf(stderr, "invalid digit brightness: %s\n", value);
+        return false;
+      }
+      options.digitLevels[first - 1] = second;
+    }
+    else if (strcmp(arg, "--loop-us") == 0) {
+      options.loopUs = strtoul(value, nullptr, 10);
+    }
+    else if (strcmp(arg, "--stall") == 0) {
+      if (!parsePair(value, first, second) || first == 0 || options.stallCount >= EMULATOR_MAX_STALLS) {
+        fprintf(stderr, "invalid stall: %s\n", value);
+        return false;
+      }
+      Stall& stall = options.stalls[options.stallCount++];
+      stall.periodUs = first * 1000;
+      stall.durationUs = second;
+      stall.nextUs = stall.periodUs;
+    }
+    else if (strcmp(arg, "--png") == 0) {
+      options.pngPath = value;
+    }
+    else if (strcmp(arg, "--scale") == 0) {
+      options.pngScale = constrain(strtoul(value, nullptr, 10), 1UL, 32UL);
+    }
+    else if (strcmp(arg, "--matrix") == 0) {
+      options.matrixPath = value;
+    }
+    else if (strcmp(arg, "--expect") == 0) {
+      options.expectPath = value;
+    }
+    else if (strcmp(arg, "--tolerance") == 0) {
+      options.tolerance = strtod(value, nullptr);
+    }
+    else if (strcmp(arg, "--no-terminal") == 0) {
+      options.terminal = false;
+    }
+    else if (strcmp(arg, "--no-color") == 0) {
+      options.color = false;
+    }
+    else {
+      fprintf(stderr, "unknown option: %s\n", arg);
+      return false;
+    }
+
+    if (takesValue) {
+      i++;
+    }
+  }
+
+  if (options.windowMs == 0 || options.windowMs > options.runMs) {
+    fprintf(stderr, "the window must be between 1 ms and the run time\n");
+    return false;
+  }
+  return true;
+}
+
+int main(int argc, char** argv)
+{
+  Options options;
+  if (!parseOptions(argc, argv, options)) {
+    usage(stderr);
+    return 2;
+  }
+  if (options.help) {
+    usage(stdout);
+    return 0;
+  }
+
+  VfdTube tube(EMULATOR_LOAD_PIN);
+  hostAttachTube(&tube);
+
+  MAX6921 display(EMULATOR_DIN_PIN, EMULATOR_CLK_PIN, EMULATOR_LOAD_PIN, DIGIT_PINS, NUM_DIGITS, SEGMENT_PINS,
+                  NUM_SEGMENTS);
+  ClockRenderer clockRenderer(display);
+  Marquee marquee(display);
+
+  display.begin();
+  display.setBrightness(options.brightness);
+  for (uint8_t i = 0; i < NUM_DIGITS; i++) {
+    display.setDigitBrightness(i, options.digitLevels[i]);
+  }
+
+  switch (options.scene) {
+  case SCENE_CLOCK:
+    clockRenderer.begin();
+    clockRenderer.setTime(options.hour, options.minute, options.second, 0);
+    break;
+  case SCENE_TEXT:
+    display.setDisplayText(options.text);
+    break;
+  case SCENE_MARQUEE:
+    marquee.setText(options.text);
+    break;
+  }
+
+  clock_t started = clock();
+  uint64_t endUs = hostMicros() + (uint64_t)options.runMs * 1000;
+  uint64_t windowUs = endUs - (uint64_t)options.windowMs * 1000;
+  bool measuring = false;
+  uint32_t passes = 0;
+
+  // The firmware's loop: draw, multiplex, then sleep until the multiplex has work again
+  while (hostMicros() < endUs) {
+    if (!measuring && hostMicros() >= windowUs) {
+      // The duty analyzer is left alone: it always covers the last second of the run
+      tube.resetWindow(hostMicros());
+      display.resetRefreshStats();
+      measuring = true;
+    }
+
+    if (options.scene == SCENE_CLOCK) {
+      clockRenderer.update();
+    }
+    else if (options.scene == SCENE_MARQUEE) {
+      marquee.update();
+    }
+
+    display.refreshDisplay();
+    passes++;
+
+    hostAdvanceMicros(options.loopUs);
+    for (uint8_t i = 0; i < options.stallCount; i++) {
+      Stall& stall = options.stalls[i];
+      if (hostMicros() >= stall.nextUs) {
+        hostAdvanceMicros(stall.durationUs);
+        stall.nextUs += stall.periodUs;
+      }
+    }
+
+    unsigned long wait = display.getMicrosToNextRefresh();
+    uint64_t remaining = endUs - hostMicros();
+    if (!measuring && windowUs > hostMicros() && windowUs - hostMicros() < remaining) {
+      remaining = windowUs - hostMicros();
+    }
+    hostAdvanceMicros(wait == 0 ? 1 : (wait < remaining ? wait : remaining));
+  }
+  tube.integrate(hostMicros());
+  double wallMs = (double)(clock() - started) * 1000.0 / CLOCKS_PER_SEC;
+
+  if (options.terminal) {
+    tube.renderTerminal(stdout, options.color);
+  }
+
+  fprintf(stderr, "%lu ms simulated in %.1f ms, %lu loop passes; window %lu ms: %lu latches, %lu with several "
+          "grids (%lu us overlap), max slot %lu us; ",
+          (unsigned long)options.runMs, wallMs, (unsigned long)passes, (unsigned long)options.windowMs,
+          (unsigned long)tube.getLatches(), (unsigned long)tube.getGhostLatches(),
+          (unsigned long)tube.getOverlapUs(), display.getMaxRefreshGap());
+  DutyAnalyzer& duty = display.getDutyAnalyzer();
+  if (duty.isReady()) {
+    fprintf(stderr, "imbalance over the last %lu ms %.1f%%\n", (unsigned long)(duty.getWindowUs() / 1000),
+            duty.getImbalancePercent());
+  }
+  else {
+    fprintf(stderr, "no imbalance (runs shorter than %lu ms)\n", DUTY_SLICE_US * DUTY_WINDOW_SLICES / 1000);
+  }
+
+  int status = 0;
+
+  if (options.pngPath && !tube.writePng(options.pngPath, options.pngScale)) {
+    fprintf(stderr, "cannot write %s\n", options.pngPath);
+    status = 2;
+  }
+
+  if (options.matrixPath) {
+    FILE* out = strcmp(options.matrixPath, "-") == 0 ? stdout : fopen(options.matrixPath, "w");
+    if (out) {
+      tube.writeMatrix(out);
+      if (out != stdout) {
+        fclose(out);
+      }
+    }
+    else {
+      fprintf(stderr, "cannot write %s\n", options.matrixPath);
+      status = 2;
+    }
+  }
+
+  if (options.expectPath) {
+    int mismatches = tube.compareMatrix(options.expectPath, options.tolerance, stderr);
+    if (mismatches < 0) {
+      fprintf(stderr, "cannot read %s\n", options.expectPath);
+      status = 2;
+    }
+    else if (mismatches > 0) {
+      fprintf(stderr, "%d segments differ from %s by more than %.3f\n", mismatches, options.expectPath,
+              options.tolerance);
+      if (status == 0) {
+        status = 1;
+      }
+    }
+    else {
+      fprintf(stderr, "matches %s\n", options.expectPath);
+    }
+  }
+
+  return status;
+}
+#endif
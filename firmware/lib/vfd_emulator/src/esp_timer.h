@@ -0,0 +1,27 @@
+#ifndef EMULATOR_ESP_TIMER_H
+#define EMULATOR_ESP_TIMER_H
+
+#include <stdint.h>
+
+// esp_timer on the virtual clock. One-shot timers are kept but fire only when a task waits for a notification
+// (see freertos/task.h): that wait moves the clock to the earliest armed timer and runs its callback.
+
+typedef int esp_err_t;
+#define ESP_OK 0
+#define ESP_FAIL -1
+
+typedef struct esp_timer* esp_timer_handle_t;
+typedef void (*esp_timer_cb_t)(void* arg);
+
+typedef struct {
+  esp_timer_cb_t callback;
+  void* arg;
+  const char* name;
+} esp_timer_create_args_t;
+
+int64_t esp_timer_get_time();
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle);
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs);
+esp_err_t esp_timer_stop(esp_timer_handle_t timer);
+
+#endif
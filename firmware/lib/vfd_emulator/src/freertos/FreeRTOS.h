@@ -0,0 +1,17 @@
+#ifndef EMULATOR_FREERTOS_H
+#define EMULATOR_FREERTOS_H
+
+#include <stdint.h>
+
+// The single task of the host build: FreeRTOS types and tick conversion (1 ms ticks, as configured on the clock)
+
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef uint32_t TickType_t;
+
+#define pdTRUE 1
+#define pdFALSE 0
+#define portMAX_DELAY UINT32_MAX
+#define pdMS_TO_TICKS(ms) ((TickType_t)(ms))
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef EMULATOR_FREERTOS_TASK_H
+#define EMULATOR_FREERTOS_TASK_H
+
+#include "FreeRTOS.h"
+
+// Task notifications for the one task there is. Waiting for a notification advances the virtual clock to the
+// earliest armed esp_timer, which runs its callback, or by the timeout if no timer fires first.
+
+typedef struct HostTask* TaskHandle_t;
+
+TaskHandle_t xTaskGetCurrentTaskHandle();
+BaseType_t xTaskNotifyGive(TaskHandle_t task);
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait);
+
+#endif
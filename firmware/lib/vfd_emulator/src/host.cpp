@@ -0,0 +1,99 @@
+#include <Arduino.h>
+#include <SPI.h>
+#include <esp_timer.h>
+#include "host.h"
+#include "vfdtube.h"
+
+static uint64_t nowUs = 0;
+static VfdTube* attachedTube = nullptr;
+static uint32_t randomState = 1;
+
+SPIClass SPI;
+
+uint64_t hostMicros()
+{
+  return nowUs;
+}
+
+void hostAdvanceMicros(uint64_t us)
+{
+  nowUs += us;
+}
+
+void hostAttachTube(VfdTube* tube)
+{
+  attachedTube = tube;
+}
+
+unsigned long micros()
+{
+  return (unsigned long)nowUs;
+}
+
+unsigned long millis()
+{
+  return (unsigned long)(nowUs / 1000);
+}
+
+void delay(unsigned long ms)
+{
+  nowUs += (uint64_t)ms * 1000;
+}
+
+void delayMicroseconds(unsigned int us)
+{
+  nowUs += us;
+}
+
+int64_t esp_timer_get_time()
+{
+  return (int64_t)nowUs;
+}
+
+void pinMode(uint8_t pin, uint8_t mode)
+{
+}
+
+void digitalWrite(uint8_t pin, uint8_t value)
+{
+  if (attachedTube) {
+    attachedTube->writePin(pin, value, nowUs);
+  }
+}
+
+uint8_t SPIClass::transfer(uint8_t data)
+{
+  // Eight clocks at the transaction's rate; the byte is in the shift register at the end of them
+  nowUs += (8000000ULL + clock - 1) / clock;
+  if (attachedTube) {
+    attachedTube->shiftByte(data, nowUs);
+  }
+  return 0;
+}
+
+// Deterministic, so that scenes with random effects render the same on every run
+long random(long howBig)
+{
+  if (howBig <= 0) return 0;
+  return (long)(esp_random() % (uint32_t)howBig);
+}
+
+long random(long howSmall, long howBig)
+{
+  if (howSmall >= howBig) return howSmall;
+  return howSmall + random(howBig - howSmall);
+}
+
+void randomSeed(unsigned long seed)
+{
+  randomState = seed ? (uint32_t)seed : 1;
+}
+
+uint32_t esp_random()
+{
+  // xorshift32
+  randomState ^= randomState << 13;
+  randomState ^= randomState >> 17;
+  randomState ^= randomState << 5;
+  return randomState;
+}
@@ -0,0 +1,19 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include <stdint.h>
+
+class VfdTube;
+
+// Virtual time and pin routing behind the Arduino shim.
+//
+// The clock starts at 0 and only moves when the emulator advances it, when a module calls delay(), or while
+// an SPI byte is clocked out. It is 64 bits wide, so micros() never wraps during a run.
+
+uint64_t hostMicros();
+void hostAdvanceMicros(uint64_t us);
+
+// Routes digitalWrite() and SPI.transfer() to the tube; null detaches it
+void hostAttachTube(VfdTube* tube);
+
+#endif
@@ -0,0 +1,81 @@
+#include <Preferences.h>
+#include <map>
+#include <string>
+#include <vector>
+
+// Namespace and key, joined by a character NVS names cannot contain
+static std::map<std::string, std::vector<uint8_t>> storage;
+
+static std::string entryName(const char* space, const char* key)
+{
+  return std::string(space) + '\n' + key;
+}
+
+void hostClearPreferences()
+{
+  storage.clear();
+}
+
+bool Preferences::begin(const char* name, bool readOnly, const char* partitionLabel)
+{
+  // NVS limits namespace names to 15 characters
+  if (strlen(name) >= sizeof(this->name)) return false;
+
+  strcpy(this->name, name);
+  this->readOnly = readOnly;
+  opened = true;
+  return true;
+}
+
+bool Preferences::isKey(const char* key)
+{
+  return opened && storage.count(entryName(name, key)) > 0;
+}
+
+bool Preferences::remove(const char* key)
+{
+  if (!opened || readOnly) return false;
+  return storage.erase(entryName(name, key)) > 0;
+}
+
+bool Preferences::clear()
+{
+  if (!opened || readOnly) return false;
+
+  std::string prefix = entryName(name, "");
+  for (auto entry = storage.begin(); entry != storage.end();) {
+    if (entry->first.compare(0, prefix.size(), prefix) == 0) {
+      entry = storage.erase(entry);
+    }
+    else {
+      ++entry;
+    }
+  }
+  return true;
+}
+
+size_t Preferences::putBytes(const char* key, const void* value, size_t length)
+{
+  if (!opened || readOnly || value == nullptr || length == 0) return 0;
+
+  const uint8_t* bytes = (const uint8_t*)value;
+  storage[entryName(name, key)].assign(bytes, bytes + length);
+  return length;
+}
+
+size_t Preferences::getBytesLength(const char* key)
+{
+  if (!opened) return 0;
+
+  auto entry = storage.find(entryName(name, key));
+  return entry != storage.end() ? entry->second.size() : 0;
+}
+
+size_t Preferences::getBytes(const char* key, void* buffer, size_t maxLength)
+{
+  size_t length = getBytesLength(key);
+  if (length == 0 || length > maxLength) return 0;
+
+  memcpy(buffer, storage[entryName(name, key)].data(), length);
+  return length;
+}
@@ -0,0 +1,82 @@
+#include <esp_timer.h>
+#include <freertos/task.h>
+#include <vector>
+#include "host.h"
+
+struct esp_timer {
+  esp_timer_cb_t callback;
+  void* arg;
+  bool armed;
+  uint64_t dueUs;
+};
+
+struct HostTask {
+  uint32_t notifications;
+};
+
+static std::vector<esp_timer*> timers;             // Live until the program ends (no esp_timer_delete())
+static HostTask loopTask = { 0 };
+
+esp_err_t esp_timer_create(const esp_timer_create_args_t* args, esp_timer_handle_t* handle)
+{
+  *handle = new esp_timer { args->callback, args->arg, false, 0 };
+  timers.push_back(*handle);
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_start_once(esp_timer_handle_t timer, uint64_t timeoutUs)
+{
+  timer->armed = true;
+  timer->dueUs = hostMicros() + timeoutUs;
+  return ESP_OK;
+}
+
+esp_err_t esp_timer_stop(esp_timer_handle_t timer)
+{
+  if (!timer->armed) return ESP_FAIL;
+
+  timer->armed = false;
+  return ESP_OK;
+}
+
+TaskHandle_t xTaskGetCurrentTaskHandle()
+{
+  return &loopTask;
+}
+
+BaseType_t xTaskNotifyGive(TaskHandle_t task)
+{
+  task->notifications++;
+  return pdTRUE;
+}
+
+uint32_t ulTaskNotifyTake(BaseType_t clearOnExit, TickType_t ticksToWait)
+{
+  uint64_t timeoutUs = hostMicros() + (uint64_t)ticksToWait * 1000;
+
+  while (loopTask.notifications == 0) {
+    esp_timer* next = nullptr;
+    for (esp_timer* timer : timers) {
+      if (timer->armed && (next == nullptr || timer->dueUs < next->dueUs)) {
+        next = timer;
+      }
+    }
+
+    if (next == nullptr || next->dueUs > timeoutUs) {
+      if (timeoutUs > hostMicros()) {
+        hostAdvanceMicros(timeoutUs - hostMicros());
+      }
+      return 0;
+    }
+
+    if (next->dueUs > hostMicros()) {
+      hostAdvanceMicros(next->dueUs - hostMicros());
+    }
+    next->armed = false;
+    next->callback(next->arg);
+  }
+
+  uint32_t count = loopTask.notifications;
+  loopTask.notifications = clearOnExit ? 0 : count - 1;
+  return count;
+}
@@ -0,0 +1,60 @@
+#include <WiFiUdp.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+static std::map<uint16_t, std::deque<std::vector<uint8_t>>> queues;
+
+void hostSendUdp(uint16_t port, const uint8_t* data, size_t length)
+{
+  queues[port].emplace_back(data, data + length);
+}
+
+size_t hostPendingUdp(uint16_t port)
+{
+  auto queue = queues.find(port);
+  return queue != queues.end() ? queue->second.size() : 0;
+}
+
+void hostClearUdp()
+{
+  queues.clear();
+}
+
+uint8_t WiFiUDP::begin(uint16_t port)
+{
+  this->port = port;
+  return 1;
+}
+
+void WiFiUDP::stop()
+{
+  packet.clear();
+  readOffset = 0;
+  port = 0;
+}
+
+int WiFiUDP::parsePacket()
+{
+  // Whatever was not read of the previous packet is lost, as with the lwIP socket
+  packet.clear();
+  readOffset = 0;
+  if (port == 0) return 0;
+
+  auto queue = queues.find(port);
+  if (queue == queues.end() || queue->second.empty()) return 0;
+
+  packet.swap(queue->second.front());
+  queue->second.pop_front();
+  return (int)packet.size();
+}
+
+int WiFiUDP::read(uint8_t* buffer, size_t length)
+{
+  size_t count = min(length, packet.size() - readOffset);
+  if (count == 0) return 0;
+
+  memcpy(buffer, packet.data() + readOffset, count);
+  readOffset += count;
+  return (int)count;
+}
@@ -0,0 +1,369 @@
+#include "vfdtube.h"
+#include <string.h>
+#include <math.h>
+
+#define PNG_CELL_WIDTH 10                        // Digit cell in segment units, scaled by writePng()
+#define PNG_CELL_HEIGHT 17
+#define PNG_MARGIN 2
+#define PNG_MAX_STORED_BLOCK 65535
+
+struct SegmentRect {
+  uint8_t x0, y0, x1, y1;                        // Half-open, in cell units
+};
+
+// A B C D E F G H, in the order of the segment masks
+static const SegmentRect SEGMENT_RECTS[VFDTUBE_SEGMENTS] = {
+  { 2, 1, 7, 2 },
+  { 7, 2, 8, 8 },
+  { 7, 9, 8, 15 },
+  { 2, 15, 7, 16 },
+  { 1, 9, 2, 15 },
+  { 1, 2, 2, 8 },
+  { 2, 8, 7, 9 },
+  { 8, 15, 9, 16 },
+};
+
+static const uint8_t BACKGROUND[3] = { 0x08, 0x0A, 0x0A };
+static const uint8_t UNLIT_SEGMENT[3] = { 0x18, 0x20, 0x20 };
+static const uint8_t PHOSPHOR[3] = { VFDTUBE_PHOSPHOR_RED, VFDTUBE_PHOSPHOR_GREEN, VFDTUBE_PHOSPHOR_BLUE };
+
+static uint8_t countGrids(uint32_t outputs)
+{
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < NUM_DIGITS; i++) {
+    if (outputs & (1UL << DIGIT_PINS[i])) {
+      count++;
+    }
+  }
+  return count;
+}
+
+VfdTube::VfdTube(uint8_t loadPin)
+  : loadPin(loadPin), loadHigh(false), shiftRegister(0), outputs(0), lastChangeUs(0), windowStartUs(0),
+    overlapUs(0), latches(0), ghostLatches(0)
+{
+  memset(onTimeUs, 0, sizeof(onTimeUs));
+}
+
+void VfdTube::writePin(uint8_t pin, uint8_t value, uint64_t nowUs)
+{
+  if (pin != loadPin) return;
+
+  if (value && !loadHigh) {
+    latch(nowUs);
+  }
+  loadHigh = value;
+}
+
+void VfdTube::shiftByte(uint8_t data, uint64_t nowUs)
+{
+  shiftRegister = (shiftRegister << 8) | data;
+
+  // The latch is transparent while LOAD is high, so the outputs see every partial shift
+  if (loadHigh) {
+    latch(nowUs);
+  }
+}
+
+void VfdTube::latch(uint64_t nowUs)
+{
+  integrate(nowUs);
+
+  outputs = shiftRegister & VFDTUBE_OUTPUT_MASK;
+  latches++;
+  if (countGrids(outputs) > 1) {
+    ghostLatches++;
+  }
+}
+
+void VfdTube::integrate(uint64_t nowUs)
+{
+  if (nowUs <= lastChangeUs) return;
+
+  uint64_t elapsed = nowUs - lastChangeUs;
+  lastChangeUs = nowUs;
+
+  if (countGrids(outputs) > 1) {
+    overlapUs += elapsed;
+  }
+
+  for (uint8_t i = 0; i < NUM_DIGITS; i++) {
+    if (!(outputs & (1UL << DIGIT_PINS[i]))) continue;
+
+    // DIGIT_PINS counts from the right of the tube
+    uint8_t position = NUM_DIGITS - 1 - i;
+    for (uint8_t s = 0; s < VFDTUBE_SEGMENTS && s < NUM_SEGMENTS; s++) {
+      if (outputs & (1UL << SEGMENT_PINS[s])) {
+        onTimeUs[position][s] += elapsed;
+      }
+    }
+  }
+}
+
+void VfdTube::resetWindow(uint64_t nowUs)
+{
+  integrate(nowUs);
+  memset(onTimeUs, 0, sizeof(onTimeUs));
+  overlapUs = 0;
+  latches = 0;
+  ghostLatches = 0;
+  windowStartUs = lastChangeUs;
+}
+
+double VfdTube::getBrightness(uint8_t position, uint8_t segment) const
+{
+  uint64_t window = getWindowUs();
+  if (window == 0 || position >= NUM_DIGITS || segment >= VFDTUBE_SEGMENTS) return 0.0;
+
+  return (double)onTimeUs[position][segment] * NUM_DIGITS / window;
+}
+
+double VfdTube::getDigitBrightness(uint8_t position) const
+{
+  double brightest = 0.0;
+  for (uint8_t s = 0; s < VFDTUBE_SEGMENTS; s++) {
+    double level = getBrightness(position, s);
+    if (level > brightest) {
+      brightest = level;
+    }
+  }
+  return brightest;
+}
+
+void VfdTube::renderTerminal(FILE* out, bool color) const
+{
+  // Character cells of each segment: row, column and glyph
+  static const uint8_t ROWS[VFDTUBE_SEGMENTS] = { 0, 1, 2, 2, 2, 1, 1, 2 };
+  static const uint8_t COLUMNS[VFDTUBE_SEGMENTS] = { 1, 2, 2, 1, 0, 0, 1, 3 };
+  static const char GLYPHS[VFDTUBE_SEGMENTS] = { '_', '|', '|', '_', '|', '|', '_', '.' };
+
+  for (uint8_t row = 0; row < 3; row++) {
+    for (uint8_t position = 0; position < NUM_DIGITS; position++) {
+      for (uint8_t column = 0; column < 4; column++) {
+        // The segment drawn in this cell, if any
+        int segment = -1;
+        for (uint8_t s = 0; s < VFDTUBE_SEGMENTS; s++) {
+          if (ROWS[s] == row && COLUMNS[s] == column) {
+            segment = s;
+            break;
+          }
+        }
+
+        double level = segment >= 0 ? getBrightness(position, segment) : 0.0;
+        if (level < VFDTUBE_MIN_VISIBLE) {
+          fputc(' ', out);
+          continue;
+        }
+
+        if (color) {
+          double scale = level > 1.0 ? 1.0 : level;
+          fprintf(out, "\x1b[38;2;%d;%d;%dm%c\x1b[0m", (int)lround(PHOSPHOR[0] * scale),
+                  (int)lround(PHOSPHOR[1] * scale), (int)lround(PHOSPHOR[2] * scale), GLYPHS[segment]);
+        }
+        else {
+          fputc(GLYPHS[segment], out);
+        }
+      }
+    }
+    fputc('\n', out);
+  }
+}
+
+static uint32_t crc32Update(uint32_t crc, const uint8_t* data, size_t length)
+{
+  static uint32_t table[256];
+  static bool tableReady = false;
+
+  if (!tableReady) {
+    for (uint32_t n = 0; n < 256; n++) {
+      uint32_t c = n;
+      for (int k = 0; k < 8; k++) {
+        c = (c & 1) ? 0xEDB88320UL ^ (c >> 1) : c >> 1;
+      }
+      table[n] = c;
+    }
+    tableReady = true;
+  }
+
+  crc = ~crc;
+  for (size_t i = 0; i < length; i++) {
+    crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+  }
+  return ~crc;
+}
+
+static void putBigEndian(uint8_t* out, uint32_t value)
+{
+  out[0] = value >> 24;
+  out[1] = value >> 16;
+  out[2] = value >> 8;
+  out[3] = value;
+}
+
+static bool writeChunk(FILE* file, const char* type, const uint8_t* data, uint32_t length)
+{
+  uint8_t header[8];
+  putBigEndian(header, length);
+  memcpy(header + 4, type, 4);
+
+  uint32_t crc = crc32Update(0, header + 4, 4);
+  crc = crc32Update(crc, data, length);
+  uint8_t trailer[4];
+  putBigEndian(trailer, crc);
+
+  return fwrite(header, 1, 8, file) == 8 && (length == 0 || fwrite(data, 1, length, file) == length) &&
+         fwrite(trailer, 1, 4, file) == 4;
+}
+
+bool VfdTube::writePng(const char* path, uint8_t scale) const
+{
+  if (scale == 0) {
+    scale = 1;
+  }
+
+  const uint32_t width = (NUM_DIGITS * PNG_CELL_WIDTH + 2 * PNG_MARGIN) * scale;
+  const uint32_t height = (PNG_CELL_HEIGHT + 2 * PNG_MARGIN) * scale;
+  const uint32_t rowBytes = 1 + width * 3;       // Filter type 0, then RGB
+  const uint32_t rawSize = rowBytes * height;
+
+  uint8_t* raw = new uint8_t[rawSize];
+  for (uint32_t y = 0; y < height; y++) {
+    uint8_t* row = raw + y * rowBytes;
+    row[0] = 0;
+    for (uint32_t x = 0; x < width; x++) {
+      memcpy(row + 1 + x * 3, BACKGROUND, 3);
+    }
+  }
+
+  for (uint8_t position = 0; position < NUM_DIGITS; position++) {
+    for (uint8_t s = 0; s < VFDTUBE_SEGMENTS; s++) {
+      double level = getBrightness(position, s);
+      if (level > 1.0) {
+        level = 1.0;
+      }
+
+      // Unlit segments stay faintly visible, as they do on the tube
+      uint8_t color[3];
+      for (int c = 0; c < 3; c++) {
+        double value = UNLIT_SEGMENT[c] + (PHOSPHOR[c] - UNLIT_SEGMENT[c]) * level;
+        color[c] = (uint8_t)lround(value < 0 ? 0 : value);
+      }
+
+      const SegmentRect& rect = SEGMENT_RECTS[s];
+      uint32_t left = (PNG_MARGIN + position * PNG_CELL_WIDTH) * scale;
+      uint32_t top = PNG_MARGIN * scale;
+      for (uint32_t y = top + rect.y0 * scale; y < top + rect.y1 * scale; y++) {
+        for (uint32_t x = left + rect.x0 * scale; x < left + rect.x1 * scale; x++) {
+          memcpy(raw + y * rowBytes + 1 + x * 3, color, 3);
+        }
+      }
+    }
+  }
+
+  // zlib stream of stored (uncompressed) deflate blocks, so no compression library is needed
+  uint32_t blocks = (rawSize + PNG_MAX_STORED_BLOCK - 1) / PNG_MAX_STORED_BLOCK;
+  uint32_t zlibSize = 2 + blocks * 5 + rawSize + 4;
+  uint8_t* zlib = new uint8_t[zlibSize];
+  uint32_t length = 0;
+  zlib[length++] = 0x78;
+  zlib[length++] = 0x01;
+
+  uint32_t a = 1, b = 0;
+  for (uint32_t offset = 0; offset < rawSize; offset += PNG_MAX_STORED_BLOCK) {
+    uint32_t size = rawSize - offset < PNG_MAX_STORED_BLOCK ? rawSize - offset : PNG_MAX_STORED_BLOCK;
+    zlib[length++] = offset + size == rawSize ? 1 : 0;
+    zlib[length++] = size & 0xFF;
+    zlib[length++] = size >> 8;
+    zlib[length++] = ~size & 0xFF;
+    zlib[length++] = (~size >> 8) & 0xFF;
+    memcpy(zlib + length, raw + offset, size);
+    length += size;
+
+    for (uint32_t i = 0; i < size; i++) {
+      a = (a + raw[offset + i]) % 65521;
+      b = (b + a) % 65521;
+    }
+  }
+  putBigEndian(zlib + length, (b << 16) | a);
+  length += 4;
+
+  uint8_t header[13];
+  putBigEndian(header, width);
+  putBigEndian(header + 4, height);
+  header[8] = 8;                                 // Bit depth
+  header[9] = 2;                                 // Truecolour
+  header[10] = 0;
+  header[11] = 0;
+  header[12] = 0;
+
+  static const uint8_t SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+  bool written = false;
+  FILE* file = fopen(path, "wb");
+  if (file) {
+    written = fwrite(SIGNATURE, 1, sizeof(SIGNATURE), file) == sizeof(SIGNATURE) &&
+              writeChunk(file, "IHDR", header, sizeof(header)) && writeChunk(file, "IDAT", zlib, length) &&
+              writeChunk(file, "IEND", nullptr, 0);
+    written = fclose(file) == 0 && written;
+  }
+
+  delete[] zlib;
+  delete[] raw;
+  return written;
+}
+
+void VfdTube::writeMatrix(FILE* out) const
+{
+  fprintf(out, "# Segment brightness per digit from the left: A B C D E F G H (1.000 = full multiplex duty)\n");
+  for (uint8_t position = 0; position < NUM_DIGITS; position++) {
+    fprintf(out, "%d", position + 1);
+    for (uint8_t s = 0; s < VFDTUBE_SEGMENTS; s++) {
+      fprintf(out, " %.3f", getBrightness(position, s));
+    }
+    fputc('\n', out);
+  }
+}
+
+int VfdTube::compareMatrix(const char* path, double tolerance, FILE* out) const
+{
+  FILE* file = fopen(path, "r");
+  if (!file) return -1;
+
+  static const char SEGMENT_NAMES[] = "ABCDEFGH";
+
+  int mismatches = 0;
+  bool seen[NUM_DIGITS] = {};
+  char line[256];
+  while (fgets(line, sizeof(line), file)) {
+    if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+
+    int digit;
+    double expected[VFDTUBE_SEGMENTS];
+    if (sscanf(line, "%d %lf %lf %lf %lf %lf %lf %lf %lf", &digit, &expected[0], &expected[1], &expected[2],
+               &expected[3], &expected[4], &expected[5], &expected[6], &expected[7]) != 1 + VFDTUBE_SEGMENTS ||
+        digit < 1 || digit > NUM_DIGITS) {
+      fprintf(out, "%s: malformed line: %s", path, line);
+      mismatches++;
+      continue;
+    }
+
+    uint8_t position = digit - 1;
+    seen[position] = true;
+    for (uint8_t s = 0; s < VFDTUBE_SEGMENTS; s++) {
+      double actual = getBrightness(position, s);
+      if (fabs(actual - expected[s]) > tolerance) {
+        fprintf(out, "digit %d segment %c: %.3f, expected %.3f\n", digit, SEGMENT_NAMES[s], actual, expected[s]);
+        mismatches++;
+      }
+    }
+  }
+  fclose(file);
+
+  for (uint8_t position = 0; position < NUM_DIGITS; position++) {
+    if (!seen[position]) {
+      fprintf(out, "%s: digit %d is missing\n", path, position + 1);
+      mismatches++;
+    }
+  }
+  return mismatches;
+}
@@ -0,0 +1,85 @@
+#ifndef VFDTUBE_H
+#define VFDTUBE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "vfdpins.h"
+
+// Emulated MAX6921 and IV-21 tube.
+//
+// The MAX6921 is a 20-bit shift register in front of a latch: bytes clocked in on DIN shift the register
+// left, and the outputs follow the register while LOAD is high (they latch on its rising edge and hold while
+// it is low). OUT-n is bit n of the latched word. The tube is wired through DIGIT_PINS and SEGMENT_PINS
+// (vfdpins.h): a segment glows while its anode and its digit's grid are both high.
+//
+// Between two output changes the tube adds the elapsed time to every segment that glowed, so the on-time of
+// each segment over a window is exact, however the multiplex is timed. Brightness is that on-time as a share
+// of the window times the digit count: a digit lit for its whole 1/N slot of every frame reads 1.0. Any grids
+// high at the same time count as overlap, which on a real tube shows as ghosting.
+
+#define VFDTUBE_OUTPUTS 20
+#define VFDTUBE_OUTPUT_MASK 0xFFFFFUL
+#define VFDTUBE_SEGMENTS 8                       // A-G and the period (H)
+#define VFDTUBE_MIN_VISIBLE 0.02                 // Brightness below this renders as off
+
+// Phosphor colour of the IV-21 at full brightness
+#define VFDTUBE_PHOSPHOR_RED 0x50
+#define VFDTUBE_PHOSPHOR_GREEN 0xFF
+#define VFDTUBE_PHOSPHOR_BLUE 0xD0
+
+class VfdTube {
+private:
+  uint8_t loadPin;
+  bool loadHigh;
+  uint32_t shiftRegister;
+  uint32_t outputs;
+
+  uint64_t lastChangeUs;                         // When the outputs last changed (integrated up to here)
+  uint64_t windowStartUs;
+  uint64_t onTimeUs[NUM_DIGITS][VFDTUBE_SEGMENTS];  // Digits from the left
+  uint64_t overlapUs;                            // Time with more than one grid high
+  uint32_t latches;
+  uint32_t ghostLatches;                         // Latches that left more than one grid high
+
+  void latch(uint64_t nowUs);
+
+public:
+  VfdTube(uint8_t loadPin);
+
+  // Fed by the Arduino shim with the firmware's pin writes and SPI bytes
+  void writePin(uint8_t pin, uint8_t value, uint64_t nowUs);
+  void shiftByte(uint8_t data, uint64_t nowUs);
+
+  // Adds the on-time up to nowUs; call before reading the window
+  void integrate(uint64_t nowUs);
+
+  // Starts a new measurement window at nowUs
+  void resetWindow(uint64_t nowUs);
+
+  uint64_t getWindowUs() const { return lastChangeUs - windowStartUs; }
+  uint32_t getOutputs() const { return outputs; }
+  uint64_t getOverlapUs() const { return overlapUs; }
+  uint32_t getLatches() const { return latches; }
+  uint32_t getGhostLatches() const { return ghostLatches; }
+
+  // Position and segment count from the left and from A; 0.0 when the window is empty
+  double getBrightness(uint8_t position, uint8_t segment) const;
+
+  // Brightest segment of a digit, a stand-in for how bright the digit looks
+  double getDigitBrightness(uint8_t position) const;
+
+  // Seven-segment art in ANSI colour (or plain characters), three rows per line of digits
+  void renderTerminal(FILE* out, bool color) const;
+
+  // Writes the tube as an RGB PNG; false if the file cannot be written
+  bool writePng(const char* path, uint8_t scale) const;
+
+  // One line per digit with the brightness of each segment, the format of the golden files
+  void writeMatrix(FILE* out) const;
+
+  // Compares with a matrix written by writeMatrix(); prints the differing segments to out and returns their count,
+  // or -1 if the file cannot be read
+  int compareMatrix(const char* path, double tolerance, FILE* out) const;
+};
+
+#endif
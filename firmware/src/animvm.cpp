@@ -0,0 +1,415 @@
+#include "animvm.h"
+#include <esp_timer.h>
+
+static const char* ANIM_NAMESPACE = "vfdanim";
+static const char* ANIM_KEY = "script";
+
+static const char* ANIM_ERROR_NAMES[] = { "ok", "format", "size", "opcode", "truncated", "operand", "jump" };
+
+#define ANIM_ALL_DIGITS 0xFF
+
+// Instruction lengths in bytes, including the opcode
+static const uint8_t OP_SIZES[ANIM_OP_COUNT] = {
+  1,   // END
+  9,   // FRAME
+  3,   // DIGIT
+  3,   // DIGITR
+  3,   // NUM
+  3,   // BRIGHT
+  3,   // WAIT
+  2,   // WAITR
+  4,   // SET
+  3,   // ADD
+  4,   // RAND
+  3,   // TIME
+  3,   // JUMP
+  4,   // LOOP
+  4,   // JZ
+};
+
+static inline uint16_t read16(const uint8_t* p)
+{
+  return p[0] | (p[1] << 8);
+}
+
+AnimationVM::AnimationVM(MAX6921& display, uint8_t budget)
+  : display(display), budget(budget), codeLength(0), errorOffset(0), running(false), pc(0), waiting(false),
+    resumeTime(0), waitMs(0), state(0x9E3779B9), changed(0), invalidated(true),
+    ticks(0), instructions(0), budgetHits(0),
+    storageReady(false)
+{
+  memset(code, 0, sizeof(code));
+  memset(registers, 0, sizeof(registers));
+  memset(frame, 0, sizeof(frame));
+  memset(levels, MAX6921_MAX_BRIGHTNESS, sizeof(levels));
+}
+
+void AnimationVM::begin()
+{
+  state = esp_random() | 1;
+
+  storageReady = preferences.begin(ANIM_NAMESPACE, false);
+  if (!storageReady) return;
+
+  size_t length = preferences.getBytesLength(ANIM_KEY);
+  if (length == 0 || length > ANIM_HEADER_SIZE + ANIM_MAX_CODE) return;
+
+  uint8_t script[ANIM_HEADER_SIZE + ANIM_MAX_CODE];
+  preferences.getBytes(ANIM_KEY, script, length);
+  load(script, length);
+}
+
+AnimError AnimationVM::load(const uint8_t* script, size_t length)
+{
+  errorOffset = 0;
+
+  if (length < ANIM_HEADER_SIZE || script[0] != 'V' || script[1] != 'A' || script[2] != ANIM_VERSION) {
+    return ANIM_ERROR_FORMAT;
+  }
+  if (length == ANIM_HEADER_SIZE || length > ANIM_HEADER_SIZE + ANIM_MAX_CODE) {
+    return ANIM_ERROR_SIZE;
+  }
+
+  AnimError error = validate(script + ANIM_HEADER_SIZE, length - ANIM_HEADER_SIZE);
+  if (error != ANIM_OK) {
+    return error;
+  }
+
+  stop();
+  codeLength = length - ANIM_HEADER_SIZE;
+  memcpy(code, script + ANIM_HEADER_SIZE, codeLength);
+  return ANIM_OK;
+}
+
+AnimError AnimationVM::loadHex(const char* hex)
+{
+  uint8_t script[ANIM_HEADER_SIZE + ANIM_MAX_CODE];
+  size_t length = 0;
+
+  for (const char* p = hex; *p != '\0'; p += 2) {
+    if (p[1] == '\0' || length >= sizeof(script) || !isxdigit(p[0]) || !isxdigit(p[1])) {
+      errorOffset = 0;
+      return length >= sizeof(script) ? ANIM_ERROR_SIZE : ANIM_ERROR_FORMAT;
+    }
+
+    char byte[3] = { p[0], p[1], '\0' };
+    script[length++] = strtoul(byte, NULL, 16);
+  }
+
+  return load(script, length);
+}
+
+AnimError AnimationVM::validate(const uint8_t* code, uint16_t length)
+{
+  // Instruction start offsets, for checking jump targets
+  uint8_t starts[ANIM_MAX_CODE / 8];
+  memset(starts, 0, sizeof(starts));
+
+  // First pass: decode every instruction and check its operands
+  uint16_t offset = 0;
+  while (offset < length) {
+    errorOffset = offset;
+
+    uint8_t op = code[offset];
+    if (op >= ANIM_OP_COUNT) {
+      return ANIM_ERROR_OPCODE;
+    }
+    if (offset + OP_SIZES[op] > length) {
+      return ANIM_ERROR_TRUNCATED;
+    }
+    starts[offset >> 3] |= 1 << (offset & 7);
+
+    const uint8_t* operands = code + offset + 1;
+    bool valid = true;
+    switch (op) {
+      case ANIM_OP_DIGIT:
+        valid = operands[0] < ANIM_DIGITS;
+        break;
+      case ANIM_OP_DIGITR:
+        valid = operands[0] < ANIM_DIGITS && operands[1] < ANIM_REGISTERS;
+        break;
+      case ANIM_OP_NUM:
+        valid = operands[0] < ANIM_DIGITS - 1 && operands[1] < ANIM_REGISTERS;
+        break;
+      case ANIM_OP_BRIGHT:
+        valid = operands[0] < ANIM_DIGITS || operands[0] == ANIM_ALL_DIGITS;
+        break;
+      case ANIM_OP_WAITR:
+      case ANIM_OP_SET:
+      case ANIM_OP_ADD:
+      case ANIM_OP_LOOP:
+      case ANIM_OP_JZ:
+        valid = operands[0] < ANIM_REGISTERS;
+        break;
+      case ANIM_OP_RAND:
+        valid = operands[0] < ANIM_REGISTERS && read16(operands + 1) > 0;
+        break;
+      case ANIM_OP_TIME:
+        valid = operands[0] < ANIM_REGISTERS && operands[1] <= 3;
+        break;
+      default:
+        break;
+    }
+    if (!valid) {
+      return ANIM_ERROR_OPERAND;
+    }
+
+    offset += OP_SIZES[op];
+  }
+
+  // Second pass: jumps must land on the start of an instruction
+  offset = 0;
+  while (offset < length) {
+    errorOffset = offset;
+
+    uint8_t op = code[offset];
+    if (op == ANIM_OP_JUMP || op == ANIM_OP_LOOP || op == ANIM_OP_JZ) {
+      uint16_t target = read16(code + offset + OP_SIZES[op] - 2);
+      if (target >= length || !(starts[target >> 3] & (1 << (target & 7)))) {
+        return ANIM_ERROR_JUMP;
+      }
+    }
+
+    offset += OP_SIZES[op];
+  }
+
+  errorOffset = 0;
+  return ANIM_OK;
+}
+
+bool AnimationVM::save()
+{
+  if (!storageReady || codeLength == 0) return false;
+
+  uint8_t script[ANIM_HEADER_SIZE + ANIM_MAX_CODE] = { 'V', 'A', ANIM_VERSION, 0 };
+  memcpy(script + ANIM_HEADER_SIZE, code, codeLength);
+  size_t length = ANIM_HEADER_SIZE + codeLength;
+  return preferences.putBytes(ANIM_KEY, script, length) == length;
+}
+
+void AnimationVM::clear()
+{
+  stop();
+  codeLength = 0;
+  if (storageReady) {
+    preferences.remove(ANIM_KEY);
+  }
+}
+
+bool AnimationVM::start()
+{
+  if (codeLength == 0) return false;
+
+  running = true;
+  pc = 0;
+  waiting = false;
+  resumeTime = millis();
+  memset(registers, 0, sizeof(registers));
+  memset(frame, 0, sizeof(frame));
+  for (uint8_t i = 0; i < ANIM_DIGITS; i++) {
+    setLevel(i, MAX6921_MAX_BRIGHTNESS);
+  }
+  invalidated = true;
+  return true;
+}
+
+void AnimationVM::stop()
+{
+  if (!running) return;
+
+  running = false;
+  for (uint8_t i = 0; i < ANIM_DIGITS; i++) {
+    setLevel(i, MAX6921_MAX_BRIGHTNESS);
+  }
+}
+
+void AnimationVM::update()
+{
+  if (!running) return;
+
+  unsigned long now = millis();
+
+  if (waiting) {
+    if (now - resumeTime < waitMs) {
+      flush();
+      return;
+    }
+
+    // Measure the next wait from the end of this one so timing does not drift, unless we fell far behind
+    resumeTime += waitMs;
+    if (now - resumeTime > ANIM_MAX_CATCHUP_MS) {
+      resumeTime = now;
+    }
+    waiting = false;
+  }
+
+  ticks++;
+  uint8_t remaining = budget;
+  while (running && !waiting) {
+    if (remaining == 0) {
+      budgetHits++;
+      break;
+    }
+    remaining--;
+    instructions++;
+    step(now);
+  }
+
+  flush();
+}
+
+void AnimationVM::step(unsigned long now)
+{
+  // Validation guarantees the whole instruction and its operands are in range
+  if (pc >= codeLength) {
+    stop();
+    return;
+  }
+
+  uint8_t op = code[pc];
+  const uint8_t* operands = code + pc + 1;
+  uint16_t next = pc + OP_SIZES[op];
+
+  switch (op) {
+    case ANIM_OP_END:
+      stop();
+      return;
+
+    case ANIM_OP_FRAME:
+      for (uint8_t i = 0; i < ANIM_DIGITS; i++) {
+        setDigit(i, operands[i]);
+      }
+      break;
+
+    case ANIM_OP_DIGIT:
+      setDigit(operands[0], operands[1]);
+      break;
+
+    case ANIM_OP_DIGITR:
+      setDigit(operands[0], registers[operands[1]] & 0xFF);
+      break;
+
+    case ANIM_OP_NUM: {
+      uint16_t value = registers[operands[1]] % 100;
+      setDigit(operands[0], getFontSegments('0' + value / 10));
+      setDigit(operands[0] + 1, getFontSegments('0' + value % 10));
+      break;
+    }
+
+    case ANIM_OP_BRIGHT:
+      if (operands[0] == ANIM_ALL_DIGITS) {
+        for (uint8_t i = 0; i < ANIM_DIGITS; i++) {
+          setLevel(i, operands[1]);
+        }
+      }
+      else {
+        setLevel(operands[0], operands[1]);
+      }
+      break;
+
+    case ANIM_OP_WAIT:
+    case ANIM_OP_WAITR:
+      waitMs = (op == ANIM_OP_WAIT) ? read16(operands) : registers[operands[0]];
+      waiting = true;
+      if (now - resumeTime > ANIM_MAX_CATCHUP_MS) {
+        resumeTime = now;
+      }
+      break;
+
+    case ANIM_OP_SET:
+      registers[operands[0]] = read16(operands + 1);
+      break;
+
+    case ANIM_OP_ADD:
+      registers[operands[0]] += (int8_t)operands[1];
+      break;
+
+    case ANIM_OP_RAND:
+      state ^= state << 13;
+      state ^= state >> 17;
+      state ^= state << 5;
+      registers[operands[0]] = ((state & 0xFFFF) * read16(operands + 1)) >> 16;
+      break;
+
+    case ANIM_OP_TIME:
+      registers[operands[0]] = readTime(operands[1]);
+      break;
+
+    case ANIM_OP_JUMP:
+      next = read16(operands);
+      break;
+
+    case ANIM_OP_LOOP:
+      if (--registers[operands[0]] != 0) {
+        next = read16(operands + 1);
+      }
+      break;
+
+    case ANIM_OP_JZ:
+      if (registers[operands[0]] == 0) {
+        next = read16(operands + 1);
+      }
+      break;
+  }
+
+  pc = next;
+}
+
+void AnimationVM::setDigit(uint8_t position, uint8_t segments)
+{
+  if (frame[position] != segments) {
+    frame[position] = segments;
+    changed |= 1 << position;
+  }
+}
+
+void AnimationVM::setLevel(uint8_t position, uint8_t level)
+{
+  if (levels[position] != level) {
+    levels[position] = level;
+    display.setDigitBrightness(position, level);
+  }
+}
+
+uint16_t AnimationVM::readTime(uint8_t field) const
+{
+  if (!clock.isSet()) return 0;
+
+  int64_t dayUs = clock.getDayMicros();
+  uint32_t seconds = dayUs / 1000000;
+
+  switch (field) {
+    case 0:
+      return seconds / 3600;
+    case 1:
+      return (seconds / 60) % 60;
+    case 2:
+      return seconds % 60;
+    default:
+      return (dayUs / 10000) % 100;
+  }
+}
+
+void AnimationVM::flush()
+{
+  // Write the digits that changed since the last tick
+  for (uint8_t i = 0; i < ANIM_DIGITS; i++) {
+    if (invalidated || (changed & (1 << i))) {
+      display.setDigitSegments(i, frame[i]);
+    }
+  }
+
+  if (invalidated) {
+    for (uint8_t i = 0; i < ANIM_DIGITS; i++) {
+      display.setDigitBrightness(i, levels[i]);
+    }
+  }
+
+  changed = 0;
+  invalidated = false;
+}
+
+const char* AnimationVM::getErrorName(AnimError error)
+{
+  return error <= ANIM_ERROR_JUMP ? ANIM_ERROR_NAMES[error] : "unknown";
+}
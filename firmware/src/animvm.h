@@ -0,0 +1,154 @@
+#ifndef ANIMVM_H
+#define ANIMVM_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "max6921.h"
+#include "dayclock.h"
+
+// Bytecode interpreter for user animations.
+//
+// Scripts are compiled on the host (tools/vfd_anim.py) and uploaded through /api/animation. A script is the
+// header "VA", the format version and a reserved byte, followed by the code. The whole script is validated
+// before it replaces the current one: every opcode, register, digit and jump target is checked once, so the
+// interpreter never needs bounds checks. Each update() runs at most the instruction budget and then yields,
+// so a script without waits still cannot hold up the multiplex or the boost regulator.
+//
+// Instructions (operands are bytes, imm16 and addr16 little endian, registers r0-r7 are 16 bits):
+//   END                      Stop; the display returns to the clock
+//   FRAME m0 .. m7           Set all eight digits (segment masks, left to right)
+//   DIGIT pos mask           Set one digit
+//   DIGITR pos reg           Set one digit to the low byte of a register
+//   NUM pos reg              Show reg % 100 as two decimal digits at pos and pos + 1
+//   BRIGHT pos level         Per-digit brightness (pos 0xFF = all digits)
+//   WAIT imm16               Yield for imm16 ms (0 = until the next tick)
+//   WAITR reg                Yield for reg ms
+//   SET reg imm16            reg = imm16
+//   ADD reg imm8             reg += signed imm8
+//   RAND reg imm16           reg = random value below imm16
+//   TIME reg field           reg = local hour (0), minute (1), second (2) or hundredths (3)
+//   JUMP addr16              Continue at addr16
+//   LOOP reg addr16          Decrement reg and continue at addr16 unless it reached zero
+//   JZ reg addr16            Continue at addr16 if reg is zero
+
+#define ANIM_DIGITS 8
+#define ANIM_REGISTERS 8
+#define ANIM_MAX_CODE 1024
+#define ANIM_HEADER_SIZE 4
+#define ANIM_VERSION 1
+#define ANIM_DEFAULT_BUDGET 64               // Instructions per update()
+#define ANIM_MAX_CATCHUP_MS 100              // Waits that end later than this restart from the current time
+
+enum AnimOpcode : uint8_t {
+  ANIM_OP_END = 0,
+  ANIM_OP_FRAME,
+  ANIM_OP_DIGIT,
+  ANIM_OP_DIGITR,
+  ANIM_OP_NUM,
+  ANIM_OP_BRIGHT,
+  ANIM_OP_WAIT,
+  ANIM_OP_WAITR,
+  ANIM_OP_SET,
+  ANIM_OP_ADD,
+  ANIM_OP_RAND,
+  ANIM_OP_TIME,
+  ANIM_OP_JUMP,
+  ANIM_OP_LOOP,
+  ANIM_OP_JZ,
+  ANIM_OP_COUNT
+};
+
+enum AnimError : uint8_t {
+  ANIM_OK = 0,
+  ANIM_ERROR_FORMAT,                         // Bad hex, header or version
+  ANIM_ERROR_SIZE,                           // No code, or more than ANIM_MAX_CODE bytes
+  ANIM_ERROR_OPCODE,
+  ANIM_ERROR_TRUNCATED,                      // Last instruction runs past the end
+  ANIM_ERROR_OPERAND,                        // Register, digit, time field or random range out of range
+  ANIM_ERROR_JUMP,                           // Target outside the code or inside an instruction
+};
+
+class AnimationVM {
+private:
+  MAX6921& display;
+  uint8_t budget;
+
+  uint8_t code[ANIM_MAX_CODE];
+  uint16_t codeLength;
+  uint16_t errorOffset;                      // Code offset of the last validation error
+
+  // Machine state
+  bool running;
+  uint16_t pc;
+  uint16_t registers[ANIM_REGISTERS];
+  bool waiting;
+  unsigned long resumeTime;                  // Where the current wait is measured from
+  uint32_t waitMs;
+  uint32_t state;                            // xorshift32 state for RAND
+
+  // Output
+  uint8_t frame[ANIM_DIGITS];
+  uint8_t levels[ANIM_DIGITS];
+  uint8_t changed;                           // Bit per digit written since the last flush
+  bool invalidated;
+
+  // Local time of day for TIME, refreshed by the caller once a minute
+  DayClock clock;
+
+  // Statistics
+  uint32_t ticks;
+  uint32_t instructions;
+  uint32_t budgetHits;                       // Ticks that ended on the budget rather than a wait
+
+  Preferences preferences;
+  bool storageReady;
+
+  AnimError validate(const uint8_t* code, uint16_t length);
+  void step(unsigned long now);
+  void setDigit(uint8_t position, uint8_t segments);
+  void setLevel(uint8_t position, uint8_t level);
+  uint16_t readTime(uint8_t field) const;
+  void flush();
+
+public:
+  AnimationVM(MAX6921& display, uint8_t budget = ANIM_DEFAULT_BUDGET);
+
+  // Seeds the generator and restores the stored script, if there is one (it is not started)
+  void begin();
+
+  // Replace the script after validating it; the current one keeps running if the new one is rejected
+  AnimError load(const uint8_t* script, size_t length);
+  AnimError loadHex(const char* hex);
+
+  // Store the current script in NVS, or remove the script and the stored copy
+  bool save();
+  void clear();
+
+  // Run the script from the top with blank digits at full brightness
+  bool start();
+  void stop();
+
+  // Runs one tick: resumes after an expired wait and executes up to the budget
+  void update();
+
+  // Force a full redraw, e.g. after something else was shown on the display
+  void invalidate() { invalidated = true; }
+
+  // Anchor TIME to the local time of day
+  void setClockTime(uint32_t secondsOfDay, uint32_t microsIntoSecond) { clock.setTime(secondsOfDay, microsIntoSecond); }
+  bool needsClockTime() const { return clock.needsTime(); }
+
+  bool isLoaded() const { return codeLength > 0; }
+  bool isRunning() const { return running; }
+  uint16_t getCodeLength() const { return codeLength; }
+  uint16_t getPc() const { return pc; }
+  uint16_t getErrorOffset() const { return errorOffset; }
+  uint8_t getBudget() const { return budget; }
+  uint32_t getTicks() const { return ticks; }
+  uint32_t getInstructions() const { return instructions; }
+  uint32_t getBudgetHits() const { return budgetHits; }
+
+  static const char* getErrorName(AnimError error);
+};
+
+#endif
@@ -0,0 +1,32 @@
+#include "boot.h"
+
+static const char* BOOT_PHASE_NAMES[BOOT_PHASE_COUNT] = {
+  "configLoaded",
+  "hardwareReady",
+  "firstDigit",
+  "boostReady",
+  "wifiConnected",
+  "timeSynced",
+  "clockShown",
+};
+
+BootTimeline::BootTimeline()
+{
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++) {
+    phaseTimes[i] = 0;
+    phaseReached[i] = false;
+  }
+}
+
+void BootTimeline::mark(BootPhase phase)
+{
+  if (phase >= BOOT_PHASE_COUNT || phaseReached[phase]) return;
+
+  phaseTimes[phase] = millis();
+  phaseReached[phase] = true;
+}
+
+const char* BootTimeline::getName(BootPhase phase)
+{
+  return phase < BOOT_PHASE_COUNT ? BOOT_PHASE_NAMES[phase] : "unknown";
+}
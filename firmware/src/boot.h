@@ -0,0 +1,38 @@
+#ifndef BOOT_H
+#define BOOT_H
+
+#include <Arduino.h>
+
+// Boot phase timing.
+//
+// Records when each milestone of the startup sequence was first reached, in ms since reset, so the
+// time-to-first-digit and time-to-network-clock can be tracked across firmware changes (see /api/boot).
+
+enum BootPhase : uint8_t {
+  BOOT_PHASE_CONFIG_LOADED = 0,  // Settings read from NVS
+  BOOT_PHASE_HARDWARE_READY,     // Filament, ADC, boost PWM and VFD driver initialized
+  BOOT_PHASE_FIRST_DIGIT,        // Multiplexing started (something is on the tube)
+  BOOT_PHASE_BOOST_READY,        // Boost soft-start reached the target voltage
+  BOOT_PHASE_WIFI_CONNECTED,
+  BOOT_PHASE_TIME_SYNCED,        // NTP time received
+  BOOT_PHASE_CLOCK_SHOWN,        // Valid time on the display
+  BOOT_PHASE_COUNT
+};
+
+class BootTimeline {
+private:
+  uint32_t phaseTimes[BOOT_PHASE_COUNT];  // millis() when reached, 0 if not yet
+  bool phaseReached[BOOT_PHASE_COUNT];
+
+public:
+  BootTimeline();
+
+  // Record the first time a phase is reached; later calls are ignored
+  void mark(BootPhase phase);
+
+  bool isReached(BootPhase phase) const { return phaseReached[phase]; }
+  uint32_t getTime(BootPhase phase) const { return phaseTimes[phase]; }
+  static const char* getName(BootPhase phase);
+};
+
+#endif
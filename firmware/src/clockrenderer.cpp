@@ -0,0 +1,83 @@
+#include "clockrenderer.h"
+
+ClockRenderer::ClockRenderer(MAX6921& display)
+  : display(display), timeSet(false), invalidated(true), hours(0), minutes(0), seconds(0), nextTick(0),
+    separatorSegments(0)
+{
+  memset(digitSegments, 0, sizeof(digitSegments));
+  memset(shown, 0, sizeof(shown));
+}
+
+void ClockRenderer::begin()
+{
+  for (int i = 0; i < 10; i++) {
+    digitSegments[i] = display.getCharSegments('0' + i);
+  }
+  separatorSegments = display.getCharSegments('-');
+}
+
+void ClockRenderer::setTime(uint8_t hour, uint8_t minute, uint8_t second, uint32_t microsIntoSecond)
+{
+  hours = hour % 24;
+  minutes = minute % 60;
+  seconds = second % 60;
+
+  if (microsIntoSecond >= CLOCK_RENDERER_SECOND_US) {
+    microsIntoSecond = CLOCK_RENDERER_SECOND_US - 1;
+  }
+  nextTick = micros() + (CLOCK_RENDERER_SECOND_US - microsIntoSecond);
+  timeSet = true;
+
+  render();
+}
+
+bool ClockRenderer::update()
+{
+  if (!timeSet) return false;
+
+  bool newMinute = false;
+  bool ticked = false;
+
+  // Signed difference keeps this correct across the micros() wrap. If the loop stalled for several seconds
+  // the counters catch up here (the caller resyncs on the next minute anyway).
+  while ((long)(micros() - nextTick) >= 0) {
+    nextTick += CLOCK_RENDERER_SECOND_US;
+    ticked = true;
+
+    if (++seconds < 60) continue;
+    seconds = 0;
+    newMinute = true;
+
+    if (++minutes < 60) continue;
+    minutes = 0;
+
+    if (++hours >= 24) {
+      hours = 0;
+    }
+  }
+
+  if (ticked || invalidated) {
+    render();
+  }
+
+  return newMinute;
+}
+
+void ClockRenderer::render()
+{
+  uint8_t segments[CLOCK_RENDERER_DIGITS] = {
+    digitSegments[hours / 10], digitSegments[hours % 10], separatorSegments,
+    digitSegments[minutes / 10], digitSegments[minutes % 10], separatorSegments,
+    digitSegments[seconds / 10], digitSegments[seconds % 10]
+  };
+
+  // Usually only the last one or two digits differ from what is shown
+  for (uint8_t i = 0; i < CLOCK_RENDERER_DIGITS; i++) {
+    if (invalidated || segments[i] != shown[i]) {
+      display.setDigitSegments(i, segments[i]);
+      shown[i] = segments[i];
+    }
+  }
+
+  invalidated = false;
+}
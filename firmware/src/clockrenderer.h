@@ -0,0 +1,51 @@
+#ifndef CLOCKRENDERER_H
+#define CLOCKRENDERER_H
+
+#include <Arduino.h>
+#include "max6921.h"
+
+// Second-aligned clock face ("HH-MM-SS").
+//
+// The wall clock is read once with setTime(); after that hours, minutes and seconds are kept as counters
+// and advanced on second boundaries scheduled from micros(), so the seconds flip on time without calling
+// localtime() every poll. Only digits whose segments changed are written to the display.
+
+#define CLOCK_RENDERER_DIGITS 8
+#define CLOCK_RENDERER_SECOND_US 1000000UL
+
+class ClockRenderer {
+private:
+  MAX6921& display;
+
+  bool timeSet;
+  bool invalidated;                    // Redraw every digit on the next update (display was overwritten)
+  uint8_t hours;
+  uint8_t minutes;
+  uint8_t seconds;
+  unsigned long nextTick;              // micros() at the next second boundary
+
+  uint8_t digitSegments[10];           // Segment masks for '0'..'9'
+  uint8_t separatorSegments;
+  uint8_t shown[CLOCK_RENDERER_DIGITS];  // Masks currently written to the display
+
+  void render();
+
+public:
+  ClockRenderer(MAX6921& display);
+
+  // Builds the digit lookup from the driver's character map
+  void begin();
+
+  // Anchor the counters to the wall clock. microsIntoSecond is the fraction of the current second already elapsed.
+  void setTime(uint8_t hour, uint8_t minute, uint8_t second, uint32_t microsIntoSecond);
+
+  // Advance on due second boundaries and redraw changed digits. Returns true when a new minute started.
+  bool update();
+
+  // Force a full redraw, e.g. after something else was shown on the display
+  void invalidate() { invalidated = true; }
+
+  bool isTimeSet() const { return timeSet; }
+};
+
+#endif
@@ -0,0 +1,209 @@
+#include "config.h"
+
+static const char* CONFIG_NAMESPACE = "vfdclock";
+static const char* CONFIG_KEY = "config";
+
+// Older layouts, kept for migration
+#define CONFIG_V2_TEXT_LENGTH 8
+
+// Version 1 (before the timezone rule was added)
+struct ClockConfigV1 {
+  uint32_t flashIntervalMinMs;
+  uint32_t flashIntervalMaxMs;
+  uint32_t flashDurationMs;
+  uint32_t glitchDurationMs;
+  float targetVoltage;
+  uint8_t displayMode;
+  uint8_t brightness;
+  bool flashMessageMode;
+  char customText[CONFIG_V2_TEXT_LENGTH + 1];
+};
+
+struct BlobV1 {
+  uint16_t magic;
+  uint16_t version;
+  uint32_t crc;
+  ClockConfigV1 config;
+};
+
+// Version 2 (before scrolling text)
+struct ClockConfigV2 {
+  ClockConfigV1 base;
+  char timezone[CONFIG_TIMEZONE_LENGTH + 1];
+};
+
+struct BlobV2 {
+  uint16_t magic;
+  uint16_t version;
+  uint32_t crc;
+  ClockConfigV2 config;
+};
+
+// Versions 3 to 5 are prefixes of the current layout: without the fields from the flash transition on, without
+// the night mode schedules, and without the filament levels
+#define CONFIG_V3_SIZE offsetof(ClockConfig, flashTransition)
+#define CONFIG_V4_SIZE offsetof(ClockConfig, powerSchedules)
+#define CONFIG_V5_SIZE offsetof(ClockConfig, filamentLevel)
+#define CONFIG_FIRST_PREFIX_VERSION 3
+static const size_t CONFIG_PREFIX_SIZES[] = { CONFIG_V3_SIZE, CONFIG_V4_SIZE, CONFIG_V5_SIZE };
+
+ConfigStore::ConfigStore(uint32_t coalesceMs, uint32_t minCommitIntervalMs)
+  : hasStored(false), dirty(false), dirtySince(0), lastCommit(0), commitCount(0),
+    coalesceMs(coalesceMs), minCommitIntervalMs(minCommitIntervalMs)
+{
+  memset(&stored, 0, sizeof(stored));
+}
+
+bool ConfigStore::begin(ClockConfig& config)
+{
+  if (!preferences.begin(CONFIG_NAMESPACE, false)) {
+    return false;
+  }
+
+  Blob blob;
+  size_t length = preferences.getBytesLength(CONFIG_KEY);
+  if (length != sizeof(blob)) {
+    return migrate(length, config);
+  }
+
+  preferences.getBytes(CONFIG_KEY, &blob, sizeof(blob));
+
+  if (blob.magic != CONFIG_MAGIC || blob.version != CONFIG_VERSION ||
+      blob.crc != crc32((const uint8_t*)&blob.config, sizeof(blob.config))) {
+    return false;
+  }
+
+  // Always keep the strings terminated, whatever was stored
+  blob.config.customText[CONFIG_TEXT_LENGTH] = '\0';
+  blob.config.timezone[CONFIG_TIMEZONE_LENGTH] = '\0';
+
+  config = blob.config;
+  stored = blob.config;
+  hasStored = true;
+  return true;
+}
+
+bool ConfigStore::migrate(size_t length, ClockConfig& config)
+{
+  for (uint16_t i = 0; i < sizeof(CONFIG_PREFIX_SIZES) / sizeof(CONFIG_PREFIX_SIZES[0]); i++) {
+    size_t prefixSize = CONFIG_PREFIX_SIZES[i];
+    if (length != offsetof(Blob, config) + prefixSize) continue;
+
+    Blob blob;
+    preferences.getBytes(CONFIG_KEY, &blob, length);
+
+    if (blob.magic != CONFIG_MAGIC || blob.version != CONFIG_FIRST_PREFIX_VERSION + i ||
+        blob.crc != crc32((const uint8_t*)&blob.config, prefixSize)) {
+      return false;
+    }
+
+    memcpy(&config, &blob.config, prefixSize);
+    config.customText[CONFIG_TEXT_LENGTH] = '\0';
+    config.timezone[CONFIG_TIMEZONE_LENGTH] = '\0';
+
+    markDirty();
+    return true;
+  }
+
+  // Both older versions start with the version 1 fields; version 2 appends the timezone rule
+  BlobV2 old;
+  uint16_t version;
+  size_t configSize;
+
+  if (length == sizeof(BlobV1)) {
+    version = 1;
+    configSize = sizeof(ClockConfigV1);
+  }
+  else if (length == sizeof(BlobV2)) {
+    version = 2;
+    configSize = sizeof(ClockConfigV2);
+  }
+  else {
+    return false;
+  }
+
+  preferences.getBytes(CONFIG_KEY, &old, length);
+
+  if (old.magic != CONFIG_MAGIC || old.version != version ||
+      old.crc != crc32((const uint8_t*)&old.config, configSize)) {
+    return false;
+  }
+
+  // Copy the fields that existed; the rest keep the defaults already in config
+  const ClockConfigV1& base = old.config.base;
+  config.flashIntervalMinMs = base.flashIntervalMinMs;
+  config.flashIntervalMaxMs = base.flashIntervalMaxMs;
+  config.flashDurationMs = base.flashDurationMs;
+  config.glitchDurationMs = base.glitchDurationMs;
+  config.targetVoltage = base.targetVoltage;
+  config.displayMode = base.displayMode;
+  config.brightness = base.brightness;
+  config.flashMessageMode = base.flashMessageMode;
+  memcpy(config.customText, base.customText, CONFIG_V2_TEXT_LENGTH);
+  config.customText[CONFIG_V2_TEXT_LENGTH] = '\0';
+
+  if (version >= 2) {
+    memcpy(config.timezone, old.config.timezone, sizeof(config.timezone));
+    config.timezone[CONFIG_TIMEZONE_LENGTH] = '\0';
+  }
+
+  // Rewrite in the current format once things settle
+  markDirty();
+  return true;
+}
+
+void ConfigStore::markDirty()
+{
+  // Every change restarts the quiet period so bursts of changes become a single write
+  dirty = true;
+  dirtySince = millis();
+}
+
+void ConfigStore::update(const ClockConfig& config)
+{
+  if (!dirty) return;
+
+  unsigned long now = millis();
+  if (now - dirtySince < coalesceMs) return;
+  if (commitCount > 0 && now - lastCommit < minCommitIntervalMs) return;
+
+  commit(config);
+}
+
+bool ConfigStore::commit(const ClockConfig& config)
+{
+  dirty = false;
+
+  // Skip the flash write entirely if nothing actually changed
+  if (hasStored && memcmp(&stored, &config, sizeof(config)) == 0) {
+    return true;
+  }
+
+  Blob blob;
+  blob.magic = CONFIG_MAGIC;
+  blob.version = CONFIG_VERSION;
+  blob.config = config;
+  blob.crc = crc32((const uint8_t*)&blob.config, sizeof(blob.config));
+
+  if (preferences.putBytes(CONFIG_KEY, &blob, sizeof(blob)) != sizeof(blob)) {
+    return false;
+  }
+
+  stored = config;
+  hasStored = true;
+  lastCommit = millis();
+  commitCount++;
+  return true;
+}
+
+uint32_t ConfigStore::crc32(const uint8_t* data, size_t length)
+{
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+    }
+  }
+  return ~crc;
+}
@@ -0,0 +1,89 @@
+#ifndef CONFIG_H
+#define CONFIG_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "powermanager.h"
+
+// Persisted clock configuration.
+//
+// All user settings live in one versioned binary blob in NVS. Changes are coalesced: markDirty() starts a
+// quiet period and the blob is only written once no further changes arrive, never more often than the
+// minimum commit interval, and never when the contents match what is already stored.
+
+#define CONFIG_VERSION 6
+#define CONFIG_MAGIC 0x5646            // "VF"
+#define CONFIG_TEXT_LENGTH 63           // Longer than the tube; the marquee scrolls it
+#define CONFIG_TIMEZONE_LENGTH 47       // POSIX TZ rule, e.g. "CST6CDT,M3.2.0,M11.1.0"
+
+enum DisplayMode : uint8_t {
+  DISPLAY_MODE_TIME = 0,
+  DISPLAY_MODE_TEXT = 1,
+};
+
+// Field order keeps the struct free of padding so the blob compares and checksums byte for byte
+struct ClockConfig {
+  uint32_t flashIntervalMinMs;
+  uint32_t flashIntervalMaxMs;
+  uint32_t flashDurationMs;
+  uint32_t glitchDurationMs;
+  float targetVoltage;
+  uint16_t scrollStepMs;
+  uint16_t scrollPauseMs;
+  uint8_t displayMode;
+  uint8_t brightness;
+  bool flashMessageMode;
+  uint8_t scrollMode;                  // MarqueeMode
+  char customText[CONFIG_TEXT_LENGTH + 1];
+  char timezone[CONFIG_TIMEZONE_LENGTH + 1];
+  uint8_t flashTransition;             // TimelinePreset
+  uint8_t reserved[3];
+  PowerSchedule powerSchedules[POWER_SCHEDULES];  // Night mode windows
+  uint8_t filamentLevel;               // Filament PWM level while on (0-255)
+  uint8_t filamentStandbyLevel;        // Filament level while night mode has the tube off
+  uint16_t filamentRampMs;             // Warm-up ramp from cold to full power
+};
+
+class ConfigStore {
+private:
+  struct Blob {
+    uint16_t magic;
+    uint16_t version;
+    uint32_t crc;
+    ClockConfig config;
+  };
+
+  Preferences preferences;
+  ClockConfig stored;                  // Contents of the last blob read or written
+  bool hasStored;
+  bool dirty;
+  unsigned long dirtySince;
+  unsigned long lastCommit;
+  uint32_t commitCount;
+  uint32_t coalesceMs;
+  uint32_t minCommitIntervalMs;
+
+  static uint32_t crc32(const uint8_t* data, size_t length);
+  bool migrate(size_t length, ClockConfig& config);
+
+public:
+  ConfigStore(uint32_t coalesceMs = 2000, uint32_t minCommitIntervalMs = 10000);
+
+  // Loads the stored configuration into config. Leaves config untouched (defaults) if nothing valid is stored.
+  // Blobs from older versions are migrated (new fields keep their defaults) and rewritten on the next update().
+  bool begin(ClockConfig& config);
+
+  // Schedule a commit of the current configuration
+  void markDirty();
+
+  // Commit the configuration once the quiet period has passed
+  void update(const ClockConfig& config);
+
+  // Write immediately if the contents differ from what is stored
+  bool commit(const ClockConfig& config);
+
+  bool isDirty() const { return dirty; }
+  uint32_t getCommitCount() const { return commitCount; }
+};
+
+#endif
@@ -0,0 +1,40 @@
+#ifndef DAYCLOCK_H
+#define DAYCLOCK_H
+
+#include <stdint.h>
+#include <esp_timer.h>
+
+// Local time of day anchored to esp_timer, for displays that need it between whole seconds.
+//
+// The caller sets the time of day (from the NTP-disciplined clock and the timezone rule); from then on it is the
+// anchor plus the esp_timer time elapsed since, which costs no system call per frame. needsTime() asks for a new
+// anchor once a minute so NTP corrections and DST changes are followed.
+
+#define DAYCLOCK_US_PER_DAY 86400000000LL
+#define DAYCLOCK_REANCHOR_US 60000000LL
+
+class DayClock {
+private:
+  bool set;
+  int64_t anchor;                          // esp_timer time of the anchor
+  int64_t anchorDayUs;                     // Microseconds into the local day at the anchor
+
+public:
+  DayClock() : set(false), anchor(0), anchorDayUs(0) {}
+
+  void setTime(uint32_t secondsOfDay, uint32_t microsIntoSecond)
+  {
+    anchor = esp_timer_get_time();
+    anchorDayUs = (int64_t)secondsOfDay * 1000000 + microsIntoSecond;
+    set = true;
+  }
+
+  bool isSet() const { return set; }
+  bool needsTime() const { return !set || esp_timer_get_time() - anchor >= DAYCLOCK_REANCHOR_US; }
+
+  // Microseconds into the local day at the esp_timer time now (0 until the time is set)
+  int64_t getDayMicros(int64_t now) const { return set ? (anchorDayUs + now - anchor) % DAYCLOCK_US_PER_DAY : 0; }
+  int64_t getDayMicros() const { return getDayMicros(esp_timer_get_time()); }
+};
+
+#endif
@@ -0,0 +1,128 @@
+#include "dutyanalyzer.h"
+
+DutyAnalyzer::DutyAnalyzer(uint8_t numDigits)
+  : numDigits(min(numDigits, (uint8_t)DUTY_MAX_DIGITS)), thresholdPercent(DUTY_DEFAULT_THRESHOLD_PERCENT),
+    alert(false), alerts(0)
+{
+  reset();
+}
+
+void DutyAnalyzer::reset()
+{
+  for (uint8_t i = 0; i < DUTY_WINDOW_SLICES; i++) {
+    clearSlice(slices[i]);
+  }
+  current = 0;
+  completed = 0;
+
+  windowUs = 0;
+  windowSlots = 0;
+  minSlotUs = 0;
+  maxSlotUs = 0;
+  memset(litUs, 0, sizeof(litUs));
+  memset(expectedUs, 0, sizeof(expectedUs));
+  imbalancePercent = 0;
+  alert = false;
+}
+
+void DutyAnalyzer::clearSlice(Slice& slice)
+{
+  slice.spanUs = 0;
+  slice.slots = 0;
+  slice.minSlotUs = UINT32_MAX;
+  slice.maxSlotUs = 0;
+  memset(slice.litUs, 0, sizeof(slice.litUs));
+  memset(slice.expectedUs, 0, sizeof(slice.expectedUs));
+}
+
+void DutyAnalyzer::recordSlot(uint8_t position, uint32_t slotUs, uint32_t litUs, uint32_t expectedUs)
+{
+  if (position >= numDigits) return;
+
+  Slice& slice = slices[current];
+  slice.spanUs += slotUs;
+  slice.slots++;
+  slice.litUs[position] += litUs;
+  slice.expectedUs[position] += expectedUs;
+  if (slotUs < slice.minSlotUs) {
+    slice.minSlotUs = slotUs;
+  }
+  if (slotUs > slice.maxSlotUs) {
+    slice.maxSlotUs = slotUs;
+  }
+
+  // Slices are measured in multiplex time, so no clock is read here
+  if (slice.spanUs >= DUTY_SLICE_US) {
+    closeSlice();
+  }
+}
+
+void DutyAnalyzer::closeSlice()
+{
+  if (completed < DUTY_WINDOW_SLICES) {
+    completed++;
+  }
+
+  if (completed >= DUTY_WINDOW_SLICES) {
+    // Sum the window
+    windowUs = 0;
+    windowSlots = 0;
+    minSlotUs = UINT32_MAX;
+    maxSlotUs = 0;
+    memset(litUs, 0, sizeof(litUs));
+    memset(expectedUs, 0, sizeof(expectedUs));
+
+    for (uint8_t s = 0; s < DUTY_WINDOW_SLICES; s++) {
+      const Slice& slice = slices[s];
+      windowUs += slice.spanUs;
+      windowSlots += slice.slots;
+      minSlotUs = min(minSlotUs, slice.minSlotUs);
+      maxSlotUs = max(maxSlotUs, slice.maxSlotUs);
+      for (uint8_t i = 0; i < numDigits; i++) {
+        litUs[i] += slice.litUs[i];
+        expectedUs[i] += slice.expectedUs[i];
+      }
+    }
+
+    // Spread of the actual/expected ratios; digits that were meant to be dark are left out
+    float lowest = 0;
+    float highest = 0;
+    float total = 0;
+    uint8_t counted = 0;
+    for (uint8_t i = 0; i < numDigits; i++) {
+      if (expectedUs[i] == 0) continue;
+
+      float ratio = (float)litUs[i] / expectedUs[i];
+      if (counted == 0 || ratio < lowest) {
+        lowest = ratio;
+      }
+      if (counted == 0 || ratio > highest) {
+        highest = ratio;
+      }
+      total += ratio;
+      counted++;
+    }
+    imbalancePercent = (counted >= 2 && total > 0) ? (highest - lowest) * 100.0f * counted / total : 0;
+
+    bool over = imbalancePercent > thresholdPercent;
+    if (over && !alert) {
+      alerts++;
+    }
+    alert = over;
+  }
+
+  current = (current + 1) % DUTY_WINDOW_SLICES;
+  clearSlice(slices[current]);
+}
+
+float DutyAnalyzer::getRefreshRate() const
+{
+  if (windowUs == 0 || numDigits == 0) return 0;
+  return windowSlots * 1000000.0f / numDigits / windowUs;
+}
+
+float DutyAnalyzer::getDutyPercent(uint8_t position) const
+{
+  if (position >= numDigits || windowUs == 0) return 0;
+  return litUs[position] * 100.0f / windowUs;
+}
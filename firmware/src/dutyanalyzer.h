@@ -0,0 +1,78 @@
+#ifndef DUTYANALYZER_H
+#define DUTYANALYZER_H
+
+#include <Arduino.h>
+
+// Multiplex duty-cycle analyzer.
+//
+// The MAX6921 driver reports every finished digit slot: how long the slot lasted, how long its digit was actually
+// lit, and how long the brightness asked for (the on-time of a nominal 1 ms slot). Slots are summed into
+// DUTY_WINDOW_SLICES slices of DUTY_SLICE_US; each time a slice fills, the statistics of the last full window
+// are recomputed. A late loop stretches the slot of whichever digit happens to be lit, so that digit glows
+// brighter. The imbalance is the spread of each digit's actual/expected on-time ratio relative to their mean,
+// so deliberate differences (per-digit brightness, dimming) do not count. It raises an alert above the threshold.
+
+#define DUTY_MAX_DIGITS 12                       // At least MAX_DIGITS in max6921.h
+#define DUTY_SLICE_US 250000UL
+#define DUTY_WINDOW_SLICES 4                     // Sliding window of 1 s
+#define DUTY_DEFAULT_THRESHOLD_PERCENT 10        // Imbalance that raises the alert
+
+class DutyAnalyzer {
+private:
+  struct Slice {
+    uint32_t spanUs;
+    uint32_t slots;
+    uint32_t minSlotUs;
+    uint32_t maxSlotUs;
+    uint32_t litUs[DUTY_MAX_DIGITS];
+    uint32_t expectedUs[DUTY_MAX_DIGITS];
+  };
+
+  uint8_t numDigits;
+  Slice slices[DUTY_WINDOW_SLICES];
+  uint8_t current;
+  uint8_t completed;                             // Full slices so far, up to DUTY_WINDOW_SLICES
+
+  // Last full window
+  uint32_t windowUs;
+  uint32_t windowSlots;
+  uint32_t minSlotUs;
+  uint32_t maxSlotUs;
+  uint32_t litUs[DUTY_MAX_DIGITS];
+  uint32_t expectedUs[DUTY_MAX_DIGITS];
+  float imbalancePercent;
+
+  uint8_t thresholdPercent;
+  bool alert;
+  uint32_t alerts;
+
+  void clearSlice(Slice& slice);
+  void closeSlice();
+
+public:
+  DutyAnalyzer(uint8_t numDigits);
+
+  // Called by the driver at each digit switch; position counts from the left
+  void recordSlot(uint8_t position, uint32_t slotUs, uint32_t litUs, uint32_t expectedUs);
+  void reset();
+
+  void setThreshold(uint8_t percent) { thresholdPercent = percent; }
+  uint8_t getThreshold() const { return thresholdPercent; }
+  bool isAlert() const { return alert; }
+  uint32_t getAlerts() const { return alerts; }       // Times the imbalance rose above the threshold
+
+  // Statistics of the last full window (all zero until the first window is complete)
+  bool isReady() const { return completed >= DUTY_WINDOW_SLICES; }
+  uint32_t getWindowUs() const { return windowUs; }
+  uint32_t getSlots() const { return windowSlots; }
+  uint32_t getMinSlotUs() const { return minSlotUs; }
+  uint32_t getMaxSlotUs() const { return maxSlotUs; }
+  float getRefreshRate() const;                  // Full passes over all digits per second
+  float getImbalancePercent() const { return imbalancePercent; }
+  float getDutyPercent(uint8_t position) const;  // Share of the window the digit was lit
+  uint32_t getLitUs(uint8_t position) const { return position < numDigits ? litUs[position] : 0; }
+  uint32_t getExpectedUs(uint8_t position) const { return position < numDigits ? expectedUs[position] : 0; }
+  uint8_t getNumDigits() const { return numDigits; }
+};
+
+#endif
@@ -0,0 +1,70 @@
+#include "filament.h"
+#include <esp_timer.h>
+
+Filament::Filament(uint8_t pin)
+  : pin(pin), attached(false), level(0), rampFrom(0), target(0), rampStartUs(0), rampDurationUs(0)
+{
+}
+
+bool Filament::begin()
+{
+  attached = ledcAttach(pin, FILAMENT_PWM_FREQUENCY, FILAMENT_PWM_RESOLUTION);
+  if (attached) {
+    ledcWrite(pin, 0);
+  }
+  else {
+    // No free channel: fall back to switching the filament fully on or off
+    pinMode(pin, OUTPUT);
+    digitalWrite(pin, LOW);
+  }
+  level = 0;
+  return attached;
+}
+
+void Filament::rampTo(uint8_t level, uint32_t fullRampMs)
+{
+  target = level;
+
+  if (level <= this->level || fullRampMs == 0) {
+    rampDurationUs = 0;
+    write(level);
+    return;
+  }
+
+  // Continue from wherever the filament is now, e.g. the standby level
+  rampFrom = this->level;
+  rampStartUs = esp_timer_get_time();
+  rampDurationUs = (uint64_t)fullRampMs * 1000 * (level - rampFrom) / FILAMENT_MAX_LEVEL;
+  if (rampDurationUs == 0) {
+    write(level);
+  }
+}
+
+void Filament::update()
+{
+  if (rampDurationUs == 0) return;
+
+  int64_t elapsed = esp_timer_get_time() - rampStartUs;
+  if (elapsed >= rampDurationUs) {
+    rampDurationUs = 0;
+    write(target);
+    return;
+  }
+
+  write(rampFrom + (uint32_t)((target - rampFrom) * elapsed / rampDurationUs));
+}
+
+void Filament::write(uint8_t value)
+{
+  if (value == level) return;
+  level = value;
+
+  // The top level is a constant high output rather than one step short of it
+  uint32_t duty = value >= FILAMENT_MAX_LEVEL ? (1 << FILAMENT_PWM_RESOLUTION) : value;
+  if (attached) {
+    ledcWrite(pin, duty);
+  }
+  else {
+    digitalWrite(pin, value > 0 ? HIGH : LOW);
+  }
+}
@@ -0,0 +1,48 @@
+#ifndef FILAMENT_H
+#define FILAMENT_H
+
+#include <Arduino.h>
+
+// PWM drive of the tube filament.
+//
+// The filament transistor is switched by an LEDC channel, so the heating power is set as a duty level (0-255,
+// 255 = fully on as with the old hard switch). Raising the level ramps linearly over a time proportional to the
+// step, which spares the cold filament the full inrush at power-up; lowering it takes effect at once. The ramp is
+// timed from esp_timer, so update() may be called at any rate; it only writes the channel when the duty changes.
+//
+// The PWM runs well above the 1 kHz multiplex so the ripple does not beat with it.
+
+#define FILAMENT_PWM_FREQUENCY 20000
+#define FILAMENT_PWM_RESOLUTION 8
+#define FILAMENT_MAX_LEVEL 255
+
+class Filament {
+private:
+  uint8_t pin;
+  bool attached;
+  uint8_t level;                                 // Duty level written to the channel
+  uint8_t rampFrom;
+  uint8_t target;
+  int64_t rampStartUs;
+  uint32_t rampDurationUs;                       // 0 when not ramping
+
+  void write(uint8_t value);
+
+public:
+  Filament(uint8_t pin);
+
+  // Attaches the LEDC channel with the filament off. Without a free channel the pin is switched on/off instead.
+  bool begin();
+
+  // Moves to level: upwards over fullRampMs scaled by the step (fullRampMs for 0 to 255), downwards at once
+  void rampTo(uint8_t level, uint32_t fullRampMs);
+
+  // Advances a ramp in progress
+  void update();
+
+  uint8_t getLevel() const { return level; }
+  uint8_t getTarget() const { return target; }
+  bool isRamping() const { return rampDurationUs != 0; }
+};
+
+#endif
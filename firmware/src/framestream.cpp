@@ -0,0 +1,179 @@
+#include "framestream.h"
+
+FrameStream::FrameStream(MAX6921& display, uint16_t port, uint16_t playoutDelayMs, uint16_t timeoutMs)
+  : display(display), port(port), playoutDelayMs(playoutDelayMs), timeoutMs(timeoutMs),
+    active(false), hasPlayed(false), lastPlayedSequence(0), clockOffset(0), lastPacketTime(0),
+    idleBrightness(MAX6921_MAX_BRIGHTNESS),
+    framesReceived(0), framesPlayed(0), framesDroppedLate(0), framesDroppedInvalid(0), framesOverwritten(0)
+{
+  for (int i = 0; i < FRAME_STREAM_JITTER_SLOTS; i++) {
+    jitterBuffer[i].used = false;
+  }
+}
+
+bool FrameStream::begin()
+{
+  return udp.begin(port) == 1;
+}
+
+void FrameStream::update()
+{
+  receivePackets();
+
+  if (!active) return;
+
+  playDueFrame();
+
+  // Hand the display back to the clock once the sender goes quiet
+  if (millis() - lastPacketTime > timeoutMs) {
+    endStream();
+  }
+}
+
+void FrameStream::receivePackets()
+{
+  uint8_t packet[FRAME_STREAM_MAX_PACKET];
+
+  // Bound the work per call so a flood of packets cannot stall the multiplex
+  for (int i = 0; i < FRAME_STREAM_JITTER_SLOTS; i++) {
+    int size = udp.parsePacket();
+    if (size <= 0) break;
+
+    int length = udp.read(packet, sizeof(packet));
+    if (size > (int)sizeof(packet)) {
+      framesDroppedInvalid++;
+      continue;
+    }
+
+    handlePacket(packet, length);
+  }
+}
+
+void FrameStream::handlePacket(const uint8_t* packet, int length)
+{
+  // Validate header
+  if (length < FRAME_STREAM_HEADER_SIZE || packet[0] != 'V' || packet[1] != 'F' ||
+      packet[2] != FRAME_STREAM_VERSION) {
+    framesDroppedInvalid++;
+    return;
+  }
+
+  uint8_t flags = packet[3];
+  uint32_t sequence = (uint32_t)packet[4] | ((uint32_t)packet[5] << 8) |
+                      ((uint32_t)packet[6] << 16) | ((uint32_t)packet[7] << 24);
+  uint32_t timestamp = (uint32_t)packet[8] | ((uint32_t)packet[9] << 8) |
+                       ((uint32_t)packet[10] << 16) | ((uint32_t)packet[11] << 24);
+  uint8_t numDigits = packet[12];
+  bool hasBrightness = flags & FRAME_STREAM_FLAG_BRIGHTNESS;
+
+  if (numDigits == 0 || numDigits > MAX_DIGITS ||
+      length < FRAME_STREAM_HEADER_SIZE + numDigits + (hasBrightness ? 1 : 0)) {
+    framesDroppedInvalid++;
+    return;
+  }
+
+  unsigned long now = millis();
+  lastPacketTime = now;
+  framesReceived++;
+
+  if (!active || (flags & FRAME_STREAM_FLAG_NEW_STREAM)) {
+    startStream(timestamp);
+  }
+  else {
+    // Track the fastest transit seen so the playout delay only has to absorb jitter
+    long transit = (long)(now - timestamp);
+    if (transit < clockOffset) {
+      clockOffset = transit;
+    }
+  }
+
+  // Drop frames older than the last one shown (reordered or duplicated)
+  if (hasPlayed && (int32_t)(sequence - lastPlayedSequence) <= 0) {
+    framesDroppedLate++;
+    return;
+  }
+
+  // Drop frames that arrived after their deadline
+  unsigned long dueTime = timestamp + clockOffset + playoutDelayMs;
+  if ((long)(now - dueTime) > 0) {
+    framesDroppedLate++;
+    return;
+  }
+
+  Slot& slot = jitterBuffer[sequence % FRAME_STREAM_JITTER_SLOTS];
+  if (slot.used) {
+    if (slot.sequence == sequence) return;  // Duplicate
+    if ((int32_t)(sequence - slot.sequence) < 0) {
+      framesDroppedLate++;
+      return;
+    }
+    framesOverwritten++;
+  }
+
+  slot.used = true;
+  slot.sequence = sequence;
+  slot.dueTime = dueTime;
+  slot.numDigits = numDigits;
+  memcpy(slot.segments, packet + FRAME_STREAM_HEADER_SIZE, numDigits);
+  slot.hasBrightness = hasBrightness;
+  slot.brightness = hasBrightness ? packet[FRAME_STREAM_HEADER_SIZE + numDigits] : 0;
+}
+
+void FrameStream::playDueFrame()
+{
+  unsigned long now = millis();
+  Slot* newest = nullptr;
+
+  // Find the newest frame whose deadline has passed
+  for (int i = 0; i < FRAME_STREAM_JITTER_SLOTS; i++) {
+    Slot& slot = jitterBuffer[i];
+    if (!slot.used || (long)(now - slot.dueTime) < 0) continue;
+
+    if (newest == nullptr || (int32_t)(slot.sequence - newest->sequence) > 0) {
+      newest = &slot;
+    }
+  }
+
+  if (newest == nullptr) return;
+
+  // Anything older than the frame we are about to show is late
+  for (int i = 0; i < FRAME_STREAM_JITTER_SLOTS; i++) {
+    Slot& slot = jitterBuffer[i];
+    if (slot.used && &slot != newest && (int32_t)(slot.sequence - newest->sequence) < 0) {
+      slot.used = false;
+      framesDroppedLate++;
+    }
+  }
+
+  display.setDisplaySegments(newest->segments, newest->numDigits);
+  if (newest->hasBrightness) {
+    display.setBrightness(newest->brightness);
+  }
+
+  lastPlayedSequence = newest->sequence;
+  hasPlayed = true;
+  newest->used = false;
+  framesPlayed++;
+}
+
+void FrameStream::startStream(uint32_t timestamp)
+{
+  active = true;
+  hasPlayed = false;
+  clockOffset = (long)(millis() - timestamp);
+
+  for (int i = 0; i < FRAME_STREAM_JITTER_SLOTS; i++) {
+    jitterBuffer[i].used = false;
+  }
+}
+
+void FrameStream::endStream()
+{
+  active = false;
+  hasPlayed = false;
+  display.setBrightness(idleBrightness);
+
+  for (int i = 0; i < FRAME_STREAM_JITTER_SLOTS; i++) {
+    jitterBuffer[i].used = false;
+  }
+}
@@ -0,0 +1,93 @@
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include <Arduino.h>
+#include <WiFiUdp.h>
+#include "max6921.h"
+
+// UDP real-time frame streaming.
+//
+// A host pushes raw segment frames straight into the MAX6921 frame buffer. Packet layout (little-endian):
+//
+//   offset  size  field
+//   0       2     magic 'V' 'F'
+//   2       1     protocol version (FRAME_STREAM_VERSION)
+//   3       1     flags (bit 0: brightness byte present, bit 1: start of a new stream)
+//   4       4     sequence number (incremented by one per frame)
+//   8       4     sender timestamp in ms (when the frame should be shown, on the sender's clock)
+//   12      1     digit count N (1..MAX_DIGITS)
+//   13      N     segment masks, left to right (bit 0 = A ... bit 6 = G, bit 7 = H/period)
+//   13+N    1     brightness 0-255 (only if flag bit 0 is set)
+//
+// Frames are held in a small jitter buffer and shown at sender timestamp + playout delay (mapped onto the
+// local clock). Frames that arrive after their deadline, or that are older than the last frame shown, are dropped.
+
+#define FRAME_STREAM_VERSION 1
+#define FRAME_STREAM_HEADER_SIZE 13
+#define FRAME_STREAM_MAX_PACKET (FRAME_STREAM_HEADER_SIZE + MAX_DIGITS + 1)
+#define FRAME_STREAM_JITTER_SLOTS 8
+#define FRAME_STREAM_FLAG_BRIGHTNESS 0x01
+#define FRAME_STREAM_FLAG_NEW_STREAM 0x02
+
+class FrameStream {
+private:
+  struct Slot {
+    bool used;
+    uint32_t sequence;
+    unsigned long dueTime;          // Local millis() at which the frame is shown
+    uint8_t numDigits;
+    uint8_t segments[MAX_DIGITS];
+    bool hasBrightness;
+    uint8_t brightness;
+  };
+
+  WiFiUDP udp;
+  MAX6921& display;
+  uint16_t port;
+  uint16_t playoutDelayMs;
+  uint16_t timeoutMs;
+
+  // Stream state
+  bool active;
+  bool hasPlayed;
+  uint32_t lastPlayedSequence;
+  long clockOffset;                 // Local millis() minus sender timestamp, tracking the fastest transit seen
+  unsigned long lastPacketTime;
+  uint8_t idleBrightness;           // Brightness restored when the stream ends
+  Slot jitterBuffer[FRAME_STREAM_JITTER_SLOTS];
+
+  // Statistics
+  uint32_t framesReceived;
+  uint32_t framesPlayed;
+  uint32_t framesDroppedLate;
+  uint32_t framesDroppedInvalid;
+  uint32_t framesOverwritten;
+
+  // Internal methods
+  void receivePackets();
+  void handlePacket(const uint8_t* packet, int length);
+  void playDueFrame();
+  void startStream(uint32_t timestamp);
+  void endStream();
+
+public:
+  FrameStream(MAX6921& display, uint16_t port, uint16_t playoutDelayMs = 50, uint16_t timeoutMs = 2000);
+
+  bool begin();
+  void update();
+
+  // True while frames are being received; the normal clock display should not draw meanwhile
+  bool isActive() const { return active; }
+
+  // Brightness the display returns to when the stream ends
+  void setIdleBrightness(uint8_t level) { idleBrightness = level; }
+
+  // Statistics
+  uint32_t getFramesReceived() const { return framesReceived; }
+  uint32_t getFramesPlayed() const { return framesPlayed; }
+  uint32_t getFramesDroppedLate() const { return framesDroppedLate; }
+  uint32_t getFramesDroppedInvalid() const { return framesDroppedInvalid; }
+  uint32_t getFramesOverwritten() const { return framesOverwritten; }
+};
+
+#endif
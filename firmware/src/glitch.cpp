@@ -0,0 +1,164 @@
+#include "glitch.h"
+
+// Characters that can appear in the noise
+static const char GLITCH_CHARS[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-=+*#@$%&!?";
+
+static const char* GLITCH_EFFECT_NAMES[] = { "noise", "flicker", "decay", "scanline" };
+
+#define GLITCH_NOISE_DENSITY 179         // Chance (of 256) that a noise digit is lit, about 70%
+#define GLITCH_SCANLINE_SEGMENTS 0x49    // Segments A, D and G, a horizontal bar
+
+GlitchEngine::GlitchEngine(MAX6921& display, uint16_t frameMs)
+  : display(display), frameMs(frameMs), state(0x9E3779B9), decaySeed(1), numGlyphs(0),
+    effect(GLITCH_EFFECT_NOISE), reveal(true), active(false), startTime(0), duration(0), lastFrame(0),
+    invalidated(true)
+{
+  memset(glyphs, 0, sizeof(glyphs));
+  memset(target, 0, sizeof(target));
+  memset(shown, 0, sizeof(shown));
+}
+
+void GlitchEngine::begin()
+{
+  numGlyphs = 0;
+  for (const char* p = GLITCH_CHARS; *p != '\0' && numGlyphs < sizeof(glyphs); p++) {
+    // Characters without a segment pattern would only show as blanks
+    uint8_t mask = display.getCharSegments(*p);
+    if (mask != 0) {
+      glyphs[numGlyphs++] = mask;
+    }
+  }
+
+  state = esp_random() | 1;
+}
+
+uint32_t GlitchEngine::next()
+{
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+uint8_t GlitchEngine::randomGlyph()
+{
+  // Multiply-shift maps 16 random bits onto the table without a division
+  return glyphs[((next() & 0xFFFF) * numGlyphs) >> 16];
+}
+
+void GlitchEngine::start(const uint8_t* segments, bool reveal, uint32_t durationMs, GlitchEffect effect)
+{
+  memcpy(target, segments, GLITCH_DISPLAY_DIGITS);
+
+  this->effect = (effect < GLITCH_EFFECT_COUNT) ? effect : GLITCH_EFFECT_NOISE;
+  this->reveal = reveal;
+  decaySeed = next() | 1;
+  startTime = millis();
+  duration = durationMs;
+  active = true;
+
+  // Draw the first frame on the next update
+  lastFrame = startTime - frameMs;
+  invalidated = true;
+}
+
+void GlitchEngine::start(const uint8_t* segments, bool reveal, uint32_t durationMs)
+{
+  start(segments, reveal, durationMs, (GlitchEffect)(next() % GLITCH_EFFECT_COUNT));
+}
+
+bool GlitchEngine::update()
+{
+  if (!active) return false;
+
+  unsigned long now = millis();
+  unsigned long elapsed = now - startTime;
+  if (elapsed >= duration) {
+    active = false;
+    return false;
+  }
+
+  if (now - lastFrame >= frameMs || invalidated) {
+    // Progress towards the target in 1/256ths
+    uint8_t progress = (elapsed * 256) / duration;
+    if (!reveal) {
+      progress = 255 - progress;
+    }
+
+    render(progress);
+    lastFrame = now;
+  }
+
+  return true;
+}
+
+uint8_t GlitchEngine::renderDigit(uint8_t position, uint8_t mask, uint8_t progress, uint32_t& decayState)
+{
+  switch (effect) {
+    case GLITCH_EFFECT_NOISE:
+      return ((next() & 0xFF) < GLITCH_NOISE_DENSITY) ? randomGlyph() : 0;
+
+    case GLITCH_EFFECT_FLICKER: {
+      // Each target segment is lit with the progress as its probability; stray segments fade the other way
+      uint32_t r = next();
+      uint8_t keep = 0;
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        if (((r >> (bit * 4)) & 0x0F) < (progress >> 4)) {
+          keep |= 1 << bit;
+        }
+      }
+      uint8_t stray = ((next() & 0xFF) >= progress) ? (next() & 0x7F) : 0;
+      return (mask & keep) | (stray & ~mask & 0x7F);
+    }
+
+    case GLITCH_EFFECT_DECAY: {
+      // The replayed sequence gives every segment the same threshold on every frame, so segments switch once
+      uint8_t lit = 0;
+      for (uint8_t bit = 0; bit < 8; bit++) {
+        decayState ^= decayState << 13;
+        decayState ^= decayState >> 17;
+        decayState ^= decayState << 5;
+        if ((decayState & 0xFF) < progress) {
+          lit |= 1 << bit;
+        }
+      }
+      return mask & lit;
+    }
+
+    case GLITCH_EFFECT_SCANLINE: {
+      // The bar moves left to right; digits it has passed show the target, the rest show noise
+      uint8_t bar = ((uint16_t)progress * (GLITCH_DISPLAY_DIGITS + 1)) >> 8;
+      if (position < bar) {
+        return mask;
+      }
+      if (position == bar) {
+        return GLITCH_SCANLINE_SEGMENTS;
+      }
+      return ((next() & 0xFF) < GLITCH_NOISE_DENSITY / 2) ? randomGlyph() : 0;
+    }
+
+    default:
+      return 0;
+  }
+}
+
+void GlitchEngine::render(uint8_t progress)
+{
+  uint32_t decayState = decaySeed;
+
+  for (uint8_t i = 0; i < GLITCH_DISPLAY_DIGITS; i++) {
+    uint8_t segments = renderDigit(i, target[i], progress, decayState);
+
+    if (invalidated || segments != shown[i]) {
+      display.setDigitSegments(i, segments);
+      shown[i] = segments;
+    }
+  }
+
+  invalidated = false;
+}
+
+const char* GlitchEngine::getEffectName(GlitchEffect effect)
+{
+  return effect < GLITCH_EFFECT_COUNT ? GLITCH_EFFECT_NAMES[effect] : "unknown";
+}
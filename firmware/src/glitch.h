@@ -0,0 +1,75 @@
+#ifndef GLITCH_H
+#define GLITCH_H
+
+#include <Arduino.h>
+#include "max6921.h"
+
+// Glitch transitions for flash messages.
+//
+// Frames are generated as segment masks straight into the display (MAX6921::setDigitSegments, changed digits
+// only) from a xorshift32 generator, so an effect frame costs a few dozen integer operations and no heap.
+// Every effect is a function of the progress through the transition: revealing runs it towards the target
+// message, hiding runs it backwards, away from the message.
+
+#define GLITCH_DISPLAY_DIGITS 8
+
+enum GlitchEffect : uint8_t {
+  GLITCH_EFFECT_NOISE = 0,               // Random characters on random digits (the original effect)
+  GLITCH_EFFECT_FLICKER,                 // Target segments flicker, with stray segments fading out
+  GLITCH_EFFECT_DECAY,                   // Target segments light (or burn out) one by one in a fixed random order
+  GLITCH_EFFECT_SCANLINE,                // A bright bar sweeps across, leaving the target behind it
+  GLITCH_EFFECT_COUNT
+};
+
+class GlitchEngine {
+private:
+  MAX6921& display;
+  uint16_t frameMs;
+
+  uint32_t state;                        // xorshift32 state, never zero
+  uint32_t decaySeed;                    // Fixes the segment order of the decay effect for one transition
+
+  uint8_t glyphs[48];                    // Segment masks of the characters used for noise
+  uint8_t numGlyphs;
+
+  GlitchEffect effect;
+  bool reveal;
+  bool active;
+  uint8_t target[GLITCH_DISPLAY_DIGITS];
+  unsigned long startTime;
+  unsigned long duration;
+  unsigned long lastFrame;
+
+  uint8_t shown[GLITCH_DISPLAY_DIGITS];
+  bool invalidated;
+
+  uint32_t next();
+  uint8_t randomGlyph();
+  uint8_t renderDigit(uint8_t position, uint8_t mask, uint8_t progress, uint32_t& decayState);
+  void render(uint8_t progress);
+
+public:
+  GlitchEngine(MAX6921& display, uint16_t frameMs);
+
+  // Builds the noise glyph table from the driver's character map and seeds the generator
+  void begin();
+
+  // Start a transition towards (reveal) or away from (hide) the given frame (GLITCH_DISPLAY_DIGITS masks)
+  void start(const uint8_t* segments, bool reveal, uint32_t durationMs, GlitchEffect effect);
+
+  // Same, with an effect picked at random
+  void start(const uint8_t* segments, bool reveal, uint32_t durationMs);
+
+  // Draws the next frame when due. Returns false once the transition is over.
+  bool update();
+
+  // Force a full redraw, e.g. after something else was shown on the display
+  void invalidate() { invalidated = true; }
+
+  bool isActive() const { return active; }
+  GlitchEffect getEffect() const { return effect; }
+
+  static const char* getEffectName(GlitchEffect effect);
+};
+
+#endif
@@ -0,0 +1,229 @@
+#include "heapprofile.h"
+#include <stdlib.h>
+
+HeapProfiler heapProfiler;
+
+// Interrupts off: nothing else can run on the single core. Usable before the scheduler starts and from any task.
+#define HEAP_LOCK() UBaseType_t heapLockState = portSET_INTERRUPT_MASK_FROM_ISR()
+#define HEAP_UNLOCK() portCLEAR_INTERRUPT_MASK_FROM_ISR(heapLockState)
+
+void HeapProfiler::begin()
+{
+  loopTask = xTaskGetCurrentTaskHandle();
+}
+
+void HeapProfiler::recordAllocation(uint32_t caller, size_t size, bool succeeded)
+{
+  // Runs inside malloc: must not allocate, log or block
+  bool onLoop = loopTask != nullptr && xTaskGetCurrentTaskHandle() == loopTask;
+  bool violation = false;
+
+  HEAP_LOCK();
+  allocations++;
+  bytes += size;
+  if (!succeeded) {
+    failures++;
+  }
+  if (onLoop) {
+    loopAllocations++;
+    loopBytes += size;
+  }
+
+  uint8_t i = 0;
+  while (i < siteCount && sites[i].address != caller) {
+    i++;
+  }
+  if (i == siteCount && siteCount < HEAP_CALL_SITES) {
+    sites[siteCount++] = { caller, 0, 0 };
+  }
+  if (i < siteCount) {
+    sites[i].count++;
+    sites[i].bytes += size;
+  }
+  else {
+    otherCount++;
+    otherBytes += size;
+  }
+
+  if (onLoop && guardArmed && exemptDepth == 0) {
+    violations++;
+    if (guardSiteCount < HEAP_GUARD_SITES) {
+      guardSites[guardSiteCount++] = { caller, (uint32_t)size, 0 };
+    }
+    violation = true;
+  }
+  HEAP_UNLOCK();
+
+  if (violation && guardAbort) {
+    abort();
+  }
+}
+
+void HeapProfiler::recordFree()
+{
+  HEAP_LOCK();
+  frees++;
+  HEAP_UNLOCK();
+}
+
+void HeapProfiler::sample()
+{
+  HeapSample& next = samples[sampleNext];
+  next.uptimeS = millis() / 1000;
+  next.freeBytes = ESP.getFreeHeap();
+  next.largestBlock = ESP.getMaxAllocHeap();
+  next.allocations = allocations;
+
+  if (next.largestBlock < lowestLargestBlock) {
+    lowestLargestBlock = next.largestBlock;
+  }
+
+  sampleNext = (sampleNext + 1) % HEAP_SAMPLES;
+  if (sampleCount < HEAP_SAMPLES) {
+    sampleCount++;
+  }
+}
+
+const HeapSample& HeapProfiler::getSample(uint8_t index) const
+{
+  return samples[(sampleNext + HEAP_SAMPLES - sampleCount + index) % HEAP_SAMPLES];
+}
+
+void HeapProfiler::armGuard(bool abortOnViolation)
+{
+  HEAP_LOCK();
+  guardAbort = abortOnViolation;
+  guardArmed = true;
+  HEAP_UNLOCK();
+}
+
+void HeapProfiler::resetGuard()
+{
+  HEAP_LOCK();
+  violations = 0;
+  guardSiteCount = 0;
+  HEAP_UNLOCK();
+}
+
+void HeapProfiler::enterExempt()
+{
+  if (xTaskGetCurrentTaskHandle() == loopTask) {
+    exemptDepth++;
+  }
+}
+
+void HeapProfiler::leaveExempt()
+{
+  if (xTaskGetCurrentTaskHandle() == loopTask && exemptDepth > 0) {
+    exemptDepth--;
+  }
+}
+
+void HeapProfiler::resetCounters()
+{
+  HEAP_LOCK();
+  allocations = 0;
+  frees = 0;
+  failures = 0;
+  bytes = 0;
+  loopAllocations = 0;
+  loopBytes = 0;
+  siteCount = 0;
+  otherCount = 0;
+  otherBytes = 0;
+  HEAP_UNLOCK();
+}
+
+uint8_t HeapProfiler::getCallSites(HeapCallSite* out, uint8_t max, uint32_t& othersCount, uint32_t& othersBytes) const
+{
+  HEAP_LOCK();
+  uint8_t count = siteCount < max ? siteCount : max;
+  memcpy(out, sites, count * sizeof(HeapCallSite));
+  othersCount = otherCount;
+  othersBytes = otherBytes;
+  HEAP_UNLOCK();
+  return count;
+}
+
+uint8_t HeapProfiler::getGuardSites(HeapCallSite* out, uint8_t max) const
+{
+  HEAP_LOCK();
+  uint8_t count = guardSiteCount < max ? guardSiteCount : max;
+  memcpy(out, guardSites, count * sizeof(HeapCallSite));
+  HEAP_UNLOCK();
+  return count;
+}
+
+#ifdef HEAP_PROFILE
+
+// The linker sends every call to malloc and friends here (--wrap), and __real_* to the allocator itself.
+// operator new and new[] (_Znwj, _Znaj for the 32-bit size_t) are wrapped as well and allocate with
+// __real_malloc, so an object is counted once, at the new expression, instead of inside the library's new.
+extern "C" {
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+void __real_free(void* pointer);
+void* __real__Znwj(size_t size);
+void* __real__Znaj(size_t size);
+
+void* __wrap_malloc(size_t size)
+{
+  void* pointer = __real_malloc(size);
+  heapProfiler.recordAllocation((uint32_t)(uintptr_t)__builtin_return_address(0), size, pointer != nullptr);
+  return pointer;
+}
+
+void* __wrap_calloc(size_t count, size_t size)
+{
+  void* pointer = __real_calloc(count, size);
+  heapProfiler.recordAllocation((uint32_t)(uintptr_t)__builtin_return_address(0), count * size, pointer != nullptr);
+  return pointer;
+}
+
+void* __wrap_realloc(void* pointer, size_t size)
+{
+  // realloc(pointer, 0) frees; growing a String in place still counts as an allocation
+  void* result = __real_realloc(pointer, size);
+  if (size == 0) {
+    if (pointer) {
+      heapProfiler.recordFree();
+    }
+  }
+  else {
+    heapProfiler.recordAllocation((uint32_t)(uintptr_t)__builtin_return_address(0), size, result != nullptr);
+  }
+  return result;
+}
+
+void* __wrap__Znwj(size_t size)
+{
+  void* pointer = __real_malloc(size ? size : 1);
+  if (pointer == nullptr) {
+    // Out of memory: the library's operator new runs the new handler and fails as it always has
+    return __real__Znwj(size);
+  }
+  heapProfiler.recordAllocation((uint32_t)(uintptr_t)__builtin_return_address(0), size, true);
+  return pointer;
+}
+
+void* __wrap__Znaj(size_t size)
+{
+  void* pointer = __real_malloc(size ? size : 1);
+  if (pointer == nullptr) {
+    return __real__Znaj(size);
+  }
+  heapProfiler.recordAllocation((uint32_t)(uintptr_t)__builtin_return_address(0), size, true);
+  return pointer;
+}
+
+void __wrap_free(void* pointer)
+{
+  if (pointer) {
+    heapProfiler.recordFree();
+  }
+  __real_free(pointer);
+}
+}
+
+#endif
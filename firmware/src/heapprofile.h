@@ -0,0 +1,142 @@
+#ifndef HEAPPROFILE_H
+#define HEAPPROFILE_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Heap profiler and steady-state allocation guard.
+//
+// Samples of the free heap and the largest free block are kept every HEAP_SAMPLE_INTERVAL_MS, so slow
+// fragmentation shows as a trend over the last hours. Allocation tracking needs -DHEAP_PROFILE plus the linker
+// flags -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=free,--wrap=_Znwj,--wrap=_Znaj (see
+// platformio.ini): every malloc, calloc, realloc, free and operator new in the firmware and the prebuilt
+// libraries then passes through this profiler, which counts them and the bytes requested per call site (the
+// return address of the allocating call; resolve it with addr2line). A new expression is attributed to the
+// function that contains it. String growth is attributed to String's own buffer code, since the RISC-V build
+// keeps no frame pointers to walk further up; to find which String grows on the loop, arm the guard with abort.
+// Allocations made inside ESP-IDF with heap_caps_malloc() bypass the hook.
+//
+// The guard is the test mode: once armed, every allocation on the loop task outside a HEAP_EXEMPT() scope is a
+// violation. Its call site is kept for /api/heap and logged from the loop; with abort set the clock panics at
+// the allocation, so the backtrace shows the whole call chain. Web request handling and outgoing network
+// traffic are exempt, everything else that runs on the loop must not allocate once the clock is running.
+//
+// The hooks run on every task and before setup(), so the profiler is constant-initialized and only uses
+// interrupt masking for mutual exclusion (the ESP32-C3 has a single core).
+
+#define HEAP_SAMPLE_INTERVAL_MS 60000UL
+#define HEAP_SAMPLES 60                          // One hour of history
+#define HEAP_CALL_SITES 32                       // Sites beyond this are counted together
+#define HEAP_GUARD_SITES 8                       // Violations whose call site is kept
+
+struct HeapCallSite {
+  uint32_t address;
+  uint32_t count;
+  uint32_t bytes;
+};
+
+struct HeapSample {
+  uint32_t uptimeS;
+  uint32_t freeBytes;
+  uint32_t largestBlock;
+  uint32_t allocations;                          // Allocations since boot at the time of the sample
+};
+
+class HeapProfiler {
+private:
+  uint32_t allocations = 0;                      // All tasks
+  uint32_t frees = 0;
+  uint32_t failures = 0;                         // Allocations that returned null
+  uint64_t bytes = 0;                            // Bytes requested
+  uint32_t loopAllocations = 0;
+  uint64_t loopBytes = 0;
+
+  HeapCallSite sites[HEAP_CALL_SITES] = {};
+  uint8_t siteCount = 0;
+  uint32_t otherCount = 0;
+  uint32_t otherBytes = 0;
+
+  TaskHandle_t loopTask = nullptr;
+  uint8_t exemptDepth = 0;                       // Nested HEAP_EXEMPT() scopes on the loop task
+  bool guardArmed = false;
+  bool guardAbort = false;
+  uint32_t violations = 0;
+  HeapCallSite guardSites[HEAP_GUARD_SITES] = {};  // count holds the size of the violating allocation
+  uint8_t guardSiteCount = 0;
+
+  HeapSample samples[HEAP_SAMPLES] = {};
+  uint8_t sampleNext = 0;
+  uint8_t sampleCount = 0;
+  uint32_t lowestLargestBlock = UINT32_MAX;
+
+public:
+  constexpr HeapProfiler() {}
+
+  // Marks the calling task as the loop task; call early in setup()
+  void begin();
+
+  // Called by the allocator hooks
+  void recordAllocation(uint32_t caller, size_t size, bool succeeded);
+  void recordFree();
+
+  // Adds a free heap sample; called every HEAP_SAMPLE_INTERVAL_MS
+  void sample();
+
+  void armGuard(bool abortOnViolation);
+  void disarmGuard() { guardArmed = false; }
+  void resetGuard();
+  void enterExempt();
+  void leaveExempt();
+
+  // Clears the counters and call sites (the samples are kept)
+  void resetCounters();
+
+  static constexpr bool isTracking()
+  {
+#ifdef HEAP_PROFILE
+    return true;
+#else
+    return false;
+#endif
+  }
+
+  uint32_t getAllocations() const { return allocations; }
+  uint32_t getFrees() const { return frees; }
+  uint32_t getFailures() const { return failures; }
+  uint64_t getBytes() const { return bytes; }
+  uint32_t getLoopAllocations() const { return loopAllocations; }
+  uint64_t getLoopBytes() const { return loopBytes; }
+
+  // Copies the call sites, so they can be formatted without the hooks changing them meanwhile
+  uint8_t getCallSites(HeapCallSite* out, uint8_t max, uint32_t& othersCount, uint32_t& othersBytes) const;
+  uint8_t getGuardSites(HeapCallSite* out, uint8_t max) const;
+
+  bool isGuardArmed() const { return guardArmed; }
+  bool isGuardAbort() const { return guardAbort; }
+  uint32_t getViolations() const { return violations; }
+
+  // Samples oldest first
+  uint8_t getSampleCount() const { return sampleCount; }
+  const HeapSample& getSample(uint8_t index) const;
+  uint32_t getLowestLargestBlock() const { return lowestLargestBlock == UINT32_MAX ? 0 : lowestLargestBlock; }
+};
+
+extern HeapProfiler heapProfiler;
+
+// Keeps the guard off for the rest of the enclosing scope, for work that is allowed to allocate
+class HeapExemptScope {
+public:
+  HeapExemptScope() { heapProfiler.enterExempt(); }
+  ~HeapExemptScope() { heapProfiler.leaveExempt(); }
+};
+
+#ifdef HEAP_PROFILE
+#define HEAP_CONCAT_(a, b) a##b
+#define HEAP_CONCAT(a, b) HEAP_CONCAT_(a, b)
+#define HEAP_EXEMPT() HeapExemptScope HEAP_CONCAT(heapExempt, __LINE__)
+#else
+#define HEAP_EXEMPT() do {} while (0)
+#endif
+
+#endif
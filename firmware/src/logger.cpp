@@ -0,0 +1,401 @@
+#include "logger.h"
+#include <stdarg.h>
+
+#define LOG_RING_MASK (LOG_BUFFER_SIZE - 1)
+#define LOG_HEADER_SIZE (2 + 4 + 1 + 1 + sizeof(const char*))
+#define LOG_SPEC_LENGTH 16
+
+Logger logger;
+
+static const char* const LOG_TAG_NAMES[LOG_TAG_COUNT] = {
+  "system", "wifi", "time", "web", "boost", "display", "flash", "media", "config", "power"
+};
+
+static const char* const LOG_LEVEL_NAMES[] = { "none", "error", "warn", "info", "debug" };
+static const char LOG_LEVEL_LETTERS[] = { '-', 'E', 'W', 'I', 'D' };
+
+// One conversion of a printf format: the spec text and what kind of argument it takes
+struct LogConversion {
+  char spec[LOG_SPEC_LENGTH];
+  char type;                                     // Conversion character, 0 at the end of the format
+  uint8_t longs;                                 // Number of 'l' modifiers
+  bool size;                                     // 'z' modifier
+};
+
+// Copies literal text to out (if given) and parses the next conversion; returns the position after it
+static const char* nextConversion(const char* p, LogConversion& conversion, char* out, size_t& used, size_t size)
+{
+  conversion.type = 0;
+  while (*p) {
+    if (*p != '%' || p[1] == '%') {
+      if (out != NULL && used + 1 < size) {
+        out[used++] = *p;
+      }
+      p += (*p == '%') ? 2 : 1;
+      continue;
+    }
+
+    const char* start = p++;
+    while (*p && strchr("-+ #0", *p)) p++;
+    while ((*p >= '0' && *p <= '9') || *p == '.') p++;
+    conversion.longs = 0;
+    conversion.size = false;
+    while (*p == 'l' || *p == 'h' || *p == 'z') {
+      conversion.longs += (*p == 'l');
+      conversion.size |= (*p == 'z');
+      p++;
+    }
+    if (*p == 0) return p;
+
+    conversion.type = *p++;
+    size_t length = min((size_t)(p - start), (size_t)LOG_SPEC_LENGTH - 1);
+    memcpy(conversion.spec, start, length);
+    conversion.spec[length] = 0;
+    return p;
+  }
+  return p;
+}
+
+Logger::Logger()
+  : head(0), tail(0), written(0), dropped(0), droppedReported(0), historyLength(0), historyLock(NULL), drainTask(NULL)
+{
+  memset(ring, 0, sizeof(ring));
+  memset(history, 0, sizeof(history));
+  setLevel(LOG_LEVEL);
+}
+
+bool Logger::begin()
+{
+  historyLock = xSemaphoreCreateMutex();
+  if (historyLock == NULL) return false;
+
+  // Idle priority: records are formatted only while the loop sleeps
+  return xTaskCreate(drain, "log", LOG_TASK_STACK, this, tskIDLE_PRIORITY, &drainTask) == pdPASS;
+}
+
+void Logger::write(uint8_t level, LogTag tag, const char* format, ...)
+{
+  if (tag >= LOG_TAG_COUNT || level > levels[tag]) return;
+
+  uint8_t record[LOG_MAX_RECORD];
+  uint32_t now = millis();
+  size_t length = LOG_HEADER_SIZE;
+  memcpy(record + 2, &now, 4);
+  record[6] = level;
+  record[7] = tag;
+  memcpy(record + 8, &format, sizeof(format));
+
+  // Store the arguments as the format describes them; whatever does not fit is left out and shown as '?'
+  va_list args;
+  va_start(args, format);
+  LogConversion conversion;
+  size_t unused = 0;
+  const char* p = format;
+  bool full = false;
+  while (!full) {
+    p = nextConversion(p, conversion, NULL, unused, 0);
+    if (conversion.type == 0) break;
+
+    switch (conversion.type) {
+      case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c': {
+        if (conversion.longs >= 2) {
+          long long value = va_arg(args, long long);
+          if ((full = length + sizeof(value) > sizeof(record))) break;
+          memcpy(record + length, &value, sizeof(value));
+          length += sizeof(value);
+        }
+        else if (conversion.longs == 1 || conversion.size) {
+          long value = va_arg(args, long);
+          if ((full = length + sizeof(value) > sizeof(record))) break;
+          memcpy(record + length, &value, sizeof(value));
+          length += sizeof(value);
+        }
+        else {
+          int value = va_arg(args, int);
+          if ((full = length + sizeof(value) > sizeof(record))) break;
+          memcpy(record + length, &value, sizeof(value));
+          length += sizeof(value);
+        }
+        break;
+      }
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': {
+        double value = va_arg(args, double);
+        if ((full = length + sizeof(value) > sizeof(record))) break;
+        memcpy(record + length, &value, sizeof(value));
+        length += sizeof(value);
+        break;
+      }
+      case 'p': {
+        void* value = va_arg(args, void*);
+        if ((full = length + sizeof(value) > sizeof(record))) break;
+        memcpy(record + length, &value, sizeof(value));
+        length += sizeof(value);
+        break;
+      }
+      case 's': {
+        const char* text = va_arg(args, const char*);
+        if (text == NULL) {
+          text = "(null)";
+        }
+        size_t textLength = strnlen(text, LOG_MAX_STRING);
+        if ((full = length + 1 >= sizeof(record))) break;
+        textLength = min(textLength, sizeof(record) - length - 1);
+        record[length++] = textLength;
+        memcpy(record + length, text, textLength);
+        length += textLength;
+        break;
+      }
+      default:
+        full = true;
+        break;
+    }
+  }
+  va_end(args);
+
+  uint16_t recordLength = length;
+  memcpy(record, &recordLength, 2);
+
+  // Publish the record, or drop it if the drain task has fallen behind
+  uint32_t position = head.load(std::memory_order_relaxed);
+  if (LOG_BUFFER_SIZE - (position - tail.load(std::memory_order_acquire)) < length) {
+    dropped++;
+    return;
+  }
+
+  for (size_t i = 0; i < length; i++) {
+    ring[(position + i) & LOG_RING_MASK] = record[i];
+  }
+  head.store(position + length, std::memory_order_release);
+  written++;
+
+  if (drainTask == NULL) {
+    drainPending();
+  }
+}
+
+bool Logger::read(uint8_t* record, uint16_t& length)
+{
+  uint32_t position = tail.load(std::memory_order_relaxed);
+  if (position == head.load(std::memory_order_acquire)) return false;
+
+  length = ring[position & LOG_RING_MASK] | (ring[(position + 1) & LOG_RING_MASK] << 8);
+  for (uint16_t i = 0; i < length; i++) {
+    record[i] = ring[(position + i) & LOG_RING_MASK];
+  }
+  tail.store(position + length, std::memory_order_release);
+  return true;
+}
+
+size_t Logger::format(const uint8_t* record, uint16_t length, char* line, size_t size) const
+{
+  uint32_t time;
+  const char* formatText;
+  memcpy(&time, record + 2, 4);
+  uint8_t level = record[6];
+  uint8_t tag = record[7];
+  memcpy(&formatText, record + 8, sizeof(formatText));
+
+  int used = snprintf(line, size, "[%6lu.%03lu] %c %s: ", (unsigned long)(time / 1000), (unsigned long)(time % 1000),
+                      LOG_LEVEL_LETTERS[min(level, (uint8_t)LOG_LEVEL_DEBUG)], getTagName((LogTag)tag));
+  size_t position = min((size_t)used, size - 1);
+
+  size_t offset = LOG_HEADER_SIZE;
+  LogConversion conversion;
+  const char* p = formatText;
+  char text[LOG_MAX_STRING + 1];
+  while (true) {
+    p = nextConversion(p, conversion, line, position, size);
+    if (conversion.type == 0) break;
+
+    int added = 0;
+    char* out = line + position;
+    size_t room = size - position;
+    switch (conversion.type) {
+      case 'd': case 'i': case 'u': case 'x': case 'X': case 'o': case 'c':
+        if (conversion.longs >= 2 && offset + sizeof(long long) <= length) {
+          long long value;
+          memcpy(&value, record + offset, sizeof(value));
+          offset += sizeof(value);
+          added = snprintf(out, room, conversion.spec, value);
+        }
+        else if ((conversion.longs == 1 || conversion.size) && conversion.longs < 2 && offset + sizeof(long) <= length) {
+          long value;
+          memcpy(&value, record + offset, sizeof(value));
+          offset += sizeof(value);
+          added = snprintf(out, room, conversion.spec, value);
+        }
+        else if (conversion.longs == 0 && !conversion.size && offset + sizeof(int) <= length) {
+          int value;
+          memcpy(&value, record + offset, sizeof(value));
+          offset += sizeof(value);
+          added = snprintf(out, room, conversion.spec, value);
+        }
+        else {
+          added = snprintf(out, room, "?");
+        }
+        break;
+      case 'f': case 'F': case 'e': case 'E': case 'g': case 'G':
+        if (offset + sizeof(double) <= length) {
+          double value;
+          memcpy(&value, record + offset, sizeof(value));
+          offset += sizeof(value);
+          added = snprintf(out, room, conversion.spec, value);
+        }
+        else {
+          added = snprintf(out, room, "?");
+        }
+        break;
+      case 'p':
+        if (offset + sizeof(void*) <= length) {
+          void* value;
+          memcpy(&value, record + offset, sizeof(value));
+          offset += sizeof(value);
+          added = snprintf(out, room, conversion.spec, value);
+        }
+        else {
+          added = snprintf(out, room, "?");
+        }
+        break;
+      case 's':
+        if (offset < length && offset + 1 + record[offset] <= length) {
+          uint8_t textLength = record[offset++];
+          memcpy(text, record + offset, textLength);
+          text[textLength] = 0;
+          offset += textLength;
+          added = snprintf(out, room, conversion.spec, text);
+        }
+        else {
+          added = snprintf(out, room, "?");
+        }
+        break;
+      default:
+        added = snprintf(out, room, "%s", conversion.spec);
+        break;
+    }
+    position = min(position + max(added, 0), size - 1);
+  }
+
+  // Leave room for the newline
+  position = min(position, size - 2);
+  line[position++] = '\n';
+  line[position] = 0;
+  return position;
+}
+
+void Logger::output(const char* line, size_t length)
+{
+  Serial.write((const uint8_t*)line, length);
+
+  if (historyLock != NULL) {
+    xSemaphoreTake(historyLock, portMAX_DELAY);
+  }
+  for (size_t i = 0; i < length; i++) {
+    history[(historyLength + i) % LOG_HISTORY_SIZE] = line[i];
+  }
+  historyLength += length;
+  if (historyLock != NULL) {
+    xSemaphoreGive(historyLock);
+  }
+}
+
+void Logger::drainPending()
+{
+  uint8_t record[LOG_MAX_RECORD];
+  uint16_t length;
+  char line[LOG_LINE_LENGTH];
+
+  while (read(record, length)) {
+    output(line, format(record, length, line, sizeof(line)));
+  }
+
+  // dropped is only ever increased, so a stale read reports the rest next time
+  uint32_t droppedNow = dropped;
+  if (droppedNow != droppedReported) {
+    int used = snprintf(line, sizeof(line), "[%6lu.%03lu] W system: %lu log messages dropped\n", millis() / 1000,
+                        millis() % 1000, (unsigned long)(droppedNow - droppedReported));
+    droppedReported = droppedNow;
+    output(line, min((size_t)used, sizeof(line) - 1));
+  }
+}
+
+void Logger::drain(void* arg)
+{
+  Logger* self = (Logger*)arg;
+  while (true) {
+    self->drainPending();
+    vTaskDelay(pdMS_TO_TICKS(LOG_DRAIN_INTERVAL_MS));
+  }
+}
+
+void Logger::setLevel(uint8_t level)
+{
+  for (uint8_t i = 0; i < LOG_TAG_COUNT; i++) {
+    levels[i] = level;
+  }
+}
+
+void Logger::setLevel(LogTag tag, uint8_t level)
+{
+  if (tag < LOG_TAG_COUNT) {
+    levels[tag] = level;
+  }
+}
+
+String Logger::getHistory()
+{
+  String text;
+  if (historyLock != NULL) {
+    xSemaphoreTake(historyLock, portMAX_DELAY);
+  }
+
+  uint32_t count = min(historyLength, (uint32_t)LOG_HISTORY_SIZE);
+  uint32_t start = historyLength - count;
+  text.reserve(count);
+
+  // Once the history has wrapped, skip the partial first line
+  uint32_t i = 0;
+  if (historyLength > LOG_HISTORY_SIZE) {
+    while (i < count && history[(start + i) % LOG_HISTORY_SIZE] != '\n') i++;
+    i++;
+  }
+  for (; i < count; i++) {
+    text += history[(start + i) % LOG_HISTORY_SIZE];
+  }
+
+  if (historyLock != NULL) {
+    xSemaphoreGive(historyLock);
+  }
+  return text;
+}
+
+const char* Logger::getTagName(LogTag tag)
+{
+  return tag < LOG_TAG_COUNT ? LOG_TAG_NAMES[tag] : "?";
+}
+
+const char* Logger::getLevelName(uint8_t level)
+{
+  return level <= LOG_LEVEL_DEBUG ? LOG_LEVEL_NAMES[level] : "?";
+}
+
+bool Logger::parseTag(const String& name, LogTag& tag)
+{
+  for (uint8_t i = 0; i < LOG_TAG_COUNT; i++) {
+    if (name == LOG_TAG_NAMES[i]) {
+      tag = (LogTag)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+bool Logger::parseLevel(const String& name, uint8_t& level)
+{
+  for (uint8_t i = 0; i <= LOG_LEVEL_DEBUG; i++) {
+    if (name == LOG_LEVEL_NAMES[i]) {
+      level = i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,135 @@
+#ifndef LOGGER_H
+#define LOGGER_H
+
+#include <Arduino.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+#include <freertos/semphr.h>
+#include <atomic>
+
+// Asynchronous logger.
+//
+// LOG_ERROR/LOG_WARN/LOG_INFO/LOG_DEBUG take a module tag and a printf format. Levels above LOG_LEVEL are
+// removed by the preprocessor, arguments included (LOG_LEVEL defaults to debug with -DDEBUG, else info).
+// Nothing is formatted on the caller's side: write() stores the format pointer (formats must be string
+// literals) and the raw arguments as a binary record in a ring buffer, and returns. A task at idle priority
+// formats the records and writes them to Serial and to a text history served at /api/log, so a slow UART
+// never stalls the multiplex. If the buffer is full the record is dropped and counted, never waited for.
+// The loop task is the only writer (the web handlers run on it too); before begin() records are printed at once.
+//
+// Supported conversions: %d %i %u %x %X %o %c %s %p %f %e %g with flags, width, precision and the h, l, ll
+// and z modifiers. Strings are copied (up to LOG_MAX_STRING characters), so temporaries are safe.
+//
+// Record layout: length (2), time ms (4), level (1), tag (1), format pointer, then the arguments in order:
+// integers and doubles in their native size, strings as a length byte and the characters.
+
+#define LOG_LEVEL_NONE 0
+#define LOG_LEVEL_ERROR 1
+#define LOG_LEVEL_WARN 2
+#define LOG_LEVEL_INFO 3
+#define LOG_LEVEL_DEBUG 4
+
+#ifndef LOG_LEVEL
+#ifdef DEBUG
+#define LOG_LEVEL LOG_LEVEL_DEBUG
+#else
+#define LOG_LEVEL LOG_LEVEL_INFO
+#endif
+#endif
+
+#define LOG_BUFFER_SIZE 4096                     // Binary records; power of two
+#define LOG_HISTORY_SIZE 4096                    // Formatted text kept for /api/log
+#define LOG_MAX_RECORD 192
+#define LOG_MAX_STRING 96
+#define LOG_LINE_LENGTH 192
+#define LOG_DRAIN_INTERVAL_MS 20
+#define LOG_TASK_STACK 3072                      // snprintf of a double needs about 2 KB
+
+enum LogTag : uint8_t {
+  LOG_TAG_SYSTEM = 0,                            // Setup and hardware bring-up
+  LOG_TAG_WIFI,
+  LOG_TAG_TIME,                                  // NTP and timezone
+  LOG_TAG_WEB,                                   // Web server and API handlers
+  LOG_TAG_BOOST,                                 // ADC and boost regulator
+  LOG_TAG_DISPLAY,                               // Multiplex, display modes and custom text
+  LOG_TAG_FLASH,                                 // Flash messages and transitions
+  LOG_TAG_MEDIA,                                 // Animations, frame stream and recordings
+  LOG_TAG_CONFIG,
+  LOG_TAG_POWER,                                 // Night mode schedules and power sequencing
+  LOG_TAG_COUNT
+};
+
+class Logger {
+private:
+  uint8_t ring[LOG_BUFFER_SIZE];
+  std::atomic<uint32_t> head;                    // Bytes written, advanced by the writer
+  std::atomic<uint32_t> tail;                    // Bytes consumed, advanced by the drain task
+  uint32_t written;
+  uint32_t dropped;                              // Written by the writer only
+  uint32_t droppedReported;                      // Written by the drain task only
+
+  uint8_t levels[LOG_TAG_COUNT];                 // Runtime minimum per tag, below the compile-time LOG_LEVEL
+
+  char history[LOG_HISTORY_SIZE];
+  uint32_t historyLength;                        // Characters appended since boot
+  SemaphoreHandle_t historyLock;
+
+  TaskHandle_t drainTask;
+
+  bool read(uint8_t* record, uint16_t& length);
+  size_t format(const uint8_t* record, uint16_t length, char* line, size_t size) const;
+  void output(const char* line, size_t length);
+  void drainPending();
+  static void drain(void* arg);
+
+public:
+  Logger();
+
+  // Starts the drain task; records written before are printed synchronously
+  bool begin();
+
+  void write(uint8_t level, LogTag tag, const char* format, ...) __attribute__((format(printf, 4, 5)));
+
+  void setLevel(uint8_t level);
+  void setLevel(LogTag tag, uint8_t level);
+  uint8_t getLevel(LogTag tag) const { return tag < LOG_TAG_COUNT ? levels[tag] : LOG_LEVEL_NONE; }
+
+  // The most recent formatted lines, oldest first
+  String getHistory();
+
+  uint32_t getWritten() const { return written; }
+  uint32_t getDropped() const { return dropped; }
+
+  static const char* getTagName(LogTag tag);
+  static const char* getLevelName(uint8_t level);
+  static bool parseTag(const String& name, LogTag& tag);
+  static bool parseLevel(const String& name, uint8_t& level);
+};
+
+extern Logger logger;
+
+#if LOG_LEVEL >= LOG_LEVEL_ERROR
+#define LOG_ERROR(tag, ...) logger.write(LOG_LEVEL_ERROR, tag, __VA_ARGS__)
+#else
+#define LOG_ERROR(tag, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_WARN
+#define LOG_WARN(tag, ...) logger.write(LOG_LEVEL_WARN, tag, __VA_ARGS__)
+#else
+#define LOG_WARN(tag, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_INFO
+#define LOG_INFO(tag, ...) logger.write(LOG_LEVEL_INFO, tag, __VA_ARGS__)
+#else
+#define LOG_INFO(tag, ...) do {} while (0)
+#endif
+
+#if LOG_LEVEL >= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(tag, ...) logger.write(LOG_LEVEL_DEBUG, tag, __VA_ARGS__)
+#else
+#define LOG_DEBUG(tag, ...) do {} while (0)
+#endif
+
+#endif
@@ -4,8 +4,33 @@
 #include <WiFi.h>
 #include <WebServer.h>
 #include <time.h>
+#include <sys/time.h>
+#include <functional>
+#include <vector>
 #include "mcp3221.h"  // Abstraction for the MCP3221 ADC. This is a 12-bit ADC. Communicates over I2C.
 #include "max6921.h"  // MAX6921 VFD driver class
+#include "vfdpins.h"  // IV-21 grid and segment wiring to the MAX6921 outputs
+#include "clockrenderer.h"  // Second-aligned HH-MM-SS rendering with per-digit updates
+#include "timerdisplay.h"  // Stopwatch, countdown and hundredths clock at 100 Hz
+#include "marquee.h"  // Scrolling custom text
+#include "glitch.h"  // Allocation-free glitch transitions for flash messages
+#include "messages.h"  // Pre-rendered flash message sets
+#include "timeline.h"  // Keyframe transitions (glitch, cross-fade, wipe, cascade) around flash messages
+#include "animvm.h"  // Bytecode interpreter for uploaded animations
+#include "scheduler.h"  // Timer wheel for the periodic tasks
+#include "framestream.h"  // UDP real-time frame streaming into the VFD frame buffer
+#include "recording.h"  // Delta-encoded frame recordings on LittleFS
+#include "ntpclient.h"  // SNTP client with a drift-corrected timebase
+#include "timezone.h"  // POSIX TZ rule engine (local time and DST)
+#include "wificache.h"  // Cached BSSID/channel/IP for fast reconnects
+#include "boot.h"  // Boot phase timing
+#include "config.h"  // Persisted clock configuration (NVS)
+#include "metrics.h"  // Allocation-free counters and histograms exported at /metrics
+#include "trace.h"  // Compile-time optional begin/end trace of the timing-critical calls
+#include "logger.h"  // Asynchronous ring-buffered logging with compile-time level elision
+#include "heapprofile.h"  // Allocation tracking (-DHEAP_PROFILE) and the steady-state allocation guard
+#include "filament.h"  // LEDC PWM filament drive with a warm-up ramp
+#include "powermanager.h"  // Night mode schedules and filament/boost power sequencing
 #include "webui.h"
 #include "credentials.h" // Wifi credentials.
 
@@ -22,49 +47,71 @@
 
 // Time configuration.
 const char* NTP_SERVER = "pool.ntp.org";
-const long GMT_OFFSET_SEC = -6 * 3600;                               // Central Time is GMT-5 (CST)
-const int DAYLIGHT_OFFSET_SEC = 3600;                                // Daylight saving time offset (1 hour)
-const int DST = 0;                                                   // Set to 1 to make daylight savings adjustments
+const char* DEFAULT_TIMEZONE = "CST6CDT,M3.2.0,M11.1.0";             // POSIX TZ rule: US Central Time (default; the live value is in clockConfig)
+const time_t MIN_VALID_TIME = 1451606400;                            // 2016-01-01 UTC. Anything earlier means the clock has not been set yet
+TimeZone timeZone;                                                   // The system clock runs in UTC; this converts it to local time
 bool timeSet = false;                                                // Flag to indicate if time has been set
-
-// Flash message configuration
-static bool flashMessageMode = true;                                 // Enable/disable flash message feature
-const String flashMessages[] = {                                     // Array of messages to flash
-  "COMRADE ",
-  "SOVIET  ",
-  "MARX    ",
-  "LENIN   ",
-  "STALIN  ",
-  "WORKERS ",
-  "UNITE   ",
-  "POWER   ",
-  "PARTY   ",
-  "STATE   ",
-  "RED DAWN",
-  "FOR USSR",
-  "GO RED  ",
-  "OUR LAND"
+const uint32_t NTP_MAX_ERROR_MS = 10;                                // Keep the displayed second within this of true time; the sync interval adapts to it
+NtpClient ntpClient(NTP_SERVER, NTP_MAX_ERROR_MS);
+
+// Network bring-up. Wi-Fi and NTP run in the background from loop() so the tube lights immediately at power-up.
+const unsigned long WIFI_CONNECT_TIMEOUT_MS = 10000;                 // Give up on a connection attempt after this long
+const unsigned long WIFI_FAST_CONNECT_TIMEOUT_MS = 3000;             // Fall back to a full scan if the cached access point does not answer by then
+const unsigned long WIFI_RETRY_MIN_MS = 2000;                        // First retry delay after a failed attempt
+const unsigned long WIFI_RETRY_MAX_MS = 60000;                       // Retry delay doubles up to this limit
+enum NetworkState {
+  NETWORK_WIFI_CONNECTING,
+  NETWORK_WIFI_BACKOFF,                                              // Waiting to retry after a failed attempt
+  NETWORK_TIME_SYNCING,
+  NETWORK_READY,
+};
+NetworkState networkState = NETWORK_WIFI_CONNECTING;
+unsigned long networkStateSince = 0;                                 // millis() when the current state was entered
+unsigned long wifiRetryDelay = WIFI_RETRY_MIN_MS;
+uint32_t wifiAttempts = 0;
+bool wifiFastConnect = false;                                        // Current attempt uses the cached BSSID/channel/IP
+uint32_t wifiFastConnects = 0;                                       // Successful connections through the cache
+unsigned long wifiConnectTime = 0;                                   // Duration of the last successful connection attempt (ms)
+WifiCache wifiCache;
+BootTimeline bootTimeline;
+
+// Flash message configuration (defaults; the live values are in clockConfig)
+const bool FLASH_MESSAGE_MODE = true;                                // Enable/disable flash message feature
+constexpr FlashMessage FLASH_MESSAGES[] = {                          // Built-in messages, rendered to segments at compile time
+  FLASH_MESSAGE("COMRADE"),
+  FLASH_MESSAGE("SOVIET"),
+  FLASH_MESSAGE("MARX"),
+  FLASH_MESSAGE("LENIN"),
+  FLASH_MESSAGE("STALIN"),
+  FLASH_MESSAGE("WORKERS"),
+  FLASH_MESSAGE("UNITE"),
+  FLASH_MESSAGE("POWER"),
+  FLASH_MESSAGE("PARTY"),
+  FLASH_MESSAGE("STATE"),
+  FLASH_MESSAGE("RED DAWN"),
+  FLASH_MESSAGE("FOR USSR"),
+  FLASH_MESSAGE("GO RED"),
+  FLASH_MESSAGE("OUR LAND")
 };
-const int numFlashMessages = sizeof(flashMessages) / sizeof(flashMessages[0]);
+MessageSet flashMessages(FLASH_MESSAGES, sizeof(FLASH_MESSAGES) / sizeof(FLASH_MESSAGES[0]));  // Active set (built-in or uploaded through /api/messages)
 // const unsigned long FLASH_INTERVAL_MIN = 30000;                      // Minimum time between flashes (30 seconds)
 // const unsigned long FLASH_INTERVAL_MAX = 120000;                     // Maximum time between flashes (2 minutes)
 const unsigned long FLASH_INTERVAL_MIN = 7000;                       // Minimum time between flashes (in ms)
 const unsigned long FLASH_INTERVAL_MAX = 15000;                      // Maximum time between flashes (in ms)
 const unsigned long FLASH_DURATION = 500;                            // How long each message is displayed (in ms)
 const unsigned long GLITCH_DURATION = 400;                           // How long the glitch effect lasts (in ms)
-const unsigned long GLITCH_FRAME_TIME = 50;                          // Time between glitch frames (in ms)
-unsigned long nextFlashTime = 0;                                     // When the next flash should occur
-unsigned long flashEndTime = 0;                                      // When the current flash should end
-unsigned long glitchEndTime = 0;                                     // When the glitch effect should end
-unsigned long nextGlitchFrame = 0;                                   // When to show next glitch frame
-bool isFlashing = false;                                             // Currently displaying a flash message
-bool isGlitching = false;                                            // Currently showing glitch effect
-bool isGlitchingOut = false;                                         // Currently showing glitch-out effect
-int currentFlashIndex = 0;                                           // Index of current flash message
-String currentGlitchText = "";                                       // Current glitch text being displayed
+const uint16_t GLITCH_FRAME_TIME = 20;                               // Time between glitch frames (in ms)
+const TimelinePreset FLASH_TRANSITION = TIMELINE_GLITCH;             // Transition around each message (glitch, crossfade, wipe, cascade or random)
+uint8_t currentFlashIndex = 0;                                       // Index of current flash message
 
 // VFD tube filament. Used to turn on the VFD tube filament heater. Applies voltage to transistor.
-const int VFD_FILAMENT_PIN = D2;         // D2 pin is GPIO4 on Seeeduino ESP32-C3. Used to turn on the filament current to the VFD.
+const int VFD_FILAMENT_PIN = D2;         // D2 pin is GPIO4 on Seeeduino ESP32-C3. PWM output to the filament transistor (filament power).
+const uint8_t FILAMENT_LEVEL = 255;      // Filament PWM level while on (255 = fully on, as the fixed resistor was sized for; the live value is in clockConfig)
+const uint8_t FILAMENT_STANDBY_LEVEL = 0;  // Level while night mode has the tube off; above 0 keeps the cathode warm for a quick wake
+const uint16_t FILAMENT_RAMP_MS = 1000;  // Warm-up ramp from cold to full power (limits the inrush into the cold filament)
+
+// Night mode (the windows are in clockConfig and set through /api/power)
+const uint8_t NIGHT_DIM_LEVEL = 64;      // Brightness scale of a dim window or override when none is given (0-255)
 
 // LED
 const int PWM_LED_INDICATOR_PIN = D6;    // D6 pin is GPIO21 on Seeeduino ESP32-C3. Used for PWM output to the brightness of the indicator LED/
@@ -84,11 +131,20 @@ const int MCP3221_SCL_PIN = SCL;        // SCL pin (default) is GPIO7 on Seeedui
 // Voltage Boost PWM configuration.
 const int MAX_VBOOST_PWM_DUTY_CYCLE = 220;                             // Maximum duty cycle for PWM signal (8-bit resolution, 0-255 range). In testing, above about 85% (220 for 8-bit value) yielded diminishing returns.
 const int MIN_VBOOST_PWM_DUTY_CYCLE = 5;                               // Minimum duty cycle to keep the VFD lit (8-bit resolution, 0-255 range)
+const unsigned long VBOOST_SOFT_START_STEP_MS = 10;                    // Regulator period while ramping up at boot (one duty step each)
+const unsigned long VBOOST_SOFT_START_TIMEOUT_MS = 5000;               // Fall back to the normal regulator period after this long
+const unsigned long VBOOST_REGULATOR_INTERVAL_MS = 200;                // Normal regulator period
+const int VBOOST_SOFT_STOP_STEP = 2;                                   // Duty decrease per regulator pass while ramping down for night mode
+const int VBOOST_FALLBACK_DUTY_CYCLE = 110;                            // Open-loop duty cycle if the ADC is missing (moderate for IV-21)
 const int VBOOST_PWM_RESOLUTION = 8;                                   // 8-bit resolution (0-255 values)
 const int VBOOST_PWM_DUTY_MAX_VALUE = pow(2, VBOOST_PWM_RESOLUTION);   // Convert bit resolution to max value (256 for 8-bit resolution)
 const int VBOOST_PWM_FREQUENCY = 25000;                                // Default frequency in Hz
-const float VBOOST_TARGET_VOLTAGE_V = 30;                              // 30 Volts
-int boostDutyCycle = 110;                                              // Start with moderate duty cycle for IV-21
+const float VBOOST_TARGET_VOLTAGE_V = 30;                              // 30 Volts (default; the live value is in clockConfig)
+const float VBOOST_TARGET_VOLTAGE_MIN_V = 20;                          // Lowest target voltage accepted through the settings API
+const float VBOOST_TARGET_VOLTAGE_MAX_V = 35;                          // Highest target voltage accepted through the settings API
+int boostDutyCycle = MIN_VBOOST_PWM_DUTY_CYCLE;                        // Soft-start from the minimum; the regulator ramps it up to the target voltage
+bool boostSoftStart = true;                                            // Regulate quickly until the target voltage is first reached
+unsigned long boostSoftStartAt = 0;                                    // millis() when the soft-start began (boot or leaving night mode)
 
 // Indicator LED PWM configuration.
 const int LED_PWM_BIT_RESOLUTION = 8;                                  // 8-bit resolution (0-255 values)
@@ -102,8 +158,56 @@ int voltageUpdateCounter = 0;
 
 // Web server configuration
 WebServer server(80);
-bool isDisplayTimeMode = true;  // true = time, false = custom text
-String customText = "HELLO   ";  // Default custom text (8 characters max)
+
+// Custom text scrolling (defaults; the live values are in clockConfig)
+const uint16_t SCROLL_STEP_MS = 250;                                   // Time per one-digit scroll step
+const uint16_t SCROLL_PAUSE_MS = 1000;                                 // Extra hold when the start or end of the text is aligned with the tube
+const MarqueeMode SCROLL_MODE = MARQUEE_LEFT;                          // Scroll direction (left, right or bounce)
+
+// Persisted configuration. Starts with the defaults above and is replaced by the stored settings at boot.
+ClockConfig clockConfig = {
+  FLASH_INTERVAL_MIN,
+  FLASH_INTERVAL_MAX,
+  FLASH_DURATION,
+  GLITCH_DURATION,
+  VBOOST_TARGET_VOLTAGE_V,
+  SCROLL_STEP_MS,
+  SCROLL_PAUSE_MS,
+  DISPLAY_MODE_TIME,          // Display mode (time or custom text)
+  MAX6921_MAX_BRIGHTNESS,     // Display brightness (0-255)
+  FLASH_MESSAGE_MODE,
+  SCROLL_MODE,
+  "HELLO   ",                 // Default custom text (scrolls if longer than the tube)
+  "CST6CDT,M3.2.0,M11.1.0",   // Timezone (same as DEFAULT_TIMEZONE)
+  FLASH_TRANSITION,
+  { 0 },                      // Reserved
+  {},                         // Night mode windows (none)
+  FILAMENT_LEVEL,
+  FILAMENT_STANDBY_LEVEL,
+  FILAMENT_RAMP_MS
+};
+ConfigStore configStore;
+
+// UDP frame streaming configuration
+const uint16_t FRAME_STREAM_PORT = 4210;                               // UDP port the frame stream listens on
+const uint16_t FRAME_STREAM_PLAYOUT_DELAY_MS = 50;                     // Jitter buffer depth (frames are shown this long after the fastest arrival)
+const uint16_t FRAME_STREAM_TIMEOUT_MS = 2000;                         // Return to the normal display after this long without packets
+
+// Runtime metrics (exported at /metrics). Bucket bounds are upper limits in microseconds unless noted.
+const uint32_t LOOP_TIME_BUCKETS_US[] = { 50, 100, 250, 500, 1000, 2000, 5000, 10000, 25000, 50000, 100000 };
+const uint32_t REFRESH_INTERVAL_BUCKETS_US[] = { 1000, 1050, 1100, 1250, 1500, 2000, 3000, 5000, 10000, 25000, 50000 };
+const uint32_t REGULATOR_ERROR_BUCKETS_MV[] = { 100, 250, 500, 1000, 2000, 5000, 10000 };    // Absolute error in mV
+const uint32_t HTTP_LATENCY_BUCKETS_US[] = { 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000, 500000, 1000000 };
+Histogram loopTimeHistogram(LOOP_TIME_BUCKETS_US, sizeof(LOOP_TIME_BUCKETS_US) / sizeof(LOOP_TIME_BUCKETS_US[0]));
+Histogram refreshIntervalHistogram(REFRESH_INTERVAL_BUCKETS_US, sizeof(REFRESH_INTERVAL_BUCKETS_US) / sizeof(REFRESH_INTERVAL_BUCKETS_US[0]));
+Histogram regulatorErrorHistogram(REGULATOR_ERROR_BUCKETS_MV, sizeof(REGULATOR_ERROR_BUCKETS_MV) / sizeof(REGULATOR_ERROR_BUCKETS_MV[0]));
+Histogram httpLatencyHistogram(HTTP_LATENCY_BUCKETS_US, sizeof(HTTP_LATENCY_BUCKETS_US) / sizeof(HTTP_LATENCY_BUCKETS_US[0]));
+uint32_t adcDisconnectedCount = 0;                                     // Regulator passes skipped because the ADC did not respond
+uint32_t dutyAlertsReported = 0;                                       // Multiplex imbalance alerts already logged
+uint32_t heapViolationsReported = 0;                                   // Heap guard violations already logged
+uint32_t heapLowWater = UINT32_MAX;                                    // Lowest free heap sampled since the last /api/stats?reset=1
+float boostVoltage = 0;                                                // Last measured boost voltage
+float regulatorError = 0;                                              // Target minus measured boost voltage
 
 // MCP3221 configuration. The MCP3221 is a 12-bit ADC with I2C interface.
 const uint8_t MCP3221_ADDRESS = 0x4E;                                  // Typical default is 0x4D, but that did not work for this ADC.
@@ -111,68 +215,93 @@ const float MCP3221_REFERENCE_VOLTAGE_V = 3.3;                         // Refere
 const float MCP3221_RESOLUTION = 12;                                   // MCP3221 is a 12-bit ADC, so the resolution is 2^12 = 4096.
 MCP3221 mcp3221(MCP3221_ADDRESS, MCP3221_REFERENCE_VOLTAGE_V, MCP3221_RESOLUTION);
 
-// Initialize digit pins array
-uint8_t DIGIT_PINS[] = {
-  15,  // Digit 1:     MAX6921 pin 7  (OUT-15)     (Adapter pin 1)      (IV-21 pin 6:  Digit 8 Grid)   
-  1,   // Digit 2:     MAX6921 pin 25 (OUT-1)      (Adapter pin 11)     (IV-21 pin 15: Digit 7 Grid)   
-  13,  // Digit 3:     MAX6921 pin 9  (OUT-13)     (Adapter pin 3)      (IV-21 pin 7:  Digit 6 Grid)   
-  2,   // Digit 4:     MAX6921 pin 24 (OUT-2)      (Adapter pin 12)     (IV-21 pin 14: Digit 5 Grid)   
-  14,  // Digit 5:     MAX6921 pin 8  (OUT-14)     (Adapter pin 4)      (IV-21 pin 8:  Digit 4 Grid)   
-  0,   // Digit 6:     MAX6921 pin 26 (OUT-0)      (Adapter pin 10)     (IV-21 pin 13: Digit 3 Grid)      
-  12,  // Digit 7:     MAX6921 pin 10 (OUT-12)     (Adapter pin 6)      (IV-21 pin 9:  Digit 2 Grid)   
-  11,  // Digit 8:     MAX6921 pin 11 (OUT-11)     (Adapter pin 8)      (IV-21 pin 12: Digit 1 Grid)   
-  10,  // Digit 9:     MAX6921 pin 12 (OUT-10)     (Adapter pin 7)      (IV-21 pin 11: Symbols Grid) (TODO: Currently not used/supported in this code)
-  17,  // Digit 10:    MAX6921 pin 5  (OUT-17)     (NOT CONNECTED)
-  18,  // Digit 11:    MAX6921 pin 4  (OUT-18)     (NOT CONNECTED)
-  19,  // Digit 12:    MAX6921 pin 3  (OUT-19)     (NOT CONNECTED)
-};
+// MAX6921 VFD Display instance
+MAX6921 vfdDisplay(MAX6921_DIN_PIN, MAX6921_CLK_PIN, MAX6921_LOAD_PIN, DIGIT_PINS, NUM_DIGITS, SEGMENT_PINS, NUM_SEGMENTS);
 
-// TODO: Support digit 9 - symbols grid.
-// TODO: Support digit 9 - symbols grid.
-// TODO: Support digit 9 - symbols grid.
-
-// Initialize segment pins array
-uint8_t SEGMENT_PINS[] = {
-  16,  // Segment A:             MAX6921 pin 6  (OUT-16)    (Adapter pin 2)       (IV-21 pin 5:  Segment A Anode)
-  8,   // Segment B:             MAX6921 pin 18 (OUT-8)     (Adapter pin 19)      (IV-21 pin 3:  Segment B Anode)
-  5,   // Segment C:             MAX6921 pin 21 (OUT-5)     (Adapter pin 15)      (IV-21 pin 18: Segment C Anode)
-  3,   // Segment D:             MAX6921 pin 23 (OUT-3)     (Adapter pin 13)      (IV-21 pin 17: Segment D Anode)
-  6,   // Segment E:             MAX6921 pin 20 (OUT-6)     (Adapter pin 16)      (IV-21 pin 19: Segment E Anode (Short lead))
-  9,   // Segment F:             MAX6921 pin 17 (OUT-9)     (Adapter pin 20)      (IV-21 pin 4:  Segment Segment F Anode / Dot Symbol Anode)
-  7,   // Segment G:             MAX6921 pin 19 (OUT-7)     (Adapter pin 17)      (IV-21 pin 2:  Segment G Anode / - Symbol Anode)
-  4,   // Segment H (period):    MAX6921 pin 22 (OUT-4)     (Adapter pin 14)      (IV-21 pin 16: Segment DP Anode)
-};
+// Filament heater PWM
+Filament filament(VFD_FILAMENT_PIN);
 
-// Calculate array sizes
-// const uint8_t NUM_DIGITS = sizeof(DIGIT_PINS) / sizeof(DIGIT_PINS[0]);
-// const uint8_t NUM_SEGMENTS = sizeof(SEGMENT_PINS) / sizeof(SEGMENT_PINS[0]);
-const uint8_t NUM_DIGITS = 8;
-const uint8_t NUM_SEGMENTS = 8;
+// Night mode: blanks or dims the display and powers the boost and filament down on a schedule
+PowerManager powerManager(vfdDisplay, filament);
 
-// MAX6921 VFD Display instance
-MAX6921 vfdDisplay(MAX6921_DIN_PIN, MAX6921_CLK_PIN, MAX6921_LOAD_PIN, DIGIT_PINS, NUM_DIGITS, SEGMENT_PINS, NUM_SEGMENTS);
+// Clock face renderer (writes only the digits that change each second)
+ClockRenderer clockRenderer(vfdDisplay);
+
+// Stopwatch/countdown/hundredths display (controlled through /api/timer; takes over the display while active)
+TimerDisplay timerDisplay(vfdDisplay);
+
+// Uploaded bytecode animation (controlled through /api/animation; takes over the display while running)
+const uint8_t ANIMATION_TICK_BUDGET = 64;                              // Instructions per loop pass before the script yields
+AnimationVM animation(vfdDisplay, ANIMATION_TICK_BUDGET);
+
+// Custom text renderer (scrolls text longer than the tube)
+Marquee marquee(vfdDisplay);
+
+// Glitch transitions around flash messages
+GlitchEngine glitchEngine(vfdDisplay, GLITCH_FRAME_TIME);
+
+// Keyframe timeline of the flash message in progress (scene and per-digit brightness)
+Timeline flashTimeline(vfdDisplay);
+
+// UDP frame stream instance (drives vfdDisplay directly while a host is streaming)
+FrameStream frameStream(vfdDisplay, FRAME_STREAM_PORT, FRAME_STREAM_PLAYOUT_DELAY_MS, FRAME_STREAM_TIMEOUT_MS);
+
+// Frame recording and playback (controlled through /api/recording; playback takes over the display)
+const char* RECORDING_PATH = "/show.vfr";                              // The one stored recording (recorded, uploaded or played)
+FrameRecorder frameRecorder(vfdDisplay);
+FramePlayer framePlayer(vfdDisplay);
+const char* RECORDING_UPLOAD_PATH = "/show.vfr.part";                  // Uploads go here and replace the recording once valid
+bool recordingUploadOk = false;                                        // Set while an upload is being written without errors
+bool recordingUploadTooLarge = false;                                  // Set once an upload exceeds RECORDING_MAX_BYTES
+
+// Timer wheel that runs the periodic tasks; loop() sleeps until the next one is due
+Scheduler scheduler;
 
 // Prototypes
 void initWifi();
 void initTime();
+void updateNetwork();
+void setNetworkState(NetworkState state);
+const char* getNetworkStateName();
 void initIndicatorLedPwmSignal(int dutyCycle);
 void printLocalTime();
-String getFormattedTime();
+void getFormattedTime(char* buffer, size_t size);
 
 // Voltage monitoring/adjustment functions
 void initADC();
 void initBoostPwmSignal();
+void startBoost();
 int updateBoostDutyCycle(int currentDuty, bool printInfo = false);
 void checkVoltage();
+void checkDutyAlert();
+void checkHeapGuard();
+void trackHeapLowWater();
+void updatePower();
 
 void updateDisplay();
 void updateTimeDisplay();
+bool syncClockRenderer();
+void syncDisplayClocks();
+bool getClockTime(struct tm& timeinfo, uint32_t* microsIntoSecond);
+
+// Configuration functions
+bool isDisplayTimeMode();
+void setCustomText(ClockConfig& config, const String& text);
+void applyConfig();
+String jsonEscape(const char* text);
+String getSettingsJson();
+bool parseUnsignedArg(const String& value, uint32_t minValue, uint32_t maxValue, uint32_t& result);
+bool parseFloatArg(const String& value, float minValue, float maxValue, float& result);
+bool parseBoolArg(const String& value, bool& result);
+bool parseJsonObject(const char* json, std::vector<std::pair<String, String>>& members);
+bool forEachArg(const char* error, const std::function<bool(const String& name, const String& value)>& accept);
 
 // Flash message functions
 void initFlashMessages();
-void updateFlashMessages();
+void startFlashMessage();
+void updateFlashMessage();
+void cancelFlashMessage();
 void scheduleNextFlash();
-String generateGlitchText();
 
 // Web server handlers
 void initWebServer();
@@ -181,10 +310,71 @@ void handleRoot();
 void handleToggleMode();
 void handleToggleMessageMode();
 void handleSetText();
+void handleGetSettings();
+void handleSetSettings();
+void handleGetStats();
+void handleGetBoot();
+void handleGetNtp();
+void handleGetTimer();
+void handleSetTimer();
+String getTimerJson();
+void handleGetMessages();
+void handleGetAnimation();
+void handleGetRecording();
+void handleSetRecording();
+void handleRecordingUpload();
+void handleUploadRecording();
+void handleDownloadRecording();
+String getRecordingJson();
+void handleSetAnimation();
+String getAnimationJson();
+void handleSetMessages();
+String getMessagesJson();
+void handleGetLog();
+void handleSetLog();
+void handleGetDuty();
+void handleSetDuty();
+String getDutyJson();
+void handleGetHeap();
+void handleSetHeap();
+String getHeapJson();
+void handleGetPower();
+void handleSetPower();
+String getPowerJson();
+void handleMetrics();
+#ifdef TRACE
+void handleGetTrace();
+void handleSetTrace();
+void handleDownloadTrace();
+String getTraceJson();
+#endif
+WebServer::THandlerFunction timed(void (*handler)());
+void handleUiCss();
+void handleUiJs();
+void sendCachedAsset(const char* contentType, const char* data, size_t length);
+#ifdef WEBUI_HAS_GZIP_ASSETS
+bool sendCompressedAsset(const char* contentType, const uint8_t* data, size_t length);
+#endif
 void handleNotFound();
 
+// Scheduled tasks. Periodic tasks keep their phase; the flash message task is re-armed after each flash.
+const uint32_t NETWORK_TASK_INTERVAL_MS = 10;                          // Wi-Fi/NTP connection state machine
+const uint32_t WEB_TASK_INTERVAL_MS = 5;                               // HTTP polling (adds at most this to the request latency)
+const uint32_t CONFIG_TASK_INTERVAL_MS = 100;                          // Checks whether pending settings are ready to be written
+const uint32_t NETWORK_TASK_OFF_INTERVAL_MS = 100;                     // Slower polling while night mode has the tube off, so the CPU sleeps longer
+const uint32_t WEB_TASK_OFF_INTERVAL_MS = 50;
+SchedulerTask networkTask("network", updateNetwork, NETWORK_TASK_INTERVAL_MS);
+SchedulerTask webTask("web", []() { TRACE_SCOPE(TRACE_HTTP); HEAP_EXEMPT(); server.handleClient(); }, WEB_TASK_INTERVAL_MS);
+SchedulerTask voltageTask("boost", checkVoltage, VBOOST_SOFT_START_STEP_MS);  // Switches to VBOOST_REGULATOR_INTERVAL_MS after the soft-start
+SchedulerTask configTask("config", []() { HEAP_EXEMPT(); configStore.update(clockConfig); }, CONFIG_TASK_INTERVAL_MS);  // NVS allocates while writing
+SchedulerTask flashTask("flash", startFlashMessage);
+SchedulerTask heapTask("heap", []() { heapProfiler.sample(); }, HEAP_SAMPLE_INTERVAL_MS);
+SchedulerTask powerTask("power", updatePower, POWER_UPDATE_INTERVAL_MS);
+SchedulerTask* const scheduledTasks[] = { &networkTask, &webTask, &voltageTask, &configTask, &flashTask, &heapTask, &powerTask };
+
 void setup()
 { 
+  heapProfiler.begin();
   Serial.begin(115200);
 
 #ifdef DEBUG
@@ -192,169 +382,441 @@ void setup()
   delay(3000);
 #endif
 
-  Serial.println("Beginning setup...");
+  // From here on, messages are formatted and printed by the logger's task while the loop sleeps
+  if (!logger.begin())
+  {
+    LOG_WARN(LOG_TAG_SYSTEM, "Failed to start the log task; logging synchronously.");
+  }
+  LOG_INFO(LOG_TAG_SYSTEM, "Beginning setup...");
+
+  if (!scheduler.begin())
+  {
+    LOG_WARN(LOG_TAG_SYSTEM, "Failed to create the scheduler wake timer; the loop will poll instead of sleeping.");
+  }
 
   // Init Indicator LED PWM
-  Serial.println("Init Indicator LED PWM Signal (on)...");
+  LOG_INFO(LOG_TAG_SYSTEM, "Init Indicator LED PWM Signal (on)...");
   initIndicatorLedPwmSignal(LED_PWM_DUTY_CYCLE);
 
-  Serial.println("Init WiFi...");
-  initWifi();
-
-  Serial.println("Init Time...");
-  initTime();
+  // Load persisted settings
+  LOG_INFO(LOG_TAG_CONFIG, "Load Config...");
+  if (configStore.begin(clockConfig))
+  {
+    LOG_INFO(LOG_TAG_CONFIG, "Stored configuration loaded.");
+  }
+  else
+  {
+    LOG_WARN(LOG_TAG_CONFIG, "No valid stored configuration, using defaults.");
+  }
+  applyConfig();
+  scheduler.schedule(configTask, CONFIG_TASK_INTERVAL_MS);
+  bootTimeline.mark(BOOT_PHASE_CONFIG_LOADED);
 
-  // Initialize web server
-  Serial.println("Init Web Server...");
-  initWebServer();
+  // Bring up the tube first; the network follows in the background
 
-  // Turn on VFD Filament heater
-  Serial.println("Turning on VFD Filament...");
-  pinMode(VFD_FILAMENT_PIN, OUTPUT);
-  digitalWrite(VFD_FILAMENT_PIN, HIGH); // Turn on the filament (5V before filament resistor) to heat the VFD tube
+  // Turn on VFD Filament heater: ramps up to its level, then the power manager sets it for night mode
+  LOG_INFO(LOG_TAG_SYSTEM, "Turning on VFD Filament (level %u, %u ms ramp)...", clockConfig.filamentLevel, clockConfig.filamentRampMs);
+  powerManager.begin(clockConfig.powerSchedules);
 
   // Initialize I2C with explicit pins
-  Serial.println("Init I2C for ADC...");
+  LOG_INFO(LOG_TAG_SYSTEM, "Init I2C for ADC...");
   Wire.begin(MCP3221_SDA_PIN, MCP3221_SCL_PIN);
-  delay(100);
 
   // Init MCP3221 ADC
-  Serial.println("Init MCP3221 ADC (using I2C)...");
+  LOG_INFO(LOG_TAG_SYSTEM, "Init MCP3221 ADC (using I2C)...");
   initADC();
-  delay(100);
 
-  // Init Voltage Booster PWM
-  Serial.println("Init Boost PWM Signal...");
+  // Init Voltage Booster PWM (starts at the minimum duty cycle; checkVoltage() soft-starts it)
+  LOG_INFO(LOG_TAG_SYSTEM, "Init Boost PWM Signal...");
   initBoostPwmSignal();
-  delay(500);
+  scheduler.schedule(voltageTask, 0);
   
   // Init VFD
-  Serial.println("Init MAX6921 VFD IC (using SPI)...");
+  LOG_INFO(LOG_TAG_SYSTEM, "Init MAX6921 VFD IC (using SPI)...");
   vfdDisplay.begin();
+  clockRenderer.begin();
+  timerDisplay.begin();
+  animation.begin();
+  if (animation.isLoaded())
+  {
+    LOG_INFO(LOG_TAG_MEDIA, "Stored animation script: %u bytes", animation.getCodeLength());
+  }
+  marquee.setText(clockConfig.customText);
+  glitchEngine.begin();
+  vfdDisplay.setDisplayText("--------");
+
+  // Frame recordings live on LittleFS (formatted on first boot)
+  if (!LittleFS.begin(true))
+  {
+    LOG_ERROR(LOG_TAG_MEDIA, "LittleFS mount failed; frame recordings are unavailable");
+  }
+  bootTimeline.mark(BOOT_PHASE_HARDWARE_READY);
+
+  // Start connecting (non-blocking; see updateNetwork())
+  LOG_INFO(LOG_TAG_WIFI, "Init WiFi...");
+  if (wifiCache.begin(wifi_ssid, wifi_passphrase))
+  {
+    LOG_INFO(LOG_TAG_WIFI, "Cached WiFi association found, trying a fast connect.");
+  }
+  WiFi.persistent(false);        // Credentials come from credentials.h; don't rewrite them to flash on every connect
+  WiFi.setAutoReconnect(false);  // updateNetwork() handles reconnects
+  initWifi();
+  scheduler.schedule(networkTask, NETWORK_TASK_INTERVAL_MS);
+
+  // Initialize web server
+  LOG_INFO(LOG_TAG_WEB, "Init Web Server...");
+  initWebServer();
+  scheduler.schedule(webTask, 0);
+
+  // Init UDP frame stream
+  LOG_INFO(LOG_TAG_MEDIA, "Init UDP Frame Stream...");
+  if (frameStream.begin())
+  {
+    LOG_INFO(LOG_TAG_MEDIA, "Frame stream listening on UDP port %u", FRAME_STREAM_PORT);
+  }
+  else
+  {
+    LOG_ERROR(LOG_TAG_MEDIA, "Failed to open frame stream UDP port.");
+  }
 
   // Init Flash Messages
-  Serial.println("Init Flash Messages...");
+  LOG_INFO(LOG_TAG_FLASH, "Init Flash Messages...");
   initFlashMessages();
 
   // Init Indicator LED PWM (turn off to indicate setup complete)
-  Serial.println("Init Indicator LED PWM Signal (off)...");
+  LOG_INFO(LOG_TAG_SYSTEM, "Init Indicator LED PWM Signal (off)...");
   initIndicatorLedPwmSignal(0);
 
-  Serial.println("Setup complete.");
-  Serial.print("Web interface available at: http://");
-  Serial.println(WiFi.localIP());
+  heapProfiler.sample();
+  scheduler.schedule(heapTask, HEAP_SAMPLE_INTERVAL_MS);
+
+  // Night mode takes over once the clock is set
+  scheduler.schedule(powerTask, POWER_UPDATE_INTERVAL_MS);
+
+  LOG_INFO(LOG_TAG_SYSTEM, "Setup complete. Waiting for WiFi in the background.");
 }
 
 void loop()
 {
-  // Handle web server requests
-  server.handleClient();
+  // Record the time between loop iterations (this bounds how late the multiplex can run)
+  static unsigned long lastLoopStart = 0;
+  unsigned long loopStart = micros();
+  if (lastLoopStart != 0)
+  {
+    loopTimeHistogram.observe(loopStart - lastLoopStart);
+  }
+  lastLoopStart = loopStart;
+  trackHeapLowWater();
+
+  // Run the tasks that are due: network, web server, boost regulator, flash messages and settings
+  scheduler.run();
+
+  // NTP replies and streamed frames are timed on arrival, so they are polled on every pass
+  ntpClient.update();
+  frameStream.update();
 
-  // Update flash messages (only if enabled and in time mode)
-  if (flashMessageMode && isDisplayTimeMode) {
-    updateFlashMessages();
+  // The filament ramp is timed from esp_timer and advances a step whenever the loop comes round
+  filament.update();
+
+  if (frameStream.isActive())
+  {
+    // The stream draws over the clock; redraw it fully once the stream ends
+    cancelFlashMessage();
+    animation.stop();
+    framePlayer.stop();
+    clockRenderer.invalidate();
+    timerDisplay.invalidate();
+    marquee.invalidate();
+    glitchEngine.invalidate();
+  }
+  else if (framePlayer.isPlaying())
+  {
+    // Records are applied on their recorded schedule, read from flash a buffer at a time
+    cancelFlashMessage();
+    animation.stop();
+    framePlayer.update();
+    clockRenderer.invalidate();
+    timerDisplay.invalidate();
+    marquee.invalidate();
+    glitchEngine.invalidate();
+  }
+  else if (animation.isRunning())
+  {
+    // The script runs up to its instruction budget per pass and writes the digits that changed
+    if (animation.needsClockTime())
+    {
+      syncDisplayClocks();
+    }
+    cancelFlashMessage();
+    animation.update();
+    clockRenderer.invalidate();
+    timerDisplay.invalidate();
+    marquee.invalidate();
+    glitchEngine.invalidate();
+  }
+  else if (timerDisplay.isActive())
+  {
+    // Timer modes update individual digits at up to 100 Hz
+    if (timerDisplay.getMode() == TIMER_MODE_HUNDREDTHS && timerDisplay.needsClockTime())
+    {
+      syncDisplayClocks();
+    }
+    cancelFlashMessage();
+    timerDisplay.update();
+    clockRenderer.invalidate();
+    marquee.invalidate();
+    glitchEngine.invalidate();
+  }
+  else
+  {
+    // Update VFD display
+    updateDisplay();
   }
 
-  // Update VFD display
-  updateDisplay();
+  // Capture whatever was drawn this pass
+  frameRecorder.update();
 
-  // Check and adjust voltage
-  checkVoltage();
-  
   // Refresh the display
-  vfdDisplay.refreshDisplay();
+  unsigned long refreshInterval = vfdDisplay.refreshDisplay();
+  if (refreshInterval != 0)
+  {
+    refreshIntervalHistogram.observe(refreshInterval);
+    bootTimeline.mark(BOOT_PHASE_FIRST_DIGIT);
+    checkDutyAlert();
+#ifdef TRACE
+    traceBuffer.checkTrigger(refreshInterval);
+#endif
+  }
+
+  // Also while the tube is blanked in night mode, when there are no refreshes
+  checkHeapGuard();
+
+  // Sleep until the next multiplex step, recorded frame or scheduled task
+  scheduler.sleep(min(vfdDisplay.getMicrosToNextRefresh(), framePlayer.getMicrosToNextFrame()));
 }
 
 void initWifi()
 {
-  // Initialize WiFi
+  // Start a connection attempt. updateNetwork() follows it up from loop().
   WiFi.mode(WIFI_STA);
-  WiFi.begin(wifi_ssid, wifi_passphrase);
-  Serial.println("Connecting to WiFi...");
-  
-  int count = 0;
+  wifiAttempts++;
 
-  // Connection status monitoring
-  while (WiFi.status() != WL_CONNECTED)
+  wifiFastConnect = wifiCache.isValid();
+  if (wifiFastConnect)
   {
-    delay(500);
-    Serial.print(".");
-    count++;
-
-    if (count >= 20) // Timeout after 10 seconds
+    // Skip the scan: go straight to the last access point, and skip DHCP too while the cached lease is trusted
+    const WifiCache::Entry& cached = wifiCache.getEntry();
+    bool cachedAddress = wifiCache.takeCachedAddress();
+    if (cachedAddress)
     {
-      Serial.println("Failed to connect to WiFi. Check credentials and network.");
-      return;
+      WiFi.config(IPAddress(cached.localIP), IPAddress(cached.gateway), IPAddress(cached.subnet), IPAddress(cached.dns));
     }
+    else
+    {
+      WiFi.config(IPAddress(), IPAddress(), IPAddress());  // Revalidate the address through DHCP
+    }
+    WiFi.begin(wifi_ssid, wifi_passphrase, cached.channel, cached.bssid);
+    LOG_INFO(LOG_TAG_WIFI, "Connecting to WiFi (attempt %lu, cached channel %u%s)...", (unsigned long)wifiAttempts, cached.channel, cachedAddress ? " and address" : "");
+  }
+  else
+  {
+    WiFi.config(IPAddress(), IPAddress(), IPAddress());  // Back to DHCP
+    WiFi.begin(wifi_ssid, wifi_passphrase);
+    LOG_INFO(LOG_TAG_WIFI, "Connecting to WiFi (attempt %lu)...", (unsigned long)wifiAttempts);
   }
 
-  Serial.println();
-  Serial.print("Connected to WiFi! IP address: ");
-  Serial.println(WiFi.localIP());
+  setNetworkState(NETWORK_WIFI_CONNECTING);
 }
 
 void initTime()
 {
-  Serial.println("Initializing time from NTP server...");
+  LOG_INFO(LOG_TAG_TIME, "Initializing time from NTP server...");
   
-  // Configure time with NTP server and timezone
-  configTime(GMT_OFFSET_SEC, DAYLIGHT_OFFSET_SEC, NTP_SERVER);
-  
-  // Wait for time to be set
-  struct tm timeinfo;
-  int attempts = 0;
-  while (!getLocalTime(&timeinfo) && attempts < 10)
+  // Start the SNTP client (runs from loop()). Time is kept in UTC; timeZone handles the local offset and DST.
+  static bool started = false;
+  if (!started)
   {
-    Serial.println("Failed to obtain time, retrying...");
-    delay(500);
-    attempts++;
+    started = ntpClient.begin();
   }
-  
-  if (attempts >= 10)
+  ntpClient.syncNow();
+  setNetworkState(NETWORK_TIME_SYNCING);
+}
+
+void updateNetwork()
+{
+  // Connecting, DHCP and the socket calls allocate inside the Wi-Fi stack
+  HEAP_EXEMPT();
+
+  unsigned long elapsed = millis() - networkStateSince;
+
+  switch (networkState)
   {
-    Serial.println("Failed to obtain time after 10 attempts!");
-    timeSet = false;
+    case NETWORK_WIFI_CONNECTING:
+      if (WiFi.status() == WL_CONNECTED)
+      {
+        wifiConnectTime = elapsed;
+        if (wifiFastConnect)
+        {
+          wifiFastConnects++;
+        }
+        wifiCache.save(WiFi.BSSID(), WiFi.channel(), WiFi.localIP(), WiFi.gatewayIP(), WiFi.subnetMask(), WiFi.dnsIP());
+
+        LOG_INFO(LOG_TAG_WIFI, "Connected to WiFi in %lu ms%s. IP address: %s", elapsed, wifiFastConnect ? " (cached)" : "", WiFi.localIP().toString().c_str());
+        LOG_INFO(LOG_TAG_WEB, "Web interface available at: http://%s", WiFi.localIP().toString().c_str());
+        bootTimeline.mark(BOOT_PHASE_WIFI_CONNECTED);
+        wifiRetryDelay = WIFI_RETRY_MIN_MS;
+
+        if (timeSet)
+        {
+          setNetworkState(NETWORK_READY);  // Reconnected; the SNTP client catches up on any sync it missed
+        }
+        else
+        {
+          initTime();
+        }
+      }
+      else if (wifiFastConnect && (elapsed >= WIFI_FAST_CONNECT_TIMEOUT_MS || WiFi.status() == WL_NO_SSID_AVAIL || WiFi.status() == WL_CONNECT_FAILED))
+      {
+        // The cached access point or address is stale; forget it and scan right away
+        LOG_WARN(LOG_TAG_WIFI, "Fast connect failed, falling back to a full scan.");
+        wifiCache.invalidate();
+        WiFi.disconnect();
+        initWifi();
+      }
+      else if (elapsed >= WIFI_CONNECT_TIMEOUT_MS)
+      {
+        LOG_WARN(LOG_TAG_WIFI, "Failed to connect to WiFi. Retrying in %lu s.", wifiRetryDelay / 1000);
+        WiFi.disconnect();
+        setNetworkState(NETWORK_WIFI_BACKOFF);
+      }
+      break;
+
+    case NETWORK_WIFI_BACKOFF:
+      if (elapsed >= wifiRetryDelay)
+      {
+        wifiRetryDelay = min(wifiRetryDelay * 2, WIFI_RETRY_MAX_MS);
+        initWifi();
+      }
+      break;
+
+    case NETWORK_TIME_SYNCING:
+      if (ntpClient.isSynced())
+      {
+        LOG_INFO(LOG_TAG_TIME, "Time synchronized successfully! Round trip %lu ms.", (unsigned long)(ntpClient.getLastRoundTrip() / 1000));
+        timeSet = true;
+        bootTimeline.mark(BOOT_PHASE_TIME_SYNCED);
+        printLocalTime();
+        syncClockRenderer();
+        setNetworkState(NETWORK_READY);
+      }
+      else if (WiFi.status() != WL_CONNECTED)
+      {
+        LOG_WARN(LOG_TAG_WIFI, "WiFi connection lost.");
+        initWifi();
+      }
+      break;
+
+    case NETWORK_READY:
+      if (WiFi.status() != WL_CONNECTED)
+      {
+        // Reconnect straight away (through the cache when possible); failures back off as at boot
+        LOG_WARN(LOG_TAG_WIFI, "WiFi connection lost.");
+        wifiRetryDelay = WIFI_RETRY_MIN_MS;
+        initWifi();
+      }
+      break;
   }
-  else
+}
+
+void setNetworkState(NetworkState state)
+{
+  networkState = state;
+  networkStateSince = millis();
+}
+
+const char* getNetworkStateName()
+{
+  switch (networkState)
   {
-    Serial.println("Time synchronized successfully!");
-    printLocalTime();
-    timeSet = true;
+    case NETWORK_WIFI_CONNECTING: return "wifiConnecting";
+    case NETWORK_WIFI_BACKOFF:    return "wifiBackoff";
+    case NETWORK_TIME_SYNCING:    return "timeSyncing";
+    case NETWORK_READY:           return "ready";
   }
+  return "unknown";
 }
 
 void initWebServer()
 {
   // Define web server routes
-  server.on("/", handleRoot);
-  server.on("/toggle", handleToggleMode);
-  server.on("/toggleFlashMessage", handleToggleMessageMode);
-  server.on("/settext", HTTP_POST, handleSetText);
+  server.on("/", timed(handleRoot));
+  server.on("/toggle", timed(handleToggleMode));
+  server.on("/toggleFlashMessage", timed(handleToggleMessageMode));
+  server.on("/settext", HTTP_POST, timed(handleSetText));
+  server.on("/api/settings", HTTP_GET, timed(handleGetSettings));
+  server.on("/api/settings", HTTP_POST, timed(handleSetSettings));
+  server.on("/api/stats", HTTP_GET, timed(handleGetStats));
+  server.on("/api/boot", HTTP_GET, timed(handleGetBoot));
+  server.on("/api/ntp", HTTP_GET, timed(handleGetNtp));
+  server.on("/api/timer", HTTP_GET, timed(handleGetTimer));
+  server.on("/api/timer", HTTP_POST, timed(handleSetTimer));
+  server.on("/api/messages", HTTP_GET, timed(handleGetMessages));
+  server.on("/api/messages", HTTP_POST, timed(handleSetMessages));
+  server.on("/api/animation", HTTP_GET, timed(handleGetAnimation));
+  server.on("/api/animation", HTTP_POST, timed(handleSetAnimation));
+  server.on("/api/recording", HTTP_GET, timed(handleGetRecording));
+  server.on("/api/recording", HTTP_POST, timed(handleSetRecording));
+  server.on("/api/recording/upload", HTTP_POST, timed(handleUploadRecording), timed(handleRecordingUpload));
+  server.on("/show.vfr", HTTP_GET, timed(handleDownloadRecording));
+  server.on("/api/log", HTTP_GET, timed(handleGetLog));
+  server.on("/api/log", HTTP_POST, timed(handleSetLog));
+  server.on("/api/duty", HTTP_GET, timed(handleGetDuty));
+  server.on("/api/duty", HTTP_POST, timed(handleSetDuty));
+  server.on("/api/heap", HTTP_GET, timed(handleGetHeap));
+  server.on("/api/heap", HTTP_POST, timed(handleSetHeap));
+  server.on("/api/power", HTTP_GET, timed(handleGetPower));
+  server.on("/api/power", HTTP_POST, timed(handleSetPower));
+  server.on("/metrics", HTTP_GET, timed(handleMetrics));
+#ifdef TRACE
+  server.on("/api/trace", HTTP_GET, timed(handleGetTrace));
+  server.on("/api/trace", HTTP_POST, timed(handleSetTrace));
+  server.on("/trace.bin", HTTP_GET, timed(handleDownloadTrace));
+#endif
+  server.on("/ui.css", HTTP_GET, timed(handleUiCss));
+  server.on("/ui.js", HTTP_GET, timed(handleUiJs));
+#ifdef WEBUI_HAS_FONTS
+  server.on("/fonts/russo-one.woff2", HTTP_GET, timed([]() {
+    sendCachedAsset("font/woff2", (const char*)WEBUI_FONT_RUSSO_ONE, sizeof(WEBUI_FONT_RUSSO_ONE));
+  }));
+  server.on("/fonts/rubik-400.woff2", HTTP_GET, timed([]() {
+    sendCachedAsset("font/woff2", (const char*)WEBUI_FONT_RUBIK_400, sizeof(WEBUI_FONT_RUBIK_400));
+  }));
+  server.on("/fonts/rubik-700.woff2", HTTP_GET, timed([]() {
+    sendCachedAsset("font/woff2", (const char*)WEBUI_FONT_RUBIK_700, sizeof(WEBUI_FONT_RUBIK_700));
+  }));
+#endif
+#ifdef WEBUI_HAS_GZIP_ASSETS
+  // The asset handlers pick the gzip copies by the request's Accept-Encoding
+  const char* assetHeaders[] = { "Accept-Encoding" };
+  server.collectHeaders(assetHeaders, 1);
+#endif
   server.onNotFound(handleNotFound);
   
   // Start the server
   server.begin();
-  Serial.println("Web server started");
+  LOG_INFO(LOG_TAG_WEB, "Web server started");
 }
 
 void initADC()
 {
   if (mcp3221.begin())
   {
-    Serial.println("MCP3221 found and ready!");
-    Serial.print("I2C Address: 0x");
-    Serial.println(mcp3221.getAddress(), HEX);
-    Serial.print("Reference Voltage: ");
-    Serial.print(mcp3221.getVref(), 2);
-    Serial.println(" V");
-    Serial.print("Resolution: ");
-    Serial.println(mcp3221.getResolution());
-    Serial.print("Max Value: ");
-    Serial.println(mcp3221.getMaxValue());
+    LOG_INFO(LOG_TAG_BOOST, "MCP3221 found and ready! I2C Address: 0x%X, Reference Voltage: %.2f V, Resolution: %u, Max Value: %u",
+             mcp3221.getAddress(), mcp3221.getVref(), mcp3221.getResolution(), mcp3221.getMaxValue());
   }
   else
   {
-    Serial.println("MCP3221 not found. Check connections and address.");
+    LOG_ERROR(LOG_TAG_BOOST, "MCP3221 not found. Check connections and address.");
   }
 }
 
@@ -366,6 +828,17 @@ void initBoostPwmSignal()
   ledcWrite(PWM_VBOOST_PIN, boostDutyCycle);
 }
 
+void startBoost()
+{
+  // Soft-start again from the minimum duty (or from wherever an interrupted soft-stop got to)
+  boostDutyCycle = max(boostDutyCycle, MIN_VBOOST_PWM_DUTY_CYCLE);
+  ledcWrite(PWM_VBOOST_PIN, boostDutyCycle);
+  boostSoftStart = true;
+  boostSoftStartAt = millis();
+  scheduler.setPeriod(voltageTask, VBOOST_SOFT_START_STEP_MS);
+  scheduler.schedule(voltageTask, 0);
+}
+
 void initIndicatorLedPwmSignal(int dutyCycle)
 {
   // Set up LEDC PWM on the pin
@@ -376,154 +849,136 @@ void initIndicatorLedPwmSignal(int dutyCycle)
 
 void initFlashMessages()
 {
-  // Schedule the first flash message
+  // Restore an uploaded message set, then schedule the first flash message
+  flashMessages.begin();
   scheduleNextFlash();
-  Serial.println("Flash messages initialized");
-  Serial.print("Flash message mode: ");
-  Serial.println(flashMessageMode ? "ENABLED" : "DISABLED");
-  Serial.print("Number of flash messages: ");
-  Serial.println(numFlashMessages);
+  LOG_INFO(LOG_TAG_FLASH, "Flash messages initialized, mode %s, %u messages (%s)", clockConfig.flashMessageMode ? "ENABLED" : "DISABLED",
+           flashMessages.getCount(), flashMessages.isCustom() ? "uploaded" : "built-in");
 }
 
 void scheduleNextFlash()
 {
   // Generate a random interval between min and max
-  unsigned long interval = random(FLASH_INTERVAL_MIN, FLASH_INTERVAL_MAX + 1);
-  nextFlashTime = millis() + interval;
+  unsigned long interval = random(clockConfig.flashIntervalMinMs, clockConfig.flashIntervalMaxMs + 1);
+  scheduler.schedule(flashTask, interval);
   
-  Serial.print("Next flash scheduled in ");
-  Serial.print(interval / 1000);
-  Serial.println(" seconds");
+  LOG_DEBUG(LOG_TAG_FLASH, "Next flash scheduled in %lu seconds", interval / 1000);
 }
 
-void updateFlashMessages()
+void startFlashMessage()
 {
-  unsigned long currentTime = millis();
-  
-  // Check if we're currently glitching out (transition from flash message back to time)
-  if (isGlitchingOut)
+  // Runs from flashTask; the timeline then plays from the loop and schedules the next flash when it ends
+  if (!clockConfig.flashMessageMode || !isDisplayTimeMode() || frameStream.isActive() || timerDisplay.isActive())
   {
-    // Update glitch-out frames
-    if (currentTime >= nextGlitchFrame)
-    {
-      currentGlitchText = generateGlitchText();
-      nextGlitchFrame = currentTime + GLITCH_FRAME_TIME;
-    }
-    
-    // Check if glitch-out duration has ended
-    if (currentTime >= glitchEndTime)
-    {
-      isGlitchingOut = false;
-      Serial.println("Glitch-out effect ended, returning to time display");
-      scheduleNextFlash(); // Schedule the next flash
-    }
-
+    // Messages only flash over the clock; skip this one
+    scheduleNextFlash();
     return;
   }
-  
-  // Check if we're currently glitching in (transition to flash message)
-  if (isGlitching && !isGlitchingOut)
-  {
-    // Update glitch-in frames
-    if (currentTime >= nextGlitchFrame)
-    {
-      currentGlitchText = generateGlitchText();
-      nextGlitchFrame = currentTime + GLITCH_FRAME_TIME;
-    }
-    
-    // Check if glitch-in duration has ended
-    if (currentTime >= glitchEndTime)
-    {
-      isGlitching = false;
-      isFlashing = true;
-      flashEndTime = currentTime + FLASH_DURATION;
-      Serial.println("Glitch-in effect ended, showing flash message");
-    }
 
-    return;
+  TimelinePreset preset = (TimelinePreset)clockConfig.flashTransition;
+  if (preset >= TIMELINE_PRESET_COUNT)
+  {
+    preset = (TimelinePreset)random(TIMELINE_PRESET_COUNT);
   }
-  
-  // Check if we're currently flashing a message
-  if (isFlashing)
+
+  currentFlashIndex = flashMessages.next();
+  flashTimeline.start(preset, clockConfig.glitchDurationMs, clockConfig.flashDurationMs);
+
+  LOG_INFO(LOG_TAG_FLASH, "Starting flash message \"%s\" with transition: %s", flashMessages.getText(currentFlashIndex), Timeline::getPresetName(preset));
+}
+
+void updateFlashMessage()
+{
+  switch (flashTimeline.update())
   {
-    // Check if flash duration has ended
-    if (currentTime >= flashEndTime)
-    {
-      isFlashing = false;
-      isGlitchingOut = true;  // Start glitch-out effect
-      glitchEndTime = currentTime + GLITCH_DURATION;
-      nextGlitchFrame = currentTime;
-      Serial.println("Flash message ended, starting glitch-out effect");
-    }
-    
-    // If still flashing, the display will show the flash message
-    return;
+    case TIMELINE_SCENE_STARTED:
+      // Glitch keyframes drive the glitch engine for their duration; glitching out reuses the effect of the way in
+      if (flashTimeline.getScene() == TIMELINE_SCENE_GLITCH_IN)
+      {
+        glitchEngine.start(flashMessages.getSegments(currentFlashIndex), true, flashTimeline.getKeyframeDuration());
+        LOG_DEBUG(LOG_TAG_FLASH, "Glitch effect: %s", GlitchEngine::getEffectName(glitchEngine.getEffect()));
+      }
+      else if (flashTimeline.getScene() == TIMELINE_SCENE_GLITCH_OUT)
+      {
+        glitchEngine.start(flashMessages.getSegments(currentFlashIndex), false, flashTimeline.getKeyframeDuration(), glitchEngine.getEffect());
+      }
+      break;
+
+    case TIMELINE_FINISHED:
+      LOG_DEBUG(LOG_TAG_FLASH, "Flash message ended, returning to time display");
+      scheduleNextFlash();
+      break;
+
+    default:
+      break;
   }
-  
-  // Check if it's time for the next flash
-  if (!isFlashing && !isGlitching && !isGlitchingOut && currentTime >= nextFlashTime)
+}
+
+void cancelFlashMessage()
+{
+  // Something else took over the display; restore full brightness and try again later
+  if (flashTimeline.isActive())
   {
-    // Start glitching in first
-    isGlitching = true;
-    glitchEndTime = currentTime + GLITCH_DURATION;
-    nextGlitchFrame = currentTime;
-    
-    // Select a random message from the array
-    currentFlashIndex = random(0, numFlashMessages);
-    
-    Serial.print("Starting glitch-in effect before flash message: \"");
-    Serial.print(flashMessages[currentFlashIndex]);
-    Serial.println("\"");
+    flashTimeline.stop();
+    scheduleNextFlash();
   }
 }
 
 void printLocalTime()
 {
   struct tm timeinfo;
-  if (!getLocalTime(&timeinfo))
+  if (!getClockTime(timeinfo, NULL))
   {
-    Serial.println("Failed to obtain time");
+    LOG_WARN(LOG_TAG_TIME, "Failed to obtain time");
     return;
   }
   
   // Print formatted time
-  Serial.print("Current time: ");
-  Serial.println(&timeinfo, "%A, %B %d %Y %H:%M:%S");
+  char timeString[48];
+  strftime(timeString, sizeof(timeString), "%A, %B %d %Y %H:%M:%S", &timeinfo);
+  LOG_INFO(LOG_TAG_TIME, "Current time: %s", timeString);
 }
 
-String getFormattedTime()
+void getFormattedTime(char* buffer, size_t size)
 {
   struct tm timeinfo;
-  if (!getLocalTime(&timeinfo))
+  if (!getClockTime(timeinfo, NULL))
   {
-    return "NO TIME";
+    snprintf(buffer, size, "NO TIME");
+    return;
   }
   
-  char timeString[16];
-  strftime(timeString, sizeof(timeString), "%H:%M:%S", &timeinfo);
-  return String(timeString);
+  strftime(buffer, size, "%H:%M:%S", &timeinfo);
 }
 
 int updateBoostDutyCycle(int currentDutyCycle, bool printInfo)
 {
+  TRACE_SCOPE(TRACE_BOOST);
+
   if (!mcp3221.isConnected())
   {
-    Serial.println("MCP3221 ADC disconnected!");
+    adcDisconnectedCount++;
+    LOG_WARN(LOG_TAG_BOOST, "MCP3221 ADC disconnected!");
     return currentDutyCycle;
   }
 
   //uint16_t rawValue = mcp3221.readRaw();
   float voltage = mcp3221.readVoltage();
   float voltageConverted = voltage * VOLTAGE_MULTIPLIER;
+
+  // Record regulation error for /metrics
+  boostVoltage = voltageConverted;
+  regulatorError = clockConfig.targetVoltage - voltageConverted;
+  regulatorErrorHistogram.observe((uint32_t)(fabsf(regulatorError) * 1000));
   
   // Adjust duty cycle based on voltage comparison
   int newDuty = currentDutyCycle;
 
-  if (voltageConverted < VBOOST_TARGET_VOLTAGE_V)
+  if (voltageConverted < clockConfig.targetVoltage)
   {
       newDuty = min(MAX_VBOOST_PWM_DUTY_CYCLE, newDuty + 1);
   }
-  else if (voltageConverted > VBOOST_TARGET_VOLTAGE_V)
+  else if (voltageConverted > clockConfig.targetVoltage)
   {
       newDuty = max(MIN_VBOOST_PWM_DUTY_CYCLE, newDuty - 1);
   }
@@ -531,223 +986,1850 @@ int updateBoostDutyCycle(int currentDutyCycle, bool printInfo)
   // Update PWM output
   ledcWrite(PWM_VBOOST_PIN, newDuty);
 
-#ifdef DEBUG
   if (printInfo)
   {
-    Serial.println("-----------------");
-    Serial.print("Voltage Factor: ");
-    Serial.println(VOLTAGE_MULTIPLIER);
-    // Serial.print("MCP Value: ");
-    // Serial.println(rawValue);
-    Serial.print("Low voltage measurement: ");
-    Serial.print(voltage, 3);
-    Serial.println(" V");
-    Serial.print("High voltage (converted): ");
-    Serial.print(voltageConverted, 3);
-    Serial.println(" V");
-    Serial.print("Target voltage: ");
-    Serial.print(VBOOST_TARGET_VOLTAGE_V);
-    Serial.println(" V");
-    Serial.print("Previous duty cycle: ");
-    Serial.print(currentDutyCycle);
-    Serial.print(" (");
-    Serial.print((currentDutyCycle * 100.0) / VBOOST_PWM_DUTY_MAX_VALUE, 1);
-    Serial.println("%)");
-    Serial.print("Updated duty cycle: ");
-    Serial.print(newDuty);
-    Serial.print(" (");
-    Serial.print((newDuty * 100.0) / VBOOST_PWM_DUTY_MAX_VALUE, 1);
-    Serial.println("%)");
-    Serial.print("Min duty cycle: ");
-    Serial.print(MIN_VBOOST_PWM_DUTY_CYCLE);
-    Serial.print(" (");
-    Serial.print((MIN_VBOOST_PWM_DUTY_CYCLE * 100.0) / VBOOST_PWM_DUTY_MAX_VALUE, 1);
-    Serial.println("%)");
-    Serial.print("Max duty cycle: ");
-    Serial.print(MAX_VBOOST_PWM_DUTY_CYCLE);
-    Serial.print(" (");
-    Serial.print((MAX_VBOOST_PWM_DUTY_CYCLE * 100.0) / VBOOST_PWM_DUTY_MAX_VALUE, 1);
-    Serial.println("%)");
-    Serial.print("Frequency: ");
-    Serial.print(VBOOST_PWM_FREQUENCY);
-    Serial.println(" Hz");
-    Serial.println("--------");
+    LOG_DEBUG(LOG_TAG_BOOST, "Voltage factor %.2f, low voltage %.3f V, high voltage %.3f V, target %.2f V",
+              VOLTAGE_MULTIPLIER, voltage, voltageConverted, clockConfig.targetVoltage);
+    LOG_DEBUG(LOG_TAG_BOOST, "Duty cycle %d -> %d (%.1f%%), range %d-%d, %d Hz", currentDutyCycle, newDuty,
+              (newDuty * 100.0) / VBOOST_PWM_DUTY_MAX_VALUE, MIN_VBOOST_PWM_DUTY_CYCLE, MAX_VBOOST_PWM_DUTY_CYCLE, VBOOST_PWM_FREQUENCY);
   }
-#endif
 
   return newDuty;
 }
 
 void checkVoltage()
 {
-  static unsigned long lastVoltageCheck = 0;
+  // Runs from voltageTask: every 10ms during soft-start so the boost ramps up in about a second, then every 200ms
+  if (powerManager.isBoostStopping())
+  {
+    // Night mode: ramp the duty down at the soft-start rate, then let the power manager switch the filament off
+    boostDutyCycle = max(0, boostDutyCycle - VBOOST_SOFT_STOP_STEP);
+    ledcWrite(PWM_VBOOST_PIN, boostDutyCycle);
+    if (boostDutyCycle == 0)
+    {
+      powerManager.boostStopped();
+    }
+    return;
+  }
+
+  bool printInfo = (voltageUpdateCounter >= VOLTAGE_UPDATE_INTERVAL);
+  boostDutyCycle = updateBoostDutyCycle(boostDutyCycle, printInfo);
+  
+  if (printInfo)
+  {
+    voltageUpdateCounter = 0;
+  }
+  else
+  {
+    voltageUpdateCounter++;
+  }
 
-  // Check and adjust VFD voltage every 40ms (25 times per second)
-  if (millis() - lastVoltageCheck > 200)
+  if (boostSoftStart && (boostVoltage >= clockConfig.targetVoltage || millis() - boostSoftStartAt >= VBOOST_SOFT_START_TIMEOUT_MS))
   {
-    bool printInfo = (voltageUpdateCounter >= VOLTAGE_UPDATE_INTERVAL);
-    boostDutyCycle = updateBoostDutyCycle(boostDutyCycle, printInfo);
-    
-    if (printInfo)
+    boostSoftStart = false;
+    scheduler.setPeriod(voltageTask, VBOOST_REGULATOR_INTERVAL_MS);
+    bootTimeline.mark(BOOT_PHASE_BOOST_READY);
+
+    // Without voltage feedback the ramp never moves; run open loop at a safe level instead
+    if (!mcp3221.isConnected())
     {
-      voltageUpdateCounter = 0;
+      boostDutyCycle = VBOOST_FALLBACK_DUTY_CYCLE;
+      ledcWrite(PWM_VBOOST_PIN, boostDutyCycle);
     }
-    else
+    LOG_INFO(LOG_TAG_BOOST, "Boost soft-start done at %.1f V, duty %d", boostVoltage, boostDutyCycle);
+    powerManager.boostReady();
+  }
+}
+
+void checkDutyAlert()
+{
+  // Log each time the per-digit on-time imbalance rises above the threshold
+  const DutyAnalyzer& duty = vfdDisplay.getDutyAnalyzer();
+  if (duty.getAlerts() == dutyAlertsReported) return;
+
+  dutyAlertsReported = duty.getAlerts();
+  LOG_WARN(LOG_TAG_DISPLAY, "Multiplex imbalance %.1f%% (threshold %u%%), slots %lu-%lu us", duty.getImbalancePercent(), duty.getThreshold(),
+           (unsigned long)duty.getMinSlotUs(), (unsigned long)duty.getMaxSlotUs());
+}
+
+void trackHeapLowWater()
+{
+  // ESP.getMinFreeHeap() only has a lifetime minimum, so the window's own is sampled on every loop pass and
+  // around each request handler
+  uint32_t freeHeap = ESP.getFreeHeap();
+  if (freeHeap < heapLowWater)
+  {
+    heapLowWater = freeHeap;
+  }
+}
+
+void checkHeapGuard()
+{
+  // The allocator hook cannot log, so violations are reported from here: each kept call site once, then the
+  // total each time it doubles
+  uint32_t violations = heapProfiler.getViolations();
+  if (violations < heapViolationsReported)
+  {
+    heapViolationsReported = 0;  // The guard was reset
+  }
+  if (violations == heapViolationsReported) return;
+
+  HeapCallSite sites[HEAP_GUARD_SITES];
+  uint8_t count = heapProfiler.getGuardSites(sites, HEAP_GUARD_SITES);
+  if (heapViolationsReported < count)
+  {
+    for (uint32_t i = heapViolationsReported; i < count; i++)
     {
-      voltageUpdateCounter++;
+      LOG_ERROR(LOG_TAG_SYSTEM, "Heap guard: %lu bytes allocated on the loop task from 0x%08lx", (unsigned long)sites[i].count, (unsigned long)sites[i].address);
     }
-    
-    lastVoltageCheck = millis();
+    heapViolationsReported = count;
+  }
+  else if (violations >= 2 * heapViolationsReported)
+  {
+    LOG_ERROR(LOG_TAG_SYSTEM, "Heap guard: %lu allocations on the loop task so far", (unsigned long)violations);
+    heapViolationsReported = violations;
+  }
+}
+
+void updatePower()
+{
+  // Runs from powerTask. Steps the night mode sequence and follows its phase changes with the boost regulator and
+  // the polling rates; the power manager itself handles the display, the filament and the CPU.
+  struct tm timeinfo;
+  bool hasTime = getClockTime(timeinfo, NULL);
+
+  PowerPhase previous = powerManager.getPhase();
+  powerManager.update(hasTime ? &timeinfo : NULL, scheduler.getSleepTotalUs());
+  PowerPhase phase = powerManager.getPhase();
+  if (phase == previous) return;
+
+  LOG_INFO(LOG_TAG_POWER, "Power %s -> %s (%s, %s)", PowerManager::getPhaseName(previous), PowerManager::getPhaseName(phase),
+           PowerManager::getModeName(powerManager.getMode()), powerManager.isOverridden() ? "override" : "schedule");
+
+  switch (phase)
+  {
+    case POWER_PHASE_STOPPING:
+      // checkVoltage() ramps the duty down
+      boostSoftStart = false;
+      scheduler.setPeriod(voltageTask, VBOOST_SOFT_START_STEP_MS);
+      scheduler.schedule(voltageTask, 0);
+      break;
+
+    case POWER_PHASE_OFF:
+      // Whatever the ramp reached (it times out if the regulator stalls), the boost is off from here
+      scheduler.cancel(voltageTask);
+      boostDutyCycle = 0;
+      ledcWrite(PWM_VBOOST_PIN, 0);
+      scheduler.setPeriod(webTask, WEB_TASK_OFF_INTERVAL_MS);
+      scheduler.setPeriod(networkTask, NETWORK_TASK_OFF_INTERVAL_MS);
+      LOG_INFO(LOG_TAG_POWER, "Tube off; CPU in %s", powerManager.isLightSleep() ? "automatic light sleep" : "low clock (light sleep not available)");
+      break;
+
+    case POWER_PHASE_WARMUP:
+      scheduler.setPeriod(webTask, WEB_TASK_INTERVAL_MS);
+      scheduler.setPeriod(networkTask, NETWORK_TASK_INTERVAL_MS);
+      break;
+
+    case POWER_PHASE_STARTING:
+      startBoost();
+      break;
+
+    case POWER_PHASE_ON:
+      break;
   }
 }
 
 void updateDisplay()
 {
-  // Check if we should display glitch effect (either in or out)
-  if (flashMessageMode && isDisplayTimeMode && (isGlitching || isGlitchingOut))
+  // A flash only plays over the clock; stop it if flash mode or the display mode changed underneath it
+  if (flashTimeline.isActive() && (!clockConfig.flashMessageMode || !isDisplayTimeMode()))
+  {
+    cancelFlashMessage();
+  }
+  else if (flashTimeline.isActive())
+  {
+    updateFlashMessage();
+  }
+
+  TimelineScene scene = flashTimeline.getScene();
+
+  if (scene == TIMELINE_SCENE_GLITCH_IN || scene == TIMELINE_SCENE_GLITCH_OUT)
   {
-    // Display the current glitch text
-    vfdDisplay.setDisplayText(currentGlitchText.c_str());
+    // The engine writes its frames straight into the display
+    glitchEngine.update();
+    clockRenderer.invalidate();
+    marquee.invalidate();
   }
-  // Check if we should display flash message (only in time mode and when flash is enabled)
-  else if (flashMessageMode && isDisplayTimeMode && isFlashing)
+  else if (scene == TIMELINE_SCENE_MESSAGE)
   {
     // Display the current flash message
-    vfdDisplay.setDisplayText(flashMessages[currentFlashIndex].c_str());
+    vfdDisplay.setDisplaySegments(flashMessages.getSegments(currentFlashIndex), MESSAGE_DIGITS);
+    clockRenderer.invalidate();
+    marquee.invalidate();
+    glitchEngine.invalidate();
   }
-  else if (isDisplayTimeMode)
+  else if (isDisplayTimeMode())
   {
     updateTimeDisplay();
+    marquee.invalidate();
   }
   else
   {
     updateCustomDisplay();
+    clockRenderer.invalidate();
   }
 }
 
 void updateTimeDisplay()
 {
-  static unsigned long lastUpdate = 0;
-  static struct tm currentTimeInfo;
+  static unsigned long lastSyncAttempt = 0;
 
-  // Update time every 100ms
-  if (millis() - lastUpdate >= 100)
+  if (!clockRenderer.isTimeSet())
   {
-    if (getLocalTime(&currentTimeInfo))
+    // Wait for NTP; retry every 100ms
+    if (millis() - lastSyncAttempt >= 100)
     {
-      int hour = currentTimeInfo.tm_hour;
-      int minute = currentTimeInfo.tm_min;
-      int second = currentTimeInfo.tm_sec;
-      
-      // Apply DST adjustment if enabled
-      if (DST == 1)
+      lastSyncAttempt = millis();
+      if (!syncClockRenderer() && !timeSet)
       {
-        // DST in US: Second Sunday in March to first Sunday in November
-        if (currentTimeInfo.tm_yday > 67 && currentTimeInfo.tm_yday < 307)
-        {
-          hour = (hour + 1) % 24;
-        }
+        // Dashes while the network comes up, an error once a connection attempt has failed
+        vfdDisplay.setDisplayText(networkState == NETWORK_WIFI_BACKOFF ? "--ERR-- " : "--------");
       }
-
-      // Calculate fractions of a second from system uptime
-      //int centiseconds = (millis() / 100) % 10;  // 0-9 (tenths of seconds)
-      //int centiseconds = (millis() / 10) % 100;  // 0-999 (hundredths of seconds)
-      
-      // Format time string for 8 digits.
-      char timeStr[12];
-      snprintf(timeStr, sizeof(timeStr), "%02d-%02d-%02d", hour, minute, second);
-      //snprintf(timeStr, sizeof(timeStr), "%02d.%02d.%02d.%d", hour, minute, second, centiseconds); // 00.00.00.0
-      
-      vfdDisplay.setDisplayText(timeStr);
     }
-    
-    lastUpdate = millis();
+    return;
   }
-  else if (!timeSet)
+
+  // Advance on second boundaries. Resync with the NTP timebase once a minute to follow its corrections and DST.
+  if (clockRenderer.update())
   {
-    vfdDisplay.setDisplayText("--ERR-- ");
+    syncClockRenderer();
   }
 }
 
-void updateCustomDisplay()
+bool syncClockRenderer()
 {
-  static unsigned long lastUpdate = 0;
-  
-  // Update custom text every 100ms (same rate as time for consistency)
-  if (millis() - lastUpdate >= 100)
+  struct tm timeinfo;
+  uint32_t microsIntoSecond;
+
+  if (!getClockTime(timeinfo, &microsIntoSecond))
   {
-    vfdDisplay.setDisplayText(customText.c_str());
-    lastUpdate = millis();
+    return false;
   }
-}
 
-// Web server handlers - Comrade VFD Clock Control Interface
-void handleRoot()
-{
-  String html = getWebUI(isDisplayTimeMode, customText, flashMessageMode, getFormattedTime());
-  server.send(200, "text/html", html);
+  clockRenderer.setTime(timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec, microsIntoSecond);
+  bootTimeline.mark(BOOT_PHASE_CLOCK_SHOWN);
+  return true;
 }
 
-void handleToggleMode()
+void syncDisplayClocks()
 {
-  isDisplayTimeMode = !isDisplayTimeMode;
-  Serial.println("Display mode toggled to: " + String(isDisplayTimeMode ? "Time" : "Custom"));
-  server.sendHeader("Location", "/");
-  server.send(302, "text/plain", "");
-}
+  // Anchors the hundredths clock and the animation VM's TIME to the local time of day
+  static unsigned long lastAttempt = 0;
+  struct tm timeinfo;
+  uint32_t microsIntoSecond;
 
-void handleToggleMessageMode()
-{
-  flashMessageMode = !flashMessageMode;
-  Serial.println("Flash Message mode toggled to: " + String(flashMessageMode ? "True" : "False"));
-  server.sendHeader("Location", "/");
-  server.send(302, "text/plain", "");
+  // Until the clock is set, only retry every 100ms
+  if (millis() - lastAttempt < 100)
+  {
+    return;
+  }
+  lastAttempt = millis();
+
+  if (getClockTime(timeinfo, &microsIntoSecond))
+  {
+    uint32_t secondsOfDay = timeinfo.tm_hour * 3600 + timeinfo.tm_min * 60 + timeinfo.tm_sec;
+    timerDisplay.setClockTime(secondsOfDay, microsIntoSecond);
+    animation.setClockTime(secondsOfDay, microsIntoSecond);
+  }
 }
 
-void handleSetText()
+bool getClockTime(struct tm& timeinfo, uint32_t* microsIntoSecond)
 {
-  if (server.hasArg("text")) {
-    customText = server.arg("text");
-    // Pad with spaces if less than 8 characters
-    while (customText.length() < 8) {
-      customText += " ";
-    }
-    // Truncate if more than 8 characters
-    if (customText.length() > 8) {
-      customText = customText.substring(0, 8);
-    }
-    Serial.println("Custom text set to: \"" + customText + "\"");
+  // Local wall-clock time from the NTP-disciplined timebase (or the system clock before the first sync)
+  // and the configured timezone rule
+  struct timeval now;
+  if (!ntpClient.getTime(now))
+  {
+    gettimeofday(&now, NULL);
+  }
+
+  if (now.tv_sec < MIN_VALID_TIME)
+  {
+    return false;
+  }
+
+  time_t local = timeZone.toLocal(now.tv_sec);
+  gmtime_r(&local, &timeinfo);
+
+  if (microsIntoSecond != NULL)
+  {
+    *microsIntoSecond = now.tv_usec;
+  }
+  return true;
+}
+
+void updateCustomDisplay()
+{
+  // The marquee redraws only when it steps (or after something else was shown)
+  marquee.update();
+}
+
+bool isDisplayTimeMode()
+{
+  return clockConfig.displayMode == DISPLAY_MODE_TIME;
+}
+
+void setCustomText(ClockConfig& config, const String& text)
+{
+  // Truncate at the stored length; text longer than the tube scrolls
+  strncpy(config.customText, text.c_str(), CONFIG_TEXT_LENGTH);
+  config.customText[CONFIG_TEXT_LENGTH] = '\0';
+}
+
+void applyConfig()
+{
+  if (!timeZone.setRule(clockConfig.timezone))
+  {
+    LOG_WARN(LOG_TAG_TIME, "Invalid timezone rule \"%s\", using %s", clockConfig.timezone, DEFAULT_TIMEZONE);
+    strcpy(clockConfig.timezone, DEFAULT_TIMEZONE);
+    timeZone.setRule(DEFAULT_TIMEZONE);
+  }
+
+  // Re-anchor the clock face so a timezone change shows immediately
+  if (clockRenderer.isTimeSet())
+  {
+    syncClockRenderer();
+  }
+
+  vfdDisplay.setBrightness(clockConfig.brightness);
+  frameStream.setIdleBrightness(clockConfig.brightness);
+  framePlayer.setIdleBrightness(clockConfig.brightness);
+
+  marquee.setScroll((MarqueeMode)clockConfig.scrollMode, clockConfig.scrollStepMs, clockConfig.scrollPauseMs);
+
+  powerManager.setFilamentProfile(clockConfig.filamentLevel, clockConfig.filamentStandbyLevel, clockConfig.filamentRampMs);
+}
+
+String jsonEscape(const char* text)
+{
+  // Escape quotes and backslashes; control characters are replaced with spaces
+  String escaped = "";
+  for (const char* p = text; *p; p++)
+  {
+    if (*p == '"' || *p == '\\')
+    {
+      escaped += '\\';
+      escaped += *p;
+    }
+    else if ((uint8_t)*p < 0x20)
+    {
+      escaped += ' ';
+    }
+    else
+    {
+      escaped += *p;
+    }
+  }
+  return escaped;
+}
+
+String getSettingsJson()
+{
+  String json = "{";
+  json += "\"mode\":\"" + String(isDisplayTimeMode() ? "time" : "text") + "\",";
+  json += "\"text\":\"" + jsonEscape(clockConfig.customText) + "\",";
+  json += "\"scroll\":\"" + String(Marquee::getModeName((MarqueeMode)clockConfig.scrollMode)) + "\",";
+  json += "\"scrollSpeed\":" + String(clockConfig.scrollStepMs) + ",";
+  json += "\"scrollPause\":" + String(clockConfig.scrollPauseMs) + ",";
+  json += "\"flash\":" + String(clockConfig.flashMessageMode ? "true" : "false") + ",";
+  json += "\"flashIntervalMin\":" + String(clockConfig.flashIntervalMinMs) + ",";
+  json += "\"flashIntervalMax\":" + String(clockConfig.flashIntervalMaxMs) + ",";
+  json += "\"flashDuration\":" + String(clockConfig.flashDurationMs) + ",";
+  json += "\"glitchDuration\":" + String(clockConfig.glitchDurationMs) + ",";
+  json += "\"transition\":\"" + String(Timeline::getPresetName((TimelinePreset)clockConfig.flashTransition)) + "\",";
+  json += "\"brightness\":" + String(clockConfig.brightness) + ",";
+  json += "\"voltage\":" + String(clockConfig.targetVoltage, 1) + ",";
+  json += "\"timezone\":\"" + jsonEscape(clockConfig.timezone) + "\",";
+  json += "\"filament\":" + String(clockConfig.filamentLevel) + ",";
+  json += "\"filamentStandby\":" + String(clockConfig.filamentStandbyLevel) + ",";
+  json += "\"filamentRamp\":" + String(clockConfig.filamentRampMs) + ",";
+  json += "\"saved\":" + String(configStore.isDirty() ? "false" : "true");
+  json += "}";
+  return json;
+}
+
+// Argument parsing helpers for the settings API. Each returns false if the value is malformed or out of range.
+bool parseUnsignedArg(const String& value, uint32_t minValue, uint32_t maxValue, uint32_t& result)
+{
+  char* end;
+  unsigned long parsed = strtoul(value.c_str(), &end, 10);
+  if (value.length() == 0 || *end != '\0' || value[0] == '-' || parsed < minValue || parsed > maxValue)
+  {
+    return false;
+  }
+  result = parsed;
+  return true;
+}
+
+bool parseFloatArg(const String& value, float minValue, float maxValue, float& result)
+{
+  char* end;
+  float parsed = strtof(value.c_str(), &end);
+  if (value.length() == 0 || *end != '\0' || !(parsed >= minValue && parsed <= maxValue))
+  {
+    return false;
+  }
+  result = parsed;
+  return true;
+}
+
+bool parseBoolArg(const String& value, bool& result)
+{
+  if (value == "1" || value == "true" || value == "on")
+  {
+    result = true;
+    return true;
+  }
+  if (value == "0" || value == "false" || value == "off")
+  {
+    result = false;
+    return true;
+  }
+  return false;
+}
+
+// Members of a flat JSON object: strings unescaped, numbers and true/false as written. False for anything else,
+// including nested objects, arrays and null.
+bool parseJsonObject(const char* json, std::vector<std::pair<String, String>>& members)
+{
+  auto skipSpace = [](const char*& p) {
+    while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n')
+    {
+      p++;
+    }
+  };
+
+  auto parseString = [](const char*& p, String& out) {
+    if (*p++ != '"') return false;
+    while (*p != '"')
+    {
+      if ((uint8_t)*p < 0x20) return false;  // Also the end of the body
+      if (*p != '\\')
+      {
+        out += *p++;
+        continue;
+      }
+
+      p++;
+      const char* plain = strchr("\"\\/bfnrt", *p);
+      if (*p != '\0' && plain != NULL)
+      {
+        out += "\"\\/\b\f\n\r\t"[plain - "\"\\/bfnrt"];
+        p++;
+        continue;
+      }
+      if (*p != 'u') return false;
+
+      // \uXXXX as UTF-8; surrogate pairs are not needed for the values the API takes
+      char hex[5] = {};
+      for (int i = 0; i < 4; i++)
+      {
+        if (!isxdigit((uint8_t)p[1 + i])) return false;
+        hex[i] = p[1 + i];
+      }
+      uint32_t code = strtoul(hex, NULL, 16);
+      p += 5;
+      if (code >= 0xD800 && code < 0xE000) return false;
+      if (code < 0x80)
+      {
+        out += (char)code;
+      }
+      else if (code < 0x800)
+      {
+        out += (char)(0xC0 | (code >> 6));
+        out += (char)(0x80 | (code & 0x3F));
+      }
+      else
+      {
+        out += (char)(0xE0 | (code >> 12));
+        out += (char)(0x80 | ((code >> 6) & 0x3F));
+        out += (char)(0x80 | (code & 0x3F));
+      }
+    }
+    p++;
+    return true;
+  };
+
+  const char* p = json;
+  skipSpace(p);
+  if (*p++ != '{') return false;
+  skipSpace(p);
+
+  if (*p != '}')
+  {
+    while (true)
+    {
+      String name;
+      String value;
+      if (!parseString(p, name)) return false;
+      skipSpace(p);
+      if (*p++ != ':') return false;
+      skipSpace(p);
+
+      if (*p == '"')
+      {
+        if (!parseString(p, value)) return false;
+      }
+      else
+      {
+        const char* start = p;
+        while (isalnum((uint8_t)*p) || *p == '+' || *p == '-' || *p == '.')
+        {
+          p++;
+        }
+        value = String(start).substring(0, p - start);
+
+        char* end;
+        strtod(value.c_str(), &end);
+        if (value != "true" && value != "false" && (value.length() == 0 || *end != '\0')) return false;
+      }
+      members.emplace_back(name, value);
+
+      skipSpace(p);
+      if (*p != ',') break;
+      p++;
+      skipSpace(p);
+    }
+    if (*p != '}') return false;
+  }
+
+  p++;
+  skipSpace(p);
+  return *p == '\0';
+}
+
+// Passes every argument of a POST to accept() before the handler applies anything. Arguments are form fields (and
+// the query string) or the members of a JSON object body, which WebServer hands over as the "plain" argument.
+// On the first argument accept() rejects this sends 400 with error and the name, for any other body 415, and
+// returns false.
+bool forEachArg(const char* error, const std::function<bool(const String& name, const String& value)>& accept)
+{
+  std::vector<std::pair<String, String>> args;
+  for (int i = 0; i < server.args(); i++)
+  {
+    if (server.argName(i) != "plain")
+    {
+      args.emplace_back(server.argName(i), server.arg(i));
+    }
+  }
+
+  if (server.hasArg("plain") && !parseJsonObject(server.arg("plain").c_str(), args))
+  {
+    server.send(415, "application/json", "{\"error\":\"expected form fields or a flat JSON object\"}");
+    return false;
+  }
+
+  for (const auto& arg : args)
+  {
+    if (!accept(arg.first, arg.second))
+    {
+      server.send(400, "application/json", "{\"error\":\"" + String(error) + "\",\"name\":\"" + jsonEscape(arg.first.c_str()) + "\"}");
+      return false;
+    }
   }
+  return true;
+}
+
+// Web server handlers - Comrade VFD Clock Control Interface
+void handleRoot()
+{
+  char formattedTime[16];
+  getFormattedTime(formattedTime, sizeof(formattedTime));
+  sendWebUI(server, isDisplayTimeMode(), clockConfig.customText, clockConfig.flashMessageMode, formattedTime, clockConfig.timezone);
+}
+
+void handleToggleMode()
+{
+  clockConfig.displayMode = isDisplayTimeMode() ? DISPLAY_MODE_TEXT : DISPLAY_MODE_TIME;
+  configStore.markDirty();
+  LOG_INFO(LOG_TAG_WEB, "Display mode toggled to: %s", isDisplayTimeMode() ? "Time" : "Custom");
   server.sendHeader("Location", "/");
   server.send(302, "text/plain", "");
 }
 
-void handleNotFound()
+void handleToggleMessageMode()
 {
-  server.send(404, "text/plain", "Not Found");
+  clockConfig.flashMessageMode = !clockConfig.flashMessageMode;
+  configStore.markDirty();
+  LOG_INFO(LOG_TAG_WEB, "Flash Message mode toggled to: %s", clockConfig.flashMessageMode ? "True" : "False");
+  server.sendHeader("Location", "/");
+  server.send(302, "text/plain", "");
+}
+
+void handleSetText()
+{
+  if (server.hasArg("text")) {
+    setCustomText(clockConfig, server.arg("text"));
+    marquee.setText(clockConfig.customText);
+    configStore.markDirty();
+    LOG_INFO(LOG_TAG_WEB, "Custom text set to: \"%s\"", clockConfig.customText);
+  }
+  server.sendHeader("Location", "/");
+  server.send(302, "text/plain", "");
 }
 
-String generateGlitchText()
+void handleGetSettings()
 {
-  // Characters that can appear in glitch effect
-  const char glitchChars[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-=+*#@$%&!?";
-  const int numGlitchChars = sizeof(glitchChars) - 1; // -1 to exclude null terminator
-  
-  String glitchText = "";
-  
-  // Generate 8 random characters for the glitch effect
-  for (int i = 0; i < 8; i++)
+  server.send(200, "application/json", getSettingsJson());
+}
+
+void handleSetSettings()
+{
+  // Apply a batch of settings atomically: everything is validated against a copy first,
+  // and nothing changes unless every argument is valid.
+  ClockConfig updated = clockConfig;
+
+  if (!forEachArg("invalid setting", [&](const String& name, const String& value)
   {
-    // Randomly decide if this position should be glitched or show a space
-    if (random(0, 100) < 70) // 70% chance to show a glitch character
+    bool valid = true;
+
+    if (name == "mode")
+    {
+      valid = (value == "time" || value == "text");
+      updated.displayMode = (value == "text") ? DISPLAY_MODE_TEXT : DISPLAY_MODE_TIME;
+    }
+    else if (name == "text")
+    {
+      valid = value.length() <= CONFIG_TEXT_LENGTH;
+      setCustomText(updated, value);
+    }
+    else if (name == "scroll")
+    {
+      MarqueeMode scrollMode;
+      valid = Marquee::parseMode(value.c_str(), scrollMode);
+      updated.scrollMode = scrollMode;
+    }
+    else if (name == "scrollSpeed")
+    {
+      uint32_t stepMs;
+      valid = parseUnsignedArg(value, MARQUEE_MIN_STEP_MS, MARQUEE_MAX_STEP_MS, stepMs);
+      updated.scrollStepMs = stepMs;
+    }
+    else if (name == "scrollPause")
+    {
+      uint32_t pauseMs;
+      valid = parseUnsignedArg(value, 0, MARQUEE_MAX_PAUSE_MS, pauseMs);
+      updated.scrollPauseMs = pauseMs;
+    }
+    else if (name == "flash")
+    {
+      valid = parseBoolArg(value, updated.flashMessageMode);
+    }
+    else if (name == "flashIntervalMin")
+    {
+      valid = parseUnsignedArg(value, 1000, 3600000, updated.flashIntervalMinMs);
+    }
+    else if (name == "flashIntervalMax")
+    {
+      valid = parseUnsignedArg(value, 1000, 3600000, updated.flashIntervalMaxMs);
+    }
+    else if (name == "flashDuration")
+    {
+      valid = parseUnsignedArg(value, 50, 60000, updated.flashDurationMs);
+    }
+    else if (name == "glitchDuration")
     {
-      int randomIndex = random(0, numGlitchChars);
-      glitchText += glitchChars[randomIndex];
-    } else
+      valid = parseUnsignedArg(value, 0, 10000, updated.glitchDurationMs);
+    }
+    else if (name == "transition")
+    {
+      TimelinePreset transition;
+      valid = Timeline::parsePreset(value.c_str(), transition);
+      updated.flashTransition = transition;
+    }
+    else if (name == "brightness")
+    {
+      uint32_t brightness;
+      valid = parseUnsignedArg(value, 0, MAX6921_MAX_BRIGHTNESS, brightness);
+      updated.brightness = brightness;
+    }
+    else if (name == "voltage")
+    {
+      valid = parseFloatArg(value, VBOOST_TARGET_VOLTAGE_MIN_V, VBOOST_TARGET_VOLTAGE_MAX_V, updated.targetVoltage);
+    }
+    else if (name == "timezone")
+    {
+      valid = TimeZone::isValidRule(value.c_str()) && value.length() <= CONFIG_TIMEZONE_LENGTH;
+      if (valid)
+      {
+        strcpy(updated.timezone, value.c_str());
+      }
+    }
+    else if (name == "filament")
+    {
+      uint32_t level;
+      valid = parseUnsignedArg(value, 1, FILAMENT_MAX_LEVEL, level);
+      updated.filamentLevel = level;
+    }
+    else if (name == "filamentStandby")
+    {
+      uint32_t level;
+      valid = parseUnsignedArg(value, 0, FILAMENT_MAX_LEVEL, level);
+      updated.filamentStandbyLevel = level;
+    }
+    else if (name == "filamentRamp")
+    {
+      uint32_t rampMs;
+      valid = parseUnsignedArg(value, 0, 10000, rampMs);
+      updated.filamentRampMs = rampMs;
+    }
+    else
     {
-      glitchText += " "; // 30% chance to show a space
+      valid = false;
     }
+
+    return valid;
+  }))
+  {
+    return;
   }
-  
-  return glitchText;
+
+  if (updated.flashIntervalMinMs > updated.flashIntervalMaxMs)
+  {
+    server.send(400, "application/json", "{\"error\":\"flashIntervalMin is greater than flashIntervalMax\"}");
+    return;
+  }
+
+  if (updated.filamentStandbyLevel > updated.filamentLevel)
+  {
+    server.send(400, "application/json", "{\"error\":\"filamentStandby is greater than filament\"}");
+    return;
+  }
+
+  bool intervalsChanged = updated.flashIntervalMinMs != clockConfig.flashIntervalMinMs ||
+                          updated.flashIntervalMaxMs != clockConfig.flashIntervalMaxMs;
+
+  bool textChanged = strcmp(updated.customText, clockConfig.customText) != 0;
+
+  clockConfig = updated;
+  applyConfig();
+  if (textChanged)
+  {
+    marquee.setText(clockConfig.customText);
+  }
+  configStore.markDirty();
+
+  if (intervalsChanged && !flashTimeline.isActive())
+  {
+    scheduleNextFlash();
+  }
+
+  LOG_INFO(LOG_TAG_WEB, "Settings updated through API.");
+  server.send(200, "application/json", getSettingsJson());
+}
+
+void handleGetStats()
+{
+  // Runtime health snapshot, polled by tools/http_bench.py during load tests.
+  // Pass reset=1 to restart the multiplex timing window and the free heap low-water mark.
+  trackHeapLowWater();
+  String json = "{";
+  json += "\"uptimeMs\":" + String(millis()) + ",";
+  json += "\"heapSize\":" + String(ESP.getHeapSize()) + ",";
+  json += "\"freeHeap\":" + String(ESP.getFreeHeap()) + ",";
+  json += "\"minFreeHeap\":" + String(ESP.getMinFreeHeap()) + ",";
+  json += "\"windowMinFreeHeap\":" + String(heapLowWater) + ",";
+  json += "\"largestFreeBlock\":" + String(ESP.getMaxAllocHeap()) + ",";
+  json += "\"refreshCount\":" + String(vfdDisplay.getRefreshCount()) + ",";
+  json += "\"refreshAvgGapUs\":" + String(vfdDisplay.getAverageRefreshGap()) + ",";
+  json += "\"refreshMaxGapUs\":" + String(vfdDisplay.getMaxRefreshGap()) + ",";
+  json += "\"loopSleepMs\":" + String((uint32_t)(scheduler.getSleepTotalUs() / 1000)) + ",";
+  json += "\"loopWakeups\":" + String(scheduler.getWakeCount()) + ",";
+  json += "\"tasks\":[";
+  for (size_t i = 0; i < sizeof(scheduledTasks) / sizeof(scheduledTasks[0]); i++)
+  {
+    const SchedulerTask* task = scheduledTasks[i];
+    json += (i > 0 ? "," : "");
+    json += "{\"name\":\"" + String(task->name) + "\",\"runs\":" + String(task->runs) + ",\"maxLateMs\":" + String(task->maxLateMs) + "}";
+  }
+  json += "]";
+  json += "}";
+
+  if (server.hasArg("reset") && server.arg("reset") == "1")
+  {
+    vfdDisplay.resetRefreshStats();
+    heapLowWater = ESP.getFreeHeap();
+  }
+
+  server.send(200, "application/json", json);
+}
+
+void handleGetBoot()
+{
+  // Startup timing: ms since reset at which each boot phase was first reached (null if not yet)
+  String json = "{\"phases\":{";
+  for (int i = 0; i < BOOT_PHASE_COUNT; i++)
+  {
+    BootPhase phase = (BootPhase)i;
+    json += (i > 0 ? ",\"" : "\"") + String(BootTimeline::getName(phase)) + "\":";
+    json += bootTimeline.isReached(phase) ? String(bootTimeline.getTime(phase)) : String("null");
+  }
+  json += "},";
+  json += "\"network\":\"" + String(getNetworkStateName()) + "\",";
+  json += "\"wifiAttempts\":" + String(wifiAttempts) + ",";
+  json += "\"wifiRetryDelayMs\":" + String(wifiRetryDelay) + ",";
+  json += "\"wifiConnectMs\":" + String(wifiConnectTime) + ",";
+  json += "\"wifiFastConnect\":" + String(wifiFastConnect ? "true" : "false") + ",";
+  json += "\"wifiFastConnects\":" + String(wifiFastConnects) + ",";
+  json += "\"wifiCacheWrites\":" + String(wifiCache.getNvsWrites()) + ",";
+  json += "\"boostSoftStart\":" + String(boostSoftStart ? "true" : "false");
+  json += "}";
+  server.send(200, "application/json", json);
+}
+
+void handleGetNtp()
+{
+  // Time sync status and the offset history (oldest first). Offsets and round trips are in microseconds.
+  String json = "{";
+  json += "\"synced\":" + String(ntpClient.isSynced() ? "true" : "false") + ",";
+  json += "\"offsetUs\":" + String(ntpClient.getLastOffset()) + ",";
+  json += "\"roundTripUs\":" + String(ntpClient.getLastRoundTrip()) + ",";
+  json += "\"driftPpb\":" + String(ntpClient.getDriftPpb()) + ",";
+  json += "\"intervalS\":" + String(ntpClient.getInterval()) + ",";
+  json += "\"maxErrorUs\":" + String(ntpClient.getMaxError()) + ",";
+  json += "\"syncs\":" + String(ntpClient.getSyncCount()) + ",";
+  json += "\"failures\":" + String(ntpClient.getFailureCount()) + ",";
+  json += "\"requests\":" + String(ntpClient.getRequestsSent()) + ",";
+  json += "\"history\":[";
+  for (int i = 0; i < ntpClient.getHistoryCount(); i++)
+  {
+    const NtpClient::Sample& sample = ntpClient.getHistory(i);
+    json += (i > 0 ? ",{" : "{");
+    json += "\"uptimeS\":" + String(sample.uptime) + ",";
+    json += "\"offsetUs\":" + String(sample.offset) + ",";
+    json += "\"roundTripUs\":" + String(sample.roundTrip) + ",";
+    json += "\"driftPpb\":" + String(sample.drift) + ",";
+    json += "\"intervalS\":" + String(sample.interval) + "}";
+  }
+  json += "]}";
+  server.send(200, "application/json", json);
+}
+
+String getTimerJson()
+{
+  String json = "{";
+  json += "\"mode\":\"" + String(TimerDisplay::getModeName(timerDisplay.getMode())) + "\",";
+  json += "\"running\":" + String(timerDisplay.isRunning() ? "true" : "false") + ",";
+  json += "\"finished\":" + String(timerDisplay.isFinished() ? "true" : "false") + ",";
+  json += "\"elapsedMs\":" + String(timerDisplay.getElapsedMs()) + ",";
+  json += "\"countdownMs\":" + String(timerDisplay.getCountdownMs()) + ",";
+  json += "\"remainingMs\":" + String(timerDisplay.getRemainingMs()) + ",";
+  json += "\"lapTotal\":" + String(timerDisplay.getLapTotal()) + ",";
+  json += "\"laps\":[";
+  for (int i = 0; i < timerDisplay.getLapCount(); i++)
+  {
+    json += (i > 0 ? "," : "") + String(timerDisplay.getLap(i));
+  }
+  json += "]}";
+  return json;
+}
+
+void handleGetTimer()
+{
+  server.send(200, "application/json", getTimerJson());
+}
+
+void handleSetTimer()
+{
+  // Arguments: mode (off/stopwatch/countdown/hundredths), duration (countdown length in ms),
+  // action (start/stop/reset/lap).
+  TimerMode mode = timerDisplay.getMode();
+  uint32_t duration = 0;
+  bool hasDuration = false;
+  String action = "";
+
+  if (!forEachArg("invalid timer argument", [&](const String& name, const String& value)
+  {
+    bool valid = true;
+
+    if (name == "mode")
+    {
+      valid = TimerDisplay::parseMode(value.c_str(), mode);
+    }
+    else if (name == "duration")
+    {
+      valid = parseUnsignedArg(value, 10, TIMER_MAX_COUNTDOWN_MS, duration);
+      hasDuration = true;
+    }
+    else if (name == "action")
+    {
+      valid = (value == "start" || value == "stop" || value == "reset" || value == "lap");
+      action = value;
+    }
+    else
+    {
+      valid = false;
+    }
+
+    return valid;
+  }))
+  {
+    return;
+  }
+
+  timerDisplay.setMode(mode);
+  if (hasDuration)
+  {
+    timerDisplay.setCountdown(duration);
+  }
+
+  if (action == "start")
+  {
+    timerDisplay.start();
+  }
+  else if (action == "stop")
+  {
+    timerDisplay.stop();
+  }
+  else if (action == "reset")
+  {
+    timerDisplay.reset();
+  }
+  else if (action == "lap")
+  {
+    timerDisplay.lap();
+  }
+
+  server.send(200, "application/json", getTimerJson());
+}
+
+// Wraps a handler so its run time is recorded in the HTTP latency histogram
+WebServer::THandlerFunction timed(void (*handler)())
+{
+  return [handler]() {
+    unsigned long start = micros();
+    trackHeapLowWater();  // With the request parsed
+    handler();
+    httpLatencyHistogram.observe(micros() - start);
+    trackHeapLowWater();
+  };
+}
+
+String getMessagesJson()
+{
+  String json = "{";
+  json += "\"source\":\"" + String(flashMessages.isCustom() ? "custom" : "builtin") + "\",";
+  json += "\"messages\":[";
+  for (int i = 0; i < flashMessages.getCount(); i++)
+  {
+    json += (i > 0 ? ",\"" : "\"") + jsonEscape(flashMessages.getText(i)) + "\"";
+  }
+  json += "]}";
+  return json;
+}
+
+void handleGetMessages()
+{
+  server.send(200, "application/json", getMessagesJson());
+}
+
+void handleSetMessages()
+{
+  // messages: newline-separated list, rendered once into the message pool. An empty list restores the built-in set.
+  if (!server.hasArg("messages") || !flashMessages.setCustom(server.arg("messages").c_str()))
+  {
+    server.send(400, "application/json", "{\"error\":\"invalid messages\",\"name\":\"messages\"}");
+    return;
+  }
+
+  LOG_INFO(LOG_TAG_WEB, "Flash messages updated through API.");
+  server.send(200, "application/json", getMessagesJson());
+}
+
+String getAnimationJson()
+{
+  String json = "{";
+  json += "\"loaded\":" + String(animation.isLoaded() ? "true" : "false") + ",";
+  json += "\"running\":" + String(animation.isRunning() ? "true" : "false") + ",";
+  json += "\"size\":" + String(animation.getCodeLength()) + ",";
+  json += "\"pc\":" + String(animation.getPc()) + ",";
+  json += "\"budget\":" + String(animation.getBudget()) + ",";
+  json += "\"ticks\":" + String(animation.getTicks()) + ",";
+  json += "\"instructions\":" + String(animation.getInstructions()) + ",";
+  json += "\"budgetHits\":" + String(animation.getBudgetHits());
+  json += "}";
+  return json;
+}
+
+void handleGetAnimation()
+{
+  server.send(200, "application/json", getAnimationJson());
+}
+
+void handleSetAnimation()
+{
+  // Arguments: script (compiled script as hex, see tools/vfd_anim.py; stored and started unless action=stop),
+  // action (start/stop/clear).
+  String action = "";
+  bool hasScript = false;
+  String script;
+
+  if (!forEachArg("invalid animation argument", [&](const String& name, const String& value)
+  {
+    bool valid = true;
+
+    if (name == "script")
+    {
+      hasScript = true;
+      script = value;
+    }
+    else if (name == "action")
+    {
+      valid = (value == "start" || value == "stop" || value == "clear");
+      action = value;
+    }
+    else
+    {
+      valid = false;
+    }
+
+    return valid;
+  }))
+  {
+    return;
+  }
+
+  if (hasScript)
+  {
+    AnimError error = animation.loadHex(script.c_str());
+    if (error != ANIM_OK)
+    {
+      server.send(400, "application/json", "{\"error\":\"invalid script\",\"reason\":\"" + String(AnimationVM::getErrorName(error)) +
+                  "\",\"offset\":" + String(animation.getErrorOffset()) + "}");
+      return;
+    }
+    animation.save();
+    LOG_INFO(LOG_TAG_WEB, "Animation script uploaded through API: %u bytes", animation.getCodeLength());
+
+    if (action == "")
+    {
+      action = "start";
+    }
+  }
+
+  if (action == "start")
+  {
+    animation.start();
+  }
+  else if (action == "stop")
+  {
+    animation.stop();
+  }
+  else if (action == "clear")
+  {
+    animation.clear();
+  }
+
+  server.send(200, "application/json", getAnimationJson());
+}
+
+String getRecordingJson()
+{
+  File file = LittleFS.open(RECORDING_PATH, FILE_READ);
+  size_t size = file ? file.size() : 0;
+  file.close();
+
+  String json = "{";
+  json += "\"stored\":" + String(size > 0 ? "true" : "false") + ",";
+  json += "\"size\":" + String(size) + ",";
+  json += "\"recording\":" + String(frameRecorder.isRecording() ? "true" : "false") + ",";
+  json += "\"recordedRecords\":" + String(frameRecorder.getRecords()) + ",";
+  json += "\"playing\":" + String(framePlayer.isPlaying() ? "true" : "false") + ",";
+  json += "\"loop\":" + String(framePlayer.isLooping() ? "true" : "false") + ",";
+  json += "\"playedRecords\":" + String(framePlayer.getRecordsPlayed()) + ",";
+  json += "\"loops\":" + String(framePlayer.getLoops()) + ",";
+  json += "\"maxLateUs\":" + String(framePlayer.getMaxLateUs()) + ",";
+  json += "\"fsUsed\":" + String(LittleFS.usedBytes()) + ",";
+  json += "\"fsTotal\":" + String(LittleFS.totalBytes());
+  json += "}";
+  return json;
+}
+
+void handleGetRecording()
+{
+  server.send(200, "application/json", getRecordingJson());
+}
+
+void handleSetRecording()
+{
+  // Arguments: action (record/stop/play/delete), loop (play the recording repeatedly)
+  String action = "";
+  bool loop = false;
+
+  if (!forEachArg("invalid recording argument", [&](const String& name, const String& value)
+  {
+    bool valid = true;
+
+    if (name == "action")
+    {
+      valid = (value == "record" || value == "stop" || value == "play" || value == "delete");
+      action = value;
+    }
+    else if (name == "loop")
+    {
+      valid = parseBoolArg(value, loop);
+    }
+    else
+    {
+      valid = false;
+    }
+
+    return valid;
+  }))
+  {
+    return;
+  }
+
+  // Recorder and player share the file, so only one of them runs at a time
+  if (action == "record")
+  {
+    framePlayer.stop();
+    if (!frameRecorder.start(RECORDING_PATH))
+    {
+      server.send(500, "application/json", "{\"error\":\"cannot create recording\"}");
+      return;
+    }
+    LOG_INFO(LOG_TAG_MEDIA, "Recording the display to %s", RECORDING_PATH);
+  }
+  else if (action == "play")
+  {
+    frameRecorder.stop();
+    if (!framePlayer.start(RECORDING_PATH, loop))
+    {
+      server.send(400, "application/json", "{\"error\":\"no valid recording\"}");
+      return;
+    }
+    LOG_INFO(LOG_TAG_MEDIA, "Playing %s%s", RECORDING_PATH, loop ? " in a loop" : "");
+  }
+  else if (action == "stop")
+  {
+    frameRecorder.stop();
+    framePlayer.stop();
+  }
+  else if (action == "delete")
+  {
+    frameRecorder.stop();
+    framePlayer.stop();
+    LittleFS.remove(RECORDING_PATH);
+  }
+
+  server.send(200, "application/json", getRecordingJson());
+}
+
+void handleRecordingUpload()
+{
+  // Multipart upload, written to a separate file one chunk at a time so the current recording survives a failed
+  // or invalid upload. The rest of an oversized upload is read and dropped.
+  static File uploadFile;
+  HTTPUpload& upload = server.upload();
+
+  if (upload.status == UPLOAD_FILE_START)
+  {
+    uploadFile = LittleFS.open(RECORDING_UPLOAD_PATH, FILE_WRITE);
+    recordingUploadOk = (bool)uploadFile;
+    recordingUploadTooLarge = false;
+  }
+  else if (upload.status == UPLOAD_FILE_WRITE)
+  {
+    // totalSize does not include the chunk being handed over yet
+    if (upload.totalSize + upload.currentSize > RECORDING_MAX_BYTES)
+    {
+      recordingUploadTooLarge = true;
+      recordingUploadOk = false;
+    }
+    if (recordingUploadOk && uploadFile.write(upload.buf, upload.currentSize) != upload.currentSize)
+    {
+      recordingUploadOk = false;
+    }
+  }
+  else
+  {
+    uploadFile.close();
+    if (upload.status == UPLOAD_FILE_ABORTED)
+    {
+      recordingUploadOk = false;
+    }
+  }
+}
+
+void handleUploadRecording()
+{
+  if (recordingUploadTooLarge)
+  {
+    LittleFS.remove(RECORDING_UPLOAD_PATH);
+    server.send(413, "application/json", "{\"error\":\"recording too large\",\"maxBytes\":" + String(RECORDING_MAX_BYTES) + "}");
+    return;
+  }
+  if (!recordingUploadOk || !FramePlayer::isValidFile(RECORDING_UPLOAD_PATH))
+  {
+    LittleFS.remove(RECORDING_UPLOAD_PATH);
+    server.send(400, "application/json", "{\"error\":\"invalid recording\"}");
+    return;
+  }
+
+  // Recorder and player share the recording file, so both stop before it is replaced
+  frameRecorder.stop();
+  framePlayer.stop();
+  if (!LittleFS.rename(RECORDING_UPLOAD_PATH, RECORDING_PATH))
+  {
+    LittleFS.remove(RECORDING_UPLOAD_PATH);
+    server.send(500, "application/json", "{\"error\":\"cannot store recording\"}");
+    return;
+  }
+
+  LOG_INFO(LOG_TAG_WEB, "Recording uploaded through API.");
+  server.send(200, "application/json", getRecordingJson());
+}
+
+void handleDownloadRecording()
+{
+  File file = LittleFS.open(RECORDING_PATH, FILE_READ);
+  if (!file)
+  {
+    server.send(404, "application/json", "{\"error\":\"no recording\"}");
+    return;
+  }
+
+  server.streamFile(file, "application/octet-stream");
+  file.close();
+}
+
+void handleGetLog()
+{
+  // The most recent log lines, as printed on Serial
+  server.send(200, "text/plain", logger.getHistory());
+}
+
+void handleSetLog()
+{
+  // Arguments: level (none/error/warn/info/debug), tag (apply the level to one module only).
+  // Levels above the compile-time LOG_LEVEL stay compiled out.
+  bool hasLevel = false;
+  uint8_t level = LOG_LEVEL;
+  bool hasTag = false;
+  LogTag tag = LOG_TAG_SYSTEM;
+
+  if (!forEachArg("invalid log argument", [&](const String& name, const String& value)
+  {
+    bool valid = true;
+
+    if (name == "level")
+    {
+      valid = Logger::parseLevel(value, level);
+      hasLevel = true;
+    }
+    else if (name == "tag")
+    {
+      valid = Logger::parseTag(value, tag);
+      hasTag = true;
+    }
+    else
+    {
+      valid = false;
+    }
+
+    return valid;
+  }))
+  {
+    return;
+  }
+
+  if (hasLevel && hasTag)
+  {
+    logger.setLevel(tag, level);
+  }
+  else if (hasLevel)
+  {
+    logger.setLevel(level);
+  }
+
+  String json = "{";
+  json += "\"compiledLevel\":\"" + String(Logger::getLevelName(LOG_LEVEL)) + "\",";
+  json += "\"written\":" + String(logger.getWritten()) + ",";
+  json += "\"dropped\":" + String(logger.getDropped()) + ",";
+  json += "\"levels\":{";
+  for (uint8_t i = 0; i < LOG_TAG_COUNT; i++)
+  {
+    json += (i > 0 ? ",\"" : "\"") + String(Logger::getTagName((LogTag)i)) + "\":\"" + Logger::getLevelName(logger.getLevel((LogTag)i)) + "\"";
+  }
+  json += "}}";
+  server.send(200, "application/json", json);
+}
+
+String getDutyJson()
+{
+  const DutyAnalyzer& duty = vfdDisplay.getDutyAnalyzer();
+
+  String json = "{";
+  json += "\"ready\":" + String(duty.isReady() ? "true" : "false") + ",";
+  json += "\"windowMs\":" + String(duty.getWindowUs() / 1000) + ",";
+  json += "\"refreshHz\":" + String(duty.getRefreshRate(), 1) + ",";
+  json += "\"minSlotUs\":" + String(duty.getMinSlotUs()) + ",";
+  json += "\"maxSlotUs\":" + String(duty.getMaxSlotUs()) + ",";
+  json += "\"imbalancePercent\":" + String(duty.getImbalancePercent(), 2) + ",";
+  json += "\"thresholdPercent\":" + String(duty.getThreshold()) + ",";
+  json += "\"alert\":" + String(duty.isAlert() ? "true" : "false") + ",";
+  json += "\"alerts\":" + String(duty.getAlerts()) + ",";
+  json += "\"digits\":[";
+  for (uint8_t i = 0; i < duty.getNumDigits(); i++)
+  {
+    json += (i > 0 ? "," : "");
+    json += "{\"dutyPercent\":" + String(duty.getDutyPercent(i), 2) + ",\"litUs\":" + String(duty.getLitUs(i)) +
+            ",\"expectedUs\":" + String(duty.getExpectedUs(i)) + "}";
+  }
+  json += "]";
+  json += "}";
+  return json;
+}
+
+void handleGetDuty()
+{
+  server.send(200, "application/json", getDutyJson());
+}
+
+void handleSetDuty()
+{
+  // Arguments: threshold (imbalance in percent that raises the alert), reset (start a new window)
+  bool hasThreshold = false;
+  uint32_t threshold = 0;
+  bool reset = false;
+
+  if (!forEachArg("invalid duty argument", [&](const String& name, const String& value)
+  {
+    bool valid = true;
+
+    if (name == "threshold")
+    {
+      valid = parseUnsignedArg(value, 1, 100, threshold);
+      hasThreshold = true;
+    }
+    else if (name == "reset")
+    {
+      valid = parseBoolArg(value, reset);
+    }
+    else
+    {
+      valid = false;
+    }
+
+    return valid;
+  }))
+  {
+    return;
+  }
+
+  DutyAnalyzer& duty = vfdDisplay.getDutyAnalyzer();
+  if (hasThreshold)
+  {
+    duty.setThreshold(threshold);
+  }
+  if (reset)
+  {
+    duty.reset();
+  }
+
+  server.send(200, "application/json", getDutyJson());
+}
+
+String getHeapJson()
+{
+  char address[12];
+
+  String json = "{";
+  json += "\"tracking\":" + String(heapProfiler.isTracking() ? "true" : "false") + ",";
+  json += "\"freeHeap\":" + String(ESP.getFreeHeap()) + ",";
+  json += "\"minFreeHeap\":" + String(ESP.getMinFreeHeap()) + ",";
+  json += "\"largestFreeBlock\":" + String(ESP.getMaxAllocHeap()) + ",";
+  json += "\"lowestLargestFreeBlock\":" + String(heapProfiler.getLowestLargestBlock()) + ",";
+  json += "\"allocations\":" + String(heapProfiler.getAllocations()) + ",";
+  json += "\"frees\":" + String(heapProfiler.getFrees()) + ",";
+  json += "\"failures\":" + String(heapProfiler.getFailures()) + ",";
+  json += "\"bytes\":" + String(heapProfiler.getBytes()) + ",";
+  json += "\"loopAllocations\":" + String(heapProfiler.getLoopAllocations()) + ",";
+  json += "\"loopBytes\":" + String(heapProfiler.getLoopBytes()) + ",";
+
+  HeapCallSite sites[HEAP_CALL_SITES];
+  uint32_t otherCount = 0;
+  uint32_t otherBytes = 0;
+  uint8_t count = heapProfiler.getCallSites(sites, HEAP_CALL_SITES, otherCount, otherBytes);
+  json += "\"sites\":[";
+  for (uint8_t i = 0; i < count; i++)
+  {
+    snprintf(address, sizeof(address), "0x%08lx", (unsigned long)sites[i].address);
+    json += (i > 0 ? "," : "");
+    json += "{\"address\":\"" + String(address) + "\",\"count\":" + String(sites[i].count) + ",\"bytes\":" + String(sites[i].bytes) + "}";
+  }
+  json += "],";
+  json += "\"otherSites\":{\"count\":" + String(otherCount) + ",\"bytes\":" + String(otherBytes) + "},";
+
+  count = heapProfiler.getGuardSites(sites, HEAP_GUARD_SITES);
+  json += "\"guard\":{";
+  json += "\"armed\":" + String(heapProfiler.isGuardArmed() ? "true" : "false") + ",";
+  json += "\"abort\":" + String(heapProfiler.isGuardAbort() ? "true" : "false") + ",";
+  json += "\"violations\":" + String(heapProfiler.getViolations()) + ",";
+  json += "\"sites\":[";
+  for (uint8_t i = 0; i < count; i++)
+  {
+    snprintf(address, sizeof(address), "0x%08lx", (unsigned long)sites[i].address);
+    json += (i > 0 ? "," : "");
+    json += "{\"address\":\"" + String(address) + "\",\"size\":" + String(sites[i].count) + "}";
+  }
+  json += "]},";
+
+  json += "\"history\":[";
+  for (uint8_t i = 0; i < heapProfiler.getSampleCount(); i++)
+  {
+    const HeapSample& sample = heapProfiler.getSample(i);
+    json += (i > 0 ? "," : "");
+    json += "{\"uptimeS\":" + String(sample.uptimeS) + ",\"freeHeap\":" + String(sample.freeBytes) +
+            ",\"largestFreeBlock\":" + String(sample.largestBlock) + ",\"allocations\":" + String(sample.allocations) + "}";
+  }
+  json += "]";
+  json += "}";
+  return json;
+}
+
+void handleGetHeap()
+{
+  server.send(200, "application/json", getHeapJson());
+}
+
+void handleSetHeap()
+{
+  // Arguments: action (guard = arm the steady-state guard, disarm, reset = clear the counters, call sites and
+  // violations), abort (with guard: panic at the first violation).
+  String action = "";
+  bool abortOnViolation = false;
+
+  if (!forEachArg("invalid heap argument", [&](const String& name, const String& value)
+  {
+    bool valid = true;
+
+    if (name == "action")
+    {
+      valid = (value == "guard" || value == "disarm" || value == "reset");
+      action = value;
+    }
+    else if (name == "abort")
+    {
+      valid = parseBoolArg(value, abortOnViolation);
+    }
+    else
+    {
+      valid = false;
+    }
+
+    return valid;
+  }))
+  {
+    return;
+  }
+
+  if (action == "guard" && !heapProfiler.isTracking())
+  {
+    server.send(400, "application/json", "{\"error\":\"allocation tracking is not compiled in (build with -DHEAP_PROFILE)\"}");
+    return;
+  }
+
+  if (action == "guard")
+  {
+    heapProfiler.resetGuard();
+    heapProfiler.armGuard(abortOnViolation);
+  }
+  else if (action == "disarm")
+  {
+    heapProfiler.disarmGuard();
+  }
+  else if (action == "reset")
+  {
+    heapProfiler.resetCounters();
+    heapProfiler.resetGuard();
+  }
+
+  server.send(200, "application/json", getHeapJson());
+}
+
+String getPowerJson()
+{
+  char text[32];
+
+  String json = "{";
+  json += "\"mode\":\"" + String(PowerManager::getModeName(powerManager.getMode())) + "\",";
+  json += "\"level\":" + String(powerManager.getLevel()) + ",";
+  json += "\"phase\":\"" + String(PowerManager::getPhaseName(powerManager.getPhase())) + "\",";
+  json += "\"state\":\"" + String(PowerManager::getStateName(powerManager.getState())) + "\",";
+  json += "\"activeSchedule\":" + String(powerManager.getActiveSchedule()) + ",";
+  json += "\"override\":" + String(powerManager.isOverridden() ? "true" : "false") + ",";
+  json += "\"overrideRemainingS\":" + String(powerManager.getOverrideRemainingS()) + ",";
+  json += "\"lowPower\":" + String(powerManager.isLowPower() ? "true" : "false") + ",";
+  json += "\"lightSleep\":" + String(powerManager.isLightSleep() ? "true" : "false") + ",";
+  json += "\"filamentLevel\":" + String(filament.getLevel()) + ",";
+  json += "\"transitions\":" + String(powerManager.getTransitions()) + ",";
+
+  json += "\"schedules\":[";
+  for (uint8_t i = 0; i < POWER_SCHEDULES; i++)
+  {
+    const PowerSchedule& schedule = clockConfig.powerSchedules[i];
+    json += (i > 0 ? "," : "");
+    snprintf(text, sizeof(text), "%02u:%02u", schedule.startMinute / 60, schedule.startMinute % 60);
+    json += "{\"start\":\"" + String(text) + "\",";
+    snprintf(text, sizeof(text), "%02u:%02u", schedule.endMinute / 60, schedule.endMinute % 60);
+    json += "\"end\":\"" + String(text) + "\",";
+    PowerManager::formatDays(schedule.days, text, sizeof(text));
+    json += "\"days\":\"" + String(text) + "\",";
+    json += "\"mode\":\"" + String(PowerManager::getModeName((PowerMode)schedule.mode)) + "\",";
+    json += "\"level\":" + String(schedule.level) + "}";
+  }
+  json += "],";
+
+  // Residency in seconds, and the part of it the loop slept
+  json += "\"residency\":{";
+  for (uint8_t i = 0; i < POWER_STATE_COUNT; i++)
+  {
+    json += (i > 0 ? ",\"" : "\"") + String(PowerManager::getStateName((PowerState)i)) + "\":{";
+    json += "\"seconds\":" + String(powerManager.getResidencyMs((PowerState)i) / 1000.0, 1) + ",";
+    json += "\"sleepSeconds\":" + String(powerManager.getSleepMs((PowerState)i) / 1000.0, 1) + "}";
+  }
+  json += "}";
+  json += "}";
+  return json;
+}
+
+void handleGetPower()
+{
+  server.send(200, "application/json", getPowerJson());
+}
+
+void handleSetPower()
+{
+  // Arguments: schedule (window index) with any of start and end (HH:MM), days (daily, weekdays, weekends, none,
+  // a list like mon,tue or a bit mask), mode (dim or off) and level (dim brightness scale); override (auto, on, dim
+  // or off) with minutes (0 = until set back to auto) and level; reset (clear the residency).
+  bool hasSchedule = false;
+  uint32_t scheduleIndex = 0;
+  bool hasStart = false;
+  uint16_t start = 0;
+  bool hasEnd = false;
+  uint16_t end = 0;
+  bool hasDays = false;
+  uint8_t days = 0;
+  bool hasMode = false;
+  PowerMode mode = POWER_MODE_OFF;
+  bool hasLevel = false;
+  uint32_t level = NIGHT_DIM_LEVEL;
+  bool hasOverride = false;
+  bool overrideAuto = false;
+  PowerMode overrideMode = POWER_MODE_ON;
+  uint32_t minutes = 0;
+  bool reset = false;
+
+  if (!forEachArg("invalid power argument", [&](const String& name, const String& value)
+  {
+    bool valid = true;
+
+    if (name == "schedule")
+    {
+      valid = parseUnsignedArg(value, 0, POWER_SCHEDULES - 1, scheduleIndex);
+      hasSchedule = true;
+    }
+    else if (name == "start")
+    {
+      valid = PowerManager::parseTime(value.c_str(), start);
+      hasStart = true;
+    }
+    else if (name == "end")
+    {
+      valid = PowerManager::parseTime(value.c_str(), end);
+      hasEnd = true;
+    }
+    else if (name == "days")
+    {
+      valid = PowerManager::parseDays(value.c_str(), days);
+      hasDays = true;
+    }
+    else if (name == "mode")
+    {
+      valid = PowerManager::parseMode(value.c_str(), mode) && mode != POWER_MODE_ON;
+      hasMode = true;
+    }
+    else if (name == "level")
+    {
+      valid = parseUnsignedArg(value, 0, MAX6921_MAX_BRIGHTNESS, level);
+      hasLevel = true;
+    }
+    else if (name == "override")
+    {
+      overrideAuto = (value == "auto");
+      valid = overrideAuto || PowerManager::parseMode(value.c_str(), overrideMode);
+      hasOverride = true;
+    }
+    else if (name == "minutes")
+    {
+      valid = parseUnsignedArg(value, 0, POWER_MAX_OVERRIDE_MINUTES, minutes);
+    }
+    else if (name == "reset")
+    {
+      valid = parseBoolArg(value, reset);
+    }
+    else
+    {
+      valid = false;
+    }
+
+    return valid;
+  }))
+  {
+    return;
+  }
+
+  // The window fields only make sense with the window they change
+  if (!hasSchedule && (hasStart || hasEnd || hasDays || hasMode))
+  {
+    server.send(400, "application/json", "{\"error\":\"invalid power argument\",\"name\":\"schedule\"}");
+    return;
+  }
+
+  if (hasSchedule)
+  {
+    PowerSchedule& schedule = clockConfig.powerSchedules[scheduleIndex];
+    if (hasStart)
+    {
+      schedule.startMinute = start;
+    }
+    if (hasEnd)
+    {
+      schedule.endMinute = end;
+    }
+    if (hasDays)
+    {
+      schedule.days = days;
+    }
+    if (hasMode)
+    {
+      schedule.mode = mode;
+    }
+    if (hasLevel || (hasMode && schedule.level == 0))
+    {
+      schedule.level = level;
+    }
+    configStore.markDirty();
+    LOG_INFO(LOG_TAG_POWER, "Night mode window %lu: %02u:%02u-%02u:%02u, days 0x%02x, %s", (unsigned long)scheduleIndex,
+             schedule.startMinute / 60, schedule.startMinute % 60, schedule.endMinute / 60, schedule.endMinute % 60,
+             schedule.days, PowerManager::getModeName((PowerMode)schedule.mode));
+  }
+
+  if (hasOverride && overrideAuto)
+  {
+    powerManager.clearOverride();
+  }
+  else if (hasOverride)
+  {
+    powerManager.setOverride(overrideMode, level, minutes);
+  }
+
+  if (reset)
+  {
+    powerManager.resetResidency();
+  }
+
+  // Start the sequence now rather than at the next power task
+  updatePower();
+
+  server.send(200, "application/json", getPowerJson());
+}
+
+#ifdef TRACE
+String getTraceJson()
+{
+  String json = "{";
+  json += "\"recorded\":" + String(traceBuffer.getRecorded()) + ",";
+  json += "\"capacity\":" + String(TRACE_BUFFER_EVENTS) + ",";
+  json += "\"paused\":" + String(traceBuffer.isPaused() ? "true" : "false") + ",";
+  json += "\"triggerUs\":" + String(traceBuffer.getTrigger());
+  json += "}";
+  return json;
+}
+
+void handleGetTrace()
+{
+  server.send(200, "application/json", getTraceJson());
+}
+
+void handleSetTrace()
+{
+  // Arguments: action (pause/resume/clear), trigger (pause once a digit stays lit this many us, 0 = never)
+  String action = "";
+  bool hasTrigger = false;
+  uint32_t trigger = 0;
+
+  if (!forEachArg("invalid trace argument", [&](const String& name, const String& value)
+  {
+    bool valid = true;
+
+    if (name == "action")
+    {
+      valid = (value == "pause" || value == "resume" || value == "clear");
+      action = value;
+    }
+    else if (name == "trigger")
+    {
+      valid = parseUnsignedArg(value, 0, 10000000, trigger);
+      hasTrigger = true;
+    }
+    else
+    {
+      valid = false;
+    }
+
+    return valid;
+  }))
+  {
+    return;
+  }
+
+  if (hasTrigger)
+  {
+    traceBuffer.setTrigger(trigger);
+  }
+
+  if (action == "pause")
+  {
+    traceBuffer.pause();
+  }
+  else if (action == "resume")
+  {
+    traceBuffer.resume();
+  }
+  else if (action == "clear")
+  {
+    traceBuffer.clear();
+  }
+
+  server.send(200, "application/json", getTraceJson());
+}
+
+void handleDownloadTrace()
+{
+  // Binary ring buffer dump, converted by tools/vfd_trace.py
+  traceBuffer.send(server);
+}
+#endif
+
+void handleMetrics()
+{
+  // Prometheus text format, streamed in small chunks
+  MetricsWriter metrics(server);
+  metrics.begin();
+
+  metrics.gauge("vfd_uptime_seconds", "Time since boot.", millis() / 1000.0);
+  metrics.histogram("vfd_loop_interval_seconds", "Time between loop() iterations.", loopTimeHistogram, 1e-6);
+  metrics.gauge("vfd_loop_sleep_ratio", "Fraction of the time since boot the loop spent sleeping between deadlines.", scheduler.getSleepTotalUs() / (millis() * 1000.0 + 1));
+  metrics.counter("vfd_loop_wakeups_total", "Times the loop slept until the next deadline.", scheduler.getWakeCount());
+  metrics.histogram("vfd_refresh_interval_seconds", "On-time of each multiplexed digit (time between digit switches).", refreshIntervalHistogram, 1e-6);
+  const DutyAnalyzer& duty = vfdDisplay.getDutyAnalyzer();
+  metrics.gauge("vfd_refresh_rate_hz", "Full multiplex passes over all digits per second, last 1 s window.", duty.getRefreshRate());
+  metrics.gauge("vfd_refresh_slot_max_seconds", "Longest digit slot in the last 1 s window.", duty.getMaxSlotUs() * 1e-6);
+  metrics.gauge("vfd_digit_duty_imbalance_ratio", "Spread of the per-digit actual/expected on-time ratios, last 1 s window.", duty.getImbalancePercent() / 100.0);
+  metrics.counter("vfd_digit_duty_alerts_total", "Times the per-digit on-time imbalance rose above the threshold.", duty.getAlerts());
+  metrics.counter("vfd_log_messages_total", "Log messages queued.", logger.getWritten());
+  metrics.counter("vfd_log_dropped_total", "Log messages dropped because the log buffer was full.", logger.getDropped());
+  metrics.gauge("vfd_boost_voltage_volts", "Last measured boost converter output voltage.", boostVoltage);
+  metrics.gauge("vfd_boost_target_volts", "Boost converter target voltage.", clockConfig.targetVoltage);
+  metrics.gauge("vfd_boost_error_volts", "Target minus measured boost voltage.", regulatorError);
+  metrics.gauge("vfd_boost_duty_cycle", "Boost converter PWM duty cycle (0-255).", boostDutyCycle);
+  metrics.histogram("vfd_boost_error_abs_volts", "Absolute boost regulation error per regulator pass.", regulatorErrorHistogram, 1e-3);
+  metrics.counter("vfd_adc_read_failures_total", "MCP3221 reads that returned no data.", mcp3221.getReadFailures());
+  metrics.counter("vfd_adc_disconnected_total", "Regulator passes skipped because the MCP3221 did not respond.", adcDisconnectedCount);
+  metrics.gauge("vfd_heap_free_bytes", "Free heap.", ESP.getFreeHeap());
+  metrics.gauge("vfd_heap_min_free_bytes", "Lowest free heap since boot.", ESP.getMinFreeHeap());
+  metrics.gauge("vfd_heap_largest_free_block_bytes", "Largest allocatable heap block.", ESP.getMaxAllocHeap());
+  metrics.counter("vfd_heap_allocations_total", "Heap allocations on all tasks (0 unless built with -DHEAP_PROFILE).", heapProfiler.getAllocations());
+  metrics.counter("vfd_heap_loop_allocations_total", "Heap allocations on the loop task (0 unless built with -DHEAP_PROFILE).", heapProfiler.getLoopAllocations());
+  metrics.counter("vfd_heap_guard_violations_total", "Allocations on the loop task while the steady-state guard was armed.", heapProfiler.getViolations());
+  metrics.gauge("vfd_power_state", "Night mode state: 0 on, 1 dimmed, 2 off, 3 switching, 4 standby (off with the filament warm).", powerManager.getState());
+  metrics.counter("vfd_power_on_seconds_total", "Time the tube was on and not dimmed.", powerManager.getResidencyMs(POWER_STATE_ON) / 1000);
+  metrics.counter("vfd_power_dim_seconds_total", "Time the tube was dimmed by night mode.", powerManager.getResidencyMs(POWER_STATE_DIM) / 1000);
+  metrics.counter("vfd_power_off_seconds_total", "Time the tube, boost and filament were off.", powerManager.getResidencyMs(POWER_STATE_OFF) / 1000);
+  metrics.counter("vfd_power_standby_seconds_total", "Time the tube was off with the filament kept warm.", powerManager.getResidencyMs(POWER_STATE_STANDBY) / 1000);
+  metrics.counter("vfd_power_transition_seconds_total", "Time spent sequencing the tube off or on.", powerManager.getResidencyMs(POWER_STATE_TRANSITION) / 1000);
+  metrics.counter("vfd_power_off_sleep_seconds_total", "Time the loop slept while the tube was off or in standby.",
+                  (powerManager.getSleepMs(POWER_STATE_OFF) + powerManager.getSleepMs(POWER_STATE_STANDBY)) / 1000);
+  metrics.gauge("vfd_filament_level", "Filament PWM level (0-255).", filament.getLevel());
+  metrics.counter("vfd_power_transitions_total", "Completed switches of the tube to off or back on.", powerManager.getTransitions());
+  metrics.gauge("vfd_wifi_connected", "1 if Wi-Fi is connected.", WiFi.status() == WL_CONNECTED ? 1 : 0);
+  metrics.gauge("vfd_wifi_rssi_dbm", "Wi-Fi signal strength.", WiFi.status() == WL_CONNECTED ? WiFi.RSSI() : 0);
+  metrics.histogram("vfd_http_request_duration_seconds", "Web handler run time.", httpLatencyHistogram, 1e-6);
+  metrics.counter("vfd_frame_stream_received_total", "UDP frames received.", frameStream.getFramesReceived());
+  metrics.counter("vfd_frame_stream_played_total", "UDP frames shown.", frameStream.getFramesPlayed());
+  metrics.counter("vfd_frame_stream_dropped_late_total", "UDP frames dropped as late or out of order.", frameStream.getFramesDroppedLate());
+  metrics.counter("vfd_frame_stream_dropped_invalid_total", "Malformed UDP frames.", frameStream.getFramesDroppedInvalid());
+  metrics.counter("vfd_animation_instructions_total", "Animation VM instructions executed.", animation.getInstructions());
+  metrics.counter("vfd_animation_budget_exhausted_total", "Animation VM ticks cut off by the instruction budget.", animation.getBudgetHits());
+  metrics.counter("vfd_config_commits_total", "Configuration writes to flash.", configStore.getCommitCount());
+  metrics.gauge("vfd_ntp_offset_seconds", "Correction applied at the last NTP sync.", ntpClient.getLastOffset() * 1e-6);
+  metrics.gauge("vfd_ntp_round_trip_seconds", "Round trip of the sample used at the last NTP sync.", ntpClient.getLastRoundTrip() * 1e-6);
+  metrics.gauge("vfd_ntp_drift_ppm", "Learned crystal drift correction.", ntpClient.getDriftPpb() * 1e-3);
+  metrics.gauge("vfd_ntp_interval_seconds", "Current NTP sync interval.", ntpClient.getInterval());
+  metrics.counter("vfd_ntp_syncs_total", "Completed NTP syncs.", ntpClient.getSyncCount());
+  metrics.counter("vfd_ntp_failures_total", "NTP syncs without a usable reply.", ntpClient.getFailureCount());
+  metrics.counter("vfd_ntp_requests_total", "NTP requests sent.", ntpClient.getRequestsSent());
+
+  metrics.end();
+}
+
+// Static UI assets. URLs are versioned by content hash, so browsers may cache them forever.
+void sendCachedAsset(const char* contentType, const char* data, size_t length)
+{
+  server.sendHeader("Cache-Control", "public, max-age=31536000, immutable");
+  server.send_P(200, contentType, data, length);
+}
+
+#ifdef WEBUI_HAS_GZIP_ASSETS
+// The copies compressed at build time (webui_assets.h), for clients that accept gzip; false if the client does not
+bool sendCompressedAsset(const char* contentType, const uint8_t* data, size_t length)
+{
+  server.sendHeader("Vary", "Accept-Encoding");
+  if (server.header("Accept-Encoding").indexOf("gzip") < 0) return false;
+
+  server.sendHeader("Content-Encoding", "gzip");
+  sendCachedAsset(contentType, (const char*)data, length);
+  return true;
+}
+#endif
+
+void handleUiCss()
+{
+#ifdef WEBUI_HAS_GZIP_ASSETS
+  if (sendCompressedAsset("text/css", WEBUI_CSS_GZ, sizeof(WEBUI_CSS_GZ))) return;
+#endif
+
+  // Font faces and the main stylesheet are stored separately; send them as one response
+  server.sendHeader("Cache-Control", "public, max-age=31536000, immutable");
+  server.setContentLength(strlen(WEBUI_FONT_CSS) + strlen(WEBUI_CSS));
+  server.send(200, "text/css", "");
+  server.sendContent(WEBUI_FONT_CSS, strlen(WEBUI_FONT_CSS));
+  server.sendContent(WEBUI_CSS, strlen(WEBUI_CSS));
+}
+
+void handleUiJs()
+{
+#ifdef WEBUI_HAS_GZIP_ASSETS
+  if (sendCompressedAsset("application/javascript", WEBUI_JS_GZ, sizeof(WEBUI_JS_GZ))) return;
+#endif
+  sendCachedAsset("application/javascript", WEBUI_JS, strlen(WEBUI_JS));
+}
+
+void handleNotFound()
+{
+  server.send(404, "text/plain", "Not Found");
 }
\ No newline at end of file
@@ -0,0 +1,130 @@
+#include "marquee.h"
+
+static const char* MARQUEE_MODE_NAMES[] = { "left", "right", "bounce" };
+
+Marquee::Marquee(MAX6921& display)
+  : display(display), length(0), mode(MARQUEE_LEFT), stepMs(250), pauseMs(1000),
+    offset(0), direction(1), lastStep(0), holdMs(0), invalidated(true)
+{
+  memset(strip, 0, sizeof(strip));
+  memset(shown, 0, sizeof(shown));
+}
+
+void Marquee::setText(const char* text)
+{
+  length = display.renderText(text, strip, MARQUEE_MAX_LENGTH);
+  restart();
+}
+
+void Marquee::setScroll(MarqueeMode newMode, uint16_t newStepMs, uint16_t newPauseMs)
+{
+  if (newMode > MARQUEE_BOUNCE) {
+    newMode = MARQUEE_LEFT;
+  }
+  newStepMs = constrain(newStepMs, MARQUEE_MIN_STEP_MS, MARQUEE_MAX_STEP_MS);
+  newPauseMs = min(newPauseMs, (uint16_t)MARQUEE_MAX_PAUSE_MS);
+
+  if (newMode == mode && newStepMs == stepMs && newPauseMs == pauseMs) return;
+
+  mode = newMode;
+  stepMs = newStepMs;
+  pauseMs = newPauseMs;
+  restart();
+}
+
+void Marquee::restart()
+{
+  // Start with the beginning of the message on the tube (its end when scrolling right) and hold it there
+  offset = (mode == MARQUEE_RIGHT && isScrolling()) ? length - MARQUEE_DISPLAY_DIGITS : 0;
+  direction = 1;
+  lastStep = millis();
+  holdMs = stepMs + pauseMs;
+  invalidated = true;
+}
+
+bool Marquee::isPausePosition() const
+{
+  return offset == 0 || offset == length - MARQUEE_DISPLAY_DIGITS;
+}
+
+void Marquee::advance()
+{
+  int16_t last = length - MARQUEE_DISPLAY_DIGITS;
+
+  switch (mode) {
+    case MARQUEE_LEFT:
+      // One blank frame once the text has left, then it enters again from the right
+      if (++offset > length) {
+        offset = 1 - MARQUEE_DISPLAY_DIGITS;
+      }
+      break;
+
+    case MARQUEE_RIGHT:
+      if (--offset < -MARQUEE_DISPLAY_DIGITS) {
+        offset = length - 1;
+      }
+      break;
+
+    case MARQUEE_BOUNCE:
+      offset += direction;
+      if (offset >= last) {
+        offset = last;
+        direction = -1;
+      }
+      else if (offset <= 0) {
+        offset = 0;
+        direction = 1;
+      }
+      break;
+  }
+}
+
+void Marquee::update()
+{
+  if (isScrolling()) {
+    unsigned long now = millis();
+
+    if (now - lastStep >= holdMs) {
+      advance();
+      lastStep = now;
+      holdMs = isPausePosition() ? stepMs + pauseMs : stepMs;
+      render();
+      return;
+    }
+  }
+
+  if (invalidated) {
+    render();
+  }
+}
+
+void Marquee::render()
+{
+  for (uint8_t i = 0; i < MARQUEE_DISPLAY_DIGITS; i++) {
+    int16_t index = offset + i;
+    uint8_t segments = (index >= 0 && index < length) ? strip[index] : 0;
+
+    if (invalidated || segments != shown[i]) {
+      display.setDigitSegments(i, segments);
+      shown[i] = segments;
+    }
+  }
+
+  invalidated = false;
+}
+
+const char* Marquee::getModeName(MarqueeMode mode)
+{
+  return mode <= MARQUEE_BOUNCE ? MARQUEE_MODE_NAMES[mode] : "unknown";
+}
+
+bool Marquee::parseMode(const char* name, MarqueeMode& mode)
+{
+  for (uint8_t i = 0; i <= MARQUEE_BOUNCE; i++) {
+    if (strcmp(name, MARQUEE_MODE_NAMES[i]) == 0) {
+      mode = (MarqueeMode)i;
+      return true;
+    }
+  }
+  return false;
+}
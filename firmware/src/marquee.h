@@ -0,0 +1,72 @@
+#ifndef MARQUEE_H
+#define MARQUEE_H
+
+#include <Arduino.h>
+#include "max6921.h"
+
+// Scrolling text for messages longer than the tube.
+//
+// setText() renders the whole message into a strip of segment masks once (MAX6921::renderText, which folds
+// '.' into the previous character). Each scroll step then only moves a window offset over the strip and
+// writes the digits that changed, so a long message costs no more per frame than static text.
+// Text that fits the tube is shown without scrolling.
+
+#define MARQUEE_DISPLAY_DIGITS 8
+#define MARQUEE_MAX_LENGTH 64              // Strip length in digits (one per character after dot folding)
+#define MARQUEE_MIN_STEP_MS 50
+#define MARQUEE_MAX_STEP_MS 5000
+#define MARQUEE_MAX_PAUSE_MS 60000
+
+enum MarqueeMode : uint8_t {
+  MARQUEE_LEFT = 0,                      // Text moves to the left, re-entering from the right
+  MARQUEE_RIGHT,                         // Text moves to the right, re-entering from the left
+  MARQUEE_BOUNCE,                        // Text slides back and forth without leaving the tube
+};
+
+class Marquee {
+private:
+  MAX6921& display;
+
+  uint8_t strip[MARQUEE_MAX_LENGTH];
+  uint8_t length;
+
+  MarqueeMode mode;
+  uint16_t stepMs;
+  uint16_t pauseMs;                      // Extra hold when the start or end of the text is aligned with the tube
+
+  int16_t offset;                        // Strip index shown on the leftmost digit (may be negative)
+  int8_t direction;                      // Bounce direction, +1 or -1
+  unsigned long lastStep;
+  unsigned long holdMs;                  // How long the current position stays before the next step
+
+  uint8_t shown[MARQUEE_DISPLAY_DIGITS];
+  bool invalidated;
+
+  void restart();
+  void advance();
+  bool isPausePosition() const;
+  void render();
+
+public:
+  Marquee(MAX6921& display);
+
+  // Renders the text into the strip and restarts from the beginning of the message
+  void setText(const char* text);
+
+  void setScroll(MarqueeMode newMode, uint16_t newStepMs, uint16_t newPauseMs);
+
+  // Steps the window when due and redraws changed digits
+  void update();
+
+  // Force a full redraw, e.g. after something else was shown on the display
+  void invalidate() { invalidated = true; }
+
+  bool isScrolling() const { return length > MARQUEE_DISPLAY_DIGITS; }
+  uint8_t getLength() const { return length; }
+  MarqueeMode getMode() const { return mode; }
+
+  static const char* getModeName(MarqueeMode mode);
+  static bool parseMode(const char* name, MarqueeMode& mode);
+};
+
+#endif
@@ -1,4 +1,6 @@
 #include "max6921.h"
+#include "trace.h"
+#include <limits.h>
 
 MAX6921::MAX6921(int dinPin, int clkPin, int loadPin,
                  const uint8_t* digitPinMap, uint8_t numDigits,
@@ -6,7 +8,9 @@ MAX6921::MAX6921(int dinPin, int clkPin, int loadPin,
   : dinPin(dinPin), clkPin(clkPin), loadPin(loadPin),
     numDigits(numDigits), numSegments(numSegments),
     spiSettings(500000, MSBFIRST, SPI_MODE0), currentDigit(0), 
-    lastRefresh(0)
+    lastRefresh(0), brightness(MAX6921_MAX_BRIGHTNESS), litOnTime(MAX6921_REFRESH_INTERVAL_US), digitBlanked(false),
+    blankedAt(0), litPosition(MAX_DIGITS), dimLevel(MAX6921_MAX_BRIGHTNESS), blanked(false), maxRefreshGap(0), refreshGapTotal(0), refreshCount(0),
+    dutyAnalyzer(numDigits)
 {
   // Validate input parameters
   if (numDigits > MAX_DIGITS) {
@@ -26,14 +30,11 @@ MAX6921::MAX6921(int dinPin, int clkPin, int loadPin,
     segmentPins[i] = segmentPinMap[i];
   }
   
-  // Initialize display buffer
-  strcpy(displayBuffer, "        ");
-  for (int i = 0; i < numDigits; i++) {
-    digitsWithDots[i] = false;
+  // Initialize frame buffer (all segments off)
+  for (int i = 0; i < MAX_DIGITS; i++) {
+    frameBuffer[i] = 0;
+    digitLevels[i] = MAX6921_MAX_BRIGHTNESS;
   }
-  
-  // Initialize character map
-  initCharMap();
 }
 
 bool MAX6921::begin()
@@ -52,74 +53,10 @@ bool MAX6921::begin()
   return true;
 }
 
-void MAX6921::initCharMap()
-{
-  // Initialize all to 0
-  for (int i = 0; i < 128; i++) {
-    charMap[i] = 0;
-  }
-  
-  // Numbers
-  charMap['0'] = 0b00111111;  // ABCDEF
-  charMap['1'] = 0b00000110;  // BC
-  charMap['2'] = 0b01011011;  // ABDEG
-  charMap['3'] = 0b01001111;  // ABCDG
-  charMap['4'] = 0b01100110;  // BCFG
-  charMap['5'] = 0b01101101;  // ACDFG
-  charMap['6'] = 0b01111101;  // ACDEFG
-  charMap['7'] = 0b00000111;  // ABC
-  charMap['8'] = 0b01111111;  // ABCDEFG
-  charMap['9'] = 0b01101111;  // ABCDFG
-  
-  // Letters (A-Z)
-  charMap['A'] = 0b01110111;  // ABCEFG
-  charMap['B'] = 0b01111100;  // CDEFG
-  charMap['C'] = 0b00111001;  // ADEF
-  charMap['D'] = 0b01011110;  // BCDEG
-  charMap['E'] = 0b01111001;  // ADEFG
-  charMap['F'] = 0b01110001;  // AEFG
-  charMap['G'] = 0b00111101;  // ACDEF
-  charMap['H'] = 0b01110110;  // BCEFG
-  charMap['I'] = 0b00110000;  // EF
-  charMap['J'] = 0b00011110;  // BCDE
-  charMap['K'] = 0b01110110;  // BCEFG (same as 'H')
-  charMap['L'] = 0b00111000;  // DEF
-  charMap['M'] = 0b00010101;  // ACE (approximation)
-  charMap['N'] = 0b00110111;  // ABCEF
-  charMap['O'] = 0b00111111;  // ABCDEF
-  charMap['P'] = 0b01110011;  // ABEFG
-  charMap['Q'] = 0b01100111;  // ABCFG
-  charMap['R'] = 0b00110011;  // ABEF
-  charMap['S'] = 0b01101101;  // ACDFG
-  charMap['T'] = 0b01111000;  // DEFG
-  charMap['U'] = 0b00111110;  // BCDEF
-  charMap['V'] = 0b00011110;  // BCDE (approximation)
-  charMap['W'] = 0b00101010;  // BDG (approximation)
-  charMap['X'] = 0b01110110;  // BCEFG (approximation) (same as 'H')
-  charMap['Y'] = 0b01101110;  // BCDFG
-  charMap['Z'] = 0b01011011;  // ABDEG (same as '2')
-  
-  // Special characters
-  charMap[' '] = 0b00000000;  // All off
-  charMap['-'] = 0b01000000;  // G only
-  charMap['_'] = 0b00001000;  // D only
-  charMap['.'] = 0b10000000;  // H only (decimal point)
-  charMap[':'] = 0b01001000;  // DG
-  charMap['='] = 0b01001000;  // DG (same as colon)
-  charMap['!'] = 0b10000110;  // BC with decimal
-  charMap['?'] = 0b11010011;  // ABGEH
-  charMap['\''] = 0b00000010; // B only
-  charMap['"'] = 0b00100010;  // BF
-  charMap['<'] = 0b01110000;  // EFG
-  charMap['>'] = 0b01000011;  // ABG
-  charMap['['] = 0b00111001;  // ADEF
-  charMap[']'] = 0b00001111;  // ABCD
-  charMap['/'] = 0b01010010;  // BEG
-  charMap['\\'] = 0b01100100; // CFG
-}
-
 void MAX6921::writeToMAX6921(uint32_t data)
 {
+  TRACE_SCOPE(TRACE_SPI_WRITE);
+
   // Sends 3 bytes to the MAX6921
   // Stores them as [byte0, byte1, byte2] where:
   // byte0 contains bits for pins 16-23 (but reversed)
@@ -183,76 +120,184 @@ void MAX6921::displayDigit(uint8_t digitIndex, uint8_t segments)
   writeToMAX6921(data);
 }
 
-void MAX6921::refreshDisplay()
+unsigned long MAX6921::refreshDisplay()
 {
+  unsigned long now = micros();
+  unsigned long gap = 0;
+
+  if (blanked) {
+    // Clear the outputs once; nothing is lit until unblanked
+    if (litPosition != MAX_DIGITS) {
+      writeToMAX6921(0);
+      digitBlanked = true;
+      litPosition = MAX_DIGITS;
+      TRACE_DIGIT(TRACE_DIGIT_BLANK);
+    }
+    return 0;
+  }
+
   // Multiplex the display at ~1kHz (1ms per digit)
-  if (micros() - lastRefresh >= 1000) {
+  if (now - lastRefresh >= MAX6921_REFRESH_INTERVAL_US) {
+    TRACE_SCOPE(TRACE_REFRESH);
+
+    // Account the slot that ends here: how long its digit was actually lit against what its brightness asked for
+    gap = now - lastRefresh;
+    if (litPosition < numDigits) {
+      dutyAnalyzer.recordSlot(litPosition, gap, digitBlanked ? blankedAt - lastRefresh : gap, litOnTime);
+    }
+
     // Turn off all outputs first to prevent ghosting
     //writeToMAX6921(0);
 
-    // Get the character to display
-    char ch = displayBuffer[currentDigit];
-    uint8_t segments = 0;
+    // Display the digit (including spaces as blank); a digit dimmed to nothing is not lit at all
+    litOnTime = getOnTime(currentDigit);
+    if (litOnTime == 0) {
+      writeToMAX6921(0);
+      digitBlanked = true;
+      blankedAt = now;
+      TRACE_DIGIT(TRACE_DIGIT_BLANK);
+    }
+    else {
+      displayDigit(currentDigit, frameBuffer[currentDigit]);
+      digitBlanked = false;
+      TRACE_DIGIT(numDigits - 1 - currentDigit);
+    }
+
+    litPosition = numDigits - 1 - currentDigit;
+    currentDigit = (currentDigit + 1) % numDigits;
 
-    // Look up segments for this character
-    if (ch >= 0 && ch < 128) {
-      segments = charMap[(uint8_t)ch];
+    // Track how late the switch happened (the digit stays lit until the next one)
+    if (gap > maxRefreshGap) {
+      maxRefreshGap = gap;
     }
+    refreshGapTotal += gap;
+    refreshCount++;
 
-    // Check if the next character is a decimal point
-    if (currentDigit < numDigits && digitsWithDots[currentDigit]) {
-      segments |= 0x80;  // Turn on decimal point
+    lastRefresh = now;
+  }
+  else if (!digitBlanked && litOnTime < MAX6921_REFRESH_INTERVAL_US) {
+    // Dimming: blank the grid once the digit has been lit for its share of the slot
+    if (now - lastRefresh >= litOnTime) {
+      writeToMAX6921(0);
+      digitBlanked = true;
+      blankedAt = now;
+      TRACE_DIGIT(TRACE_DIGIT_BLANK);
     }
+  }
 
-    // Display the digit (including spaces as blank)
-    displayDigit(currentDigit, segments);
+  return gap;
+}
 
-    currentDigit = (currentDigit + 1) % numDigits;
+unsigned long MAX6921::getOnTime(uint8_t digitIndex) const
+{
+  // The digit's own level scales the global brightness, and the night mode level scales both
+  unsigned long level = (unsigned long)brightness * digitLevels[digitIndex];
+  unsigned long onTime = (level * MAX6921_REFRESH_INTERVAL_US) / ((unsigned long)MAX6921_MAX_BRIGHTNESS * MAX6921_MAX_BRIGHTNESS);
+  return (onTime * dimLevel) / MAX6921_MAX_BRIGHTNESS;
+}
 
-    lastRefresh = micros();
+unsigned long MAX6921::getMicrosToNextRefresh() const
+{
+  if (blanked) {
+    return litPosition == MAX_DIGITS ? ULONG_MAX : 0;
+  }
+
+  unsigned long elapsed = micros() - lastRefresh;
+  unsigned long due = MAX6921_REFRESH_INTERVAL_US;
+  if (!digitBlanked && litOnTime < MAX6921_REFRESH_INTERVAL_US) {
+    due = litOnTime;
   }
+  return (elapsed >= due) ? 0 : due - elapsed;
 }
 
 void MAX6921::setDisplayText(const char* text)
 {
-  // First, copy text to a temporary buffer, handling decimal points
-  char tempBuffer[numDigits + 1];
-  bool tempDigitsWithDots[numDigits + 1];
-  int textIndex = 0;
-  int bufferIndex = 0;
+  // Render to segment masks; setDisplaySegments blanks the unused digits
+  uint8_t segments[MAX_DIGITS];
+  uint8_t count = renderText(text, segments, numDigits);
   
-  while (bufferIndex < numDigits && text[textIndex] != 0x00) {
-    tempBuffer[bufferIndex] = toupper(text[textIndex]);
-    
-    // Skip decimal points in positioning (they share digit with previous character)
-    if (text[textIndex + 1] == '.') {
-      tempDigitsWithDots[bufferIndex] = true;
-      textIndex++;
-    } else {
-      tempDigitsWithDots[bufferIndex] = false;
-    }
+  setDisplaySegments(segments, count);
+}
 
-    bufferIndex++;
-    textIndex++;
-  }
-  
-  // Pad with spaces
-  while (bufferIndex < numDigits) {
-    tempBuffer[bufferIndex] = ' ';
-    tempDigitsWithDots[bufferIndex] = false;
-    bufferIndex++;
-  }
+uint8_t MAX6921::renderText(const char* text, uint8_t* segments, uint8_t maxCount) const
+{
+  return renderSegments(text, segments, maxCount);
+}
 
-  tempBuffer[numDigits] = '\0';
-  tempDigitsWithDots[numDigits] = false;
-  
-  // Now reverse the string into the display buffer
-  // This is specific to how the VFD digits are wired
+void MAX6921::setDisplaySegments(const uint8_t* segments, uint8_t count)
+{
+  // Segments are given left to right, one mask per digit (bit 0 = A ... bit 7 = H/period).
+  // Missing digits are blanked.
+  // Reverse into the frame buffer. This is specific to how the VFD digits are wired
   for (int i = 0; i < numDigits; i++) {
-    displayBuffer[i] = tempBuffer[numDigits - 1 - i];
-    digitsWithDots[i] = tempDigitsWithDots[numDigits - 1 - i];
+    int textIndex = numDigits - 1 - i;
+    frameBuffer[i] = (textIndex < count) ? segments[textIndex] : 0;
+  }
+}
+
+void MAX6921::setDigitSegments(uint8_t position, uint8_t segments)
+{
+  // Update a single digit without touching the rest of the frame
+  if (position >= numDigits) return;
+  frameBuffer[numDigits - 1 - position] = segments;
+}
+
+uint8_t MAX6921::getDigitSegments(uint8_t position) const
+{
+  if (position >= numDigits) return 0;
+  return frameBuffer[numDigits - 1 - position];
+}
+
+uint8_t MAX6921::getCharSegments(char ch) const
+{
+  return getFontSegments(ch);
+}
+
+void MAX6921::resetRefreshStats()
+{
+  maxRefreshGap = 0;
+  refreshGapTotal = 0;
+  refreshCount = 0;
+}
+
+void MAX6921::setBrightness(uint8_t level)
+{
+  brightness = level;
+}
+
+void MAX6921::setDimLevel(uint8_t level)
+{
+  dimLevel = level;
+}
+
+void MAX6921::setBlanked(bool blanked)
+{
+  if (blanked == this->blanked) return;
+  this->blanked = blanked;
+
+  if (!blanked) {
+    // Switch at the next refresh, and measure the duty from there rather than across the dark period
+    lastRefresh = micros() - MAX6921_REFRESH_INTERVAL_US;
+    dutyAnalyzer.reset();
   }
+}
 
-  displayBuffer[numDigits] = '\0';
-  digitsWithDots[numDigits] = false;
-}
\ No newline at end of file
+void MAX6921::setDigitBrightness(uint8_t position, uint8_t level)
+{
+  // Takes effect the next time the digit is lit
+  if (position >= numDigits) return;
+  digitLevels[numDigits - 1 - position] = level;
+}
+
+uint8_t MAX6921::getDigitBrightness(uint8_t position) const
+{
+  if (position >= numDigits) return 0;
+  return digitLevels[numDigits - 1 - position];
+}
+
+void MAX6921::resetDigitBrightness()
+{
+  for (int i = 0; i < MAX_DIGITS; i++) {
+    digitLevels[i] = MAX6921_MAX_BRIGHTNESS;
+  }
+}
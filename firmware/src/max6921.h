@@ -3,11 +3,19 @@
 
 #include <Arduino.h>
 #include <SPI.h>
+#include "segmentfont.h"
+#include "dutyanalyzer.h"
 
 // Maximum supported digits and segments (for array sizing)
 #define MAX_DIGITS 12
 #define MAX_SEGMENTS 8
 
+// Multiplex timing and brightness range
+#define MAX6921_REFRESH_INTERVAL_US 1000
+#define MAX6921_MAX_BRIGHTNESS 255
+
+static_assert(MAX_DIGITS <= DUTY_MAX_DIGITS, "the duty analyzer must cover every digit");
+
 class MAX6921 {
 private:
   // Pin definitions
@@ -29,16 +37,26 @@ private:
   // Display management
   uint8_t currentDigit;
   unsigned long lastRefresh;
-  char displayBuffer[MAX_DIGITS + 1];
-  bool digitsWithDots[MAX_DIGITS + 1];
+  uint8_t frameBuffer[MAX_DIGITS];  // Segment masks in wiring order (reversed from the text order)
+  uint8_t brightness;
+  uint8_t digitLevels[MAX_DIGITS];  // Per-digit brightness, wiring order, scaled by the global brightness
+  unsigned long litOnTime;          // On-time of the digit currently lit
+  bool digitBlanked;
+  unsigned long blankedAt;          // When the lit digit was blanked
+  uint8_t litPosition;              // Position (from the left) lit in the current slot, MAX_DIGITS before the first
+  uint8_t dimLevel;                 // Night mode scale on top of the brightness
+  bool blanked;                     // Multiplex stopped with every output off
   
-  // Character mapping
-  uint8_t charMap[128];
+  // Multiplex timing statistics (time between digit switches)
+  unsigned long maxRefreshGap;
+  uint64_t refreshGapTotal;
+  uint32_t refreshCount;
+  DutyAnalyzer dutyAnalyzer;
   
   // Internal methods
-  void initCharMap();
   void writeToMAX6921(uint32_t data);
   void displayDigit(uint8_t digitIndex, uint8_t segments);
+  unsigned long getOnTime(uint8_t digitIndex) const;
 
 public:
   // Constructor now takes pin mappings as parameters
@@ -48,8 +66,30 @@ public:
   
   // Public methods
   bool begin();
-  void refreshDisplay();
+  unsigned long refreshDisplay();  // Returns the previous digit's on-time in us when it switches digits, otherwise 0
+  unsigned long getMicrosToNextRefresh() const;  // Until refreshDisplay() next has work (digit switch or dimming blank)
   void setDisplayText(const char* text);
+  uint8_t renderText(const char* text, uint8_t* segments, uint8_t maxCount) const;  // Returns the number of digits used
+  void setDisplaySegments(const uint8_t* segments, uint8_t count);
+  void setDigitSegments(uint8_t position, uint8_t segments);  // Position counts from the left
+  uint8_t getDigitSegments(uint8_t position) const;
+  uint8_t getCharSegments(char ch) const;
+  void setBrightness(uint8_t level);
+  uint8_t getBrightness() const { return brightness; }
+  void setDigitBrightness(uint8_t position, uint8_t level);  // Position counts from the left; 255 = global level
+  uint8_t getDigitBrightness(uint8_t position) const;
+  void resetDigitBrightness();
+  void setDimLevel(uint8_t level);  // Scales every digit's on-time; 255 = not dimmed
+  uint8_t getDimLevel() const { return dimLevel; }
+  void setBlanked(bool blanked);    // Stops the multiplex with all outputs off; the frame buffer is kept
+  bool isBlanked() const { return blanked; }
+  
+  // Multiplex timing statistics, in microseconds
+  unsigned long getMaxRefreshGap() const { return maxRefreshGap; }
+  unsigned long getAverageRefreshGap() const { return refreshCount ? (unsigned long)(refreshGapTotal / refreshCount) : 0; }
+  uint32_t getRefreshCount() const { return refreshCount; }
+  void resetRefreshStats();         // The duty analyzer keeps its own sliding window and reset
+  DutyAnalyzer& getDutyAnalyzer() { return dutyAnalyzer; }
   
   // Getters for configuration
   uint8_t getNumDigits() const { return numDigits; }
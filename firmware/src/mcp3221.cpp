@@ -1,9 +1,11 @@
 #include "MCP3221.h"
+#include "trace.h"
 
 MCP3221::MCP3221(uint8_t address, float vref, uint16_t resolution)
 {
   _address = address;
   _vref = vref;
+  _readFailures = 0;
   setResolution(resolution);
 }
 
@@ -15,6 +17,8 @@ bool MCP3221::begin()
 
 uint16_t MCP3221::readRaw()
 {
+  TRACE_SCOPE(TRACE_ADC_READ);
+
   Wire.requestFrom(_address, 2);
   
   if (Wire.available() >= 2)
@@ -24,6 +28,7 @@ uint16_t MCP3221::readRaw()
     return result & 0x0FFF;             // MCP3221 is 12-bit
   }
   
+  _readFailures++;
   return 0; // Return 0 if read failed
 }
 
@@ -83,4 +88,9 @@ uint16_t MCP3221::getMaxValue()
 uint8_t MCP3221::getAddress()
 {
   return _address;
+}
+
+uint32_t MCP3221::getReadFailures()
+{
+  return _readFailures;
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ private:
   float _vref;
   uint16_t _resolution;
   uint16_t _maxValue;
+  uint32_t _readFailures;
   
 public:
   // Constructor
@@ -48,6 +49,9 @@ public:
   
   // Get I2C address
   uint8_t getAddress();
+
+  // Get number of failed reads since boot
+  uint32_t getReadFailures();
 };
 
 #endif
\ No newline at end of file
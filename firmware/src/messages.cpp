@@ -0,0 +1,160 @@
+#include "messages.h"
+
+static const char* MESSAGES_NAMESPACE = "vfdmsg";
+static const char* MESSAGES_KEY = "set";
+
+static const MessageFrame BLANK_FRAME = {};
+
+// Digits the text takes on the display, counting at most one past MESSAGE_DIGITS
+static uint8_t renderedDigits(const char* line, size_t length)
+{
+  char text[MESSAGE_TEXT_LENGTH + 1];
+  uint8_t segments[MESSAGE_DIGITS + 1];
+  memcpy(text, line, length);
+  text[length] = '\0';
+  return renderSegments(text, segments, MESSAGE_DIGITS + 1);
+}
+
+MessageSet::MessageSet(const FlashMessage* builtin, uint8_t builtinCount)
+  : builtin(builtin), builtinCount(builtinCount), customCount(0), bagSize(0), bagPosition(0), lastPicked(-1),
+    storageReady(false)
+{
+  if (builtinCount > MESSAGE_POOL_MAX) {
+    this->builtinCount = MESSAGE_POOL_MAX;
+  }
+
+  memset(frames, 0, sizeof(frames));
+  memset(textOffsets, 0, sizeof(textOffsets));
+  memset(texts, 0, sizeof(texts));
+  memset(bag, 0, sizeof(bag));
+}
+
+void MessageSet::begin()
+{
+  storageReady = preferences.begin(MESSAGES_NAMESPACE, false);
+  if (!storageReady) return;
+
+  char list[MESSAGE_POOL_TEXT_SIZE + 1];
+  if (preferences.getString(MESSAGES_KEY, list, sizeof(list)) > 0 && load(list, false)) {
+    load(list, true);
+  }
+}
+
+bool MessageSet::setCustom(const char* list)
+{
+  // Validate the whole list before touching the current set
+  if (strlen(list) > MESSAGE_POOL_TEXT_SIZE || !load(list, false)) {
+    return false;
+  }
+  load(list, true);
+
+  if (storageReady) {
+    if (customCount > 0) {
+      preferences.putString(MESSAGES_KEY, list);
+    }
+    else {
+      preferences.remove(MESSAGES_KEY);
+    }
+  }
+  return true;
+}
+
+bool MessageSet::load(const char* list, bool apply)
+{
+  uint8_t count = 0;
+  uint16_t used = 0;
+
+  const char* line = list;
+  while (*line != '\0') {
+    const char* end = line;
+    while (*end != '\0' && *end != '\n') {
+      end++;
+    }
+
+    // Tolerate CRLF line endings and blank lines
+    size_t length = end - line;
+    if (length > 0 && line[length - 1] == '\r') {
+      length--;
+    }
+
+    if (length > 0) {
+      if (length > MESSAGE_TEXT_LENGTH || count >= MESSAGE_POOL_MAX || used + length + 1 > MESSAGE_POOL_TEXT_SIZE) {
+        return false;
+      }
+
+      // A message that does not fit the tube would be shown cut off
+      if (renderedDigits(line, length) > MESSAGE_DIGITS) {
+        return false;
+      }
+
+      if (apply) {
+        memcpy(texts + used, line, length);
+        texts[used + length] = '\0';
+        textOffsets[count] = used;
+        frames[count] = renderMessage(texts + used);
+      }
+
+      used += length + 1;
+      count++;
+    }
+
+    line = (*end == '\n') ? end + 1 : end;
+  }
+
+  if (apply) {
+    customCount = count;
+    bagSize = 0;
+    bagPosition = 0;
+    lastPicked = -1;
+  }
+  return true;
+}
+
+void MessageSet::refill()
+{
+  bagSize = getCount();
+  bagPosition = 0;
+
+  for (uint8_t i = 0; i < bagSize; i++) {
+    bag[i] = i;
+  }
+
+  // Fisher-Yates shuffle
+  for (uint8_t i = bagSize; i > 1; i--) {
+    uint8_t j = random(0, i);
+    uint8_t swap = bag[i - 1];
+    bag[i - 1] = bag[j];
+    bag[j] = swap;
+  }
+
+  // Don't show the same message twice in a row across a refill
+  if (bagSize > 1 && bag[0] == lastPicked) {
+    bag[0] = bag[bagSize - 1];
+    bag[bagSize - 1] = lastPicked;
+  }
+}
+
+uint8_t MessageSet::next()
+{
+  if (bagPosition >= bagSize) {
+    refill();
+  }
+  if (bagSize == 0) {
+    return 0;
+  }
+
+  lastPicked = bag[bagPosition++];
+  return lastPicked;
+}
+
+const char* MessageSet::getText(uint8_t index) const
+{
+  if (index >= getCount()) return "";
+  return customCount > 0 ? texts + textOffsets[index] : builtin[index].text;
+}
+
+const uint8_t* MessageSet::getSegments(uint8_t index) const
+{
+  if (index >= getCount()) return BLANK_FRAME.segments;
+  return customCount > 0 ? frames[index].segments : builtin[index].frame.segments;
+}
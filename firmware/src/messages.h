@@ -0,0 +1,81 @@
+#ifndef MESSAGES_H
+#define MESSAGES_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+#include "segmentfont.h"
+
+// Flash message sets, stored as ready-to-show segment frames.
+//
+// The built-in set is a constexpr table: FLASH_MESSAGE("TEXT") renders the text with the segment font at
+// compile time, so the table (text and frame) sits in flash and showing a message is a copy of eight masks.
+// A set uploaded through the web API is rendered once into a fixed pool and kept in NVS. Messages are drawn
+// from a shuffle bag, so every message of the set is shown once before any repeats.
+
+#define MESSAGE_DIGITS 8
+#define MESSAGE_TEXT_LENGTH 16                 // Longest message text: eight digits, each with a folded-in period
+#define MESSAGE_POOL_MAX 32                    // Messages in an uploaded set
+#define MESSAGE_POOL_TEXT_SIZE 384             // Text storage of an uploaded set, including terminators
+
+struct MessageFrame {
+  uint8_t segments[MESSAGE_DIGITS];
+};
+
+constexpr MessageFrame renderMessage(const char* text)
+{
+  MessageFrame frame = {};
+  renderSegments(text, frame.segments, MESSAGE_DIGITS);
+  return frame;
+}
+
+struct FlashMessage {
+  const char* text;
+  MessageFrame frame;
+};
+
+#define FLASH_MESSAGE(text) { text, renderMessage(text) }
+
+class MessageSet {
+private:
+  const FlashMessage* builtin;
+  uint8_t builtinCount;
+
+  // Uploaded set: rendered frames and NUL-terminated texts packed into one buffer
+  MessageFrame frames[MESSAGE_POOL_MAX];
+  uint16_t textOffsets[MESSAGE_POOL_MAX];
+  char texts[MESSAGE_POOL_TEXT_SIZE];
+  uint8_t customCount;
+
+  // Shuffle bag of message indices
+  uint8_t bag[MESSAGE_POOL_MAX];
+  uint8_t bagSize;
+  uint8_t bagPosition;
+  int16_t lastPicked;
+
+  Preferences preferences;
+  bool storageReady;
+
+  bool load(const char* list, bool apply);
+  void refill();
+
+public:
+  MessageSet(const FlashMessage* builtin, uint8_t builtinCount);
+
+  // Restores an uploaded set from NVS, if there is one
+  void begin();
+
+  // Replaces the set with newline-separated messages and stores it. An empty list restores the built-in set.
+  // Returns false (and changes nothing) if a message is empty or takes more than MESSAGE_DIGITS digits (a '.' after
+  // a character shares its digit) or the set does not fit.
+  bool setCustom(const char* list);
+
+  // Index of the next message to show
+  uint8_t next();
+
+  uint8_t getCount() const { return customCount > 0 ? customCount : builtinCount; }
+  bool isCustom() const { return customCount > 0; }
+  const char* getText(uint8_t index) const;
+  const uint8_t* getSegments(uint8_t index) const;
+};
+
+#endif
@@ -0,0 +1,107 @@
+#include "metrics.h"
+
+Histogram::Histogram(const uint32_t* bounds, uint8_t numBounds)
+  : bounds(bounds), numBounds(numBounds), sum(0), count(0)
+{
+  if (numBounds > HISTOGRAM_MAX_BUCKETS) {
+    this->numBounds = HISTOGRAM_MAX_BUCKETS;
+  }
+
+  for (int i = 0; i <= HISTOGRAM_MAX_BUCKETS; i++) {
+    bucketCounts[i] = 0;
+  }
+}
+
+void Histogram::observe(uint32_t value)
+{
+  // Buckets are stored non-cumulative; the exporter accumulates them
+  uint8_t bucket = 0;
+  while (bucket < numBounds && value > bounds[bucket]) {
+    bucket++;
+  }
+
+  bucketCounts[bucket]++;
+  sum += value;
+  count++;
+}
+
+MetricsWriter::MetricsWriter(WebServer& server)
+  : server(server), length(0)
+{
+}
+
+void MetricsWriter::begin()
+{
+  server.setContentLength(CONTENT_LENGTH_UNKNOWN);
+  server.send(200, "text/plain; version=0.0.4", "");
+}
+
+void MetricsWriter::end()
+{
+  flush();
+  server.sendContent("");  // Terminating chunk
+}
+
+void MetricsWriter::append(const char* format, ...)
+{
+  va_list args;
+  va_list retry;
+
+  va_start(args, format);
+  va_copy(retry, args);
+  int written = vsnprintf(buffer + length, sizeof(buffer) - length, format, args);
+
+  // If the line did not fit, send what is buffered and format it again at the start
+  if (written >= (int)(sizeof(buffer) - length) && length > 0) {
+    flush();
+    written = vsnprintf(buffer, sizeof(buffer), format, retry);
+  }
+  va_end(retry);
+  va_end(args);
+
+  if (written > 0) {
+    length += min((size_t)written, sizeof(buffer) - length - 1);
+  }
+}
+
+void MetricsWriter::flush()
+{
+  if (length == 0) return;
+
+  server.sendContent(buffer, length);
+  length = 0;
+}
+
+void MetricsWriter::header(const char* name, const char* type, const char* help)
+{
+  append("# HELP %s %s\n", name, help);
+  append("# TYPE %s %s\n", name, type);
+}
+
+void MetricsWriter::gauge(const char* name, const char* help, double value)
+{
+  header(name, "gauge", help);
+  append("%s %g\n", name, value);
+}
+
+void MetricsWriter::counter(const char* name, const char* help, uint32_t value)
+{
+  header(name, "counter", help);
+  append("%s %lu\n", name, (unsigned long)value);
+}
+
+void MetricsWriter::histogram(const char* name, const char* help, const Histogram& histogram, double scale)
+{
+  header(name, "histogram", help);
+
+  uint32_t cumulative = 0;
+  for (uint8_t i = 0; i < histogram.getNumBounds(); i++) {
+    cumulative += histogram.getBucketCount(i);
+    append("%s_bucket{le=\"%g\"} %lu\n", name, histogram.getBound(i) * scale, (unsigned long)cumulative);
+  }
+  cumulative += histogram.getBucketCount(histogram.getNumBounds());
+
+  append("%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)cumulative);
+  append("%s_sum %g\n", name, (double)histogram.getSum() * scale);
+  append("%s_count %lu\n", name, (unsigned long)histogram.getCount());
+}
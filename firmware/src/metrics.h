@@ -0,0 +1,60 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <Arduino.h>
+#include <WebServer.h>
+
+// Runtime metrics in the Prometheus text exposition format.
+//
+// Histograms use fixed bucket bounds supplied at construction, so observe() is a short scan over a
+// static array with no allocation and is safe to call from the hot paths (loop, display multiplex).
+// Values are recorded as integers in the caller's unit (e.g. microseconds) and scaled on export.
+
+#define HISTOGRAM_MAX_BUCKETS 12
+
+class Histogram {
+private:
+  const uint32_t* bounds;              // Upper bucket bounds, ascending
+  uint8_t numBounds;
+  uint32_t bucketCounts[HISTOGRAM_MAX_BUCKETS + 1];  // Last bucket is +Inf
+  uint64_t sum;
+  uint32_t count;
+
+public:
+  Histogram(const uint32_t* bounds, uint8_t numBounds);
+
+  void observe(uint32_t value);
+
+  uint8_t getNumBounds() const { return numBounds; }
+  uint32_t getBound(uint8_t index) const { return bounds[index]; }
+  uint32_t getBucketCount(uint8_t index) const { return bucketCounts[index]; }
+  uint64_t getSum() const { return sum; }
+  uint32_t getCount() const { return count; }
+};
+
+// Formats metrics into a small fixed buffer and streams it as a chunked HTTP response
+class MetricsWriter {
+private:
+  WebServer& server;
+  char buffer[512];
+  size_t length;
+
+  void append(const char* format, ...);
+  void header(const char* name, const char* type, const char* help);
+
+public:
+  MetricsWriter(WebServer& server);
+
+  void begin();
+  void end();
+
+  void gauge(const char* name, const char* help, double value);
+  void counter(const char* name, const char* help, uint32_t value);
+
+  // scale converts the recorded unit to the exported one (e.g. 1e-6 for microseconds to seconds)
+  void histogram(const char* name, const char* help, const Histogram& histogram, double scale);
+
+  void flush();
+};
+
+#endif
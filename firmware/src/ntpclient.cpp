@@ -0,0 +1,281 @@
+#include "ntpclient.h"
+#include "heapprofile.h"
+#include <esp_timer.h>
+
+#define NTP_LOCAL_PORT 4123
+#define NTP_UNIX_OFFSET 2208988800LL          // Seconds from 1900 (NTP era 0) to 1970
+#define NTP_REPLY_TIMEOUT_US 1000000LL
+#define NTP_BURST_SPACING_US 2000000LL        // Between requests of one burst (like ntpd's iburst)
+#define NTP_MIN_DRIFT_ELAPSED_US 60000000LL   // Only learn drift over at least this long
+#define NTP_DRIFT_GAIN 0.7                    // Fraction of the measured rate error corrected per sync
+#define NTP_MAX_DRIFT 500e-6                  // Crystals are well within +-500 ppm
+
+static int64_t readTimestamp(const uint8_t* data)
+{
+  uint32_t seconds = ((uint32_t)data[0] << 24) | ((uint32_t)data[1] << 16) | ((uint32_t)data[2] << 8) | data[3];
+  uint32_t fraction = ((uint32_t)data[4] << 24) | ((uint32_t)data[5] << 16) | ((uint32_t)data[6] << 8) | data[7];
+
+  // Timestamps with the top bit clear are in NTP era 1 (after 2036)
+  int64_t fullSeconds = (int64_t)seconds + ((seconds & 0x80000000) ? 0 : 0x100000000LL);
+  return (fullSeconds - NTP_UNIX_OFFSET) * 1000000LL + (((uint64_t)fraction * 1000000ULL) >> 32);
+}
+
+static void writeTimestamp(uint8_t* data, int64_t unixUs)
+{
+  uint32_t seconds = (uint32_t)(unixUs / 1000000LL + NTP_UNIX_OFFSET);
+  uint32_t fraction = (uint32_t)(((uint64_t)(unixUs % 1000000LL) << 32) / 1000000ULL);
+
+  for (int i = 0; i < 4; i++) {
+    data[i] = seconds >> (24 - i * 8);
+    data[4 + i] = fraction >> (24 - i * 8);
+  }
+}
+
+NtpClient::NtpClient(const char* server, uint32_t maxErrorMs, uint32_t minIntervalS, uint32_t maxIntervalS)
+  : server(server), maxErrorUs(maxErrorMs * 1000), minIntervalS(minIntervalS), maxIntervalS(maxIntervalS),
+    synced(false), baseUtcUs(0), baseMonoUs(0), drift(0), lastSyncMono(0),
+    intervalS(minIntervalS), nextSyncMono(0), failures(0),
+    inBurst(false), burstSent(0), awaitingReply(false), requestMono(0), requestLocalUs(0),
+    haveBest(false), bestOffset(0), bestRoundTrip(0), bestMono(0),
+    syncCount(0), failureCount(0), requestsSent(0), historyCount(0), historyNext(0)
+{
+  memset(requestTag, 0, sizeof(requestTag));
+}
+
+bool NtpClient::begin()
+{
+  return udp.begin(NTP_LOCAL_PORT) == 1;
+}
+
+void NtpClient::update()
+{
+  if (WiFi.status() != WL_CONNECTED) {
+    // Abandon any burst; a sync that came due while offline runs as soon as we are back
+    inBurst = false;
+    awaitingReply = false;
+    return;
+  }
+
+  int64_t mono = esp_timer_get_time();
+
+  if (!inBurst) {
+    if (mono >= nextSyncMono) {
+      startBurst();
+    }
+    return;
+  }
+
+  if (awaitingReply) {
+    receiveReply();
+    if (awaitingReply && mono - requestMono >= NTP_REPLY_TIMEOUT_US) {
+      awaitingReply = false;  // Lost; move on to the next sample
+    }
+  }
+
+  if (inBurst && !awaitingReply) {
+    if (burstSent >= NTP_BURST_SAMPLES) {
+      finishBurst();
+    }
+    else if (mono - requestMono >= NTP_BURST_SPACING_US) {
+      sendRequest();
+    }
+  }
+}
+
+void NtpClient::startBurst()
+{
+  if (!WiFi.hostByName(server, serverIP)) {
+    scheduleRetry();
+    return;
+  }
+
+  inBurst = true;
+  burstSent = 0;
+  haveBest = false;
+  sendRequest();
+}
+
+void NtpClient::sendRequest()
+{
+  // lwIP allocates the outgoing packet
+  HEAP_EXEMPT();
+
+  uint8_t packet[NTP_PACKET_SIZE];
+  memset(packet, 0, sizeof(packet));
+  packet[0] = 0x23;  // LI 0, version 4, mode 3 (client)
+
+  requestMono = esp_timer_get_time();
+  requestLocalUs = localTimeUs(requestMono);
+
+  // Our transmit timestamp comes back as the originate timestamp, which ties the reply to this request
+  writeTimestamp(packet + 40, requestLocalUs);
+  memcpy(requestTag, packet + 40, sizeof(requestTag));
+
+  udp.beginPacket(serverIP, NTP_PORT);
+  udp.write(packet, sizeof(packet));
+  udp.endPacket();
+
+  burstSent++;
+  requestsSent++;
+  awaitingReply = true;
+}
+
+void NtpClient::receiveReply()
+{
+  int size = udp.parsePacket();
+  if (size <= 0) return;
+
+  int64_t mono = esp_timer_get_time();
+
+  uint8_t packet[NTP_PACKET_SIZE];
+  if (size < NTP_PACKET_SIZE || udp.read(packet, sizeof(packet)) != NTP_PACKET_SIZE) {
+    return;
+  }
+
+  uint8_t leap = packet[0] >> 6;
+  uint8_t mode = packet[0] & 0x07;
+  uint8_t stratum = packet[1];
+
+  // Ignore stale or foreign replies, unsynchronized servers and kiss-o'-death packets (stratum 0)
+  if (mode != 4 || leap == 3 || stratum == 0 || stratum > 15 || memcmp(packet + 24, requestTag, sizeof(requestTag)) != 0) {
+    return;
+  }
+  awaitingReply = false;
+
+  int64_t t1 = requestLocalUs;
+  int64_t t2 = readTimestamp(packet + 32);
+  int64_t t3 = readTimestamp(packet + 40);
+  int64_t t4 = localTimeUs(mono);
+
+  int64_t offset = ((t2 - t1) + (t3 - t4)) / 2;
+  int64_t roundTrip = (t4 - t1) - (t3 - t2);
+  if (roundTrip < 0) {
+    roundTrip = 0;
+  }
+
+  // The first sync takes the first good answer so the clock shows network time quickly
+  if (!synced) {
+    inBurst = false;
+    applySample(offset, roundTrip, mono);
+    return;
+  }
+
+  // Otherwise keep the sample least delayed by queueing
+  if (!haveBest || roundTrip < bestRoundTrip) {
+    haveBest = true;
+    bestOffset = offset;
+    bestRoundTrip = roundTrip;
+    bestMono = mono;
+  }
+}
+
+void NtpClient::finishBurst()
+{
+  inBurst = false;
+
+  if (!haveBest) {
+    scheduleRetry();
+    return;
+  }
+
+  // The timebase has not changed during the burst, so the offset still applies
+  applySample(bestOffset, bestRoundTrip, bestMono);
+}
+
+void NtpClient::applySample(int64_t offset, int64_t roundTrip, int64_t mono)
+{
+  int64_t local = localTimeUs(mono);
+
+  if (synced) {
+    // Whatever offset built up since the last sync is residual rate error: learn part of it
+    int64_t elapsed = mono - lastSyncMono;
+    if (elapsed >= NTP_MIN_DRIFT_ELAPSED_US) {
+      drift += NTP_DRIFT_GAIN * (double)offset / (double)elapsed;
+      drift = constrain(drift, -NTP_MAX_DRIFT, NTP_MAX_DRIFT);
+    }
+
+    // Error grows roughly linearly with the interval: back off while well inside the bound
+    int64_t error = offset < 0 ? -offset : offset;
+    if (error > (int64_t)maxErrorUs) {
+      intervalS = max(minIntervalS, intervalS / 2);
+    }
+    else if (error < (int64_t)maxErrorUs / 4) {
+      intervalS = min(maxIntervalS, intervalS * 2);
+    }
+  }
+  else {
+    intervalS = minIntervalS;
+  }
+
+  // Step into phase
+  baseUtcUs = local + offset;
+  baseMonoUs = mono;
+  lastSyncMono = mono;
+  synced = true;
+  syncCount++;
+  failures = 0;
+  nextSyncMono = mono + (int64_t)intervalS * 1000000LL;
+
+  // Keep the system clock close too, for anything that still uses time()/gettimeofday()
+  struct timeval now;
+  now.tv_sec = baseUtcUs / 1000000LL;
+  now.tv_usec = baseUtcUs % 1000000LL;
+  settimeofday(&now, NULL);
+
+  // The first sync sets the clock rather than correcting it, so it is recorded with a zero offset
+  Sample& sample = history[historyNext];
+  sample.uptime = mono / 1000000LL;
+  sample.offset = syncCount > 1 ? (int32_t)constrain(offset, (int64_t)INT32_MIN, (int64_t)INT32_MAX) : 0;
+  sample.roundTrip = (uint32_t)min(roundTrip, (int64_t)UINT32_MAX);
+  sample.drift = getDriftPpb();
+  sample.interval = intervalS;
+  historyNext = (historyNext + 1) % NTP_HISTORY_SIZE;
+  if (historyCount < NTP_HISTORY_SIZE) {
+    historyCount++;
+  }
+}
+
+void NtpClient::scheduleRetry()
+{
+  failures++;
+  failureCount++;
+
+  // 16 s, 32 s, ... but never later than a regular sync would have been
+  uint32_t retryS = 8u << min(failures, (uint8_t)8);
+  if (synced) {
+    retryS = min(retryS, intervalS);
+  }
+  nextSyncMono = esp_timer_get_time() + (int64_t)retryS * 1000000LL;
+}
+
+int64_t NtpClient::localTimeUs(int64_t mono) const
+{
+  int64_t elapsed = mono - baseMonoUs;
+  return baseUtcUs + elapsed + (int64_t)(elapsed * drift);
+}
+
+bool NtpClient::getTime(struct timeval& now) const
+{
+  if (!synced) return false;
+
+  int64_t local = localTimeUs(esp_timer_get_time());
+  now.tv_sec = local / 1000000LL;
+  now.tv_usec = local % 1000000LL;
+  return true;
+}
+
+int32_t NtpClient::getLastOffset() const
+{
+  return historyCount ? history[(historyNext + NTP_HISTORY_SIZE - 1) % NTP_HISTORY_SIZE].offset : 0;
+}
+
+uint32_t NtpClient::getLastRoundTrip() const
+{
+  return historyCount ? history[(historyNext + NTP_HISTORY_SIZE - 1) % NTP_HISTORY_SIZE].roundTrip : 0;
+}
+
+const NtpClient::Sample& NtpClient::getHistory(uint8_t index) const
+{
+  uint8_t oldest = (historyNext + NTP_HISTORY_SIZE - historyCount) % NTP_HISTORY_SIZE;
+  return history[(oldest + index) % NTP_HISTORY_SIZE];
+}
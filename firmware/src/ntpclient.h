@@ -0,0 +1,110 @@
+#ifndef NTPCLIENT_H
+#define NTPCLIENT_H
+
+#include <Arduino.h>
+#include <WiFi.h>
+#include <WiFiUdp.h>
+#include <sys/time.h>
+
+// SNTP client with a disciplined local timebase.
+//
+// Each sync sends a short burst of requests and keeps the sample with the smallest round trip (the least
+// affected by queueing). Its offset steps the timebase into phase and, from the second sync on, corrects the
+// learned crystal drift, so time between syncs is extrapolated from esp_timer at the corrected rate.
+// The sync interval doubles while the measured offset stays well inside the error bound and halves when it
+// does not, so a settled clock only asks the server every few hours.
+//
+// Everything runs from update() in loop(); nothing blocks except the DNS lookup at the start of a sync.
+
+#define NTP_PORT 123
+#define NTP_PACKET_SIZE 48
+#define NTP_BURST_SAMPLES 4
+#define NTP_HISTORY_SIZE 32
+
+class NtpClient {
+public:
+  struct Sample {
+    uint32_t uptime;                   // Seconds since boot when the sync completed
+    int32_t offset;                    // Correction applied, in us (true time minus local timebase)
+    uint32_t roundTrip;                // us
+    int32_t drift;                     // Learned drift after this sync, in parts per billion
+    uint32_t interval;                 // Seconds until the next sync
+  };
+
+private:
+  WiFiUDP udp;
+  const char* server;
+  IPAddress serverIP;
+  uint32_t maxErrorUs;
+  uint32_t minIntervalS;
+  uint32_t maxIntervalS;
+
+  // Timebase: local UTC = baseUtc + elapsed * (1 + drift), elapsed measured with esp_timer
+  bool synced;
+  int64_t baseUtcUs;
+  int64_t baseMonoUs;
+  double drift;                        // Fractional rate correction (ppb / 1e9)
+  int64_t lastSyncMono;
+
+  // Sync scheduling
+  uint32_t intervalS;
+  int64_t nextSyncMono;
+  uint8_t failures;
+
+  // Burst in progress
+  bool inBurst;
+  uint8_t burstSent;
+  bool awaitingReply;
+  int64_t requestMono;                 // esp_timer time the current request was sent
+  int64_t requestLocalUs;              // Local timebase at that moment (T1)
+  uint8_t requestTag[8];               // Transmit timestamp we sent, echoed back as the originate timestamp
+  bool haveBest;
+  int64_t bestOffset;
+  int64_t bestRoundTrip;
+  int64_t bestMono;
+
+  // Statistics
+  uint32_t syncCount;
+  uint32_t failureCount;
+  uint32_t requestsSent;
+  Sample history[NTP_HISTORY_SIZE];
+  uint8_t historyCount;
+  uint8_t historyNext;
+
+  int64_t localTimeUs(int64_t mono) const;
+  void startBurst();
+  void sendRequest();
+  void receiveReply();
+  void finishBurst();
+  void applySample(int64_t offset, int64_t roundTrip, int64_t mono);
+  void scheduleRetry();
+
+public:
+  NtpClient(const char* server, uint32_t maxErrorMs, uint32_t minIntervalS = 64, uint32_t maxIntervalS = 36 * 3600);
+
+  bool begin();
+  void update();
+
+  // Request a sync as soon as possible (e.g. after reconnecting)
+  void syncNow() { nextSyncMono = 0; }
+
+  bool isSynced() const { return synced; }
+
+  // Current UTC from the disciplined timebase. Returns false until the first sync.
+  bool getTime(struct timeval& now) const;
+
+  int32_t getLastOffset() const;
+  uint32_t getLastRoundTrip() const;
+  int32_t getDriftPpb() const { return (int32_t)(drift * 1e9); }
+  uint32_t getInterval() const { return intervalS; }
+  uint32_t getSyncCount() const { return syncCount; }
+  uint32_t getFailureCount() const { return failureCount; }
+  uint32_t getRequestsSent() const { return requestsSent; }
+  uint32_t getMaxError() const { return maxErrorUs; }
+
+  // History, oldest first
+  uint8_t getHistoryCount() const { return historyCount; }
+  const Sample& getHistory(uint8_t index) const;
+};
+
+#endif
@@ -0,0 +1,364 @@
+#include "powermanager.h"
+#include <esp_timer.h>
+#include <esp_pm.h>
+
+static const char* const POWER_MODE_NAMES[] = { "on", "dim", "off" };
+static const char* const POWER_PHASE_NAMES[] = { "on", "stopping", "off", "warmup", "starting" };
+static const char* const POWER_STATE_NAMES[POWER_STATE_COUNT] = { "on", "dim", "off", "transition", "standby" };
+static const char* const POWER_DAY_NAMES[7] = { "sun", "mon", "tue", "wed", "thu", "fri", "sat" };
+
+#define POWER_DAYS_ALL 0x7F
+#define POWER_DAYS_WEEKDAYS 0x3E
+#define POWER_DAYS_WEEKENDS 0x41
+
+PowerManager::PowerManager(MAX6921& display, Filament& filament)
+  : display(display), filament(filament), schedules(NULL), filamentLevel(FILAMENT_MAX_LEVEL), standbyLevel(0),
+    filamentRampMs(0), warmupMs(POWER_FILAMENT_WARMUP_MS), scheduledMode(POWER_MODE_ON),
+    scheduledLevel(MAX6921_MAX_BRIGHTNESS), activeSchedule(-1), mode(POWER_MODE_ON), level(MAX6921_MAX_BRIGHTNESS),
+    overridden(false), overrideMode(POWER_MODE_ON), overrideLevel(MAX6921_MAX_BRIGHTNESS), overrideUntilUs(0),
+    phase(POWER_PHASE_ON), phaseSinceUs(0), boostHasStopped(false), boostIsReady(false), transitions(0),
+    lowPower(false), lightSleep(false), state(POWER_STATE_ON), accountedUs(0), accountedSleepUs(0)
+{
+  memset(residencyUs, 0, sizeof(residencyUs));
+  memset(sleepUs, 0, sizeof(sleepUs));
+}
+
+void PowerManager::begin(const PowerSchedule* schedules)
+{
+  this->schedules = schedules;
+
+  filament.begin();
+  setFilament(true);
+
+  phaseSinceUs = esp_timer_get_time();
+  accountedUs = phaseSinceUs;
+}
+
+void PowerManager::setFilamentProfile(uint8_t level, uint8_t standby, uint32_t rampMs)
+{
+  filamentLevel = level;
+  standbyLevel = standby;
+  filamentRampMs = rampMs;
+
+  if (schedules == NULL) return;
+
+  bool off = phase == POWER_PHASE_OFF;
+  setFilament(!off);
+  if (off) {
+    // Whether light sleep is allowed depends on the standby level
+    setLowPower(true);
+  }
+}
+
+void PowerManager::update(const struct tm* localTime, uint64_t sleepTotalUs)
+{
+  int64_t now = esp_timer_get_time();
+
+  // The time since the last update belongs to the state it was spent in
+  account(now, sleepTotalUs);
+
+  evaluate(localTime);
+  advance(now);
+  state = getCurrentState();
+}
+
+void PowerManager::evaluate(const struct tm* localTime)
+{
+  if (overridden && overrideUntilUs != 0 && esp_timer_get_time() >= overrideUntilUs) {
+    overridden = false;
+  }
+
+  if (localTime != NULL && schedules != NULL) {
+    uint16_t minute = localTime->tm_hour * 60 + localTime->tm_min;
+    uint8_t today = 1 << localTime->tm_wday;
+    uint8_t yesterday = 1 << ((localTime->tm_wday + 6) % 7);
+
+    scheduledMode = POWER_MODE_ON;
+    scheduledLevel = MAX6921_MAX_BRIGHTNESS;
+    activeSchedule = -1;
+
+    for (uint8_t i = 0; i < POWER_SCHEDULES; i++) {
+      const PowerSchedule& schedule = schedules[i];
+      if (schedule.days == 0 || schedule.mode == POWER_MODE_ON || schedule.mode > POWER_MODE_OFF) continue;
+
+      // A window across midnight belongs to the day it starts on
+      bool active;
+      if (schedule.startMinute == schedule.endMinute) {
+        active = schedule.days & today;
+      }
+      else if (schedule.startMinute < schedule.endMinute) {
+        active = (schedule.days & today) && minute >= schedule.startMinute && minute < schedule.endMinute;
+      }
+      else {
+        active = ((schedule.days & today) && minute >= schedule.startMinute) ||
+                 ((schedule.days & yesterday) && minute < schedule.endMinute);
+      }
+      if (!active) continue;
+
+      // The darker window wins
+      if (schedule.mode > scheduledMode || (schedule.mode == scheduledMode && schedule.level < scheduledLevel)) {
+        scheduledMode = (PowerMode)schedule.mode;
+        scheduledLevel = schedule.mode == POWER_MODE_DIM ? schedule.level : 0;
+        activeSchedule = i;
+      }
+    }
+  }
+
+  mode = overridden ? overrideMode : scheduledMode;
+  level = overridden ? overrideLevel : scheduledLevel;
+}
+
+void PowerManager::advance(int64_t now)
+{
+  bool off = mode == POWER_MODE_OFF;
+  uint32_t elapsedMs = (now - phaseSinceUs) / 1000;
+
+  switch (phase) {
+    case POWER_PHASE_ON:
+      if (off) {
+        display.setBlanked(true);
+        enterPhase(POWER_PHASE_STOPPING, now);
+      }
+      else {
+        display.setDimLevel(mode == POWER_MODE_DIM ? level : MAX6921_MAX_BRIGHTNESS);
+      }
+      break;
+
+    case POWER_PHASE_STOPPING:
+      if (!off) {
+        // Changed back before the filament went off; only the boost has to come up again
+        enterPhase(POWER_PHASE_STARTING, now);
+      }
+      else if (boostHasStopped || elapsedMs >= POWER_BOOST_STOP_TIMEOUT_MS) {
+        setFilament(false);
+        setLowPower(true);
+        enterPhase(POWER_PHASE_OFF, now);
+        transitions++;
+      }
+      break;
+
+    case POWER_PHASE_OFF:
+      if (!off) {
+        // The warmer the standby, the shorter the wait for the cathode
+        warmupMs = filamentLevel > standbyLevel ?
+                   (uint32_t)POWER_FILAMENT_WARMUP_MS * (filamentLevel - standbyLevel) / filamentLevel : 0;
+        setLowPower(false);
+        setFilament(true);
+        enterPhase(POWER_PHASE_WARMUP, now);
+      }
+      break;
+
+    case POWER_PHASE_WARMUP:
+      if (off) {
+        setFilament(false);
+        setLowPower(true);
+        enterPhase(POWER_PHASE_OFF, now);
+      }
+      else if (!filament.isRamping() && elapsedMs >= warmupMs) {
+        enterPhase(POWER_PHASE_STARTING, now);
+      }
+      break;
+
+    case POWER_PHASE_STARTING:
+      if (off) {
+        enterPhase(POWER_PHASE_STOPPING, now);
+      }
+      else if (boostIsReady || elapsedMs >= POWER_BOOST_START_TIMEOUT_MS) {
+        display.setDimLevel(mode == POWER_MODE_DIM ? level : MAX6921_MAX_BRIGHTNESS);
+        display.setBlanked(false);
+        enterPhase(POWER_PHASE_ON, now);
+        transitions++;
+      }
+      break;
+  }
+}
+
+void PowerManager::enterPhase(PowerPhase next, int64_t now)
+{
+  phase = next;
+  phaseSinceUs = now;
+  boostHasStopped = false;
+  boostIsReady = false;
+}
+
+void PowerManager::account(int64_t now, uint64_t sleepTotalUs)
+{
+  residencyUs[state] += now - accountedUs;
+  sleepUs[state] += sleepTotalUs - accountedSleepUs;
+  accountedUs = now;
+  accountedSleepUs = sleepTotalUs;
+}
+
+PowerState PowerManager::getCurrentState() const
+{
+  switch (phase) {
+    case POWER_PHASE_ON:  return mode == POWER_MODE_DIM ? POWER_STATE_DIM : POWER_STATE_ON;
+    case POWER_PHASE_OFF: return standbyLevel > 0 ? POWER_STATE_STANDBY : POWER_STATE_OFF;
+    default:              return POWER_STATE_TRANSITION;
+  }
+}
+
+void PowerManager::resetResidency()
+{
+  memset(residencyUs, 0, sizeof(residencyUs));
+  memset(sleepUs, 0, sizeof(sleepUs));
+}
+
+void PowerManager::setOverride(PowerMode mode, uint8_t level, uint32_t minutes)
+{
+  overridden = true;
+  overrideMode = mode;
+  overrideLevel = mode == POWER_MODE_DIM ? level : (mode == POWER_MODE_ON ? MAX6921_MAX_BRIGHTNESS : 0);
+  overrideUntilUs = minutes ? esp_timer_get_time() + (int64_t)minutes * 60000000 : 0;
+
+  // Takes effect at the next update()
+  this->mode = overrideMode;
+  this->level = overrideLevel;
+}
+
+void PowerManager::clearOverride()
+{
+  overridden = false;
+  mode = scheduledMode;
+  level = scheduledLevel;
+}
+
+uint32_t PowerManager::getOverrideRemainingS() const
+{
+  if (!overridden || overrideUntilUs == 0) return 0;
+
+  int64_t remaining = overrideUntilUs - esp_timer_get_time();
+  return remaining > 0 ? (uint32_t)(remaining / 1000000) : 0;
+}
+
+void PowerManager::setFilament(bool on)
+{
+  // Up in a ramp, down at once
+  filament.rampTo(on ? filamentLevel : standbyLevel, filamentRampMs);
+}
+
+void PowerManager::setLowPower(bool enable)
+{
+  // Automatic light sleep needs power management and tickless idle in the SDK build; without tickless idle the
+  // clock can still scale, and without power management at all the clock is set directly. A filament kept warm
+  // needs its PWM, which stops in light sleep and changes frequency below 80 MHz, so it gets the lower clock only.
+  bool sleep = enable && filament.getTarget() == 0;
+  esp_pm_config_t config = {};
+  config.max_freq_mhz = POWER_CPU_MHZ;
+  config.min_freq_mhz = sleep ? POWER_SLEEP_MIN_CPU_MHZ : (enable ? POWER_LOW_CPU_MHZ : POWER_CPU_MHZ);
+  config.light_sleep_enable = sleep;
+  esp_err_t result = esp_pm_configure(&config);
+  lightSleep = sleep && result == ESP_OK;
+
+  if (result == ESP_ERR_NOT_SUPPORTED && sleep) {
+    config.min_freq_mhz = POWER_LOW_CPU_MHZ;
+    config.light_sleep_enable = false;
+    result = esp_pm_configure(&config);
+  }
+  if (result == ESP_ERR_NOT_SUPPORTED) {
+    setCpuFrequencyMhz(enable ? POWER_LOW_CPU_MHZ : POWER_CPU_MHZ);
+  }
+
+  lowPower = enable;
+}
+
+const char* PowerManager::getModeName(PowerMode mode)
+{
+  return mode <= POWER_MODE_OFF ? POWER_MODE_NAMES[mode] : "unknown";
+}
+
+bool PowerManager::parseMode(const char* name, PowerMode& mode)
+{
+  for (uint8_t i = 0; i <= POWER_MODE_OFF; i++) {
+    if (strcmp(name, POWER_MODE_NAMES[i]) == 0) {
+      mode = (PowerMode)i;
+      return true;
+    }
+  }
+  return false;
+}
+
+const char* PowerManager::getPhaseName(PowerPhase phase)
+{
+  return phase <= POWER_PHASE_STARTING ? POWER_PHASE_NAMES[phase] : "unknown";
+}
+
+const char* PowerManager::getStateName(PowerState state)
+{
+  return state < POWER_STATE_COUNT ? POWER_STATE_NAMES[state] : "unknown";
+}
+
+bool PowerManager::parseTime(const char* text, uint16_t& minute)
+{
+  unsigned int hours;
+  unsigned int minutes;
+  char extra;
+
+  if (!isdigit((unsigned char)text[0]) || sscanf(text, "%u:%u%c", &hours, &minutes, &extra) != 2 ||
+      hours > 23 || minutes > 59) {
+    return false;
+  }
+  minute = hours * 60 + minutes;
+  return true;
+}
+
+bool PowerManager::parseDays(const char* text, uint8_t& days)
+{
+  if (strcmp(text, "daily") == 0) {
+    days = POWER_DAYS_ALL;
+    return true;
+  }
+  if (strcmp(text, "weekdays") == 0) {
+    days = POWER_DAYS_WEEKDAYS;
+    return true;
+  }
+  if (strcmp(text, "weekends") == 0) {
+    days = POWER_DAYS_WEEKENDS;
+    return true;
+  }
+  if (strcmp(text, "none") == 0) {
+    days = 0;
+    return true;
+  }
+
+  if (isdigit((unsigned char)text[0])) {
+    char* end;
+    unsigned long mask = strtoul(text, &end, 10);
+    if (*end != '\0' || mask > POWER_DAYS_ALL) return false;
+    days = mask;
+    return true;
+  }
+
+  // Comma-separated three-letter names
+  uint8_t mask = 0;
+  const char* p = text;
+  while (true) {
+    uint8_t day = 0;
+    while (day < 7 && strncmp(p, POWER_DAY_NAMES[day], 3) != 0) {
+      day++;
+    }
+    if (day == 7) return false;
+
+    mask |= 1 << day;
+    p += 3;
+    if (*p == '\0') break;
+    if (*p != ',') return false;
+    p++;
+  }
+
+  days = mask;
+  return true;
+}
+
+void PowerManager::formatDays(uint8_t days, char* buffer, size_t size)
+{
+  size_t length = 0;
+  buffer[0] = '\0';
+
+  for (uint8_t day = 0; day < 7; day++) {
+    if (!(days & (1 << day))) continue;
+    int written = snprintf(buffer + length, size - length, "%s%s", length > 0 ? "," : "", POWER_DAY_NAMES[day]);
+    if (written < 0 || (size_t)written >= size - length) return;
+    length += written;
+  }
+}
@@ -0,0 +1,176 @@
+#ifndef POWERMANAGER_H
+#define POWERMANAGER_H
+
+#include <Arduino.h>
+#include <time.h>
+#include "max6921.h"
+#include "filament.h"
+
+// Night mode: scheduled dimming and power-down of the tube.
+//
+// Up to POWER_SCHEDULES windows of local time each select dim (the display is scaled down to the window's level)
+// or off. Outside every window the tube is on; where windows overlap the darker one wins. A runtime override
+// (from the API) replaces the schedules until it expires or is cleared.
+//
+// Turning the tube off and on is sequenced:
+//
+//   off:  blank the display, ramp the boost down (the regulator does this while isBoostStopping() and reports
+//         back with boostStopped()), then drop the filament to its standby level and put the CPU into low power
+//   on:   ramp the filament up to its normal level and let the cathode heat, soft-start the boost with the display
+//         still blank (isBoostStarting(), ended by boostReady()), then unblank
+//
+// Blanking first means nothing is drawn while the anode voltage sags, and the cathode stays hot for as long as
+// the boost runs. The heating wait is POWER_FILAMENT_WARMUP_MS from cold and shrinks in proportion as the standby
+// level approaches the normal one, so a warm standby wakes almost at once.
+//
+// While off the loop has no multiplex deadline, so with automatic light sleep configured the CPU sleeps between
+// the remaining tasks; Wi-Fi stays associated through modem sleep. Light sleep stops the LEDC clock, so with a
+// standby level above 0 (or if the SDK was built without power management) the CPU clock is lowered instead.
+//
+// Time spent in each state, and how much of it the loop slept, is accumulated for /api/power and /metrics.
+
+#define POWER_SCHEDULES 4
+#define POWER_UPDATE_INTERVAL_MS 100             // How often update() should run
+#define POWER_FILAMENT_WARMUP_MS 1500            // Heating before the boost starts, from a cold filament
+#define POWER_BOOST_STOP_TIMEOUT_MS 3000         // Give up waiting for the regulator and switch off anyway
+#define POWER_BOOST_START_TIMEOUT_MS 6000        // Unblank after this long even if the target voltage was not reached
+#define POWER_CPU_MHZ 160                        // CPU clock while on
+#define POWER_LOW_CPU_MHZ 80                     // Clock while off without light sleep (the APB clock stays at 80 MHz)
+#define POWER_SLEEP_MIN_CPU_MHZ 40               // Lowest clock (XTAL) with automatic light sleep
+#define POWER_MAX_OVERRIDE_MINUTES 1440
+
+enum PowerMode : uint8_t {
+  POWER_MODE_ON = 0,
+  POWER_MODE_DIM,
+  POWER_MODE_OFF
+};
+
+// Sequencing phases, in the order a full off/on cycle passes through them
+enum PowerPhase : uint8_t {
+  POWER_PHASE_ON = 0,                            // Filament, boost and display on (possibly dimmed)
+  POWER_PHASE_STOPPING,                          // Display blanked, boost ramping down
+  POWER_PHASE_OFF,                               // Boost and filament off, CPU in low power
+  POWER_PHASE_WARMUP,                            // Filament heating, boost still off
+  POWER_PHASE_STARTING                           // Boost soft-starting, display still blanked
+};
+
+// States the residency is measured in
+enum PowerState : uint8_t {
+  POWER_STATE_ON = 0,
+  POWER_STATE_DIM,
+  POWER_STATE_OFF,
+  POWER_STATE_TRANSITION,                        // Any phase between on and off
+  POWER_STATE_STANDBY,                           // Off with the filament kept warm
+  POWER_STATE_COUNT
+};
+
+// One schedule window. Stored in ClockConfig, so the layout is fixed (8 bytes, no padding).
+struct PowerSchedule {
+  uint16_t startMinute;                          // Minute of the day, local time
+  uint16_t endMinute;                            // Earlier than the start for a window across midnight; equal = all day
+  uint8_t days;                                  // Days the window starts on, bit 0 = Sunday; 0 = unused
+  uint8_t mode;                                  // PowerMode (dim or off)
+  uint8_t level;                                 // Brightness scale while dimmed (0-255)
+  uint8_t reserved;
+};
+
+class PowerManager {
+private:
+  MAX6921& display;
+  Filament& filament;
+  const PowerSchedule* schedules;
+
+  uint8_t filamentLevel;                         // Normal level, and the standby level while off
+  uint8_t standbyLevel;
+  uint32_t filamentRampMs;                       // Ramp from cold to full power
+  uint32_t warmupMs;                             // Heating wait of the wake in progress
+
+  // Target from the schedules, replaced by the override while one is set
+  PowerMode scheduledMode;
+  uint8_t scheduledLevel;
+  int8_t activeSchedule;                         // -1 outside every window
+  PowerMode mode;
+  uint8_t level;
+  bool overridden;
+  PowerMode overrideMode;
+  uint8_t overrideLevel;
+  int64_t overrideUntilUs;                       // 0 = until cleared
+
+  PowerPhase phase;
+  int64_t phaseSinceUs;
+  bool boostHasStopped;                          // Reported by the regulator, consumed by update()
+  bool boostIsReady;
+  uint32_t transitions;                          // Completed switches to off or back on
+
+  bool lowPower;
+  bool lightSleep;                               // Automatic light sleep is configured (rather than a lower clock)
+
+  PowerState state;
+  int64_t accountedUs;                           // Residency is accounted up to here
+  uint64_t accountedSleepUs;                     // Loop sleep total at that time
+  uint64_t residencyUs[POWER_STATE_COUNT];
+  uint64_t sleepUs[POWER_STATE_COUNT];
+
+  void evaluate(const struct tm* localTime);
+  void advance(int64_t now);
+  void enterPhase(PowerPhase next, int64_t now);
+  void account(int64_t now, uint64_t sleepTotalUs);
+  PowerState getCurrentState() const;
+  void setFilament(bool on);
+  void setLowPower(bool enable);
+
+public:
+  PowerManager(MAX6921& display, Filament& filament);
+
+  // Starts the filament's warm-up ramp; schedules points at POWER_SCHEDULES entries that stay valid (the live config)
+  void begin(const PowerSchedule* schedules);
+
+  // Filament levels (0-255) while on and while off, and the ramp time from cold to full power. May be called
+  // before begin(); afterwards the filament moves to the new level of the current phase.
+  void setFilamentProfile(uint8_t level, uint8_t standby, uint32_t rampMs);
+
+  // Evaluates the schedules for the local time (NULL while the clock is not set: keeps the current target) and
+  // steps the sequence. sleepTotalUs is the loop's sleep total, for the residency.
+  void update(const struct tm* localTime, uint64_t sleepTotalUs);
+
+  // Overrides the schedules; minutes = 0 lasts until clearOverride()
+  void setOverride(PowerMode mode, uint8_t level, uint32_t minutes);
+  void clearOverride();
+
+  // Boost regulator hand-off
+  bool isBoostStopping() const { return phase == POWER_PHASE_STOPPING; }
+  bool isBoostStarting() const { return phase == POWER_PHASE_STARTING; }
+  bool isBoostOff() const { return phase == POWER_PHASE_OFF || phase == POWER_PHASE_WARMUP; }
+  void boostStopped() { boostHasStopped = true; }
+  void boostReady() { boostIsReady = true; }
+
+  PowerMode getMode() const { return mode; }
+  uint8_t getLevel() const { return level; }
+  int8_t getActiveSchedule() const { return activeSchedule; }
+  bool isOverridden() const { return overridden; }
+  uint32_t getOverrideRemainingS() const;
+  PowerPhase getPhase() const { return phase; }
+  PowerState getState() const { return state; }
+  bool isLowPower() const { return lowPower; }
+  bool isLightSleep() const { return lightSleep; }
+  uint32_t getTransitions() const { return transitions; }
+
+  // Residency up to the last update(), in milliseconds
+  uint64_t getResidencyMs(PowerState which) const { return which < POWER_STATE_COUNT ? residencyUs[which] / 1000 : 0; }
+  uint64_t getSleepMs(PowerState which) const { return which < POWER_STATE_COUNT ? sleepUs[which] / 1000 : 0; }
+  void resetResidency();
+
+  static const char* getModeName(PowerMode mode);
+  static bool parseMode(const char* name, PowerMode& mode);
+  static const char* getPhaseName(PowerPhase phase);
+  static const char* getStateName(PowerState state);
+
+  // "HH:MM" to a minute of the day
+  static bool parseTime(const char* text, uint16_t& minute);
+  // "daily", "weekdays", "weekends", "none", a list like "mon,tue,sat" or a bit mask (0-127)
+  static bool parseDays(const char* text, uint8_t& days);
+  // The list form of a day mask; size should be at least 28
+  static void formatDays(uint8_t days, char* buffer, size_t size);
+};
+
+#endif
@@ -0,0 +1,327 @@
+#include "recording.h"
+#include <esp_timer.h>
+#include <limits.h>
+
+#define RECORDING_BRIGHTNESS_RECORD 0
+
+FrameRecorder::FrameRecorder(MAX6921& display)
+  : display(display), recording(false), lastBrightness(0), lastRecordMs(0), buffered(0), records(0), bytes(0)
+{
+  memset(last, 0, sizeof(last));
+  memset(buffer, 0, sizeof(buffer));
+}
+
+bool FrameRecorder::start(const char* path)
+{
+  stop();
+
+  file = LittleFS.open(path, FILE_WRITE);
+  if (!file) return false;
+
+  const uint8_t header[RECORDING_HEADER_SIZE] = { 'V', 'R', RECORDING_VERSION, RECORDING_DIGITS };
+  buffered = 0;
+  records = 0;
+  bytes = 0;
+  append(header, sizeof(header));
+
+  // The first update writes the whole frame and the brightness
+  for (uint8_t i = 0; i < RECORDING_DIGITS; i++) {
+    last[i] = ~display.getDigitSegments(i);
+  }
+  lastBrightness = ~display.getBrightness();
+  lastRecordMs = esp_timer_get_time() / 1000;
+
+  recording = true;
+  return true;
+}
+
+void FrameRecorder::stop()
+{
+  if (!recording) return;
+
+  // Hold the last frame until now; a file without records has no frame to hold
+  if (records > 0) {
+    int64_t nowMs = esp_timer_get_time() / 1000;
+    appendRecord(nowMs - lastRecordMs, 1, &last[0], 1);
+    lastRecordMs = nowMs;
+    if (!recording) return;
+  }
+
+  flush();
+  file.close();
+  recording = false;
+}
+
+void FrameRecorder::update()
+{
+  if (!recording) return;
+
+  uint8_t mask = 0;
+  uint8_t segments[RECORDING_DIGITS];
+  uint8_t changed = 0;
+
+  for (uint8_t i = 0; i < RECORDING_DIGITS; i++) {
+    uint8_t current = display.getDigitSegments(i);
+    if (current != last[i]) {
+      mask |= 1 << i;
+      segments[changed++] = current;
+      last[i] = current;
+    }
+  }
+
+  uint8_t brightness = display.getBrightness();
+  bool brightnessChanged = brightness != lastBrightness;
+  lastBrightness = brightness;
+
+  if (mask == 0 && !brightnessChanged) return;
+
+  // Whole milliseconds since the last record, taken from absolute time so rounding does not accumulate
+  int64_t nowMs = esp_timer_get_time() / 1000;
+  uint32_t delay = nowMs - lastRecordMs;
+  lastRecordMs = nowMs;
+
+  if (brightnessChanged) {
+    appendRecord(delay, RECORDING_BRIGHTNESS_RECORD, &brightness, 1);
+    delay = 0;
+  }
+
+  if (mask != 0) {
+    // A brightness record at the same time already carried the delay
+    appendRecord(delay, mask, segments, changed);
+  }
+
+  if (bytes + buffered >= RECORDING_MAX_BYTES) {
+    stop();
+  }
+}
+
+void FrameRecorder::appendRecord(uint32_t delay, uint8_t mask, const uint8_t* data, uint8_t count)
+{
+  uint8_t record[RECORDING_MAX_RECORD];
+  uint8_t length = 0;
+
+  do {
+    record[length++] = (delay & 0x7F) | (delay > 0x7F ? 0x80 : 0);
+    delay >>= 7;
+  } while (delay != 0);
+  record[length++] = mask;
+  memcpy(record + length, data, count);
+  length += count;
+
+  append(record, length);
+  records++;
+}
+
+void FrameRecorder::append(const uint8_t* data, uint8_t length)
+{
+  if (buffered + length > sizeof(buffer) && !flush()) {
+    // Out of space; keep what was written
+    file.close();
+    recording = false;
+    return;
+  }
+
+  memcpy(buffer + buffered, data, length);
+  buffered += length;
+}
+
+bool FrameRecorder::flush()
+{
+  if (buffered == 0) return true;
+
+  size_t written = file.write(buffer, buffered);
+  bytes += written;
+  bool complete = written == buffered;
+  buffered = 0;
+  return complete;
+}
+
+FramePlayer::FramePlayer(MAX6921& display)
+  : display(display), playing(false), looping(false), numDigits(RECORDING_DIGITS),
+    idleBrightness(MAX6921_MAX_BRIGHTNESS), bufferLength(0), bufferPosition(0), endOfFile(false),
+    hasPending(false), pendingDelayMs(0), pendingMask(0), lastRecordUs(0), recordsPlayed(0), loops(0), maxLateUs(0)
+{
+  memset(buffer, 0, sizeof(buffer));
+  memset(pendingData, 0, sizeof(pendingData));
+}
+
+bool FramePlayer::start(const char* path, bool loop)
+{
+  stop();
+
+  file = LittleFS.open(path, FILE_READ);
+  if (!file) return false;
+
+  uint8_t header[RECORDING_HEADER_SIZE];
+  if (file.read(header, sizeof(header)) != sizeof(header) || header[0] != 'V' || header[1] != 'R' ||
+      header[2] != RECORDING_VERSION || header[3] == 0 || header[3] > RECORDING_DIGITS) {
+    file.close();
+    return false;
+  }
+
+  numDigits = header[3];
+  looping = loop;
+  bufferLength = 0;
+  bufferPosition = 0;
+  endOfFile = false;
+  recordsPlayed = 0;
+  loops = 0;
+  maxLateUs = 0;
+
+  if (!readNext()) {
+    file.close();
+    return false;
+  }
+
+  lastRecordUs = esp_timer_get_time();
+  playing = true;
+  return true;
+}
+
+void FramePlayer::stop()
+{
+  if (!playing && !file) return;
+
+  file.close();
+  hasPending = false;
+  if (playing) {
+    playing = false;
+    display.setBrightness(idleBrightness);
+  }
+}
+
+void FramePlayer::update()
+{
+  if (!playing) return;
+
+  int64_t now = esp_timer_get_time();
+
+  for (int i = 0; i < RECORDING_MAX_RECORDS_PER_UPDATE && hasPending; i++) {
+    int64_t due = lastRecordUs + (int64_t)pendingDelayMs * 1000;
+    if (now < due) return;
+
+    if (now - due > maxLateUs) {
+      maxLateUs = now - due;
+    }
+
+    // Stay on the recorded schedule, even when this record is shown late
+    lastRecordUs = due;
+    apply();
+    readNext();
+  }
+
+  // The last record is the recorder's hold, so this comes only after the last frame has had its recorded length
+  if (!hasPending) {
+    stop();
+  }
+}
+
+unsigned long FramePlayer::getMicrosToNextFrame() const
+{
+  if (!playing || !hasPending) return ULONG_MAX;
+
+  int64_t remaining = lastRecordUs + (int64_t)pendingDelayMs * 1000 - esp_timer_get_time();
+  return remaining > 0 ? (unsigned long)remaining : 0;
+}
+
+bool FramePlayer::fill()
+{
+  // Keep at least one whole record in the buffer, moving the unread bytes to the front
+  if (bufferLength - bufferPosition >= RECORDING_MAX_RECORD || endOfFile) {
+    return bufferPosition < bufferLength;
+  }
+
+  memmove(buffer, buffer + bufferPosition, bufferLength - bufferPosition);
+  bufferLength -= bufferPosition;
+  bufferPosition = 0;
+
+  size_t count = file.read(buffer + bufferLength, sizeof(buffer) - bufferLength);
+  bufferLength += count;
+  if (count == 0) {
+    endOfFile = true;
+  }
+  return bufferPosition < bufferLength;
+}
+
+bool FramePlayer::readNext()
+{
+  hasPending = false;
+
+  if (!fill() && looping && recordsPlayed > 0) {
+    // Start over after the header; the first record's delay spaces the loops
+    file.seek(RECORDING_HEADER_SIZE);
+    bufferLength = 0;
+    bufferPosition = 0;
+    endOfFile = false;
+    loops++;
+    fill();
+  }
+
+  // A record cut short at the end of the file ends playback
+  uint32_t delay = 0;
+  uint8_t shift = 0;
+  uint8_t byte;
+  do {
+    if (bufferPosition >= bufferLength || shift > 28) return false;
+    byte = buffer[bufferPosition++];
+    delay |= (uint32_t)(byte & 0x7F) << shift;
+    shift += 7;
+  } while (byte & 0x80);
+
+  if (bufferPosition >= bufferLength) return false;
+  uint8_t mask = buffer[bufferPosition++];
+
+  uint8_t count = 0;
+  if (mask == RECORDING_BRIGHTNESS_RECORD) {
+    count = 1;
+  }
+  else {
+    for (uint8_t i = 0; i < RECORDING_DIGITS; i++) {
+      if (mask & (1 << i)) {
+        count++;
+      }
+    }
+  }
+
+  if (bufferLength - bufferPosition < count) return false;
+  memcpy(pendingData, buffer + bufferPosition, count);
+  bufferPosition += count;
+
+  pendingDelayMs = delay;
+  pendingMask = mask;
+  hasPending = true;
+  return true;
+}
+
+void FramePlayer::apply()
+{
+  recordsPlayed++;
+
+  if (pendingMask == RECORDING_BRIGHTNESS_RECORD) {
+    display.setBrightness(pendingData[0]);
+    return;
+  }
+
+  // Digits beyond the recorded count are skipped rather than trusted
+  uint8_t next = 0;
+  for (uint8_t i = 0; i < RECORDING_DIGITS; i++) {
+    if (pendingMask & (1 << i)) {
+      if (i < numDigits) {
+        display.setDigitSegments(i, pendingData[next]);
+      }
+      next++;
+    }
+  }
+}
+
+bool FramePlayer::isValidFile(const char* path)
+{
+  File file = LittleFS.open(path, FILE_READ);
+  if (!file) return false;
+
+  uint8_t header[RECORDING_HEADER_SIZE];
+  bool valid = file.read(header, sizeof(header)) == sizeof(header) && header[0] == 'V' && header[1] == 'R' &&
+               header[2] == RECORDING_VERSION && header[3] > 0 && header[3] <= RECORDING_DIGITS;
+  file.close();
+  return valid;
+}
@@ -0,0 +1,130 @@
+#ifndef RECORDING_H
+#define RECORDING_H
+
+#include <Arduino.h>
+#include <LittleFS.h>
+#include "max6921.h"
+
+// Frame recordings on LittleFS.
+//
+// FrameRecorder captures what the display shows (segment masks and brightness) as a delta-encoded file;
+// FramePlayer streams such a file back onto the display. Both go through small fixed buffers, so a show of any
+// length costs the same RAM and no heap. File layout (little-endian):
+//
+//   offset  size  field
+//   0       2     magic 'V' 'R'
+//   2       1     format version (RECORDING_VERSION)
+//   3       1     digit count N (1..MAX_DIGITS)
+//   4       ...   records:
+//                   varint  time since the previous record in ms (7 bits per byte, low bits first)
+//                   1       change mask, bit i set = digit i (from the left) follows
+//                   k       segment masks of the changed digits, left to right
+//
+// A change mask of 0 marks a brightness record: one brightness byte (0-255) follows instead of segment masks.
+// The recorder ends a file with a hold record, which repeats the leftmost digit with the time from the last
+// change to stop(), so the last frame keeps its length on playback and before a loop starts over.
+// Playback is timed with esp_timer, the timebase the multiplexer runs on, and keeps to the recorded schedule
+// rather than to when the loop happened to run.
+
+#define RECORDING_VERSION 1
+#define RECORDING_HEADER_SIZE 4
+#define RECORDING_DIGITS 8                       // Digits recorded and played back (the change mask is one byte)
+#define RECORDING_MAX_RECORD (5 + 1 + RECORDING_DIGITS)
+#define RECORDING_BUFFER_SIZE 256                // Read and write buffer of the recorder and player
+#define RECORDING_MAX_BYTES 524288UL             // The recorder stops once the file reaches this size
+#define RECORDING_MAX_RECORDS_PER_UPDATE 16      // Bounds the catch-up work after a stall
+
+class FrameRecorder {
+private:
+  MAX6921& display;
+
+  File file;
+  bool recording;
+  uint8_t last[RECORDING_DIGITS];
+  uint8_t lastBrightness;
+  int64_t lastRecordMs;
+
+  uint8_t buffer[RECORDING_BUFFER_SIZE];
+  uint16_t buffered;
+
+  uint32_t records;
+  uint32_t bytes;
+
+  bool flush();
+  void append(const uint8_t* data, uint8_t length);
+  void appendRecord(uint32_t delay, uint8_t mask, const uint8_t* data, uint8_t count);
+
+public:
+  FrameRecorder(MAX6921& display);
+
+  // Start recording the display into path, replacing the file
+  bool start(const char* path);
+
+  // Ends the file with the hold record and closes it
+  void stop();
+
+  // Records the display contents if they changed; call once per loop pass after drawing
+  void update();
+
+  bool isRecording() const { return recording; }
+  uint32_t getRecords() const { return records; }
+  uint32_t getBytes() const { return bytes + buffered; }
+};
+
+class FramePlayer {
+private:
+  MAX6921& display;
+
+  File file;
+  bool playing;
+  bool looping;
+  uint8_t numDigits;
+  uint8_t idleBrightness;                        // Brightness restored when playback ends
+
+  uint8_t buffer[RECORDING_BUFFER_SIZE];
+  uint16_t bufferLength;
+  uint16_t bufferPosition;
+  bool endOfFile;
+
+  // The next record, decoded ahead of time
+  bool hasPending;
+  uint32_t pendingDelayMs;
+  uint8_t pendingMask;
+  uint8_t pendingData[RECORDING_DIGITS];
+  int64_t lastRecordUs;                          // Scheduled time of the last record shown
+
+  uint32_t recordsPlayed;
+  uint32_t loops;
+  uint32_t maxLateUs;
+
+  bool fill();
+  bool readNext();
+  void apply();
+
+public:
+  FramePlayer(MAX6921& display);
+
+  // Start playing path; with loop set the file restarts at its end. Fails if the file is missing or malformed.
+  bool start(const char* path, bool loop);
+  void stop();
+
+  // Shows every record that is due
+  void update();
+
+  // Until the next record is due, for the loop's sleep
+  unsigned long getMicrosToNextFrame() const;
+
+  // Brightness the display returns to when playback ends
+  void setIdleBrightness(uint8_t level) { idleBrightness = level; }
+
+  bool isPlaying() const { return playing; }
+  bool isLooping() const { return looping; }
+  uint32_t getRecordsPlayed() const { return recordsPlayed; }
+  uint32_t getLoops() const { return loops; }
+  uint32_t getMaxLateUs() const { return maxLateUs; }
+
+  // Checks the header of a stored recording
+  static bool isValidFile(const char* path);
+};
+
+#endif
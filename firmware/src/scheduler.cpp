@@ -0,0 +1,233 @@
+#include "scheduler.h"
+
+#define SLOT_MASK (SCHEDULER_SLOTS - 1)
+#define LEVEL_SHIFT(level) ((level) * SCHEDULER_SLOT_BITS)
+#define LEVEL_RANGE(level) (1UL << LEVEL_SHIFT((level) + 1))   // Ticks covered by levels 0..level
+
+SchedulerTask::SchedulerTask(const char* name, void (*callback)(), uint32_t periodMs)
+  : name(name), callback(callback), periodMs(periodMs), deadline(0), next(NULL), prev(NULL), level(0), slot(0),
+    scheduled(false), runs(0), maxLateMs(0)
+{
+}
+
+Scheduler::Scheduler()
+  : currentTick(0), expired(NULL), loopTask(NULL), wakeTimer(NULL), sleepTotalUs(0), wakeCount(0)
+{
+  memset(slots, 0, sizeof(slots));
+  memset(occupied, 0, sizeof(occupied));
+}
+
+bool Scheduler::begin()
+{
+  currentTick = millis();
+  loopTask = xTaskGetCurrentTaskHandle();
+
+  esp_timer_create_args_t args = {};
+  args.callback = wake;
+  args.arg = loopTask;
+  args.name = "scheduler";
+  return esp_timer_create(&args, &wakeTimer) == ESP_OK;
+}
+
+void Scheduler::wake(void* arg)
+{
+  xTaskNotifyGive((TaskHandle_t)arg);
+}
+
+void Scheduler::insert(SchedulerTask& task)
+{
+  // Overdue tasks go into the next slot to be processed
+  uint32_t delta = task.deadline - currentTick;
+  uint32_t due = task.deadline;
+  if ((int32_t)delta < 0) {
+    delta = 0;
+    due = currentTick;
+  }
+
+  uint8_t level = 0;
+  while (level < SCHEDULER_LEVELS - 1 && delta >= LEVEL_RANGE(level)) {
+    level++;
+  }
+
+  // Beyond the wheel: park in the furthest slot and file again when it cascades
+  if (delta >= LEVEL_RANGE(SCHEDULER_LEVELS - 1)) {
+    due = currentTick + LEVEL_RANGE(SCHEDULER_LEVELS - 1) - 1;
+  }
+
+  uint8_t slot = (due >> LEVEL_SHIFT(level)) & SLOT_MASK;
+
+  task.level = level;
+  task.slot = slot;
+  task.prev = NULL;
+  task.next = slots[level][slot];
+  if (task.next != NULL) {
+    task.next->prev = &task;
+  }
+  slots[level][slot] = &task;
+  occupied[level] |= 1ULL << slot;
+  task.scheduled = true;
+}
+
+void Scheduler::unlink(SchedulerTask& task)
+{
+  if (task.prev != NULL) {
+    task.prev->next = task.next;
+  }
+  else if (task.level == SCHEDULER_EXPIRED) {
+    expired = task.next;
+  }
+  else {
+    slots[task.level][task.slot] = task.next;
+    if (task.next == NULL) {
+      occupied[task.level] &= ~(1ULL << task.slot);
+    }
+  }
+  if (task.next != NULL) {
+    task.next->prev = task.prev;
+  }
+
+  task.next = NULL;
+  task.prev = NULL;
+  task.scheduled = false;
+}
+
+void Scheduler::schedule(SchedulerTask& task, uint32_t delayMs)
+{
+  if (task.scheduled) {
+    unlink(task);
+  }
+
+  task.deadline = millis() + delayMs;
+  insert(task);
+}
+
+void Scheduler::cancel(SchedulerTask& task)
+{
+  if (task.scheduled) {
+    unlink(task);
+  }
+}
+
+void Scheduler::cascade(uint8_t level, uint8_t slot)
+{
+  SchedulerTask* task = slots[level][slot];
+  slots[level][slot] = NULL;
+  occupied[level] &= ~(1ULL << slot);
+
+  // Relative to currentTick the tasks now fall into a lower level
+  while (task != NULL) {
+    SchedulerTask* following = task->next;
+    insert(*task);
+    task = following;
+  }
+}
+
+void Scheduler::run()
+{
+  uint32_t now = millis();
+
+  while ((int32_t)(now - currentTick) >= 0) {
+    uint32_t tick = currentTick;
+
+    // Nothing can be due before the next occupied slot or the next cascade; skip ahead
+    uint32_t skip = getTicksToNext();
+    if (skip > 0) {
+      currentTick += min(skip, now - tick + 1);
+      continue;
+    }
+
+    // Higher levels first, so tasks cascading from level 2 can continue down to level 0 on the same tick
+    if ((tick & SLOT_MASK) == 0) {
+      for (int level = SCHEDULER_LEVELS - 1; level > 0; level--) {
+        if ((tick & (LEVEL_RANGE(level - 1) - 1)) == 0) {
+          cascade(level, (tick >> LEVEL_SHIFT(level)) & SLOT_MASK);
+        }
+      }
+    }
+
+    // Move the due list aside, where tasks rescheduled from a callback land in later slots. The tasks stay linked
+    // and scheduled there, so a callback that cancels or reschedules one that has not run yet takes it out.
+    uint8_t slot = tick & SLOT_MASK;
+    expired = slots[0][slot];
+    slots[0][slot] = NULL;
+    occupied[0] &= ~(1ULL << slot);
+    currentTick = tick + 1;
+    for (SchedulerTask* task = expired; task != NULL; task = task->next) {
+      task->level = SCHEDULER_EXPIRED;
+    }
+
+    while (expired != NULL) {
+      SchedulerTask* task = expired;
+      unlink(*task);
+
+      uint32_t late = now - task->deadline;
+      if (late > task->maxLateMs) {
+        task->maxLateMs = late;
+      }
+
+      // Periodic tasks keep their phase; after a stall they skip the missed runs instead of bunching up
+      if (task->periodMs > 0) {
+        task->deadline += task->periodMs;
+        if ((int32_t)(task->deadline - now) <= 0) {
+          task->deadline = now + task->periodMs;
+        }
+        insert(*task);
+      }
+
+      task->runs++;
+      task->callback();
+    }
+  }
+}
+
+uint32_t Scheduler::getTicksToNext() const
+{
+  uint8_t position = currentTick & SLOT_MASK;
+  uint32_t ticks = UINT32_MAX;
+
+  // Level 0 holds exact deadlines: the first occupied slot from the current position is the next one due
+  if (occupied[0] != 0) {
+    uint64_t rotated = (occupied[0] >> position) | (position ? occupied[0] << (SCHEDULER_SLOTS - position) : 0);
+    ticks = __builtin_ctzll(rotated);
+  }
+
+  // Tasks in the higher levels can't be due before level 0 wraps and the next slot cascades
+  for (uint8_t level = 1; level < SCHEDULER_LEVELS; level++) {
+    if (occupied[level] != 0) {
+      uint32_t toCascade = position ? SCHEDULER_SLOTS - position : 0;
+      return min(ticks, toCascade);
+    }
+  }
+
+  return ticks;
+}
+
+uint32_t Scheduler::getMicrosToNextDeadline() const
+{
+  uint32_t ticks = getTicksToNext();
+  if (ticks == UINT32_MAX) return UINT32_MAX;
+
+  // millis() is esp_timer time in whole milliseconds, so the task is due at the start of that millisecond
+  int64_t now = esp_timer_get_time();
+  uint32_t nowMs = now / 1000;
+  uint32_t due = currentTick + ticks;
+  if ((int32_t)(due - nowMs) <= 0) return 0;
+
+  return (due - nowMs) * 1000UL - (uint32_t)(now % 1000);
+}
+
+void Scheduler::sleep(uint32_t maxSleepUs)
+{
+  uint32_t sleepUs = min(maxSleepUs, getMicrosToNextDeadline());
+  if (sleepUs < SCHEDULER_MIN_SLEEP_US || wakeTimer == NULL) return;
+
+  int64_t start = esp_timer_get_time();
+
+  // Block the loop task until the one-shot timer notifies it; the idle task runs meanwhile
+  esp_timer_start_once(wakeTimer, sleepUs - SCHEDULER_WAKE_MARGIN_US);
+  ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(sleepUs / 1000) + 2);
+  esp_timer_stop(wakeTimer);
+
+  sleepTotalUs += esp_timer_get_time() - start;
+  wakeCount++;
+}
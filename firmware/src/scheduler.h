@@ -0,0 +1,88 @@
+#ifndef SCHEDULER_H
+#define SCHEDULER_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <freertos/FreeRTOS.h>
+#include <freertos/task.h>
+
+// Hierarchical timer wheel for the firmware's periodic and one-shot tasks.
+//
+// Three levels of 64 slots with 1 ms, 64 ms and 4.096 s granularity cover deadlines up to about 4.4 minutes;
+// later ones are parked in the last level and filed again when it comes round. Scheduling and cancelling are
+// O(1) list operations. run() walks the elapsed milliseconds and, each time a level wraps, cascades the next
+// slot of the level above into it. Occupancy bitmaps give the next deadline without visiting the tasks, so
+// loop() can sleep until then (or until the next display multiplex step) instead of polling every task.
+
+#define SCHEDULER_SLOT_BITS 6
+#define SCHEDULER_SLOTS (1 << SCHEDULER_SLOT_BITS)
+#define SCHEDULER_LEVELS 3
+#define SCHEDULER_EXPIRED SCHEDULER_LEVELS // Level of a task in the due list that run() is working through
+#define SCHEDULER_MIN_SLEEP_US 200       // Shorter waits are spun; a context switch costs about as much
+#define SCHEDULER_WAKE_MARGIN_US 50      // Wake this much early to absorb the wake-up latency
+
+class Scheduler;
+
+struct SchedulerTask {
+  const char* name;
+  void (*callback)();
+  uint32_t periodMs;                     // 0 for one-shot tasks
+
+  // Owned by the scheduler
+  uint32_t deadline;                     // millis() at which the task is due
+  SchedulerTask* next;
+  SchedulerTask* prev;
+  uint8_t level;                         // SCHEDULER_EXPIRED while waiting in run()
+  uint8_t slot;
+  bool scheduled;
+  uint32_t runs;
+  uint32_t maxLateMs;                    // Worst delay between the deadline and the call
+
+  SchedulerTask(const char* name, void (*callback)(), uint32_t periodMs = 0);
+};
+
+class Scheduler {
+private:
+  SchedulerTask* slots[SCHEDULER_LEVELS][SCHEDULER_SLOTS];
+  uint64_t occupied[SCHEDULER_LEVELS];   // Bit per non-empty slot
+  uint32_t currentTick;                  // Next millisecond to process
+  SchedulerTask* expired;                // Due tasks of the tick being run, still cancellable
+
+  TaskHandle_t loopTask;
+  esp_timer_handle_t wakeTimer;
+
+  uint64_t sleepTotalUs;
+  uint32_t wakeCount;
+
+  void insert(SchedulerTask& task);
+  void unlink(SchedulerTask& task);
+  void cascade(uint8_t level, uint8_t slot);
+  uint32_t getTicksToNext() const;
+
+  static void wake(void* arg);
+
+public:
+  Scheduler();
+
+  // Must be called from the task that later calls sleep() (the Arduino loop task)
+  bool begin();
+
+  // (Re)arm a task to run delayMs from now. Periodic tasks then repeat every periodMs.
+  void schedule(SchedulerTask& task, uint32_t delayMs);
+  void cancel(SchedulerTask& task);
+
+  // Takes effect from the next run
+  void setPeriod(SchedulerTask& task, uint32_t periodMs) { task.periodMs = periodMs; }
+
+  // Calls every task that is due
+  void run();
+
+  // Blocks until the next task is due, or at most maxSleepUs
+  void sleep(uint32_t maxSleepUs);
+
+  uint32_t getMicrosToNextDeadline() const;
+  uint64_t getSleepTotalUs() const { return sleepTotalUs; }
+  uint32_t getWakeCount() const { return wakeCount; }
+};
+
+#endif
@@ -0,0 +1,112 @@
+#ifndef SEGMENTFONT_H
+#define SEGMENTFONT_H
+
+#include <stdint.h>
+
+// Seven-segment character map (bit 0 = A ... bit 6 = G, bit 7 = H/decimal point).
+//
+// The table is built by a constexpr function, so it lives in flash and text can be rendered to segment masks
+// at compile time (see messages.h) as well as at run time.
+
+struct SegmentFont {
+  uint8_t map[128];
+};
+
+constexpr SegmentFont makeSegmentFont()
+{
+  SegmentFont font = {};
+
+  // Numbers
+  font.map['0'] = 0b00111111;  // ABCDEF
+  font.map['1'] = 0b00000110;  // BC
+  font.map['2'] = 0b01011011;  // ABDEG
+  font.map['3'] = 0b01001111;  // ABCDG
+  font.map['4'] = 0b01100110;  // BCFG
+  font.map['5'] = 0b01101101;  // ACDFG
+  font.map['6'] = 0b01111101;  // ACDEFG
+  font.map['7'] = 0b00000111;  // ABC
+  font.map['8'] = 0b01111111;  // ABCDEFG
+  font.map['9'] = 0b01101111;  // ABCDFG
+  
+  // Letters (A-Z)
+  font.map['A'] = 0b01110111;  // ABCEFG
+  font.map['B'] = 0b01111100;  // CDEFG
+  font.map['C'] = 0b00111001;  // ADEF
+  font.map['D'] = 0b01011110;  // BCDEG
+  font.map['E'] = 0b01111001;  // ADEFG
+  font.map['F'] = 0b01110001;  // AEFG
+  font.map['G'] = 0b00111101;  // ACDEF
+  font.map['H'] = 0b01110110;  // BCEFG
+  font.map['I'] = 0b00110000;  // EF
+  font.map['J'] = 0b00011110;  // BCDE
+  font.map['K'] = 0b01110110;  // BCEFG (same as 'H')
+  font.map['L'] = 0b00111000;  // DEF
+  font.map['M'] = 0b00010101;  // ACE (approximation)
+  font.map['N'] = 0b00110111;  // ABCEF
+  font.map['O'] = 0b00111111;  // ABCDEF
+  font.map['P'] = 0b01110011;  // ABEFG
+  font.map['Q'] = 0b01100111;  // ABCFG
+  font.map['R'] = 0b00110011;  // ABEF
+  font.map['S'] = 0b01101101;  // ACDFG
+  font.map['T'] = 0b01111000;  // DEFG
+  font.map['U'] = 0b00111110;  // BCDEF
+  font.map['V'] = 0b00011110;  // BCDE (approximation)
+  font.map['W'] = 0b00101010;  // BDG (approximation)
+  font.map['X'] = 0b01110110;  // BCEFG (approximation) (same as 'H')
+  font.map['Y'] = 0b01101110;  // BCDFG
+  font.map['Z'] = 0b01011011;  // ABDEG (same as '2')
+  
+  // Special characters
+  font.map[' '] = 0b00000000;  // All off
+  font.map['-'] = 0b01000000;  // G only
+  font.map['_'] = 0b00001000;  // D only
+  font.map['.'] = 0b10000000;  // H only (decimal point)
+  font.map[':'] = 0b01001000;  // DG
+  font.map['='] = 0b01001000;  // DG (same as colon)
+  font.map['!'] = 0b10000110;  // BC with decimal
+  font.map['?'] = 0b11010011;  // ABGEH
+  font.map['\''] = 0b00000010; // B only
+  font.map['"'] = 0b00100010;  // BF
+  font.map['<'] = 0b01110000;  // EFG
+  font.map['>'] = 0b01000011;  // ABG
+  font.map['['] = 0b00111001;  // ADEF
+  font.map[']'] = 0b00001111;  // ABCD
+  font.map['/'] = 0b01010010;  // BEG
+  font.map['\\'] = 0b01100100; // CFG
+  return font;
+}
+
+inline constexpr SegmentFont SEGMENT_FONT = makeSegmentFont();
+
+constexpr uint8_t getFontSegments(char ch)
+{
+  // Lower case letters use the upper case shapes
+  if (ch >= 'a' && ch <= 'z') {
+    ch = ch - 'a' + 'A';
+  }
+  return ((unsigned char)ch < 128) ? SEGMENT_FONT.map[(unsigned char)ch] : 0;
+}
+
+// Renders text to one mask per digit, folding a '.' into the preceding character. Returns the number of digits used.
+constexpr uint8_t renderSegments(const char* text, uint8_t* segments, uint8_t maxCount)
+{
+  int textIndex = 0;
+  uint8_t count = 0;
+
+  while (count < maxCount && text[textIndex] != '\0') {
+    segments[count] = getFontSegments(text[textIndex]);
+
+    // Skip decimal points in positioning (they share digit with previous character)
+    if (text[textIndex + 1] == '.') {
+      segments[count] |= 0x80;
+      textIndex++;
+    }
+
+    count++;
+    textIndex++;
+  }
+
+  return count;
+}
+
+#endif
@@ -0,0 +1,207 @@
+#include "timeline.h"
+
+static const char* TIMELINE_PRESET_NAMES[] = { "glitch", "crossfade", "wipe", "cascade", "random" };
+
+// Glitch in, hold, glitch out at full brightness
+static constexpr Keyframe PRESET_GLITCH[] = {
+  { KEYFRAME_GLITCH, TIMELINE_SCENE_GLITCH_IN, 255, TIMELINE_EASE_LINEAR, 0 },
+  { KEYFRAME_HOLD, TIMELINE_SCENE_MESSAGE, 255, TIMELINE_EASE_LINEAR, 0 },
+  { KEYFRAME_GLITCH, TIMELINE_SCENE_GLITCH_OUT, 255, TIMELINE_EASE_LINEAR, 0 },
+};
+
+// The whole tube dims to dark, switches content and comes back up
+static constexpr Keyframe PRESET_CROSSFADE[] = {
+  { 250, TIMELINE_SCENE_CLOCK, 0, TIMELINE_EASE_IN_OUT, 0 },
+  { 250, TIMELINE_SCENE_MESSAGE, 255, TIMELINE_EASE_IN_OUT, 0 },
+  { KEYFRAME_HOLD, TIMELINE_SCENE_MESSAGE, 255, TIMELINE_EASE_LINEAR, 0 },
+  { 250, TIMELINE_SCENE_MESSAGE, 0, TIMELINE_EASE_IN_OUT, 0 },
+  { 250, TIMELINE_SCENE_CLOCK, 255, TIMELINE_EASE_IN_OUT, 0 },
+};
+
+// Same, with each digit starting its fade 40 ms after its left neighbour
+static constexpr Keyframe PRESET_WIPE[] = {
+  { 400, TIMELINE_SCENE_CLOCK, 0, TIMELINE_EASE_LINEAR, 40 },
+  { 400, TIMELINE_SCENE_MESSAGE, 255, TIMELINE_EASE_LINEAR, 40 },
+  { KEYFRAME_HOLD, TIMELINE_SCENE_MESSAGE, 255, TIMELINE_EASE_LINEAR, 0 },
+  { 400, TIMELINE_SCENE_MESSAGE, 0, TIMELINE_EASE_LINEAR, 40 },
+  { 400, TIMELINE_SCENE_CLOCK, 255, TIMELINE_EASE_LINEAR, 40 },
+};
+
+// Digits switch off one at a time from the right, then light up from the left with a short settle
+static constexpr Keyframe PRESET_CASCADE[] = {
+  { 400, TIMELINE_SCENE_CLOCK, 0, TIMELINE_EASE_STEP, -50 },
+  { 480, TIMELINE_SCENE_MESSAGE, 255, TIMELINE_EASE_OUT, 50 },
+  { KEYFRAME_HOLD, TIMELINE_SCENE_MESSAGE, 255, TIMELINE_EASE_LINEAR, 0 },
+  { 400, TIMELINE_SCENE_MESSAGE, 0, TIMELINE_EASE_STEP, -50 },
+  { 480, TIMELINE_SCENE_CLOCK, 255, TIMELINE_EASE_OUT, 50 },
+};
+
+struct PresetTable {
+  const Keyframe* keyframes;
+  uint8_t count;
+};
+
+#define PRESET_TABLE(table) { table, sizeof(table) / sizeof(table[0]) }
+
+static constexpr PresetTable PRESETS[TIMELINE_PRESET_COUNT] = {
+  PRESET_TABLE(PRESET_GLITCH),
+  PRESET_TABLE(PRESET_CROSSFADE),
+  PRESET_TABLE(PRESET_WIPE),
+  PRESET_TABLE(PRESET_CASCADE),
+};
+
+Timeline::Timeline(MAX6921& display)
+  : display(display), preset(TIMELINE_GLITCH), keyframes(PRESET_GLITCH), count(0), index(0),
+    glitchMs(0), holdMs(0), keyframeStart(0), keyframeDuration(0), scene(TIMELINE_SCENE_CLOCK),
+    active(false), sceneStarted(false)
+{
+  memset(from, MAX6921_MAX_BRIGHTNESS, sizeof(from));
+  memset(levels, MAX6921_MAX_BRIGHTNESS, sizeof(levels));
+}
+
+void Timeline::start(TimelinePreset preset, uint32_t glitchMs, uint32_t holdMs)
+{
+  if (preset >= TIMELINE_PRESET_COUNT) {
+    preset = TIMELINE_GLITCH;
+  }
+
+  this->preset = preset;
+  this->glitchMs = glitchMs;
+  this->holdMs = holdMs;
+  keyframes = PRESETS[preset].keyframes;
+  count = PRESETS[preset].count;
+  index = 0;
+
+  // Ramps start from whatever the digits show now
+  memcpy(from, levels, sizeof(from));
+
+  keyframeStart = millis();
+  active = true;
+  enterKeyframe();
+  sceneStarted = true;
+}
+
+void Timeline::enterKeyframe()
+{
+  const Keyframe& keyframe = keyframes[index];
+
+  if (keyframe.durationMs == KEYFRAME_GLITCH) {
+    keyframeDuration = glitchMs;
+  }
+  else if (keyframe.durationMs == KEYFRAME_HOLD) {
+    keyframeDuration = holdMs;
+  }
+  else {
+    keyframeDuration = keyframe.durationMs;
+  }
+
+  if (keyframe.scene != scene) {
+    scene = keyframe.scene;
+    sceneStarted = true;
+  }
+}
+
+TimelineEvent Timeline::update()
+{
+  if (!active) return TIMELINE_IDLE;
+
+  unsigned long now = millis();
+
+  // Catch up on every keyframe that ended since the last update
+  while (now - keyframeStart >= keyframeDuration) {
+    memset(from, keyframes[index].brightness, sizeof(from));
+    keyframeStart += keyframeDuration;
+
+    if (++index >= count) {
+      stop();
+      return TIMELINE_FINISHED;
+    }
+    enterKeyframe();
+  }
+
+  render(now - keyframeStart);
+
+  if (sceneStarted) {
+    sceneStarted = false;
+    return TIMELINE_SCENE_STARTED;
+  }
+  return TIMELINE_RUNNING;
+}
+
+void Timeline::render(uint32_t elapsed)
+{
+  const Keyframe& keyframe = keyframes[index];
+
+  // The stagger delays each digit's ramp; the ramps all have the same length and the last one ends with the keyframe
+  uint32_t stagger = abs(keyframe.staggerMs);
+  uint32_t spread = stagger * (TIMELINE_DIGITS - 1);
+  uint32_t ramp = (keyframeDuration > spread) ? keyframeDuration - spread : 1;
+
+  for (uint8_t i = 0; i < TIMELINE_DIGITS; i++) {
+    uint8_t order = (keyframe.staggerMs >= 0) ? i : TIMELINE_DIGITS - 1 - i;
+    uint32_t delay = stagger * order;
+
+    uint16_t progress = 0;
+    if (elapsed > delay) {
+      progress = min((elapsed - delay) * 256 / ramp, (uint32_t)256);
+    }
+
+    int16_t change = (int16_t)keyframe.brightness - from[i];
+    uint8_t level = from[i] + (change * ease(keyframe.easing, progress)) / 256;
+
+    if (level != levels[i]) {
+      display.setDigitBrightness(i, level);
+      levels[i] = level;
+    }
+  }
+}
+
+uint16_t Timeline::ease(TimelineEasing easing, uint16_t progress)
+{
+  // Fixed point, 0..256 in and out
+  uint16_t rest = 256 - progress;
+
+  switch (easing) {
+    case TIMELINE_EASE_IN:
+      return (progress * progress) >> 8;
+    case TIMELINE_EASE_OUT:
+      return 256 - ((rest * rest) >> 8);
+    case TIMELINE_EASE_IN_OUT:
+      return (progress < 128) ? (progress * progress) >> 7 : 256 - ((rest * rest) >> 7);
+    case TIMELINE_EASE_STEP:
+      return (progress >= 256) ? 256 : 0;
+    case TIMELINE_EASE_LINEAR:
+    default:
+      return progress;
+  }
+}
+
+void Timeline::stop()
+{
+  active = false;
+  sceneStarted = false;
+  scene = TIMELINE_SCENE_CLOCK;
+
+  for (uint8_t i = 0; i < TIMELINE_DIGITS; i++) {
+    if (levels[i] != MAX6921_MAX_BRIGHTNESS) {
+      display.setDigitBrightness(i, MAX6921_MAX_BRIGHTNESS);
+      levels[i] = MAX6921_MAX_BRIGHTNESS;
+    }
+  }
+}
+
+const char* Timeline::getPresetName(TimelinePreset preset)
+{
+  return preset <= TIMELINE_RANDOM ? TIMELINE_PRESET_NAMES[preset] : "unknown";
+}
+
+bool Timeline::parsePreset(const char* name, TimelinePreset& preset)
+{
+  for (int i = 0; i <= TIMELINE_RANDOM; i++) {
+    if (strcmp(name, TIMELINE_PRESET_NAMES[i]) == 0) {
+      preset = (TimelinePreset)i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,104 @@
+#ifndef TIMELINE_H
+#define TIMELINE_H
+
+#include <Arduino.h>
+#include "max6921.h"
+
+// Keyframe timelines for flash message transitions.
+//
+// A preset is a constexpr table of keyframes. Each keyframe names the scene on the tube (clock, message or a
+// glitch transition), a brightness level every digit ramps to over the keyframe's duration, an easing curve and
+// a per-digit stagger, so one table format covers cross-fades, wipes and cascades. The timeline keeps only the
+// current keyframe and each digit's starting level; every update computes the levels from the elapsed time and
+// writes the ones that changed to the driver's per-digit brightness (MAX6921::setDigitBrightness).
+// The scene is left to the caller, which draws it with the existing renderers.
+
+#define TIMELINE_DIGITS 8
+#define KEYFRAME_GLITCH 0xFFFF                 // Duration placeholder: the configured glitch duration
+#define KEYFRAME_HOLD 0xFFFE                   // Duration placeholder: the configured flash duration
+
+enum TimelineScene : uint8_t {
+  TIMELINE_SCENE_CLOCK = 0,                    // Whatever the display shows without a flash
+  TIMELINE_SCENE_MESSAGE,                      // The flash message
+  TIMELINE_SCENE_GLITCH_IN,                    // Glitch transition revealing the message
+  TIMELINE_SCENE_GLITCH_OUT,                   // Glitch transition hiding the message
+};
+
+enum TimelineEasing : uint8_t {
+  TIMELINE_EASE_LINEAR = 0,
+  TIMELINE_EASE_IN,                            // Quadratic, slow start
+  TIMELINE_EASE_OUT,                           // Quadratic, slow end
+  TIMELINE_EASE_IN_OUT,
+  TIMELINE_EASE_STEP,                          // Jumps to the target at the end of the digit's ramp
+};
+
+enum TimelinePreset : uint8_t {
+  TIMELINE_GLITCH = 0,                         // Glitch in, hold, glitch out (the original flash effect)
+  TIMELINE_CROSSFADE,                          // The clock fades out and the message fades in, and back
+  TIMELINE_WIPE,                               // Fades sweep across the tube from left to right
+  TIMELINE_CASCADE,                            // Digits drop out one by one, the message lands digit by digit
+  TIMELINE_RANDOM,                             // A different preset for every flash (not a timeline itself)
+};
+
+#define TIMELINE_PRESET_COUNT TIMELINE_RANDOM
+
+enum TimelineEvent : uint8_t {
+  TIMELINE_IDLE = 0,
+  TIMELINE_RUNNING,
+  TIMELINE_SCENE_STARTED,                      // A keyframe with a different scene began
+  TIMELINE_FINISHED,
+};
+
+struct Keyframe {
+  uint16_t durationMs;                         // Or KEYFRAME_GLITCH / KEYFRAME_HOLD
+  TimelineScene scene;                         // Shown for the whole keyframe
+  uint8_t brightness;                          // Level every digit reaches by the end (255 = full)
+  TimelineEasing easing;
+  int8_t staggerMs;                            // Delay between neighbouring digits; negative runs right to left
+};
+
+class Timeline {
+private:
+  MAX6921& display;
+
+  TimelinePreset preset;
+  const Keyframe* keyframes;
+  uint8_t count;
+  uint8_t index;                               // Keyframe being played
+  uint32_t glitchMs;
+  uint32_t holdMs;
+  unsigned long keyframeStart;
+  uint32_t keyframeDuration;
+  TimelineScene scene;
+  bool active;
+  bool sceneStarted;                           // Reported by the next update()
+
+  uint8_t from[TIMELINE_DIGITS];               // Level of each digit when the keyframe started
+  uint8_t levels[TIMELINE_DIGITS];             // Level last written to the display
+
+  void enterKeyframe();
+  void render(uint32_t elapsed);
+  static uint16_t ease(TimelineEasing easing, uint16_t progress);
+
+public:
+  Timeline(MAX6921& display);
+
+  // Play a preset. The glitch and hold lengths fill in the KEYFRAME_GLITCH / KEYFRAME_HOLD placeholders.
+  void start(TimelinePreset preset, uint32_t glitchMs, uint32_t holdMs);
+
+  // Advance to the current time and write the digit levels that changed
+  TimelineEvent update();
+
+  // End early; all digits return to full level
+  void stop();
+
+  bool isActive() const { return active; }
+  TimelineScene getScene() const { return active ? scene : TIMELINE_SCENE_CLOCK; }
+  TimelinePreset getPreset() const { return preset; }
+  uint32_t getKeyframeDuration() const { return keyframeDuration; }
+
+  static const char* getPresetName(TimelinePreset preset);
+  static bool parsePreset(const char* name, TimelinePreset& preset);
+};
+
+#endif
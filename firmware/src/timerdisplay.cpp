@@ -0,0 +1,214 @@
+#include "timerdisplay.h"
+#include <esp_timer.h>
+
+#define US_PER_CENTISECOND 10000LL
+
+static const char* TIMER_MODE_NAMES[] = { "off", "stopwatch", "countdown", "hundredths" };
+
+TimerDisplay::TimerDisplay(MAX6921& display)
+  : display(display), mode(TIMER_MODE_OFF), running(false), finished(false), runStart(0), accumulated(0),
+    countdownDuration((int64_t)TIMER_DEFAULT_COUNTDOWN_MS * 1000), finishedAt(0),
+    lapTotal(0), lapHoldUntil(0), lapHoldValue(0),
+    dashSegments(0), invalidated(true)
+{
+  memset(laps, 0, sizeof(laps));
+  memset(digitSegments, 0, sizeof(digitSegments));
+  memset(shown, 0, sizeof(shown));
+}
+
+void TimerDisplay::begin()
+{
+  for (int i = 0; i < 10; i++) {
+    digitSegments[i] = display.getCharSegments('0' + i);
+  }
+  dashSegments = display.getCharSegments('-');
+}
+
+void TimerDisplay::setMode(TimerMode newMode)
+{
+  if (newMode == mode) return;
+
+  mode = newMode;
+  reset();
+}
+
+void TimerDisplay::start()
+{
+  if (running || finished || mode == TIMER_MODE_HUNDREDTHS) return;
+
+  runStart = esp_timer_get_time();
+  running = true;
+}
+
+void TimerDisplay::stop()
+{
+  if (!running) return;
+
+  accumulated += esp_timer_get_time() - runStart;
+  running = false;
+}
+
+void TimerDisplay::reset()
+{
+  running = false;
+  finished = false;
+  accumulated = 0;
+  lapTotal = 0;
+  lapHoldUntil = 0;
+  invalidated = true;
+}
+
+bool TimerDisplay::lap()
+{
+  if (!running) return false;
+
+  int64_t now = esp_timer_get_time();
+  int64_t elapsed = getElapsedUs(now);
+  int64_t value = (mode == TIMER_MODE_COUNTDOWN) ? countdownDuration - elapsed : elapsed;
+  if (value < 0) {
+    value = 0;
+  }
+
+  laps[lapTotal % TIMER_MAX_LAPS] = value / 1000;
+  lapTotal++;
+
+  // Freeze the display on the captured time for a moment while the timer keeps running
+  lapHoldValue = value / US_PER_CENTISECOND;
+  lapHoldUntil = now + (int64_t)TIMER_LAP_HOLD_MS * 1000;
+  return true;
+}
+
+void TimerDisplay::setCountdown(uint32_t durationMs)
+{
+  countdownDuration = (int64_t)min(durationMs, (uint32_t)TIMER_MAX_COUNTDOWN_MS) * 1000;
+  if (mode == TIMER_MODE_COUNTDOWN) {
+    reset();
+  }
+}
+
+void TimerDisplay::update()
+{
+  int64_t now = esp_timer_get_time();
+
+  switch (mode) {
+    case TIMER_MODE_OFF:
+      return;
+
+    case TIMER_MODE_HUNDREDTHS:
+      if (!clock.isSet()) {
+        renderDashes();
+        return;
+      }
+      render(clock.getDayMicros(now) / US_PER_CENTISECOND, false);
+      return;
+
+    case TIMER_MODE_STOPWATCH:
+    case TIMER_MODE_COUNTDOWN:
+      break;
+  }
+
+  if (now < lapHoldUntil) {
+    render(lapHoldValue, false);
+    return;
+  }
+
+  int64_t elapsed = getElapsedUs(now);
+
+  if (mode == TIMER_MODE_STOPWATCH) {
+    render(elapsed / US_PER_CENTISECOND, false);
+    return;
+  }
+
+  // Countdown: stop at zero and blink
+  if (!finished && elapsed >= countdownDuration) {
+    accumulated = countdownDuration;
+    running = false;
+    finished = true;
+    finishedAt = now;
+  }
+
+  if (finished) {
+    bool blank = ((now - finishedAt) / ((int64_t)TIMER_BLINK_MS * 1000)) % 2 == 1;
+    render(0, blank);
+    return;
+  }
+
+  // Round up so the display reaches zero exactly when the time is up
+  int64_t remaining = countdownDuration - elapsed;
+  render((remaining + US_PER_CENTISECOND - 1) / US_PER_CENTISECOND, false);
+}
+
+int64_t TimerDisplay::getElapsedUs(int64_t now) const
+{
+  return accumulated + (running ? now - runStart : 0);
+}
+
+uint32_t TimerDisplay::getElapsedMs() const
+{
+  return getElapsedUs(esp_timer_get_time()) / 1000;
+}
+
+uint32_t TimerDisplay::getRemainingMs() const
+{
+  int64_t remaining = countdownDuration - getElapsedUs(esp_timer_get_time());
+  return remaining > 0 ? remaining / 1000 : 0;
+}
+
+uint32_t TimerDisplay::getLap(uint8_t index) const
+{
+  uint32_t oldest = lapTotal - getLapCount();
+  return laps[(oldest + index) % TIMER_MAX_LAPS];
+}
+
+void TimerDisplay::render(uint32_t centiseconds, bool blank)
+{
+  uint32_t seconds = centiseconds / 100;
+  uint8_t values[TIMER_DISPLAY_DIGITS / 2] = {
+    (uint8_t)((seconds / 3600) % 100),
+    (uint8_t)((seconds / 60) % 60),
+    (uint8_t)(seconds % 60),
+    (uint8_t)(centiseconds % 100),
+  };
+
+  // Two digits per field, with the decimal point after each field but the last: HH.MM.SS.cc
+  uint8_t segments[TIMER_DISPLAY_DIGITS];
+  for (int i = 0; i < TIMER_DISPLAY_DIGITS / 2; i++) {
+    segments[i * 2] = blank ? 0 : digitSegments[values[i] / 10];
+    segments[i * 2 + 1] = blank ? 0 : digitSegments[values[i] % 10] | (i < 3 ? 0x80 : 0);
+  }
+
+  for (uint8_t i = 0; i < TIMER_DISPLAY_DIGITS; i++) {
+    if (invalidated || segments[i] != shown[i]) {
+      display.setDigitSegments(i, segments[i]);
+      shown[i] = segments[i];
+    }
+  }
+  invalidated = false;
+}
+
+void TimerDisplay::renderDashes()
+{
+  for (uint8_t i = 0; i < TIMER_DISPLAY_DIGITS; i++) {
+    if (invalidated || shown[i] != dashSegments) {
+      display.setDigitSegments(i, dashSegments);
+      shown[i] = dashSegments;
+    }
+  }
+  invalidated = false;
+}
+
+const char* TimerDisplay::getModeName(TimerMode mode)
+{
+  return mode <= TIMER_MODE_HUNDREDTHS ? TIMER_MODE_NAMES[mode] : "unknown";
+}
+
+bool TimerDisplay::parseMode(const char* name, TimerMode& mode)
+{
+  for (int i = 0; i <= TIMER_MODE_HUNDREDTHS; i++) {
+    if (strcmp(name, TIMER_MODE_NAMES[i]) == 0) {
+      mode = (TimerMode)i;
+      return true;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,99 @@
+#ifndef TIMERDISPLAY_H
+#define TIMERDISPLAY_H
+
+#include <Arduino.h>
+#include "max6921.h"
+#include "dayclock.h"
+
+// Stopwatch, countdown and hundredths-of-a-second clock, shown as "HH.MM.SS.cc".
+//
+// Time is measured with the 64-bit esp_timer and converted to digits with integer arithmetic; only the digits
+// whose segments changed are written to the frame buffer (MAX6921::setDigitSegments), so the display follows
+// the 100 Hz hundredths digit without going through text rendering.
+
+#define TIMER_DISPLAY_DIGITS 8
+#define TIMER_MAX_LAPS 20
+#define TIMER_LAP_HOLD_MS 2000            // A captured lap stays on the display this long
+#define TIMER_BLINK_MS 250                // Blink period once a countdown reaches zero
+#define TIMER_DEFAULT_COUNTDOWN_MS 300000UL
+#define TIMER_MAX_COUNTDOWN_MS 359999990UL  // 99:59:59.99
+
+enum TimerMode : uint8_t {
+  TIMER_MODE_OFF = 0,                     // Normal clock/text display
+  TIMER_MODE_STOPWATCH,
+  TIMER_MODE_COUNTDOWN,
+  TIMER_MODE_HUNDREDTHS,                  // Wall clock with hundredths of a second
+};
+
+class TimerDisplay {
+private:
+  MAX6921& display;
+  TimerMode mode;
+
+  // Stopwatch/countdown state (esp_timer microseconds)
+  bool running;
+  bool finished;
+  int64_t runStart;                       // When the current run started
+  int64_t accumulated;                    // Time counted before the current run
+  int64_t countdownDuration;
+  int64_t finishedAt;
+
+  // Laps (ring of the most recent TIMER_MAX_LAPS), shown value in ms
+  uint32_t laps[TIMER_MAX_LAPS];
+  uint32_t lapTotal;
+  int64_t lapHoldUntil;
+  uint32_t lapHoldValue;                  // Centiseconds
+
+  // Hundredths clock: local time of day, refreshed by the caller once a minute
+  DayClock clock;
+
+  // Rendering
+  uint8_t digitSegments[10];
+  uint8_t dashSegments;
+  uint8_t shown[TIMER_DISPLAY_DIGITS];
+  bool invalidated;
+
+  int64_t getElapsedUs(int64_t now) const;
+  void render(uint32_t centiseconds, bool blank);
+  void renderDashes();
+
+public:
+  TimerDisplay(MAX6921& display);
+
+  // Builds the digit lookup from the driver's character map
+  void begin();
+
+  void update();
+
+  // Switching modes stops and resets the timer
+  void setMode(TimerMode newMode);
+  TimerMode getMode() const { return mode; }
+  bool isActive() const { return mode != TIMER_MODE_OFF; }
+
+  void start();
+  void stop();
+  void reset();
+  bool lap();
+  void setCountdown(uint32_t durationMs);
+
+  // Anchor the hundredths clock to the local time of day
+  void setClockTime(uint32_t secondsOfDay, uint32_t microsIntoSecond) { clock.setTime(secondsOfDay, microsIntoSecond); }
+  bool needsClockTime() const { return clock.needsTime(); }
+
+  // Force a full redraw, e.g. after something else was shown on the display
+  void invalidate() { invalidated = true; }
+
+  bool isRunning() const { return running; }
+  bool isFinished() const { return finished; }
+  uint32_t getElapsedMs() const;
+  uint32_t getRemainingMs() const;
+  uint32_t getCountdownMs() const { return countdownDuration / 1000; }
+  uint32_t getLapTotal() const { return lapTotal; }
+  uint8_t getLapCount() const { return lapTotal < TIMER_MAX_LAPS ? lapTotal : TIMER_MAX_LAPS; }
+  uint32_t getLap(uint8_t index) const;    // Oldest stored lap first
+
+  static const char* getModeName(TimerMode mode);
+  static bool parseMode(const char* name, TimerMode& mode);
+};
+
+#endif
@@ -0,0 +1,305 @@
+#include "timezone.h"
+
+static const int32_t SECONDS_PER_DAY = 86400;
+
+TimeZone::TimeZone()
+  : standardOffset(0), dstOffset(0), hasDst(false),
+    tableYear(0), yearStart(0), yearEnd(0), dstStartUtc(0), dstEndUtc(0)
+{
+  strcpy(rule, "UTC0");
+  memset(&dstStart, 0, sizeof(dstStart));
+  memset(&dstEnd, 0, sizeof(dstEnd));
+}
+
+bool TimeZone::isValidRule(const char* rule)
+{
+  TimeZone zone;
+  return zone.setRule(rule);
+}
+
+bool TimeZone::setRule(const char* text)
+{
+  if (text == NULL || strlen(text) > TIMEZONE_RULE_LENGTH) {
+    return false;
+  }
+
+  // Parse into locals so a bad rule leaves the current one untouched
+  const char* p = text;
+  int32_t parsedStandard;
+  int32_t parsedDst = 0;
+  bool parsedHasDst = false;
+  TransitionRule parsedStart = { DATE_MONTH_WEEK_DAY, 3, 2, 0, 0, 7200 };   // US rules, used when none are given
+  TransitionRule parsedEnd = { DATE_MONTH_WEEK_DAY, 11, 1, 0, 0, 7200 };
+
+  if (!parseName(p) || !parseOffset(p, parsedStandard, 24)) {
+    return false;
+  }
+  parsedStandard = -parsedStandard;  // POSIX offsets are west of UTC
+
+  if (*p != '\0') {
+    if (!parseName(p)) {
+      return false;
+    }
+    parsedHasDst = true;
+    parsedDst = parsedStandard + 3600;
+
+    if (*p != '\0' && *p != ',') {
+      if (!parseOffset(p, parsedDst, 24)) {
+        return false;
+      }
+      parsedDst = -parsedDst;
+    }
+
+    if (*p == ',') {
+      p++;
+      if (!parseTransition(p, parsedStart) || *p != ',') {
+        return false;
+      }
+      p++;
+      if (!parseTransition(p, parsedEnd)) {
+        return false;
+      }
+    }
+
+    if (*p != '\0') {
+      return false;
+    }
+  }
+
+  strcpy(rule, text);
+  standardOffset = parsedStandard;
+  dstOffset = parsedDst;
+  hasDst = parsedHasDst;
+  dstStart = parsedStart;
+  dstEnd = parsedEnd;
+
+  // Invalidate the transition table
+  yearStart = 0;
+  yearEnd = 0;
+  return true;
+}
+
+bool TimeZone::parseNumber(const char*& p, long minValue, long maxValue, long& value)
+{
+  if (!isdigit((unsigned char)*p)) {
+    return false;
+  }
+
+  value = 0;
+  while (isdigit((unsigned char)*p)) {
+    value = value * 10 + (*p - '0');
+    if (value > maxValue) {
+      return false;
+    }
+    p++;
+  }
+  return value >= minValue;
+}
+
+bool TimeZone::parseName(const char*& p)
+{
+  const char* start;
+  int length;
+
+  if (*p == '<') {
+    // Quoted form, e.g. <+0330>, may contain digits and signs
+    start = ++p;
+    while (isalnum((unsigned char)*p) || *p == '+' || *p == '-') {
+      p++;
+    }
+    length = p - start;
+    if (*p != '>') {
+      return false;
+    }
+    p++;
+  }
+  else {
+    start = p;
+    while (isalpha((unsigned char)*p)) {
+      p++;
+    }
+    length = p - start;
+  }
+
+  return length >= 3;
+}
+
+bool TimeZone::parseOffset(const char*& p, int32_t& seconds, int32_t maxHours)
+{
+  int32_t sign = 1;
+  if (*p == '+' || *p == '-') {
+    sign = (*p == '-') ? -1 : 1;
+    p++;
+  }
+
+  long hours;
+  long minutes = 0;
+  long secs = 0;
+  if (!parseNumber(p, 0, maxHours, hours)) {
+    return false;
+  }
+  if (*p == ':') {
+    p++;
+    if (!parseNumber(p, 0, 59, minutes)) {
+      return false;
+    }
+    if (*p == ':') {
+      p++;
+      if (!parseNumber(p, 0, 59, secs)) {
+        return false;
+      }
+    }
+  }
+
+  seconds = sign * (int32_t)(hours * 3600 + minutes * 60 + secs);
+  return true;
+}
+
+bool TimeZone::parseTransition(const char*& p, TransitionRule& transition)
+{
+  long value;
+
+  if (*p == 'M') {
+    p++;
+    transition.type = DATE_MONTH_WEEK_DAY;
+    if (!parseNumber(p, 1, 12, value)) return false;
+    transition.month = value;
+    if (*p++ != '.' || !parseNumber(p, 1, 5, value)) return false;
+    transition.week = value;
+    if (*p++ != '.' || !parseNumber(p, 0, 6, value)) return false;
+    transition.weekday = value;
+  }
+  else if (*p == 'J') {
+    p++;
+    transition.type = DATE_JULIAN;
+    if (!parseNumber(p, 1, 365, value)) return false;
+    transition.day = value;
+  }
+  else {
+    transition.type = DATE_ZERO_BASED;
+    if (!parseNumber(p, 0, 365, value)) return false;
+    transition.day = value;
+  }
+
+  transition.time = 7200;
+  if (*p == '/') {
+    p++;
+    if (!parseOffset(p, transition.time, 167)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+time_t TimeZone::transitionTime(int year, const TransitionRule& transition, int32_t offset) const
+{
+  int64_t days;
+
+  if (transition.type == DATE_MONTH_WEEK_DAY) {
+    int64_t firstOfMonth = daysFromCivil(year, transition.month, 1);
+    int64_t firstOfNext = transition.month == 12 ? daysFromCivil(year + 1, 1, 1) : daysFromCivil(year, transition.month + 1, 1);
+    int firstWeekday = (int)(((firstOfMonth + 4) % 7 + 7) % 7);  // 1970-01-01 was a Thursday
+
+    int day = (transition.weekday - firstWeekday + 7) % 7 + (transition.week - 1) * 7;
+    while (day >= firstOfNext - firstOfMonth) {
+      day -= 7;  // Week 5 means the last such weekday of the month
+    }
+    days = firstOfMonth + day;
+  }
+  else {
+    days = daysFromCivil(year, 1, 1);
+    bool leap = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+
+    if (transition.type == DATE_JULIAN) {
+      days += transition.day - 1 + ((leap && transition.day >= 60) ? 1 : 0);
+    }
+    else {
+      days += transition.day;
+    }
+  }
+
+  // The time of day is in local time as it was before the transition
+  return (time_t)(days * SECONDS_PER_DAY + transition.time - offset);
+}
+
+void TimeZone::buildTable(int year)
+{
+  tableYear = year;
+  yearStart = (time_t)(daysFromCivil(year, 1, 1) * SECONDS_PER_DAY);
+  yearEnd = (time_t)(daysFromCivil(year + 1, 1, 1) * SECONDS_PER_DAY);
+
+  if (hasDst) {
+    dstStartUtc = transitionTime(year, dstStart, standardOffset);
+    dstEndUtc = transitionTime(year, dstEnd, dstOffset);
+  }
+  else {
+    dstStartUtc = 0;
+    dstEndUtc = 0;
+  }
+}
+
+bool TimeZone::isDst(time_t utc)
+{
+  if (!hasDst) return false;
+
+  if (utc < yearStart || utc >= yearEnd) {
+    buildTable(yearFromTime(utc));
+  }
+
+  // Southern hemisphere zones start DST late in the year and end it early in the next
+  if (dstStartUtc < dstEndUtc) {
+    return utc >= dstStartUtc && utc < dstEndUtc;
+  }
+  return utc >= dstStartUtc || utc < dstEndUtc;
+}
+
+int32_t TimeZone::getUtcOffset(time_t utc)
+{
+  return isDst(utc) ? dstOffset : standardOffset;
+}
+
+time_t TimeZone::getDstStart(int year)
+{
+  if (!hasDst) return 0;
+  if (year != tableYear || yearStart == yearEnd) {
+    buildTable(year);
+  }
+  return dstStartUtc;
+}
+
+time_t TimeZone::getDstEnd(int year)
+{
+  if (!hasDst) return 0;
+  if (year != tableYear || yearStart == yearEnd) {
+    buildTable(year);
+  }
+  return dstEndUtc;
+}
+
+int64_t TimeZone::daysFromCivil(int year, unsigned month, unsigned day)
+{
+  // Days since 1970-01-01 (H. Hinnant's days_from_civil)
+  int64_t y = year - (month <= 2 ? 1 : 0);
+  int64_t era = (y >= 0 ? y : y - 399) / 400;
+  int64_t yearOfEra = y - era * 400;
+  int64_t dayOfYear = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+  int64_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + dayOfEra - 719468;
+}
+
+int TimeZone::yearFromTime(time_t utc)
+{
+  int64_t days = utc / SECONDS_PER_DAY;
+  if (utc % SECONDS_PER_DAY < 0) {
+    days--;
+  }
+
+  // Inverse of daysFromCivil, year only
+  days += 719468;
+  int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+  int64_t dayOfEra = days - era * 146097;
+  int64_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  int64_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  int64_t monthIndex = (5 * dayOfYear + 2) / 153;
+  return (int)(yearOfEra + era * 400 + (monthIndex >= 10 ? 1 : 0));
+}
@@ -0,0 +1,81 @@
+#ifndef TIMEZONE_H
+#define TIMEZONE_H
+
+#include <Arduino.h>
+#include <time.h>
+
+// POSIX TZ rule engine, e.g. "CST6CDT,M3.2.0,M11.1.0" or "AEST-10AEDT,M10.1.0,M4.1.0/3".
+//
+// The rule is parsed once. The UTC instants at which daylight saving starts and ends are computed for one
+// year at a time and cached, so converting a UTC time to local time is an offset add and two compares.
+// The table is recomputed lazily the first time a conversion falls outside the cached year.
+//
+// Supported: names (alphabetic or <quoted>), offsets [+-]hh[:mm[:ss]], DST offset (default one hour ahead of
+// standard time), and transition dates Mm.w.d, Jn and n, each with an optional /time (default 02:00:00,
+// may be negative or beyond 24h). A DST name without transition dates uses the US rules (M3.2.0,M11.1.0).
+
+#define TIMEZONE_RULE_LENGTH 47
+
+class TimeZone {
+private:
+  enum DateType : uint8_t {
+    DATE_MONTH_WEEK_DAY,             // Mm.w.d: day d (0 = Sunday) of week w (5 = last) of month m
+    DATE_JULIAN,                     // Jn: day 1-365, February 29 is never counted
+    DATE_ZERO_BASED,                 // n: day 0-365, February 29 is counted in leap years
+  };
+
+  struct TransitionRule {
+    DateType type;
+    uint8_t month;
+    uint8_t week;
+    uint8_t weekday;
+    uint16_t day;
+    int32_t time;                    // Seconds after local midnight
+  };
+
+  char rule[TIMEZONE_RULE_LENGTH + 1];
+  int32_t standardOffset;            // Seconds east of UTC
+  int32_t dstOffset;
+  bool hasDst;
+  TransitionRule dstStart;
+  TransitionRule dstEnd;
+
+  // Transition table for the cached year (all UTC)
+  int tableYear;
+  time_t yearStart;
+  time_t yearEnd;
+  time_t dstStartUtc;
+  time_t dstEndUtc;
+
+  static bool parseNumber(const char*& p, long minValue, long maxValue, long& value);
+  static bool parseName(const char*& p);
+  static bool parseOffset(const char*& p, int32_t& seconds, int32_t maxHours);
+  static bool parseTransition(const char*& p, TransitionRule& transition);
+
+  void buildTable(int year);
+  time_t transitionTime(int year, const TransitionRule& transition, int32_t offset) const;
+
+public:
+  TimeZone();
+
+  // Returns false (and keeps the current rule) if the rule cannot be parsed
+  bool setRule(const char* rule);
+  const char* getRule() const { return rule; }
+
+  // Offset from UTC in seconds at the given UTC instant
+  int32_t getUtcOffset(time_t utc);
+  bool isDst(time_t utc);
+  time_t toLocal(time_t utc) { return utc + getUtcOffset(utc); }
+
+  // UTC instants of this year's transitions (both 0 if the zone has no DST)
+  time_t getDstStart(int year);
+  time_t getDstEnd(int year);
+
+  static bool isValidRule(const char* rule);
+
+  // Calendar helpers (proleptic Gregorian, UTC)
+  static int64_t daysFromCivil(int year, unsigned month, unsigned day);
+  static int yearFromTime(time_t utc);
+};
+
+#endif
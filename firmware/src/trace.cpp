@@ -0,0 +1,83 @@
+#include "trace.h"
+#include <WebServer.h>
+
+#ifdef TRACE
+
+TraceBuffer traceBuffer;
+
+static const char* const TRACE_NAMES[TRACE_ID_COUNT] = {
+  "refreshDisplay",
+  "writeToMAX6921",
+  "MCP3221::readRaw",
+  "updateBoostDutyCycle",
+  "handleClient",
+  "sendWebUI",
+  "digit"
+};
+
+TraceBuffer::TraceBuffer()
+  : head(0), paused(false), triggerUs(0)
+{
+  memset(events, 0, sizeof(events));
+}
+
+void TraceBuffer::checkTrigger(unsigned long gapUs)
+{
+  if (triggerUs != 0 && gapUs >= triggerUs) {
+    pause();
+  }
+}
+
+void TraceBuffer::clear()
+{
+  head.store(0);
+  paused.store(false);
+}
+
+void TraceBuffer::send(WebServer& server)
+{
+  bool wasPaused = paused.exchange(true);
+
+  uint32_t recorded = head.load(std::memory_order_acquire);
+  uint32_t count = min(recorded, (uint32_t)TRACE_BUFFER_EVENTS);
+  uint32_t overwritten = recorded - count;
+
+  uint8_t header[4 + TRACE_ID_COUNT * 24 + 8];
+  size_t length = 0;
+  header[length++] = 'V';
+  header[length++] = 'T';
+  header[length++] = TRACE_VERSION;
+  header[length++] = TRACE_ID_COUNT;
+  for (uint8_t i = 0; i < TRACE_ID_COUNT; i++) {
+    size_t nameLength = strlen(TRACE_NAMES[i]) + 1;
+    memcpy(header + length, TRACE_NAMES[i], nameLength);
+    length += nameLength;
+  }
+  memcpy(header + length, &overwritten, 4);
+  memcpy(header + length + 4, &count, 4);
+  length += 8;
+
+  server.setContentLength(length + count * sizeof(TraceEvent));
+  server.sendHeader("Content-Disposition", "attachment; filename=trace.bin");
+  server.send(200, "application/octet-stream", "");
+  server.sendContent((const char*)header, length);
+
+  // Oldest first; the ring may wrap, so send it as up to two runs
+  uint32_t first = (recorded - count) & (TRACE_BUFFER_EVENTS - 1);
+  uint32_t run = min(count, (uint32_t)TRACE_BUFFER_EVENTS - first);
+  server.sendContent((const char*)&events[first], run * sizeof(TraceEvent));
+  if (run < count) {
+    server.sendContent((const char*)&events[0], (count - run) * sizeof(TraceEvent));
+  }
+
+  if (!wasPaused) {
+    resume();
+  }
+}
+
+const char* TraceBuffer::getName(TraceId id)
+{
+  return id < TRACE_ID_COUNT ? TRACE_NAMES[id] : "unknown";
+}
+
+#endif
@@ -0,0 +1,127 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <Arduino.h>
+#include <esp_timer.h>
+#include <atomic>
+
+// Begin/end trace of the timing-critical calls, for finding what held a digit lit too long.
+//
+// Built only with -DTRACE (platformio.ini ships -DTRACE_NO, like DEBUG_NO); otherwise the macros expand to
+// nothing and the buffer does not exist. Events go into a fixed ring buffer that always holds the most recent
+// TRACE_BUFFER_EVENTS. The loop task is the only writer: it fills the slot first and then publishes the new
+// head with a release store, so recording takes no lock and never blocks the multiplex. Timestamps are
+// esp_timer microseconds, the timebase the multiplexer and the scheduler run on.
+//
+// GET /trace.bin downloads the buffer and tools/vfd_trace.py converts it to Chrome trace event JSON
+// (chrome://tracing or ui.perfetto.dev). File layout (little-endian):
+//
+//   offset  size  field
+//   0       2     magic 'V' 'T'
+//   2       1     format version (TRACE_VERSION)
+//   3       1     name count N
+//   4       ...   N event names, each NUL-terminated, in TraceId order
+//   ...     4     events overwritten before the download
+//   ...     4     event count
+//   ...     8     events: timestamp us (4), id (1), phase (1), argument (2)
+
+class WebServer;
+
+#define TRACE_VERSION 1
+#define TRACE_BUFFER_EVENTS 2048                 // Power of two; 16 KB
+#define TRACE_DIGIT_BLANK 0xFFFF                 // TRACE_DIGIT argument when no digit is lit
+
+enum TraceId : uint8_t {
+  TRACE_REFRESH = 0,                             // MAX6921::refreshDisplay switching digits
+  TRACE_SPI_WRITE,                               // MAX6921::writeToMAX6921
+  TRACE_ADC_READ,                                // MCP3221::readRaw
+  TRACE_BOOST,                                   // updateBoostDutyCycle
+  TRACE_HTTP,                                    // server.handleClient
+  TRACE_WEB_UI,                                  // sendWebUI
+  TRACE_LIT_DIGIT,                               // Digit lit on the display (instant, argument = position)
+  TRACE_ID_COUNT
+};
+
+enum TracePhase : uint8_t {
+  TRACE_PHASE_BEGIN = 0,
+  TRACE_PHASE_END,
+  TRACE_PHASE_INSTANT
+};
+
+struct TraceEvent {
+  uint32_t timeUs;
+  uint8_t id;
+  uint8_t phase;
+  uint16_t argument;
+};
+
+class TraceBuffer {
+private:
+  TraceEvent events[TRACE_BUFFER_EVENTS];
+  std::atomic<uint32_t> head;                    // Events recorded since the last clear
+  std::atomic<bool> paused;
+  uint32_t triggerUs;                            // Pause once a digit stays lit this long (0 = never)
+
+public:
+  TraceBuffer();
+
+  inline void record(TraceId id, TracePhase phase, uint16_t argument = 0)
+  {
+    if (paused.load(std::memory_order_relaxed)) return;
+
+    uint32_t index = head.load(std::memory_order_relaxed);
+    TraceEvent& event = events[index & (TRACE_BUFFER_EVENTS - 1)];
+    event.timeUs = (uint32_t)esp_timer_get_time();
+    event.id = id;
+    event.phase = phase;
+    event.argument = argument;
+    head.store(index + 1, std::memory_order_release);
+  }
+
+  // Called with each multiplex gap; keeps the events that led up to a gap over the trigger
+  void checkTrigger(unsigned long gapUs);
+
+  void pause() { paused.store(true); }
+  void resume() { paused.store(false); }
+  void clear();
+
+  void setTrigger(uint32_t us) { triggerUs = us; }
+  uint32_t getTrigger() const { return triggerUs; }
+  bool isPaused() const { return paused.load(); }
+  uint32_t getRecorded() const { return head.load(); }
+
+  // Streams the buffer in the format above; recording is paused while it is copied
+  void send(WebServer& server);
+
+  static const char* getName(TraceId id);
+};
+
+class TraceScope {
+private:
+  TraceId id;
+
+public:
+  TraceScope(TraceId id);
+  ~TraceScope();
+};
+
+#ifdef TRACE
+extern TraceBuffer traceBuffer;
+
+inline TraceScope::TraceScope(TraceId id) : id(id) { traceBuffer.record(id, TRACE_PHASE_BEGIN); }
+inline TraceScope::~TraceScope() { traceBuffer.record(id, TRACE_PHASE_END); }
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(id) TraceScope TRACE_CONCAT(traceScope, __LINE__)(id)
+#define TRACE_BEGIN(id) traceBuffer.record(id, TRACE_PHASE_BEGIN)
+#define TRACE_END(id) traceBuffer.record(id, TRACE_PHASE_END)
+#define TRACE_DIGIT(position) traceBuffer.record(TRACE_LIT_DIGIT, TRACE_PHASE_INSTANT, position)
+#else
+#define TRACE_SCOPE(id) do {} while (0)
+#define TRACE_BEGIN(id) do {} while (0)
+#define TRACE_END(id) do {} while (0)
+#define TRACE_DIGIT(position) do {} while (0)
+#endif
+
+#endif
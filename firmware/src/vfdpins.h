@@ -0,0 +1,48 @@
+#ifndef VFDPINS_H
+#define VFDPINS_H
+
+#include <stdint.h>
+
+// Wiring of the IV-21 tube to the MAX6921 outputs (OUT-0 .. OUT-19), shared by the firmware and the host
+// emulator (lib/vfd_emulator). DIGIT_PINS lists the grids from the right: entry 0 drives the tube's digit 8
+// and entry NUM_DIGITS - 1 its digit 1, the leftmost. SEGMENT_PINS lists the anodes A to G and the period (H).
+
+// Initialize digit pins array
+const uint8_t DIGIT_PINS[] = {
+  15,  // Digit 1:     MAX6921 pin 7  (OUT-15)     (Adapter pin 1)      (IV-21 pin 6:  Digit 8 Grid)   
+  1,   // Digit 2:     MAX6921 pin 25 (OUT-1)      (Adapter pin 11)     (IV-21 pin 15: Digit 7 Grid)   
+  13,  // Digit 3:     MAX6921 pin 9  (OUT-13)     (Adapter pin 3)      (IV-21 pin 7:  Digit 6 Grid)   
+  2,   // Digit 4:     MAX6921 pin 24 (OUT-2)      (Adapter pin 12)     (IV-21 pin 14: Digit 5 Grid)   
+  14,  // Digit 5:     MAX6921 pin 8  (OUT-14)     (Adapter pin 4)      (IV-21 pin 8:  Digit 4 Grid)   
+  0,   // Digit 6:     MAX6921 pin 26 (OUT-0)      (Adapter pin 10)     (IV-21 pin 13: Digit 3 Grid)      
+  12,  // Digit 7:     MAX6921 pin 10 (OUT-12)     (Adapter pin 6)      (IV-21 pin 9:  Digit 2 Grid)   
+  11,  // Digit 8:     MAX6921 pin 11 (OUT-11)     (Adapter pin 8)      (IV-21 pin 12: Digit 1 Grid)   
+  10,  // Digit 9:     MAX6921 pin 12 (OUT-10)     (Adapter pin 7)      (IV-21 pin 11: Symbols Grid) (TODO: Currently not used/supported in this code)
+  17,  // Digit 10:    MAX6921 pin 5  (OUT-17)     (NOT CONNECTED)
+  18,  // Digit 11:    MAX6921 pin 4  (OUT-18)     (NOT CONNECTED)
+  19,  // Digit 12:    MAX6921 pin 3  (OUT-19)     (NOT CONNECTED)
+};
+
+// TODO: Support digit 9 - symbols grid.
+// TODO: Support digit 9 - symbols grid.
+// TODO: Support digit 9 - symbols grid.
+
+// Initialize segment pins array
+const uint8_t SEGMENT_PINS[] = {
+  16,  // Segment A:             MAX6921 pin 6  (OUT-16)    (Adapter pin 2)       (IV-21 pin 5:  Segment A Anode)
+  8,   // Segment B:             MAX6921 pin 18 (OUT-8)     (Adapter pin 19)      (IV-21 pin 3:  Segment B Anode)
+  5,   // Segment C:             MAX6921 pin 21 (OUT-5)     (Adapter pin 15)      (IV-21 pin 18: Segment C Anode)
+  3,   // Segment D:             MAX6921 pin 23 (OUT-3)     (Adapter pin 13)      (IV-21 pin 17: Segment D Anode)
+  6,   // Segment E:             MAX6921 pin 20 (OUT-6)     (Adapter pin 16)      (IV-21 pin 19: Segment E Anode (Short lead))
+  9,   // Segment F:             MAX6921 pin 17 (OUT-9)     (Adapter pin 20)      (IV-21 pin 4:  Segment Segment F Anode / Dot Symbol Anode)
+  7,   // Segment G:             MAX6921 pin 19 (OUT-7)     (Adapter pin 17)      (IV-21 pin 2:  Segment G Anode / - Symbol Anode)
+  4,   // Segment H (period):    MAX6921 pin 22 (OUT-4)     (Adapter pin 14)      (IV-21 pin 16: Segment DP Anode)
+};
+
+// Calculate array sizes
+// const uint8_t NUM_DIGITS = sizeof(DIGIT_PINS) / sizeof(DIGIT_PINS[0]);
+// const uint8_t NUM_SEGMENTS = sizeof(SEGMENT_PINS) / sizeof(SEGMENT_PINS[0]);
+const uint8_t NUM_DIGITS = 8;
+const uint8_t NUM_SEGMENTS = 8;
+
+#endif
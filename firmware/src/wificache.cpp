@@ -0,0 +1,133 @@
+#include "wificache.h"
+
+#define WIFI_CACHE_MAGIC 0x57434331     // "WCC1"
+
+static const char* WIFI_CACHE_NAMESPACE = "vfdwifi";
+static const char* WIFI_CACHE_KEY = "lease";
+
+// Not initialized by the startup code, so it keeps its contents across software, panic and watchdog resets. After
+// power-on it holds garbage, which the magic and CRC of the entry reject. (RTC_DATA_ATTR would be reloaded from
+// the image on every reset and only survive deep sleep, which the clock never enters.)
+RTC_NOINIT_ATTR static WifiCache::Entry rtcEntry;
+RTC_NOINIT_ATTR static uint8_t rtcFastConnects;  // Connects on the cached address since the last DHCP lease
+
+WifiCache::WifiCache()
+  : valid(false), credentialsHash(0), nvsWrites(0), addressTaken(false)
+{
+  memset(&entry, 0, sizeof(entry));
+}
+
+bool WifiCache::begin(const char* ssid, const char* passphrase)
+{
+  credentialsHash = hash(ssid, passphrase);
+  preferences.begin(WIFI_CACHE_NAMESPACE, false);
+
+  if (isUsable(rtcEntry)) {
+    entry = rtcEntry;
+    valid = true;
+    return true;
+  }
+
+  Entry stored;
+  if (preferences.getBytesLength(WIFI_CACHE_KEY) == sizeof(stored)) {
+    preferences.getBytes(WIFI_CACHE_KEY, &stored, sizeof(stored));
+    if (isUsable(stored)) {
+      entry = stored;
+      rtcEntry = stored;
+      rtcFastConnects = WIFI_CACHE_MAX_FAST_CONNECTS;  // Unknown time off: renew the lease first
+      valid = true;
+      return true;
+    }
+  }
+
+  valid = false;
+  return false;
+}
+
+bool WifiCache::takeCachedAddress()
+{
+  addressTaken = valid && rtcFastConnects < WIFI_CACHE_MAX_FAST_CONNECTS;
+  if (addressTaken) {
+    rtcFastConnects++;
+  }
+  return addressTaken;
+}
+
+void WifiCache::save(const uint8_t* bssid, uint8_t channel, uint32_t localIP, uint32_t gateway, uint32_t subnet, uint32_t dns)
+{
+  if (bssid == NULL || localIP == 0) return;
+
+  Entry updated;
+  memset(&updated, 0, sizeof(updated));
+  updated.magic = WIFI_CACHE_MAGIC;
+  updated.credentialsHash = credentialsHash;
+  memcpy(updated.bssid, bssid, sizeof(updated.bssid));
+  updated.channel = channel;
+  updated.localIP = localIP;
+  updated.gateway = gateway;
+  updated.subnet = subnet;
+  updated.dns = dns;
+  updated.crc = checksum(updated);
+
+  rtcEntry = updated;
+  if (!addressTaken) {
+    rtcFastConnects = 0;  // A fresh lease
+  }
+  addressTaken = false;
+
+  // Flash is only written when the association actually changed. After invalidate() the entry in memory is gone,
+  // so the record in NVS is compared instead.
+  if (!valid || memcmp(&entry, &updated, sizeof(updated)) != 0) {
+    Entry stored;
+    bool unchanged = preferences.getBytesLength(WIFI_CACHE_KEY) == sizeof(stored) &&
+                     preferences.getBytes(WIFI_CACHE_KEY, &stored, sizeof(stored)) == sizeof(stored) &&
+                     memcmp(&stored, &updated, sizeof(updated)) == 0;
+    if (!unchanged && preferences.putBytes(WIFI_CACHE_KEY, &updated, sizeof(updated)) == sizeof(updated)) {
+      nvsWrites++;
+    }
+  }
+
+  entry = updated;
+  valid = true;
+}
+
+void WifiCache::invalidate()
+{
+  valid = false;
+  addressTaken = false;
+  rtcEntry.magic = 0;
+}
+
+bool WifiCache::isUsable(const Entry& candidate) const
+{
+  return candidate.magic == WIFI_CACHE_MAGIC &&
+         candidate.credentialsHash == credentialsHash &&
+         candidate.crc == checksum(candidate) &&
+         candidate.channel >= 1 && candidate.channel <= 14 &&
+         candidate.localIP != 0;
+}
+
+uint32_t WifiCache::hash(const char* ssid, const char* passphrase)
+{
+  // FNV-1a over "ssid\0passphrase"
+  uint32_t h = 2166136261u;
+  for (const char* p = ssid; *p; p++) {
+    h = (h ^ (uint8_t)*p) * 16777619u;
+  }
+  h = (h ^ 0) * 16777619u;
+  for (const char* p = passphrase; *p; p++) {
+    h = (h ^ (uint8_t)*p) * 16777619u;
+  }
+  return h;
+}
+
+uint32_t WifiCache::checksum(const Entry& entry)
+{
+  // FNV-1a over everything before the crc field
+  const uint8_t* data = (const uint8_t*)&entry;
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < offsetof(Entry, crc); i++) {
+    h = (h ^ data[i]) * 16777619u;
+  }
+  return h;
+}
@@ -0,0 +1,69 @@
+#ifndef WIFICACHE_H
+#define WIFICACHE_H
+
+#include <Arduino.h>
+#include <Preferences.h>
+
+// Cached Wi-Fi association for fast reconnects.
+//
+// After a successful connection the access point (BSSID, channel) and IP configuration are kept in RTC memory
+// that the startup code leaves alone (RTC_NOINIT_ATTR), which survives resets but not power loss, and in NVS,
+// which survives power cycles. The next connect can then skip the scan and DHCP: WiFi.begin() with a fixed
+// BSSID/channel and WiFi.config() with the cached address.
+// Entries are tied to a hash of the SSID and passphrase so changed credentials invalidate them.
+//
+// The cached address is a lease the DHCP server may since have handed to someone else, so it is only reused
+// after a reset (the RTC copy) and at most WIFI_CACHE_MAX_FAST_CONNECTS times in a row. After a power cycle, when
+// the clock may have been off for longer than the lease, and after that many reuses the connect still goes
+// straight to the cached access point but asks DHCP for the address.
+
+#define WIFI_CACHE_MAX_FAST_CONNECTS 16
+
+class WifiCache {
+public:
+  struct Entry {
+    uint32_t magic;
+    uint32_t credentialsHash;
+    uint8_t bssid[6];
+    uint8_t channel;
+    uint8_t reserved;
+    uint32_t localIP;
+    uint32_t gateway;
+    uint32_t subnet;
+    uint32_t dns;
+    uint32_t crc;                        // Over all fields above
+  };
+
+private:
+  Preferences preferences;
+  Entry entry;
+  bool valid;
+  uint32_t credentialsHash;
+  uint32_t nvsWrites;
+  bool addressTaken;                     // The connect in progress reuses the cached address
+
+  static uint32_t hash(const char* ssid, const char* passphrase);
+  static uint32_t checksum(const Entry& entry);
+  bool isUsable(const Entry& candidate) const;
+
+public:
+  WifiCache();
+
+  // Loads the cached entry for these credentials, RTC memory first, then NVS
+  bool begin(const char* ssid, const char* passphrase);
+
+  // Whether the connect about to start may reuse the cached address rather than ask DHCP. Call once per connect.
+  bool takeCachedAddress();
+
+  // Store the current association. NVS is only written when it differs from the record there.
+  void save(const uint8_t* bssid, uint8_t channel, uint32_t localIP, uint32_t gateway, uint32_t subnet, uint32_t dns);
+
+  // Forget the entry (e.g. after a fast connect failed); NVS is left alone and overwritten on the next success
+  void invalidate();
+
+  bool isValid() const { return valid; }
+  const Entry& getEntry() const { return entry; }
+  uint32_t getNvsWrites() const { return nvsWrites; }
+};
+
+#endif
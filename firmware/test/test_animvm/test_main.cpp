@@ -0,0 +1,330 @@
+// AnimationVM: script validation, the per-tick instruction budget, wait timing and TIME, on the emulator's clock.
+//
+// Run on the host: pio test -e native -f test_animvm
+
+#include <Arduino.h>
+#include <unity.h>
+#include <initializer_list>
+#include "host.h"
+#include "vfdpins.h"
+#include "max6921.h"
+#include "animvm.h"
+
+static MAX6921 display(10, 8, 5, DIGIT_PINS, NUM_DIGITS, SEGMENT_PINS, NUM_SEGMENTS);
+
+// Loads code behind a valid header
+static AnimError loadCode(AnimationVM& vm, std::initializer_list<uint8_t> code)
+{
+  uint8_t script[ANIM_HEADER_SIZE + ANIM_MAX_CODE] = { 'V', 'A', ANIM_VERSION, 0 };
+  size_t length = ANIM_HEADER_SIZE;
+  for (uint8_t byte : code) {
+    script[length++] = byte;
+  }
+  return vm.load(script, length);
+}
+
+static void advanceMs(uint32_t ms)
+{
+  hostAdvanceMicros((uint64_t)ms * 1000);
+}
+
+void setUp()
+{
+  display.begin();
+  display.setDisplaySegments(nullptr, 0);
+  display.resetDigitBrightness();
+}
+
+void tearDown()
+{
+}
+
+void test_rejects_bad_header_and_size()
+{
+  AnimationVM vm(display);
+  const uint8_t noMagic[] = { 'V', 'B', ANIM_VERSION, 0, ANIM_OP_END };
+  const uint8_t newerVersion[] = { 'V', 'A', ANIM_VERSION + 1, 0, ANIM_OP_END };
+  const uint8_t headerOnly[] = { 'V', 'A', ANIM_VERSION, 0 };
+
+  TEST_ASSERT_EQUAL(ANIM_ERROR_FORMAT, vm.load(noMagic, sizeof(noMagic)));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_FORMAT, vm.load(newerVersion, sizeof(newerVersion)));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_FORMAT, vm.load(headerOnly, 3));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_SIZE, vm.load(headerOnly, sizeof(headerOnly)));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_FORMAT, vm.loadHex("5641010"));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_FORMAT, vm.loadHex("564101zz00"));
+  TEST_ASSERT_FALSE(vm.isLoaded());
+
+  TEST_ASSERT_EQUAL(ANIM_OK, vm.loadHex("5641010000"));
+  TEST_ASSERT_EQUAL_UINT16(1, vm.getCodeLength());
+}
+
+void test_rejects_unknown_opcode()
+{
+  AnimationVM vm(display);
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPCODE, loadCode(vm, { ANIM_OP_SET, 0, 1, 0, ANIM_OP_COUNT }));
+  TEST_ASSERT_EQUAL_UINT16(4, vm.getErrorOffset());
+}
+
+void test_rejects_truncated_programs()
+{
+  AnimationVM vm(display);
+
+  // FRAME needs eight masks, SET a register and two immediate bytes, JUMP two address bytes
+  TEST_ASSERT_EQUAL(ANIM_ERROR_TRUNCATED, loadCode(vm, { ANIM_OP_FRAME, 1, 2, 3, 4, 5, 6, 7 }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_TRUNCATED, loadCode(vm, { ANIM_OP_WAIT, 100, 0, ANIM_OP_SET, 0, 1 }));
+  TEST_ASSERT_EQUAL_UINT16(3, vm.getErrorOffset());
+  TEST_ASSERT_EQUAL(ANIM_ERROR_TRUNCATED, loadCode(vm, { ANIM_OP_END, ANIM_OP_JUMP, 0 }));
+  TEST_ASSERT_FALSE(vm.isLoaded());
+}
+
+void test_rejects_bad_operands()
+{
+  AnimationVM vm(display);
+
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPERAND, loadCode(vm, { ANIM_OP_DIGIT, ANIM_DIGITS, 0xFF }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPERAND, loadCode(vm, { ANIM_OP_DIGITR, 0, ANIM_REGISTERS }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPERAND, loadCode(vm, { ANIM_OP_NUM, ANIM_DIGITS - 1, 0 }));  // Needs two digits
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPERAND, loadCode(vm, { ANIM_OP_BRIGHT, ANIM_DIGITS, 128 }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPERAND, loadCode(vm, { ANIM_OP_WAITR, ANIM_REGISTERS }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPERAND, loadCode(vm, { ANIM_OP_ADD, 9, 1 }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPERAND, loadCode(vm, { ANIM_OP_RAND, 0, 0, 0 }));  // Empty range
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPERAND, loadCode(vm, { ANIM_OP_TIME, 0, 4 }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_OPERAND, loadCode(vm, { ANIM_OP_SET, 0, 0, 0, ANIM_OP_LOOP, 8, 0, 0 }));
+  TEST_ASSERT_EQUAL_UINT16(4, vm.getErrorOffset());
+  TEST_ASSERT_FALSE(vm.isLoaded());
+
+  TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, { ANIM_OP_BRIGHT, 0xFF, 128, ANIM_OP_NUM, ANIM_DIGITS - 2, 7 }));
+}
+
+void test_rejects_out_of_range_jumps()
+{
+  AnimationVM vm(display);
+
+  // Past the end, inside an instruction, and a loop target one byte too far
+  TEST_ASSERT_EQUAL(ANIM_ERROR_JUMP, loadCode(vm, { ANIM_OP_JUMP, 3, 0 }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_JUMP, loadCode(vm, { ANIM_OP_JUMP, 0x00, 0x01, ANIM_OP_END }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_JUMP, loadCode(vm, { ANIM_OP_SET, 0, 5, 0, ANIM_OP_JUMP, 1, 0 }));
+  TEST_ASSERT_EQUAL_UINT16(4, vm.getErrorOffset());
+  TEST_ASSERT_EQUAL(ANIM_ERROR_JUMP, loadCode(vm, { ANIM_OP_SET, 0, 5, 0, ANIM_OP_LOOP, 0, 9, 0, ANIM_OP_END }));
+  TEST_ASSERT_EQUAL(ANIM_ERROR_JUMP, loadCode(vm, { ANIM_OP_JZ, 0, 0xFF, 0xFF }));
+  TEST_ASSERT_FALSE(vm.isLoaded());
+
+  // The last instruction and the instruction itself are valid targets
+  TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, { ANIM_OP_JZ, 0, 4, 0, ANIM_OP_JUMP, 4, 0 }));
+}
+
+void test_rejected_script_keeps_the_current_one()
+{
+  AnimationVM vm(display);
+  TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, { ANIM_OP_DIGIT, 0, 0x3F, ANIM_OP_WAIT, 0, 0, ANIM_OP_JUMP, 0, 0 }));
+  TEST_ASSERT_TRUE(vm.start());
+  vm.update();
+
+  TEST_ASSERT_EQUAL(ANIM_ERROR_JUMP, loadCode(vm, { ANIM_OP_JUMP, 7, 0 }));
+  TEST_ASSERT_TRUE(vm.isRunning());
+  TEST_ASSERT_EQUAL_UINT16(9, vm.getCodeLength());
+}
+
+void test_yields_at_the_budget()
+{
+  // A tight loop without a wait: r0 += 1, jump back
+  AnimationVM vm(display);
+  TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, { ANIM_OP_ADD, 0, 1, ANIM_OP_DIGITR, 0, 0, ANIM_OP_JUMP, 0, 0 }));
+  TEST_ASSERT_TRUE(vm.start());
+
+  vm.update();
+  TEST_ASSERT_TRUE(vm.isRunning());
+  TEST_ASSERT_EQUAL_UINT32(ANIM_DEFAULT_BUDGET, vm.getInstructions());
+  TEST_ASSERT_EQUAL_UINT32(1, vm.getBudgetHits());
+  TEST_ASSERT_EQUAL_UINT32(1, vm.getTicks());
+
+  // 64 instructions = 21 full passes and the ADD of the 22nd; its DIGITR has not run yet
+  TEST_ASSERT_EQUAL_UINT16(3, vm.getPc());
+  TEST_ASSERT_EQUAL_HEX8(21, display.getDigitSegments(0));
+
+  // The next tick continues where the last one stopped
+  vm.update();
+  TEST_ASSERT_EQUAL_UINT32(2 * ANIM_DEFAULT_BUDGET, vm.getInstructions());
+  TEST_ASSERT_EQUAL_UINT32(2, vm.getBudgetHits());
+  TEST_ASSERT_EQUAL_HEX8(43, display.getDigitSegments(0));
+}
+
+void test_custom_budget()
+{
+  AnimationVM vm(display, 5);
+  TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, { ANIM_OP_JUMP, 0, 0 }));
+  TEST_ASSERT_TRUE(vm.start());
+  vm.update();
+  TEST_ASSERT_EQUAL_UINT32(5, vm.getInstructions());
+  TEST_ASSERT_EQUAL_UINT32(1, vm.getBudgetHits());
+}
+
+void test_wait_timing()
+{
+  // Alternate two frames every 100 ms
+  AnimationVM vm(display);
+  TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, {
+    ANIM_OP_DIGIT, 0, 0x01,
+    ANIM_OP_WAIT, 100, 0,
+    ANIM_OP_DIGIT, 0, 0x02,
+    ANIM_OP_WAIT, 100, 0,
+    ANIM_OP_JUMP, 0, 0,
+  }));
+  TEST_ASSERT_TRUE(vm.start());
+
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, display.getDigitSegments(0));
+  TEST_ASSERT_EQUAL_UINT32(0, vm.getBudgetHits());
+
+  advanceMs(99);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, display.getDigitSegments(0));
+  TEST_ASSERT_EQUAL_UINT32(1, vm.getTicks());  // Still waiting: no instructions run
+
+  advanceMs(1);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(0x02, display.getDigitSegments(0));
+  TEST_ASSERT_EQUAL_UINT32(2, vm.getTicks());
+
+  // A late tick does not delay the next frame: the wait is measured from where the last one ended
+  advanceMs(130);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, display.getDigitSegments(0));
+  advanceMs(69);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, display.getDigitSegments(0));
+  advanceMs(1);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(0x02, display.getDigitSegments(0));
+}
+
+void test_wait_far_behind_restarts_from_now()
+{
+  AnimationVM vm(display);
+  TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, {
+    ANIM_OP_SET, 0, 50, 0,
+    ANIM_OP_ADD, 1, 1,
+    ANIM_OP_DIGITR, 0, 1,
+    ANIM_OP_WAITR, 0,
+    ANIM_OP_JUMP, 4, 0,
+  }));
+  TEST_ASSERT_TRUE(vm.start());
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(1, display.getDigitSegments(0));
+
+  // More than ANIM_MAX_CATCHUP_MS late: one step, not a burst of catch-up frames
+  advanceMs(50 + ANIM_MAX_CATCHUP_MS + 200);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(2, display.getDigitSegments(0));
+  advanceMs(49);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(2, display.getDigitSegments(0));
+  advanceMs(1);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(3, display.getDigitSegments(0));
+}
+
+void test_loop_and_end()
+{
+  // Three passes of a 10 ms blink, then END hands the display back at full brightness
+  AnimationVM vm(display);
+  TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, {
+    ANIM_OP_SET, 0, 3, 0,
+    ANIM_OP_BRIGHT, 0xFF, 64,
+    ANIM_OP_ADD, 1, 1,
+    ANIM_OP_WAIT, 10, 0,
+    ANIM_OP_LOOP, 0, 7, 0,
+    ANIM_OP_DIGITR, 0, 1,
+    ANIM_OP_END,
+  }));
+  TEST_ASSERT_TRUE(vm.start());
+  vm.update();
+  TEST_ASSERT_EQUAL_UINT8(64, display.getDigitBrightness(3));
+
+  for (int i = 0; i < 3; i++) {
+    TEST_ASSERT_TRUE(vm.isRunning());
+    advanceMs(10);
+    vm.update();
+  }
+  TEST_ASSERT_FALSE(vm.isRunning());
+  TEST_ASSERT_EQUAL_HEX8(3, display.getDigitSegments(0));
+  TEST_ASSERT_EQUAL_UINT8(MAX6921_MAX_BRIGHTNESS, display.getDigitBrightness(3));
+}
+
+void test_time_follows_the_anchored_clock()
+{
+  // Hour, minute, second and hundredths on the first four digits, every tick
+  AnimationVM vm(display);
+  TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, {
+    ANIM_OP_TIME, 0, 0, ANIM_OP_TIME, 1, 1, ANIM_OP_TIME, 2, 2, ANIM_OP_TIME, 3, 3,
+    ANIM_OP_DIGITR, 0, 0, ANIM_OP_DIGITR, 1, 1, ANIM_OP_DIGITR, 2, 2, ANIM_OP_DIGITR, 3, 3,
+    ANIM_OP_WAIT, 0, 0,
+    ANIM_OP_JUMP, 0, 0,
+  }));
+  TEST_ASSERT_TRUE(vm.needsClockTime());
+  TEST_ASSERT_TRUE(vm.start());
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(0, display.getDigitSegments(0));  // No time yet
+
+  vm.setClockTime(23 * 3600 + 59 * 60 + 59, 980000);
+  TEST_ASSERT_FALSE(vm.needsClockTime());
+  advanceMs(1);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(23, display.getDigitSegments(0));
+  TEST_ASSERT_EQUAL_HEX8(59, display.getDigitSegments(1));
+  TEST_ASSERT_EQUAL_HEX8(59, display.getDigitSegments(2));
+  TEST_ASSERT_EQUAL_HEX8(98, display.getDigitSegments(3));
+
+  // Runs on from the anchor across midnight, and asks for a new anchor after a minute
+  advanceMs(30);
+  vm.update();
+  TEST_ASSERT_EQUAL_HEX8(0, display.getDigitSegments(0));
+  TEST_ASSERT_EQUAL_HEX8(0, display.getDigitSegments(2));
+  TEST_ASSERT_EQUAL_HEX8(1, display.getDigitSegments(3));
+  advanceMs(60000 - 32);
+  TEST_ASSERT_FALSE(vm.needsClockTime());
+  advanceMs(1);
+  TEST_ASSERT_TRUE(vm.needsClockTime());
+}
+
+void test_saved_script_is_restored()
+{
+  hostClearPreferences();
+  {
+    AnimationVM vm(display);
+    vm.begin();
+    TEST_ASSERT_FALSE(vm.isLoaded());
+    TEST_ASSERT_EQUAL(ANIM_OK, loadCode(vm, { ANIM_OP_WAIT, 1, 0, ANIM_OP_END }));
+    TEST_ASSERT_TRUE(vm.save());
+  }
+
+  AnimationVM restored(display);
+  restored.begin();
+  TEST_ASSERT_TRUE(restored.isLoaded());
+  TEST_ASSERT_FALSE(restored.isRunning());
+  TEST_ASSERT_EQUAL_UINT16(4, restored.getCodeLength());
+
+  restored.clear();
+  AnimationVM cleared(display);
+  cleared.begin();
+  TEST_ASSERT_FALSE(cleared.isLoaded());
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_rejects_bad_header_and_size);
+  RUN_TEST(test_rejects_unknown_opcode);
+  RUN_TEST(test_rejects_truncated_programs);
+  RUN_TEST(test_rejects_bad_operands);
+  RUN_TEST(test_rejects_out_of_range_jumps);
+  RUN_TEST(test_rejected_script_keeps_the_current_one);
+  RUN_TEST(test_yields_at_the_budget);
+  RUN_TEST(test_custom_budget);
+  RUN_TEST(test_wait_timing);
+  RUN_TEST(test_wait_far_behind_restarts_from_now);
+  RUN_TEST(test_loop_and_end);
+  RUN_TEST(test_time_follows_the_anchored_clock);
+  RUN_TEST(test_saved_script_is_restored);
+  return UNITY_END();
+}
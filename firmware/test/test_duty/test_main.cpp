@@ -0,0 +1,185 @@
+// DutyAnalyzer: window statistics, imbalance and alert from synthetic multiplex slots.
+//
+// Run on the host: pio test -e native -f test_duty
+
+#include <Arduino.h>
+#include <unity.h>
+#include "dutyanalyzer.h"
+
+#define TEST_DIGITS 8
+#define TEST_SLOT_US 1000                        // Nominal 1 kHz multiplex
+#define TEST_WINDOW_US (DUTY_SLICE_US * DUTY_WINDOW_SLICES)
+
+// Feeds passes over all digits until at least durationUs of slots were recorded. A stretched digit's slot lasts
+// stretchUs instead of the nominal slot and stays lit for all but the blanking time, as when the loop runs late.
+static void feed(DutyAnalyzer& duty, uint32_t durationUs, uint32_t litUs, uint32_t expectedUs, int stretched = -1,
+                 uint32_t stretchUs = 0)
+{
+  uint32_t blankUs = TEST_SLOT_US - litUs;
+  uint32_t elapsed = 0;
+  while (elapsed < durationUs) {
+    for (uint8_t position = 0; position < TEST_DIGITS; position++) {
+      uint32_t slotUs = position == stretched ? stretchUs : TEST_SLOT_US;
+      duty.recordSlot(position, slotUs, slotUs - blankUs, expectedUs);
+      elapsed += slotUs;
+    }
+  }
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+}
+
+void test_not_ready_before_a_full_window()
+{
+  DutyAnalyzer duty(TEST_DIGITS);
+  feed(duty, TEST_WINDOW_US - 2 * TEST_SLOT_US * TEST_DIGITS, 900, 900);
+
+  TEST_ASSERT_FALSE(duty.isReady());
+  TEST_ASSERT_EQUAL_UINT32(0, duty.getSlots());
+  TEST_ASSERT_EQUAL_FLOAT(0, duty.getImbalancePercent());
+  TEST_ASSERT_FALSE(duty.isAlert());
+}
+
+void test_even_slots()
+{
+  DutyAnalyzer duty(TEST_DIGITS);
+  feed(duty, TEST_WINDOW_US, 900, 900);
+
+  TEST_ASSERT_TRUE(duty.isReady());
+  TEST_ASSERT_EQUAL_UINT32(TEST_WINDOW_US, duty.getWindowUs());
+  TEST_ASSERT_EQUAL_UINT32(TEST_WINDOW_US / TEST_SLOT_US, duty.getSlots());
+  TEST_ASSERT_EQUAL_UINT32(TEST_SLOT_US, duty.getMinSlotUs());
+  TEST_ASSERT_EQUAL_UINT32(TEST_SLOT_US, duty.getMaxSlotUs());
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 1000000.0 / TEST_SLOT_US / TEST_DIGITS, duty.getRefreshRate());
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 0, duty.getImbalancePercent());
+  for (uint8_t position = 0; position < TEST_DIGITS; position++) {
+    TEST_ASSERT_FLOAT_WITHIN(0.01, 90.0 / TEST_DIGITS, duty.getDutyPercent(position));
+  }
+  TEST_ASSERT_FALSE(duty.isAlert());
+  TEST_ASSERT_EQUAL_UINT32(0, duty.getAlerts());
+}
+
+void test_uniformly_dimmed_slots()
+{
+  // A dimmed display lights every digit for less of its slot, as asked: no imbalance
+  DutyAnalyzer duty(TEST_DIGITS);
+  feed(duty, TEST_WINDOW_US, 250, 250);
+
+  TEST_ASSERT_TRUE(duty.isReady());
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 0, duty.getImbalancePercent());
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 25.0 / TEST_DIGITS, duty.getDutyPercent(0));
+  TEST_ASSERT_EQUAL_UINT32(TEST_SLOT_US, duty.getMaxSlotUs());
+  TEST_ASSERT_FALSE(duty.isAlert());
+}
+
+void test_one_dimmed_digit_is_not_an_imbalance()
+{
+  // Per-digit brightness lowers the expected on-time along with the actual one
+  DutyAnalyzer duty(TEST_DIGITS);
+  uint32_t elapsed = 0;
+  while (elapsed < TEST_WINDOW_US) {
+    for (uint8_t position = 0; position < TEST_DIGITS; position++) {
+      uint32_t onUs = position == 2 ? 300 : 900;
+      duty.recordSlot(position, TEST_SLOT_US, onUs, onUs);
+      elapsed += TEST_SLOT_US;
+    }
+  }
+
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 0, duty.getImbalancePercent());
+  TEST_ASSERT_FALSE(duty.isAlert());
+}
+
+void test_stretched_digit_raises_the_alert()
+{
+  // The loop runs 2 ms late every time digit 3 is lit, so it stays lit for 2900 us instead of 900 us
+  DutyAnalyzer duty(TEST_DIGITS);
+  feed(duty, TEST_WINDOW_US, 900, 900, 3, 3000);
+
+  TEST_ASSERT_TRUE(duty.isReady());
+  TEST_ASSERT_EQUAL_UINT32(TEST_SLOT_US, duty.getMinSlotUs());
+  TEST_ASSERT_EQUAL_UINT32(3000, duty.getMaxSlotUs());
+
+  // Ratios 1 for seven digits and 2900/900 for the late one, spread relative to their mean
+  float late = 2900.0f / 900;
+  float expected = (late - 1) * 100 * TEST_DIGITS / (TEST_DIGITS - 1 + late);
+  TEST_ASSERT_FLOAT_WITHIN(expected * 0.05f, expected, duty.getImbalancePercent());
+  TEST_ASSERT_GREATER_THAN(duty.getDutyPercent(2), duty.getDutyPercent(3));
+  TEST_ASSERT_TRUE(duty.isAlert());
+  TEST_ASSERT_EQUAL_UINT32(1, duty.getAlerts());
+
+  // The alert is counted once while it lasts and clears once a whole window is even again
+  feed(duty, TEST_WINDOW_US / 2, 900, 900, 3, 3000);
+  TEST_ASSERT_TRUE(duty.isAlert());
+  TEST_ASSERT_EQUAL_UINT32(1, duty.getAlerts());
+
+  feed(duty, TEST_WINDOW_US + DUTY_SLICE_US, 900, 900);
+  TEST_ASSERT_FALSE(duty.isAlert());
+  TEST_ASSERT_FLOAT_WITHIN(0.01, 0, duty.getImbalancePercent());
+  TEST_ASSERT_EQUAL_UINT32(TEST_SLOT_US, duty.getMaxSlotUs());
+  TEST_ASSERT_EQUAL_UINT32(1, duty.getAlerts());
+
+  feed(duty, TEST_WINDOW_US, 900, 900, 3, 3000);
+  TEST_ASSERT_TRUE(duty.isAlert());
+  TEST_ASSERT_EQUAL_UINT32(2, duty.getAlerts());
+}
+
+void test_late_slot_below_the_threshold()
+{
+  // A single 1.5 ms slot in a second is well inside the threshold, but shows as the longest slot
+  DutyAnalyzer duty(TEST_DIGITS);
+  feed(duty, TEST_WINDOW_US / 2, 900, 900);
+  duty.recordSlot(5, 1500, 1400, 900);
+  feed(duty, TEST_WINDOW_US / 2, 900, 900);
+
+  TEST_ASSERT_TRUE(duty.isReady());
+  TEST_ASSERT_EQUAL_UINT32(1500, duty.getMaxSlotUs());
+  TEST_ASSERT_GREATER_THAN(0, duty.getImbalancePercent());
+  TEST_ASSERT_LESS_THAN(DUTY_DEFAULT_THRESHOLD_PERCENT, duty.getImbalancePercent());
+  TEST_ASSERT_FALSE(duty.isAlert());
+
+  duty.setThreshold(0);
+  feed(duty, DUTY_SLICE_US, 900, 900);
+  duty.recordSlot(5, 1500, 1400, 900);
+  feed(duty, DUTY_SLICE_US, 900, 900);
+  TEST_ASSERT_TRUE(duty.isAlert());
+}
+
+void test_reset_clears_the_window()
+{
+  DutyAnalyzer duty(TEST_DIGITS);
+  feed(duty, TEST_WINDOW_US, 900, 900, 3, 3000);
+  TEST_ASSERT_TRUE(duty.isAlert());
+
+  duty.reset();
+  TEST_ASSERT_FALSE(duty.isReady());
+  TEST_ASSERT_FALSE(duty.isAlert());
+  TEST_ASSERT_EQUAL_UINT32(0, duty.getMaxSlotUs());
+  TEST_ASSERT_EQUAL_UINT32(1, duty.getAlerts());
+}
+
+void test_positions_outside_the_display_are_ignored()
+{
+  DutyAnalyzer duty(TEST_DIGITS);
+  duty.recordSlot(TEST_DIGITS, DUTY_SLICE_US * DUTY_WINDOW_SLICES, 1000, 1000);
+  TEST_ASSERT_FALSE(duty.isReady());
+  TEST_ASSERT_EQUAL_UINT32(0, duty.getLitUs(TEST_DIGITS));
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_not_ready_before_a_full_window);
+  RUN_TEST(test_even_slots);
+  RUN_TEST(test_uniformly_dimmed_slots);
+  RUN_TEST(test_one_dimmed_digit_is_not_an_imbalance);
+  RUN_TEST(test_stretched_digit_raises_the_alert);
+  RUN_TEST(test_late_slot_below_the_threshold);
+  RUN_TEST(test_reset_clears_the_window);
+  RUN_TEST(test_positions_outside_the_display_are_ignored);
+  return UNITY_END();
+}
@@ -0,0 +1,331 @@
+// FrameStream: the jitter buffer's playout of reordered, late and bursty UDP frames.
+//
+// Packets are queued on the emulator's UDP shim and time is the emulator's clock. Every frame carries one digit
+// whose segment mask identifies it on the display.
+//
+// Run on the host: pio test -e native -f test_framestream
+
+#include <Arduino.h>
+#include <unity.h>
+#include <WiFiUdp.h>
+#include "host.h"
+#include "vfdpins.h"
+#include "max6921.h"
+#include "framestream.h"
+
+#define TEST_PORT 4210
+#define TEST_PLAYOUT_MS 50
+#define TEST_TIMEOUT_MS 2000
+
+static MAX6921 display(10, 8, 5, DIGIT_PINS, NUM_DIGITS, SEGMENT_PINS, NUM_SEGMENTS);
+
+static void sendFrame(uint32_t sequence, uint32_t timestamp, uint8_t mask, uint8_t flags = 0, uint8_t brightness = 0)
+{
+  uint8_t packet[FRAME_STREAM_HEADER_SIZE + 2] = {
+    'V', 'F', FRAME_STREAM_VERSION, flags,
+    (uint8_t)sequence, (uint8_t)(sequence >> 8), (uint8_t)(sequence >> 16), (uint8_t)(sequence >> 24),
+    (uint8_t)timestamp, (uint8_t)(timestamp >> 8), (uint8_t)(timestamp >> 16), (uint8_t)(timestamp >> 24),
+    1, mask, brightness,
+  };
+  hostSendUdp(TEST_PORT, packet, FRAME_STREAM_HEADER_SIZE + 1 + ((flags & FRAME_STREAM_FLAG_BRIGHTNESS) ? 1 : 0));
+}
+
+static void advanceMs(uint32_t ms)
+{
+  hostAdvanceMicros((uint64_t)ms * 1000);
+}
+
+static uint8_t shown()
+{
+  return display.getDigitSegments(0);
+}
+
+void setUp()
+{
+  hostClearUdp();
+  display.begin();
+  display.setDisplaySegments(nullptr, 0);
+  display.setBrightness(MAX6921_MAX_BRIGHTNESS);
+}
+
+void tearDown()
+{
+}
+
+void test_frames_play_at_timestamp_plus_playout_delay()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  TEST_ASSERT_TRUE(stream.begin());
+
+  // The first frame sets the clock mapping: it is due TEST_PLAYOUT_MS after its arrival
+  sendFrame(1, 1000, 0x01);
+  stream.update();
+  TEST_ASSERT_TRUE(stream.isActive());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.getFramesReceived());
+  TEST_ASSERT_EQUAL_UINT32(0, stream.getFramesPlayed());
+
+  advanceMs(TEST_PLAYOUT_MS - 1);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x00, shown());
+
+  advanceMs(1);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, shown());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.getFramesPlayed());
+
+  // 20 ms later on the sender's clock, arriving 30 ms slower than the first: still due at its own time
+  sendFrame(2, 1020, 0x02);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, shown());
+  advanceMs(20);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x02, shown());
+  TEST_ASSERT_EQUAL_UINT32(2, stream.getFramesPlayed());
+  TEST_ASSERT_EQUAL_UINT32(0, stream.getFramesDroppedLate());
+}
+
+void test_out_of_order_frames_are_reordered()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  stream.begin();
+  sendFrame(1, 1000, 0x01);
+  stream.update();
+
+  // 3 overtakes 2, which was held up 20 ms; both arrive before their deadlines
+  advanceMs(40);
+  sendFrame(3, 1040, 0x03);
+  sendFrame(2, 1020, 0x02);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x00, shown());
+
+  advanceMs(10);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, shown());
+  advanceMs(20);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x02, shown());
+  advanceMs(20);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x03, shown());
+  TEST_ASSERT_EQUAL_UINT32(3, stream.getFramesPlayed());
+  TEST_ASSERT_EQUAL_UINT32(0, stream.getFramesDroppedLate());
+
+  // A copy of a frame already shown is dropped
+  sendFrame(2, 1020, 0x02);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x03, shown());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.getFramesDroppedLate());
+}
+
+void test_duplicates_in_the_buffer_are_ignored()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  stream.begin();
+  sendFrame(1, 1000, 0x01);
+  sendFrame(1, 1000, 0x01);
+  stream.update();
+  advanceMs(TEST_PLAYOUT_MS);
+  stream.update();
+
+  TEST_ASSERT_EQUAL_UINT32(2, stream.getFramesReceived());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.getFramesPlayed());
+  TEST_ASSERT_EQUAL_UINT32(0, stream.getFramesDroppedLate());
+  TEST_ASSERT_EQUAL_UINT32(0, stream.getFramesOverwritten());
+}
+
+void test_late_frames_are_dropped()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  stream.begin();
+  sendFrame(1, 1000, 0x01);
+  stream.update();
+  advanceMs(TEST_PLAYOUT_MS);
+  stream.update();
+
+  // Frame 2 was due 20 ms after frame 1 but turns up 100 ms later: never shown
+  advanceMs(100);
+  sendFrame(2, 1020, 0x02);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, shown());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.getFramesDroppedLate());
+
+  // A frame that arrives exactly at its deadline still plays
+  sendFrame(3, 1100, 0x03);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x03, shown());
+  TEST_ASSERT_EQUAL_UINT32(2, stream.getFramesPlayed());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.getFramesDroppedLate());
+}
+
+void test_bursts_within_the_playout_delay_play_in_order()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  stream.begin();
+  sendFrame(1, 1000, 0x01);
+  stream.update();
+  advanceMs(TEST_PLAYOUT_MS);
+  stream.update();
+
+  // Three frames 20 ms apart, held up in the network, arrive together with the last of them: the oldest is
+  // 40 ms late, still inside the playout delay
+  advanceMs(10);
+  for (uint32_t sequence = 2; sequence <= 4; sequence++) {
+    sendFrame(sequence, 1000 + (sequence - 1) * 20, sequence);
+  }
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, shown());
+
+  for (uint8_t expected = 2; expected <= 4; expected++) {
+    advanceMs(expected == 2 ? 10 : 20);
+    stream.update();
+    TEST_ASSERT_EQUAL_HEX8(expected, shown());
+  }
+  TEST_ASSERT_EQUAL_UINT32(4, stream.getFramesPlayed());
+  TEST_ASSERT_EQUAL_UINT32(0, stream.getFramesDroppedLate());
+}
+
+void test_late_update_shows_only_the_newest_due_frame()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  stream.begin();
+  sendFrame(1, 1000, 0x01);
+  stream.update();
+  advanceMs(TEST_PLAYOUT_MS);
+  stream.update();
+
+  advanceMs(10);
+  sendFrame(2, 1020, 0x02);
+  sendFrame(3, 1040, 0x03);
+  sendFrame(4, 1060, 0x04);
+  stream.update();
+
+  // The loop is held up until frames 2 and 3 are both due: 3 is shown, 2 is skipped as late
+  advanceMs(35);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x03, shown());
+  TEST_ASSERT_EQUAL_UINT32(2, stream.getFramesPlayed());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.getFramesDroppedLate());
+
+  advanceMs(15);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x04, shown());
+}
+
+void test_flood_is_read_a_bounded_number_per_update()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  stream.begin();
+  for (uint32_t sequence = 1; sequence <= FRAME_STREAM_JITTER_SLOTS + 3; sequence++) {
+    sendFrame(sequence, 1000 + sequence, sequence);
+  }
+
+  stream.update();
+  TEST_ASSERT_EQUAL_UINT32(FRAME_STREAM_JITTER_SLOTS, stream.getFramesReceived());
+  TEST_ASSERT_EQUAL(3, hostPendingUdp(TEST_PORT));
+
+  // The rest land in the slots of the frames eight before them, which are still waiting
+  stream.update();
+  TEST_ASSERT_EQUAL_UINT32(FRAME_STREAM_JITTER_SLOTS + 3, stream.getFramesReceived());
+  TEST_ASSERT_EQUAL_UINT32(3, stream.getFramesOverwritten());
+
+  advanceMs(TEST_PLAYOUT_MS + FRAME_STREAM_JITTER_SLOTS + 3);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(FRAME_STREAM_JITTER_SLOTS + 3, shown());
+}
+
+void test_invalid_packets_are_counted()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  stream.begin();
+
+  uint8_t good[FRAME_STREAM_HEADER_SIZE + 1] = { 'V', 'F', FRAME_STREAM_VERSION, 0, 1, 0, 0, 0, 0, 0, 0, 0, 1, 0x3F };
+  uint8_t packet[FRAME_STREAM_MAX_PACKET + 1];
+
+  memcpy(packet, good, sizeof(good));
+  packet[1] = 'X';
+  hostSendUdp(TEST_PORT, packet, sizeof(good));                          // Magic
+  memcpy(packet, good, sizeof(good));
+  packet[2] = FRAME_STREAM_VERSION + 1;
+  hostSendUdp(TEST_PORT, packet, sizeof(good));                          // Version
+  hostSendUdp(TEST_PORT, good, FRAME_STREAM_HEADER_SIZE - 1);            // Short header
+  memcpy(packet, good, sizeof(good));
+  packet[12] = 0;
+  hostSendUdp(TEST_PORT, packet, sizeof(good));                          // No digits
+  packet[12] = MAX_DIGITS + 1;
+  hostSendUdp(TEST_PORT, packet, sizeof(good));                          // Too many digits
+  packet[12] = 4;
+  hostSendUdp(TEST_PORT, packet, sizeof(good));                          // Digits missing
+  memcpy(packet, good, sizeof(good));
+  packet[3] = FRAME_STREAM_FLAG_BRIGHTNESS;
+  hostSendUdp(TEST_PORT, packet, sizeof(good));                          // Brightness byte missing
+  memset(packet + sizeof(good), 0, sizeof(packet) - sizeof(good));
+  hostSendUdp(TEST_PORT, packet, sizeof(packet));                        // Oversized
+
+  stream.update();
+  TEST_ASSERT_EQUAL_UINT32(8, stream.getFramesDroppedInvalid());
+  TEST_ASSERT_EQUAL_UINT32(0, stream.getFramesReceived());
+  TEST_ASSERT_FALSE(stream.isActive());
+}
+
+void test_brightness_and_timeout()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  stream.begin();
+  stream.setIdleBrightness(200);
+
+  sendFrame(1, 1000, 0x01, FRAME_STREAM_FLAG_BRIGHTNESS, 40);
+  stream.update();
+  advanceMs(TEST_PLAYOUT_MS);
+  stream.update();
+  TEST_ASSERT_EQUAL_UINT8(40, display.getBrightness());
+
+  // The display is handed back once the sender has been quiet for the timeout
+  advanceMs(TEST_TIMEOUT_MS - TEST_PLAYOUT_MS);
+  stream.update();
+  TEST_ASSERT_TRUE(stream.isActive());
+  advanceMs(1);
+  stream.update();
+  TEST_ASSERT_FALSE(stream.isActive());
+  TEST_ASSERT_EQUAL_UINT8(200, display.getBrightness());
+}
+
+void test_restarted_sender_needs_the_new_stream_flag()
+{
+  FrameStream stream(display, TEST_PORT, TEST_PLAYOUT_MS, TEST_TIMEOUT_MS);
+  stream.begin();
+  sendFrame(100, 50000, 0x01);
+  stream.update();
+  advanceMs(TEST_PLAYOUT_MS);
+  stream.update();
+
+  // Sequence and clock start over: without the flag the frame looks like an old one
+  sendFrame(0, 10, 0x02);
+  stream.update();
+  advanceMs(TEST_PLAYOUT_MS);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x01, shown());
+  TEST_ASSERT_EQUAL_UINT32(1, stream.getFramesDroppedLate());
+
+  sendFrame(0, 10, 0x02, FRAME_STREAM_FLAG_NEW_STREAM);
+  stream.update();
+  advanceMs(TEST_PLAYOUT_MS);
+  stream.update();
+  TEST_ASSERT_EQUAL_HEX8(0x02, shown());
+  TEST_ASSERT_EQUAL_UINT32(2, stream.getFramesPlayed());
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_frames_play_at_timestamp_plus_playout_delay);
+  RUN_TEST(test_out_of_order_frames_are_reordered);
+  RUN_TEST(test_duplicates_in_the_buffer_are_ignored);
+  RUN_TEST(test_late_frames_are_dropped);
+  RUN_TEST(test_bursts_within_the_playout_delay_play_in_order);
+  RUN_TEST(test_late_update_shows_only_the_newest_due_frame);
+  RUN_TEST(test_flood_is_read_a_bounded_number_per_update);
+  RUN_TEST(test_invalid_packets_are_counted);
+  RUN_TEST(test_brightness_and_timeout);
+  RUN_TEST(test_restarted_sender_needs_the_new_stream_flag);
+  return UNITY_END();
+}
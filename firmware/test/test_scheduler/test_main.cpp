@@ -0,0 +1,196 @@
+// Scheduler: timer wheel deadlines, periodic phase, and tasks cancelled or rescheduled by another task's callback
+// in the same tick.
+//
+// Run on the host: pio test -e native -f test_scheduler
+
+#include <Arduino.h>
+#include <unity.h>
+#include "host.h"
+#include "scheduler.h"
+
+static Scheduler* scheduler;
+
+// Two tasks whose callbacks act on each other; whichever runs first does, so the tests do not depend on the order
+// of the tasks within a slot
+static SchedulerTask* first;
+static SchedulerTask* second;
+static bool acted;
+static void (*action)(SchedulerTask& other);
+
+static void pairCallback(SchedulerTask& self)
+{
+  if (acted) return;
+  acted = true;
+  action(&self == first ? *second : *first);
+}
+
+static void firstCallback() { pairCallback(*first); }
+static void secondCallback() { pairCallback(*second); }
+static void noop() {}
+
+static void advanceTo(uint32_t ms)
+{
+  hostAdvanceMicros((uint64_t)ms * 1000 - hostMicros());
+}
+
+// Runs the scheduler on every millisecond up to ms, as the loop does
+static void runUntil(uint32_t ms)
+{
+  while (millis() < ms) {
+    hostAdvanceMicros(1000);
+    scheduler->run();
+  }
+}
+
+void setUp()
+{
+  // Every test starts on a whole millisecond, at a different wheel position
+  advanceTo(millis() + 1000);
+  scheduler = new Scheduler();
+  scheduler->begin();
+  acted = false;
+}
+
+void tearDown()
+{
+  delete scheduler;
+}
+
+void test_one_shot_runs_at_its_deadline()
+{
+  SchedulerTask task("task", noop);
+  scheduler->schedule(task, 100);
+
+  runUntil(millis() + 99);
+  TEST_ASSERT_EQUAL_UINT32(0, task.runs);
+  runUntil(millis() + 1);
+  TEST_ASSERT_EQUAL_UINT32(1, task.runs);
+  TEST_ASSERT_EQUAL_UINT32(0, task.maxLateMs);
+  TEST_ASSERT_FALSE(task.scheduled);
+
+  // Beyond the wheel's range (about 4.4 minutes) the task is parked and filed again
+  scheduler->schedule(task, 300000);
+  runUntil(millis() + 299999);
+  TEST_ASSERT_EQUAL_UINT32(1, task.runs);
+  runUntil(millis() + 1);
+  TEST_ASSERT_EQUAL_UINT32(2, task.runs);
+}
+
+void test_periodic_task_keeps_its_phase_and_skips_missed_runs()
+{
+  SchedulerTask task("task", noop, 10);
+  uint32_t start = millis();
+  scheduler->schedule(task, 10);
+
+  runUntil(start + 100);
+  TEST_ASSERT_EQUAL_UINT32(10, task.runs);
+  TEST_ASSERT_EQUAL_UINT32(start + 110, task.deadline);
+
+  // A 55 ms stall: one late run, then on a new phase rather than five runs in a row
+  advanceTo(start + 155);
+  scheduler->run();
+  TEST_ASSERT_EQUAL_UINT32(11, task.runs);
+  TEST_ASSERT_EQUAL_UINT32(45, task.maxLateMs);
+  TEST_ASSERT_EQUAL_UINT32(start + 165, task.deadline);
+}
+
+void test_cancel_from_a_callback_in_the_same_tick()
+{
+  SchedulerTask a("a", firstCallback);
+  SchedulerTask b("b", secondCallback);
+  first = &a;
+  second = &b;
+  action = [](SchedulerTask& other) { scheduler->cancel(other); };
+
+  scheduler->schedule(a, 100);
+  scheduler->schedule(b, 100);
+  runUntil(millis() + 1000);
+
+  TEST_ASSERT_EQUAL_UINT32(1, a.runs + b.runs);
+  TEST_ASSERT_FALSE(a.scheduled);
+  TEST_ASSERT_FALSE(b.scheduled);
+}
+
+void test_reschedule_from_a_callback_in_the_same_tick()
+{
+  SchedulerTask a("a", firstCallback);
+  SchedulerTask b("b", secondCallback);
+  first = &a;
+  second = &b;
+  action = [](SchedulerTask& other) { scheduler->schedule(other, 1000); };
+
+  uint32_t start = millis();
+  scheduler->schedule(a, 100);
+  scheduler->schedule(b, 100);
+  runUntil(start + 100);
+  TEST_ASSERT_EQUAL_UINT32(1, a.runs + b.runs);
+
+  // The other one runs once, at its new time
+  runUntil(start + 1099);
+  TEST_ASSERT_EQUAL_UINT32(1, a.runs + b.runs);
+  runUntil(start + 1100);
+  TEST_ASSERT_EQUAL_UINT32(1, a.runs);
+  TEST_ASSERT_EQUAL_UINT32(1, b.runs);
+  runUntil(start + 3000);
+  TEST_ASSERT_EQUAL_UINT32(2, a.runs + b.runs);
+}
+
+void test_periodic_tasks_cancelling_each_other()
+{
+  // As when the power task turns the voltage task off: both periodic, due on the same tick, and a third task
+  // shares the slot the survivor is filed into next
+  SchedulerTask a("a", firstCallback, 10);
+  SchedulerTask b("b", secondCallback, 10);
+  SchedulerTask c("c", noop);
+  first = &a;
+  second = &b;
+  action = [](SchedulerTask& other) { scheduler->cancel(other); };
+
+  uint32_t start = millis();
+  scheduler->schedule(a, 10);
+  scheduler->schedule(b, 10);
+  scheduler->schedule(c, 20);
+  runUntil(start + 10);
+  TEST_ASSERT_EQUAL_UINT32(1, a.runs + b.runs);
+  SchedulerTask& survivor = a.runs ? a : b;
+  SchedulerTask& cancelled = a.runs ? b : a;
+
+  runUntil(start + 100);
+  TEST_ASSERT_EQUAL_UINT32(0, cancelled.runs);
+  TEST_ASSERT_FALSE(cancelled.scheduled);
+  TEST_ASSERT_EQUAL_UINT32(10, survivor.runs);
+  TEST_ASSERT_EQUAL_UINT32(1, c.runs);
+}
+
+void test_sleep_wakes_before_the_next_deadline()
+{
+  SchedulerTask task("task", noop);
+  scheduler->schedule(task, 5);
+  TEST_ASSERT_EQUAL_UINT32(5000, scheduler->getMicrosToNextDeadline());
+
+  uint64_t start = hostMicros();
+  scheduler->sleep(100000);
+  TEST_ASSERT_EQUAL_UINT32(5000 - SCHEDULER_WAKE_MARGIN_US, (uint32_t)(hostMicros() - start));
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler->getWakeCount());
+
+  // The remaining margin is shorter than a sleep is worth
+  TEST_ASSERT_EQUAL_UINT32(SCHEDULER_WAKE_MARGIN_US, scheduler->getMicrosToNextDeadline());
+  scheduler->sleep(100000);
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler->getWakeCount());
+  hostAdvanceMicros(SCHEDULER_WAKE_MARGIN_US);
+  scheduler->run();
+  TEST_ASSERT_EQUAL_UINT32(1, task.runs);
+  TEST_ASSERT_EQUAL_UINT32(UINT32_MAX, scheduler->getMicrosToNextDeadline());
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_one_shot_runs_at_its_deadline);
+  RUN_TEST(test_periodic_task_keeps_its_phase_and_skips_missed_runs);
+  RUN_TEST(test_cancel_from_a_callback_in_the_same_tick);
+  RUN_TEST(test_reschedule_from_a_callback_in_the_same_tick);
+  RUN_TEST(test_periodic_tasks_cancelling_each_other);
+  RUN_TEST(test_sleep_wakes_before_the_next_deadline);
+  return UNITY_END();
+}
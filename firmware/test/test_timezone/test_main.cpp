@@ -0,0 +1,257 @@
+// TimeZone: POSIX TZ rules, the transition instants and the offsets around them, and every transition from 1970
+// to 2100 against the host C library's TZ implementation.
+//
+// Run on the host: pio test -e native -f test_timezone
+
+#include <Arduino.h>
+#include <unity.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include "timezone.h"
+
+#define HOUR 3600
+
+static time_t utc(int year, unsigned month, unsigned day, int hour = 0, int minute = 0, int second = 0)
+{
+  return (time_t)(TimeZone::daysFromCivil(year, month, day) * 86400 + hour * 3600 + minute * 60 + second);
+}
+
+// Local time of day in seconds after local midnight
+static int32_t localSeconds(TimeZone& zone, time_t instant)
+{
+  time_t local = zone.toLocal(instant);
+  return (int32_t)(((local % 86400) + 86400) % 86400);
+}
+
+// Checks the offset, the DST flag and the local date and time at an instant against localtime_r() with TZ set
+static void expectLikeLibc(TimeZone& zone, time_t instant, const char* context)
+{
+  struct tm local;
+  TEST_ASSERT_NOT_NULL(localtime_r(&instant, &local));
+  TEST_ASSERT_EQUAL_INT32_MESSAGE(local.tm_gmtoff, zone.getUtcOffset(instant), context);
+  TEST_ASSERT_EQUAL_INT_MESSAGE(local.tm_isdst > 0, zone.isDst(instant), context);
+  TEST_ASSERT_EQUAL_INT64_MESSAGE(utc(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday, local.tm_hour, local.tm_min,
+                                      local.tm_sec), zone.toLocal(instant), context);
+}
+
+static void expectTransitionsLikeLibc(const char* rule)
+{
+  TimeZone zone;
+  TEST_ASSERT_TRUE(zone.setRule(rule));
+  setenv("TZ", rule, 1);
+  tzset();
+
+  for (int year = 1970; year <= 2100; year++)
+  {
+    char context[64];
+    snprintf(context, sizeof(context), "%s in %d", rule, year);
+
+    // Both transitions fall in the year, and the C library switches at the same second
+    time_t transitions[] = {zone.getDstStart(year), zone.getDstEnd(year)};
+    for (time_t transition : transitions)
+    {
+      TEST_ASSERT_EQUAL_INT_MESSAGE(year, TimeZone::yearFromTime(transition), context);
+      expectLikeLibc(zone, transition - 1, context);
+      expectLikeLibc(zone, transition, context);
+      expectLikeLibc(zone, transition + 1, context);
+    }
+
+    // And agree between them
+    expectLikeLibc(zone, utc(year, 1, 15), context);
+    expectLikeLibc(zone, utc(year, 7, 15), context);
+  }
+
+  // Out of order, so the cached table is rebuilt in both directions
+  expectLikeLibc(zone, utc(2100, 12, 31, 23), rule);
+  expectLikeLibc(zone, utc(1970, 1, 1), rule);
+}
+
+void setUp()
+{
+}
+
+void tearDown()
+{
+  unsetenv("TZ");
+  tzset();
+}
+
+void test_us_dst_start_skips_an_hour()
+{
+  // 2024-03-10, the second Sunday of March: 02:00 CST (08:00 UTC) becomes 03:00 CDT
+  TimeZone zone;
+  TEST_ASSERT_TRUE(zone.setRule("CST6CDT,M3.2.0,M11.1.0"));
+  TEST_ASSERT_EQUAL_INT64(utc(2024, 3, 10, 8), zone.getDstStart(2024));
+
+  time_t start = utc(2024, 3, 10, 8);
+  TEST_ASSERT_FALSE(zone.isDst(start - 1));
+  TEST_ASSERT_EQUAL_INT32(-6 * HOUR, zone.getUtcOffset(start - 1));
+  TEST_ASSERT_EQUAL_INT32(1 * HOUR + 59 * 60 + 59, localSeconds(zone, start - 1));
+
+  TEST_ASSERT_TRUE(zone.isDst(start));
+  TEST_ASSERT_EQUAL_INT32(-5 * HOUR, zone.getUtcOffset(start));
+  TEST_ASSERT_EQUAL_INT32(3 * HOUR, localSeconds(zone, start));  // 02:00-02:59 never happens
+}
+
+void test_us_dst_end_repeats_an_hour()
+{
+  // 2024-11-03, the first Sunday of November: 02:00 CDT (07:00 UTC) becomes 01:00 CST
+  TimeZone zone;
+  TEST_ASSERT_TRUE(zone.setRule("CST6CDT,M3.2.0,M11.1.0"));
+  time_t end = utc(2024, 11, 3, 7);
+  TEST_ASSERT_EQUAL_INT64(end, zone.getDstEnd(2024));
+
+  TEST_ASSERT_TRUE(zone.isDst(end - HOUR));
+  TEST_ASSERT_EQUAL_INT32(1 * HOUR, localSeconds(zone, end - HOUR));
+  TEST_ASSERT_EQUAL_INT32(1 * HOUR + 59 * 60 + 59, localSeconds(zone, end - 1));
+
+  TEST_ASSERT_FALSE(zone.isDst(end));
+  TEST_ASSERT_EQUAL_INT32(-6 * HOUR, zone.getUtcOffset(end));
+  TEST_ASSERT_EQUAL_INT32(1 * HOUR, localSeconds(zone, end));  // 01:00-01:59 happens twice
+}
+
+void test_us_default_rules_and_last_week()
+{
+  // Without dates a DST zone follows the US rules; week 5 is the last such weekday of the month
+  TimeZone zone;
+  TEST_ASSERT_TRUE(zone.setRule("EST5EDT"));
+  TEST_ASSERT_EQUAL_INT64(utc(2023, 3, 12, 7), zone.getDstStart(2023));
+  TEST_ASSERT_EQUAL_INT64(utc(2023, 11, 5, 6), zone.getDstEnd(2023));
+
+  TEST_ASSERT_TRUE(zone.setRule("CET-1CEST,M3.5.0,M10.5.0/3"));
+  TEST_ASSERT_EQUAL_INT64(utc(2024, 3, 31, 1), zone.getDstStart(2024));
+  TEST_ASSERT_EQUAL_INT64(utc(2024, 10, 27, 1), zone.getDstEnd(2024));
+  TEST_ASSERT_EQUAL_INT64(utc(2026, 3, 29, 1), zone.getDstStart(2026));
+}
+
+void test_southern_hemisphere()
+{
+  // DST runs from the first Sunday of October into the next year, ending the first Sunday of April at 03:00
+  TimeZone zone;
+  TEST_ASSERT_TRUE(zone.setRule("AEST-10AEDT,M10.1.0,M4.1.0/3"));
+
+  // 2024-04-07 03:00 AEDT = 04-06 16:00 UTC; 2024-10-06 02:00 AEST = 10-05 16:00 UTC
+  time_t end = utc(2024, 4, 6, 16);
+  time_t start = utc(2024, 10, 5, 16);
+  TEST_ASSERT_EQUAL_INT64(end, zone.getDstEnd(2024));
+  TEST_ASSERT_EQUAL_INT64(start, zone.getDstStart(2024));
+
+  TEST_ASSERT_TRUE(zone.isDst(utc(2024, 1, 15, 12)));
+  TEST_ASSERT_EQUAL_INT32(11 * HOUR, zone.getUtcOffset(utc(2024, 1, 15, 12)));
+  TEST_ASSERT_TRUE(zone.isDst(end - 1));
+  TEST_ASSERT_FALSE(zone.isDst(end));
+  TEST_ASSERT_EQUAL_INT32(2 * HOUR, localSeconds(zone, end));  // 02:00-02:59 repeats
+  TEST_ASSERT_FALSE(zone.isDst(utc(2024, 7, 1)));
+  TEST_ASSERT_EQUAL_INT32(10 * HOUR, zone.getUtcOffset(utc(2024, 7, 1)));
+  TEST_ASSERT_FALSE(zone.isDst(start - 1));
+  TEST_ASSERT_TRUE(zone.isDst(start));
+  TEST_ASSERT_EQUAL_INT32(3 * HOUR, localSeconds(zone, start));  // 02:00-02:59 is skipped
+
+  // Across the new year, in both directions through the cached table
+  TEST_ASSERT_TRUE(zone.isDst(utc(2024, 12, 31, 23)));
+  TEST_ASSERT_TRUE(zone.isDst(utc(2025, 1, 1, 1)));
+  TEST_ASSERT_TRUE(zone.isDst(utc(2024, 12, 31, 23)));
+}
+
+void test_julian_day_ignores_february_29()
+{
+  // Jn counts 1-365 and never February 29: J60 is March 1 in every year
+  TimeZone zone;
+  TEST_ASSERT_TRUE(zone.setRule("XST5XDT,J60,J300/25"));
+  TEST_ASSERT_EQUAL_INT64(utc(2023, 3, 1, 2 + 5), zone.getDstStart(2023));
+  TEST_ASSERT_EQUAL_INT64(utc(2024, 3, 1, 2 + 5), zone.getDstStart(2024));
+
+  // J300 is October 27; the time may run past midnight (25:00 local DST = 03:00 UTC + 1 day + 4 h)
+  TEST_ASSERT_EQUAL_INT64(utc(2023, 10, 28, 1 + 4), zone.getDstEnd(2023));
+  TEST_ASSERT_EQUAL_INT64(utc(2024, 10, 28, 1 + 4), zone.getDstEnd(2024));
+}
+
+void test_zero_based_day_counts_february_29()
+{
+  // n counts 0-365 including February 29: day 59 is March 1, or February 29 in a leap year
+  TimeZone zone;
+  TEST_ASSERT_TRUE(zone.setRule("XST5XDT4,59/0,300/-1"));
+  TEST_ASSERT_EQUAL_INT64(utc(2023, 3, 1, 5), zone.getDstStart(2023));
+  TEST_ASSERT_EQUAL_INT64(utc(2024, 2, 29, 5), zone.getDstStart(2024));
+
+  // Day 300 at -01:00, i.e. 23:00 local DST on day 299 (October 27 in 2023, October 26 in 2024)
+  TEST_ASSERT_EQUAL_INT64(utc(2023, 10, 28, 3), zone.getDstEnd(2023));
+  TEST_ASSERT_EQUAL_INT64(utc(2024, 10, 27, 3), zone.getDstEnd(2024));
+  TEST_ASSERT_EQUAL_INT32(-4 * HOUR, zone.getUtcOffset(utc(2024, 6, 1)));
+}
+
+void test_zone_without_dst()
+{
+  TimeZone zone;
+  TEST_ASSERT_EQUAL_STRING("UTC0", zone.getRule());
+  TEST_ASSERT_EQUAL_INT32(0, zone.getUtcOffset(utc(2024, 7, 1)));
+
+  TEST_ASSERT_TRUE(zone.setRule("MSK-3"));
+  TEST_ASSERT_FALSE(zone.isDst(utc(2024, 1, 1)));
+  TEST_ASSERT_FALSE(zone.isDst(utc(2024, 7, 1)));
+  TEST_ASSERT_EQUAL_INT32(3 * HOUR, zone.getUtcOffset(utc(2024, 7, 1)));
+  TEST_ASSERT_EQUAL_INT64(0, zone.getDstStart(2024));
+  TEST_ASSERT_EQUAL_INT64(0, zone.getDstEnd(2024));
+
+  // Quoted names and minutes in the offset
+  TEST_ASSERT_TRUE(zone.setRule("<+0530>-5:30"));
+  TEST_ASSERT_EQUAL_INT32(5 * HOUR + 30 * 60, zone.getUtcOffset(utc(2024, 3, 10, 8)));
+  TEST_ASSERT_EQUAL_INT64(utc(2024, 3, 10, 13, 30), zone.toLocal(utc(2024, 3, 10, 8)));
+}
+
+void test_invalid_rules_keep_the_current_one()
+{
+  TimeZone zone;
+  TEST_ASSERT_TRUE(zone.setRule("CST6CDT,M3.2.0,M11.1.0"));
+
+  TEST_ASSERT_FALSE(zone.setRule(""));
+  TEST_ASSERT_FALSE(zone.setRule("CS6"));                       // Name shorter than three letters
+  TEST_ASSERT_FALSE(zone.setRule("CST"));                       // No offset
+  TEST_ASSERT_FALSE(zone.setRule("CST6CDT,M3.2.0"));            // Only one transition
+  TEST_ASSERT_FALSE(zone.setRule("CST6CDT,M13.2.0,M11.1.0"));   // Month out of range
+  TEST_ASSERT_FALSE(zone.setRule("CST6CDT,M3.6.0,M11.1.0"));    // Week out of range
+  TEST_ASSERT_FALSE(zone.setRule("CST6CDT,J0,J300"));           // Julian days start at 1
+  TEST_ASSERT_FALSE(zone.setRule("CST6CDT,M3.2.0,M11.1.0 "));   // Trailing garbage
+  TEST_ASSERT_FALSE(zone.setRule("<+05-5"));                    // Unterminated quoted name
+  TEST_ASSERT_FALSE(zone.setRule("ABCDEFGHIJKLMNOPQRSTUVWXYZ0ABCDEFGHIJKLMNOPQRSTU"));  // Too long
+  TEST_ASSERT_FALSE(TimeZone::isValidRule(NULL));
+
+  TEST_ASSERT_EQUAL_STRING("CST6CDT,M3.2.0,M11.1.0", zone.getRule());
+  TEST_ASSERT_EQUAL_INT32(-5 * HOUR, zone.getUtcOffset(utc(2024, 7, 1)));
+}
+
+void test_calendar_helpers()
+{
+  TEST_ASSERT_EQUAL_INT64(0, TimeZone::daysFromCivil(1970, 1, 1));
+  TEST_ASSERT_EQUAL_INT64(19782, TimeZone::daysFromCivil(2024, 2, 29));
+  TEST_ASSERT_EQUAL_INT(2024, TimeZone::yearFromTime(utc(2024, 12, 31, 23, 59, 59)));
+  TEST_ASSERT_EQUAL_INT(2025, TimeZone::yearFromTime(utc(2025, 1, 1)));
+  TEST_ASSERT_EQUAL_INT(1969, TimeZone::yearFromTime(-1));
+}
+
+void test_transitions_match_the_c_library()
+{
+  expectTransitionsLikeLibc("CST6CDT,M3.2.0,M11.1.0");
+  expectTransitionsLikeLibc("CET-1CEST,M3.5.0,M10.5.0/3");
+  expectTransitionsLikeLibc("AEST-10AEDT,M10.1.0,M4.1.0/3");
+  expectTransitionsLikeLibc("<+1030>-10:30<+11>-11,M10.1.0,M4.1.0");
+  expectTransitionsLikeLibc("XST5XDT,J60,J300/25");
+  expectTransitionsLikeLibc("XST5XDT4,59/0,300/-1");
+  expectTransitionsLikeLibc("<-02>2<-01>,M3.5.0/-1,M10.5.0/0");
+}
+
+int main(int argc, char** argv)
+{
+  UNITY_BEGIN();
+  RUN_TEST(test_us_dst_start_skips_an_hour);
+  RUN_TEST(test_us_dst_end_repeats_an_hour);
+  RUN_TEST(test_us_default_rules_and_last_week);
+  RUN_TEST(test_southern_hemisphere);
+  RUN_TEST(test_julian_day_ignores_february_29);
+  RUN_TEST(test_zero_based_day_counts_february_29);
+  RUN_TEST(test_zone_without_dst);
+  RUN_TEST(test_invalid_rules_keep_the_current_one);
+  RUN_TEST(test_calendar_helpers);
+  RUN_TEST(test_transitions_match_the_c_library);
+  return UNITY_END();
+}
@@ -0,0 +1,219 @@
+#!/usr/bin/env python3
+"""Generate the web UI's flash assets.
+
+- src/webui_assets.h: the stylesheet (with the font faces) and the script from src/webui.h, gzip-compressed,
+  which the clock sends to browsers that accept gzip. Generated before every firmware build (extra_scripts in
+  platformio.ini) and not checked in.
+- src/webui_fonts.h: WOFF2 subsets of Russo One and Rubik, made by build_ui_fonts.py. Checked in and only
+  regenerated by hand, with --fonts, after the UI gains characters. The TTFs are the ones pinned in
+  fonts/fonts.lock (a google/fonts commit and the SHA-256 of each file), taken from fonts/ or downloaded from
+  that commit into .pio/ui_fonts, and rejected if their hash differs. --pin COMMIT downloads the fonts at
+  another commit and rewrites the lock. Without the header the UI falls back to installed and system fonts.
+
+Headers are only rewritten when their contents change, so an unchanged UI does not rebuild main.cpp.
+  tools/build_ui_assets.py                  # gzip assets only, as the build does
+  tools/build_ui_assets.py --fonts          # regenerate src/webui_fonts.h from the pinned fonts
+  tools/build_ui_assets.py --pin <commit>   # pin the fonts at a google/fonts commit, then as --fonts
+"""
+
+import argparse
+import gzip
+import hashlib
+import json
+import os
+import re
+import subprocess
+import sys
+import urllib.request
+
+TOOLS_DIR = os.path.dirname(os.path.abspath(__file__)) if "__file__" in globals() else None
+RUN_BY_PLATFORMIO = TOOLS_DIR is None
+if RUN_BY_PLATFORMIO:
+    # Run by PlatformIO (SCons exec()s the script without __file__)
+    Import("env")  # noqa: F821
+    TOOLS_DIR = os.path.join(env.subst("$PROJECT_DIR"), "tools")  # noqa: F821
+
+FIRMWARE_DIR = os.path.dirname(TOOLS_DIR)
+WEBUI_SOURCE = os.path.join(FIRMWARE_DIR, "src", "webui.h")
+FONTS_HEADER = os.path.join(FIRMWARE_DIR, "src", "webui_fonts.h")
+ASSETS_HEADER = os.path.join(FIRMWARE_DIR, "src", "webui_assets.h")
+FONT_DIRS = [os.path.join(FIRMWARE_DIR, "fonts"), os.path.join(FIRMWARE_DIR, ".pio", "ui_fonts")]
+FONT_LOCK = os.path.join(FONT_DIRS[0], "fonts.lock")
+DOWNLOAD_DIR = FONT_DIRS[-1]
+DOWNLOAD_TIMEOUT_S = 30
+
+# The Google Fonts repository ships Rubik only as a variable font; build_ui_fonts.py instances both weights
+FONT_URL = "https://raw.githubusercontent.com/google/fonts/%s/ofl/"
+FONTS = {
+    "russo_one": ("RussoOne-Regular.ttf", "russoone/RussoOne-Regular.ttf"),
+    "rubik": ("Rubik[wght].ttf", "rubik/Rubik%5Bwght%5D.ttf"),
+}
+
+
+def note(message):
+    print("build_ui_assets: " + message)
+
+
+def write_if_changed(path, text):
+    if os.path.exists(path):
+        with open(path, encoding="utf-8") as current:
+            if current.read() == text:
+                return False
+    with open(path, "w", encoding="utf-8") as out:
+        out.write(text)
+    return True
+
+
+def sha256(path):
+    with open(path, "rb") as source:
+        return hashlib.sha256(source.read()).hexdigest()
+
+
+def download(commit, name, url_path):
+    os.makedirs(DOWNLOAD_DIR, exist_ok=True)
+    path = os.path.join(DOWNLOAD_DIR, name)
+    try:
+        with urllib.request.urlopen(FONT_URL % commit + url_path, timeout=DOWNLOAD_TIMEOUT_S) as response:
+            data = response.read()
+    except OSError as error:
+        sys.exit("build_ui_assets: could not download %s (%s); put it in fonts/ instead" % (name, error))
+    with open(path + ".part", "wb") as out:
+        out.write(data)
+    os.replace(path + ".part", path)
+    return path
+
+
+def read_lock():
+    if not os.path.exists(FONT_LOCK):
+        sys.exit("build_ui_assets: %s is missing; pin the fonts first with --pin <google/fonts commit>" % FONT_LOCK)
+    with open(FONT_LOCK, encoding="utf-8") as lock:
+        return json.load(lock)
+
+
+def pin_fonts(commit):
+    if not re.fullmatch(r"[0-9a-f]{40}", commit):
+        sys.exit("build_ui_assets: --pin takes a full google/fonts commit hash")
+    lock = {"commit": commit, "sha256": {}}
+    for name, url_path in FONTS.values():
+        lock["sha256"][name] = sha256(download(commit, name, url_path))
+    os.makedirs(FONT_DIRS[0], exist_ok=True)
+    with open(FONT_LOCK, "w", encoding="utf-8") as out:
+        json.dump(lock, out, indent=2, sort_keys=True)
+        out.write("\n")
+    note("pinned the fonts at google/fonts %s" % commit)
+
+
+def pinned_font(lock, name, url_path):
+    """The path of a font file matching the lock, downloading it at the pinned commit if needed."""
+    expected = lock["sha256"].get(name)
+    if expected is None:
+        sys.exit("build_ui_assets: %s has no hash in %s" % (name, FONT_LOCK))
+    for directory in FONT_DIRS:
+        path = os.path.join(directory, name)
+        if os.path.exists(path) and sha256(path) == expected:
+            return path
+        if os.path.exists(path):
+            note("ignoring %s: its SHA-256 differs from %s" % (path, FONT_LOCK))
+
+    path = download(lock["commit"], name, url_path)
+    if sha256(path) != expected:
+        os.remove(path)
+        sys.exit("build_ui_assets: %s at google/fonts %s does not match %s" % (name, lock["commit"], FONT_LOCK))
+    return path
+
+
+def build_fonts():
+    lock = read_lock()
+    paths = {key: pinned_font(lock, name, url_path) for key, (name, url_path) in FONTS.items()}
+    command = [sys.executable, os.path.join(TOOLS_DIR, "build_ui_fonts.py"),
+               "--russo-one", paths["russo_one"], "--rubik", paths["rubik"], "--output", FONTS_HEADER]
+    if subprocess.call(command) != 0:
+        sys.exit("build_ui_assets: font subsetting failed (pip install fonttools brotli)")
+
+
+def c_literals(block, macros):
+    """Concatenate the C string literals in block, expanding the given string macros."""
+    text = ""
+    for literal, name in re.findall(r'"((?:[^"\\]|\\.)*)"|([A-Z_][A-Z0-9_]*)', block):
+        if name:
+            text += macros[name]
+        else:
+            text += literal.encode("latin-1", "backslashreplace").decode("unicode_escape")
+    return text
+
+
+def raw_literal(source, name):
+    match = re.search(r'constexpr char %s\[\] PROGMEM = R"rawliteral\((.*?)\)rawliteral";' % name, source, re.S)
+    if not match:
+        sys.exit("build_ui_assets: %s not found in %s" % (name, WEBUI_SOURCE))
+    return match.group(1)
+
+
+def font_css(source):
+    """WEBUI_FONT_CSS as the firmware compiles it, with or without the embedded fonts."""
+    version = None
+    if os.path.exists(FONTS_HEADER):
+        with open(FONTS_HEADER, encoding="utf-8") as header:
+            match = re.search(r'#define WEBUI_FONT_VERSION "([^"]*)"', header.read())
+            version = match and match.group(1)
+    if version is None:
+        return raw_literal(source, "WEBUI_FONT_CSS")
+
+    match = re.search(r"#ifdef WEBUI_HAS_FONTS\nconstexpr char WEBUI_FONT_CSS\[\] PROGMEM =\n(.*?);\n#else", source,
+                      re.S)
+    if not match:
+        sys.exit("build_ui_assets: WEBUI_FONT_CSS not found in %s" % WEBUI_SOURCE)
+    return c_literals(match.group(1), {"WEBUI_FONT_VERSION": version})
+
+
+def c_array(name, data):
+    lines = ["const uint8_t %s[] PROGMEM = {" % name]
+    for i in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def build_assets():
+    with open(WEBUI_SOURCE, encoding="utf-8") as source:
+        text = source.read().replace("\r\n", "\n")
+
+    css = font_css(text) + raw_literal(text, "WEBUI_CSS")
+    js = raw_literal(text, "WEBUI_JS")
+    assets = [
+        ("WEBUI_CSS_GZ", gzip.compress(css.encode("utf-8"), 9, mtime=0)),
+        ("WEBUI_JS_GZ", gzip.compress(js.encode("utf-8"), 9, mtime=0)),
+    ]
+
+    parts = [
+        "// Generated by tools/build_ui_assets.py from src/webui.h - do not edit.",
+        "#ifndef WEBUI_ASSETS_H",
+        "#define WEBUI_ASSETS_H",
+        "",
+        "#include <Arduino.h>",
+        "",
+        "#define WEBUI_HAS_GZIP_ASSETS 1",
+        "",
+    ]
+    for name, data in assets:
+        parts.append(c_array(name, data))
+        parts.append("")
+    parts.append("#endif")
+
+    if write_if_changed(ASSETS_HEADER, "\n".join(parts) + "\n"):
+        note("CSS %d -> %d bytes, JS %d -> %d bytes gzipped" % (
+            len(css.encode("utf-8")), len(assets[0][1]), len(js.encode("utf-8")), len(assets[1][1])))
+
+
+if RUN_BY_PLATFORMIO:
+    build_assets()
+else:
+    parser = argparse.ArgumentParser(description="Generate the web UI's flash assets.")
+    parser.add_argument("--fonts", action="store_true", help="regenerate src/webui_fonts.h from the pinned fonts")
+    parser.add_argument("--pin", metavar="COMMIT", help="pin the fonts at this google/fonts commit, then --fonts")
+    args = parser.parse_args()
+    if args.pin:
+        pin_fonts(args.pin)
+    if args.fonts or args.pin:
+        build_fonts()
+    build_assets()
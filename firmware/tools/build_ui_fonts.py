@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+"""Generate src/webui_fonts.h: WOFF2 subsets of the web UI fonts, embedded in flash.
+
+Only the glyphs the UI can show are kept: printable ASCII (for user text) plus every character that
+appears in src/webui.h (translations, symbols). When the header exists, webui.h serves the fonts from
+the clock with immutable caching; without it the UI falls back to installed and system fonts.
+
+Needs fontTools with Brotli support (pip install fonttools brotli). Font files are available from
+https://fonts.google.com/specimen/Russo+One and https://fonts.google.com/specimen/Rubik. Rubik may be the
+static regular and bold TTFs or the variable font, which is instanced at both weights. The checked-in header
+is made with build_ui_assets.py --fonts from the pinned fonts; run this directly only to try other font files.
+
+Examples:
+  build_ui_fonts.py --russo-one RussoOne-Regular.ttf --rubik Rubik-Regular.ttf --rubik-bold Rubik-Bold.ttf
+  build_ui_fonts.py --russo-one RussoOne-Regular.ttf --rubik "Rubik[wght].ttf"
+"""
+
+import argparse
+import hashlib
+import io
+import os
+import sys
+
+try:
+    from fontTools import subset
+    from fontTools.ttLib import TTFont
+    from fontTools.varLib import instancer
+except ImportError:
+    sys.exit("fontTools is required: pip install fonttools brotli")
+
+FIRMWARE_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+WEBUI_SOURCE = os.path.join(FIRMWARE_DIR, "src", "webui.h")
+OUTPUT = os.path.join(FIRMWARE_DIR, "src", "webui_fonts.h")
+
+
+def ui_characters():
+    with open(WEBUI_SOURCE, encoding="utf-8") as source:
+        text = source.read()
+    chars = {chr(c) for c in range(0x20, 0x7F)}
+    chars.update(ch for ch in text if ord(ch) >= 0x80)
+    return "".join(sorted(chars))
+
+
+def is_variable(path):
+    return "fvar" in TTFont(path)
+
+
+def subset_font(path, text, weight=400):
+    options = subset.Options()
+    options.flavor = "woff2"
+    options.layout_features = ["kern", "liga"]
+    options.name_IDs = []
+    options.notdef_outline = True
+    font = TTFont(path)
+    if "fvar" in font:
+        font = instancer.instantiateVariableFont(font, {"wght": weight})
+    subsetter = subset.Subsetter(options)
+    subsetter.populate(text=text)
+    subsetter.subset(font)
+    out = io.BytesIO()
+    font.flavor = "woff2"
+    font.save(out)
+    return out.getvalue()
+
+
+def c_array(name, data):
+    lines = ["const uint8_t %s[] PROGMEM = {" % name]
+    for i in range(0, len(data), 16):
+        lines.append("  " + ", ".join("0x%02x" % b for b in data[i:i + 16]) + ",")
+    lines.append("};")
+    return "\n".join(lines)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("--russo-one", required=True, help="Russo One regular TTF")
+    parser.add_argument("--rubik", required=True, help="Rubik regular (400) TTF, or the variable font")
+    parser.add_argument("--rubik-bold", help="Rubik bold (700) TTF (default: --rubik, if it is the variable font)")
+    parser.add_argument("--output", default=OUTPUT)
+    args = parser.parse_args()
+    if args.rubik_bold is None:
+        if not is_variable(args.rubik):
+            parser.error("--rubik-bold is needed unless --rubik is the variable font")
+        args.rubik_bold = args.rubik
+
+    text = ui_characters()
+    fonts = [
+        ("WEBUI_FONT_RUSSO_ONE", subset_font(args.russo_one, text)),
+        ("WEBUI_FONT_RUBIK_400", subset_font(args.rubik, text)),
+        ("WEBUI_FONT_RUBIK_700", subset_font(args.rubik_bold, text, 700)),
+    ]
+    version = hashlib.sha1(b"".join(data for _, data in fonts)).hexdigest()[:8]
+
+    parts = [
+        "// Generated by tools/build_ui_fonts.py - do not edit.",
+        "// Subsets of Russo One and Rubik (SIL Open Font License 1.1), %d glyphs." % len(text),
+        "#ifndef WEBUI_FONTS_H",
+        "#define WEBUI_FONTS_H",
+        "",
+        "#include <Arduino.h>",
+        "",
+        "#define WEBUI_HAS_FONTS 1",
+        '#define WEBUI_FONT_VERSION "%s"' % version,
+        "",
+    ]
+    for name, data in fonts:
+        parts.append(c_array(name, data))
+        parts.append("")
+    parts.append("#endif")
+
+    with open(args.output, "w") as out:
+        out.write("\n".join(parts) + "\n")
+    for name, data in fonts:
+        print("%-22s %6d bytes" % (name, len(data)))
+    print("wrote %s" % args.output)
+
+
+if __name__ == "__main__":
+    main()
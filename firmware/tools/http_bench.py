@@ -0,0 +1,238 @@
+#!/usr/bin/env python3
+"""HTTP load and latency benchmark for the VFD clock web interface.
+
+Drives the web handlers with concurrent clients for a fixed duration and reports throughput and latency
+per endpoint. While the load runs, /api/stats is polled on a separate connection to capture heap usage,
+the largest free heap block and the display multiplex timing, so the impact of UI traffic on the clock
+can be measured.
+
+Examples:
+  http_bench.py http://192.168.1.50 --clients 8 --duration 30
+  http_bench.py http://192.168.1.50 --endpoint GET:/ --endpoint GET:/api/settings --json results.json
+"""
+
+import argparse
+import http.client
+import json
+import sys
+import threading
+import time
+import urllib.parse
+
+# Default request mix. Read-only apart from /settext, which re-posts the current text (no flash write).
+DEFAULT_ENDPOINTS = ["GET:/", "GET:/api/settings", "POST:/settext"]
+MULTIPLEX_INTERVAL_US = 1000
+
+
+class Endpoint:
+    def __init__(self, spec):
+        method, _, path = spec.partition(":")
+        if not path.startswith("/"):
+            raise argparse.ArgumentTypeError("endpoint must look like METHOD:/path, got %r" % spec)
+        self.method = method.upper()
+        self.path = path
+        self.spec = "%s %s" % (self.method, self.path)
+        self.body = None
+
+    def __str__(self):
+        return self.spec
+
+
+def percentile(values, fraction):
+    if not values:
+        return 0.0
+    ordered = sorted(values)
+    index = min(len(ordered) - 1, int(round(fraction * (len(ordered) - 1))))
+    return ordered[index]
+
+
+def connect(url, timeout):
+    cls = http.client.HTTPSConnection if url.scheme == "https" else http.client.HTTPConnection
+    return cls(url.hostname, url.port, timeout=timeout)
+
+
+def get_json(url, path, timeout):
+    conn = connect(url, timeout)
+    try:
+        conn.request("GET", path)
+        response = conn.getresponse()
+        body = response.read()
+        if response.status != 200:
+            raise RuntimeError("%s returned %d" % (path, response.status))
+        return json.loads(body)
+    finally:
+        conn.close()
+
+
+def client_worker(url, endpoints, deadline, timeout, results, lock, index):
+    """Issue requests round-robin over the endpoints until the deadline."""
+    samples = {str(e): [] for e in endpoints}
+    errors = {str(e): 0 for e in endpoints}
+    conn = None
+    n = index
+    while time.monotonic() < deadline:
+        endpoint = endpoints[n % len(endpoints)]
+        n += 1
+        headers = {}
+        if endpoint.body is not None:
+            headers["Content-Type"] = "application/x-www-form-urlencoded"
+        started = time.perf_counter()
+        try:
+            if conn is None:
+                conn = connect(url, timeout)
+            conn.request(endpoint.method, endpoint.path, body=endpoint.body, headers=headers)
+            response = conn.getresponse()
+            response.read()
+            if response.status >= 400:
+                errors[str(endpoint)] += 1
+            else:
+                samples[str(endpoint)].append(time.perf_counter() - started)
+            if response.getheader("Connection", "").lower() == "close":
+                conn.close()
+                conn = None
+        except (OSError, http.client.HTTPException):
+            errors[str(endpoint)] += 1
+            if conn is not None:
+                conn.close()
+            conn = None
+    if conn is not None:
+        conn.close()
+    with lock:
+        for key in samples:
+            results["samples"][key].extend(samples[key])
+            results["errors"][key] += errors[key]
+
+
+def stats_poller(url, interval, stop, timeout, snapshots):
+    while not stop.is_set():
+        try:
+            snapshots.append(get_json(url, "/api/stats", timeout))
+        except (OSError, RuntimeError, ValueError, http.client.HTTPException):
+            pass
+        stop.wait(interval)
+
+
+def run(args):
+    url = urllib.parse.urlparse(args.url)
+    endpoints = [Endpoint(spec) for spec in (args.endpoint or DEFAULT_ENDPOINTS)]
+
+    # Re-post the current text so /settext exercises the handler without changing anything
+    try:
+        settings = get_json(url, "/api/settings", args.timeout)
+    except (OSError, RuntimeError, ValueError, http.client.HTTPException) as error:
+        print("cannot reach %s: %s" % (args.url, error), file=sys.stderr)
+        return 2
+    for endpoint in endpoints:
+        if endpoint.method == "POST" and endpoint.path == "/settext":
+            endpoint.body = urllib.parse.urlencode({"text": settings.get("text", "")})
+
+    # Baseline stats with a fresh multiplex window and heap low-water mark
+    baseline = get_json(url, "/api/stats?reset=1", args.timeout)
+
+    results = {
+        "samples": {str(e): [] for e in endpoints},
+        "errors": {str(e): 0 for e in endpoints},
+    }
+    lock = threading.Lock()
+    snapshots = []
+    stop = threading.Event()
+    poller = threading.Thread(target=stats_poller, args=(url, args.stats_interval, stop, args.timeout, snapshots))
+    poller.start()
+
+    started = time.monotonic()
+    deadline = started + args.duration
+    workers = [
+        threading.Thread(target=client_worker, args=(url, endpoints, deadline, args.timeout, results, lock, i))
+        for i in range(args.clients)
+    ]
+    for worker in workers:
+        worker.start()
+    for worker in workers:
+        worker.join()
+    elapsed = time.monotonic() - started
+    stop.set()
+    poller.join()
+
+    try:
+        snapshots.append(get_json(url, "/api/stats", args.timeout))
+    except (OSError, RuntimeError, ValueError, http.client.HTTPException):
+        pass
+
+    report = {
+        "url": args.url,
+        "clients": args.clients,
+        "durationS": round(elapsed, 2),
+        "endpoints": {},
+    }
+    all_samples = []
+    for key, samples in results["samples"].items():
+        all_samples.extend(samples)
+        report["endpoints"][key] = {
+            "requests": len(samples),
+            "errors": results["errors"][key],
+            "rps": round(len(samples) / elapsed, 1),
+            "p50Ms": round(percentile(samples, 0.50) * 1000, 1),
+            "p99Ms": round(percentile(samples, 0.99) * 1000, 1),
+        }
+    report["total"] = {
+        "requests": len(all_samples),
+        "errors": sum(results["errors"].values()),
+        "rps": round(len(all_samples) / elapsed, 1),
+        "p50Ms": round(percentile(all_samples, 0.50) * 1000, 1),
+        "p99Ms": round(percentile(all_samples, 0.99) * 1000, 1),
+    }
+    if snapshots:
+        # minFreeHeap is the lifetime minimum, so the peak comes from the low-water mark reset with the baseline
+        # (older firmware without it: from the free heap samples alone)
+        min_free = min(min(s.get("windowMinFreeHeap", s["freeHeap"]), s["freeHeap"]) for s in snapshots)
+        report["device"] = {
+            "heapSize": baseline["heapSize"],
+            "peakHeapUsed": baseline["heapSize"] - min_free,
+            "minFreeHeap": min_free,
+            "minLargestFreeBlock": min(s["largestFreeBlock"] for s in snapshots),
+            "multiplexAvgGapUs": snapshots[-1]["refreshAvgGapUs"],
+            "multiplexMaxGapUs": max(s["refreshMaxGapUs"] for s in snapshots),
+            "multiplexJitterUs": max(s["refreshMaxGapUs"] for s in snapshots) - MULTIPLEX_INTERVAL_US,
+            "statsSamples": len(snapshots),
+        }
+
+    print_report(report)
+    if args.json:
+        with open(args.json, "w") as out:
+            json.dump(report, out, indent=2)
+    return 0 if report["total"]["errors"] == 0 else 1
+
+
+def print_report(report):
+    print("%s  clients=%d  duration=%.1fs" % (report["url"], report["clients"], report["durationS"]))
+    print("%-24s %9s %7s %9s %9s %9s" % ("endpoint", "requests", "errors", "req/s", "p50 ms", "p99 ms"))
+    rows = list(report["endpoints"].items()) + [("TOTAL", report["total"])]
+    for name, row in rows:
+        print("%-24s %9d %7d %9.1f %9.1f %9.1f" % (
+            name, row["requests"], row["errors"], row["rps"], row["p50Ms"], row["p99Ms"]))
+    device = report.get("device")
+    if device:
+        print()
+        print("peak heap used      %d of %d bytes (min free %d)" % (
+            device["peakHeapUsed"], device["heapSize"], device["minFreeHeap"]))
+        print("largest free block  %d bytes (minimum seen)" % device["minLargestFreeBlock"])
+        print("multiplex slot      avg %d us, max %d us (jitter %d us over %d us nominal)" % (
+            device["multiplexAvgGapUs"], device["multiplexMaxGapUs"], device["multiplexJitterUs"],
+            MULTIPLEX_INTERVAL_US))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("url", help="base URL of the clock, e.g. http://192.168.1.50")
+    parser.add_argument("--clients", type=int, default=4, help="concurrent clients")
+    parser.add_argument("--duration", type=float, default=20, help="seconds of load")
+    parser.add_argument("--endpoint", action="append", metavar="METHOD:/path",
+                        help="endpoint to include (repeatable, default: %s)" % ", ".join(DEFAULT_ENDPOINTS))
+    parser.add_argument("--timeout", type=float, default=5, help="per-request timeout in seconds")
+    parser.add_argument("--stats-interval", type=float, default=1, help="seconds between /api/stats samples")
+    parser.add_argument("--json", metavar="FILE", help="also write the report as JSON")
+    return run(parser.parse_args())
+
+
+if __name__ == "__main__":
+    sys.exit(main())
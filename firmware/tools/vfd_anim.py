@@ -0,0 +1,414 @@
+#!/usr/bin/env python3
+"""Compiler, emulator and uploader for VFD clock animation scripts (see src/animvm.h for the bytecode).
+
+Scripts are plain text, one instruction per line; '#' starts a comment and 'name:' defines a label:
+
+    set r0 3                # blink HELLO three times
+  blink:
+    frame "HELLO"
+    wait 300
+    frame "     "
+    wait 200
+    loop r0 blink
+  clock:
+    time r1 hour
+    num 0 r1
+    time r1 minute
+    num 3 r1
+    digit 2 "-"
+    wait 500
+    jump clock
+
+Examples:
+  vfd_anim.py compile blink.vfa --hex
+  vfd_anim.py run blink.vfa --ms 3000 --time 12:34:56
+  vfd_anim.py upload blink.vfa 192.168.1.50
+"""
+
+import argparse
+import shlex
+import sys
+import urllib.error
+import urllib.parse
+import urllib.request
+
+from vfd_stream import CHAR_MAP, NUM_DIGITS, render_text
+
+MAGIC = b"VA"
+VERSION = 1
+MAX_CODE = 1024
+REGISTERS = 8
+DEFAULT_BUDGET = 64
+MAX_CATCHUP_MS = 100
+ALL_DIGITS = 0xFF
+TIME_FIELDS = {"hour": 0, "minute": 1, "second": 2, "hundredths": 3}
+
+# Opcode, operand kinds. Kinds: pos (digit 0-7), npos (first of two digits, 0-6), mask (number, or one character other than a digit),
+# reg (r0-r7), u8, s8, u16, field (time field), addr (label), frame (eight masks or quoted text),
+# bpos (digit or "all")
+OPCODES = {
+    "end": (0x00, []),
+    "frame": (0x01, ["frame"]),
+    "digit": (0x02, ["pos", "mask"]),
+    "digitr": (0x03, ["pos", "reg"]),
+    "num": (0x04, ["npos", "reg"]),
+    "bright": (0x05, ["bpos", "u8"]),
+    "wait": (0x06, ["u16"]),
+    "waitr": (0x07, ["reg"]),
+    "set": (0x08, ["reg", "u16"]),
+    "add": (0x09, ["reg", "s8"]),
+    "rand": (0x0A, ["reg", "u16"]),
+    "time": (0x0B, ["reg", "field"]),
+    "jump": (0x0C, ["addr"]),
+    "loop": (0x0D, ["reg", "addr"]),
+    "jz": (0x0E, ["reg", "addr"]),
+}
+SIZES = {"frame": NUM_DIGITS, "addr": 2, "u16": 2}
+OP_SIZES = [0] * len(OPCODES)
+for _name, (_code, _kinds) in OPCODES.items():
+    OP_SIZES[_code] = 1 + sum(SIZES.get(kind, 1) for kind in _kinds)
+
+
+class CompileError(Exception):
+    pass
+
+
+def parse_int(token, low, high, what):
+    try:
+        value = int(token, 0)
+    except ValueError:
+        raise CompileError("expected %s, got %r" % (what, token))
+    if not low <= value <= high:
+        raise CompileError("%s %d out of range %d..%d" % (what, value, low, high))
+    return value
+
+
+def encode_operand(kind, token, labels, tokens_left):
+    if kind == "frame":
+        if len(tokens_left) == 1:
+            return render_text(tokens_left[0])
+        if len(tokens_left) != NUM_DIGITS:
+            raise CompileError("frame takes quoted text or %d masks" % NUM_DIGITS)
+        return [parse_int(t, 0, 255, "mask") for t in tokens_left]
+    if kind == "pos":
+        return [parse_int(token, 0, NUM_DIGITS - 1, "digit")]
+    if kind == "npos":
+        return [parse_int(token, 0, NUM_DIGITS - 2, "digit")]
+    if kind == "bpos":
+        return [ALL_DIGITS if token == "all" else parse_int(token, 0, NUM_DIGITS - 1, "digit")]
+    if kind == "mask":
+        if len(token) == 1 and not token.isdigit():
+            return render_text(token)[:1]
+        return [parse_int(token, 0, 255, "mask")]
+    if kind == "reg":
+        if len(token) != 2 or token[0] != "r" or not token[1].isdigit() or int(token[1]) >= REGISTERS:
+            raise CompileError("expected a register r0-r%d, got %r" % (REGISTERS - 1, token))
+        return [int(token[1])]
+    if kind == "u8":
+        return [parse_int(token, 0, 255, "value")]
+    if kind == "s8":
+        return [parse_int(token, -128, 127, "value") & 0xFF]
+    if kind == "u16":
+        value = parse_int(token, 0, 0xFFFF, "value")
+        return [value & 0xFF, value >> 8]
+    if kind == "field":
+        if token not in TIME_FIELDS:
+            raise CompileError("time field must be one of %s" % ", ".join(TIME_FIELDS))
+        return [TIME_FIELDS[token]]
+    if kind == "addr":
+        if labels is None:
+            return [0, 0]
+        if token not in labels:
+            raise CompileError("unknown label %r" % token)
+        return [labels[token] & 0xFF, labels[token] >> 8]
+    raise AssertionError(kind)
+
+
+def assemble(source):
+    """Compile script text to a complete script (header and code). Raises CompileError with the line number."""
+    lines = []
+    for number, raw in enumerate(source.splitlines(), 1):
+        try:
+            tokens = shlex.split(raw, comments=True)
+        except ValueError as error:
+            raise CompileError("line %d: %s" % (number, error))
+        while tokens and tokens[0].endswith(":"):
+            lines.append((number, tokens.pop(0)[:-1], None))
+        if tokens:
+            lines.append((number, None, tokens))
+
+    # Two passes: label addresses first, then the code with the jumps filled in
+    labels = {}
+    for final in (False, True):
+        code = []
+        for number, label, tokens in lines:
+            if label is not None:
+                if not final and label in labels:
+                    raise CompileError("line %d: duplicate label %r" % (number, label))
+                labels[label] = len(code)
+                continue
+            name, operands = tokens[0].lower(), tokens[1:]
+            if name not in OPCODES:
+                raise CompileError("line %d: unknown instruction %r" % (number, name))
+            opcode, kinds = OPCODES[name]
+            if kinds != ["frame"] and len(operands) != len(kinds):
+                raise CompileError("line %d: %s takes %d operands" % (number, name, len(kinds)))
+            if name == "rand" and operands[1] in ("0", "0x0"):
+                raise CompileError("line %d: rand needs a range above 0" % number)
+            try:
+                encoded = [opcode]
+                for i, kind in enumerate(kinds):
+                    encoded += encode_operand(kind, operands[i] if i < len(operands) else "",
+                                              labels if final else None, operands)
+            except CompileError as error:
+                raise CompileError("line %d: %s" % (number, error))
+            code += encoded
+    if not code:
+        raise CompileError("empty script")
+    if len(code) > MAX_CODE:
+        raise CompileError("script is %d bytes, the limit is %d" % (len(code), MAX_CODE))
+    return MAGIC + bytes([VERSION, 0]) + bytes(code)
+
+
+def validate(code):
+    """Same checks as AnimationVM::validate(). Returns (error name, offset), error None if the code is valid."""
+    if not code:
+        return "size", 0
+    starts = set()
+    offset = 0
+    while offset < len(code):
+        op = code[offset]
+        if op >= len(OP_SIZES):
+            return "opcode", offset
+        if offset + OP_SIZES[op] > len(code):
+            return "truncated", offset
+        starts.add(offset)
+        a = code[offset + 1:offset + OP_SIZES[op]]
+        valid = {
+            0x02: lambda: a[0] < NUM_DIGITS,
+            0x03: lambda: a[0] < NUM_DIGITS and a[1] < REGISTERS,
+            0x04: lambda: a[0] < NUM_DIGITS - 1 and a[1] < REGISTERS,
+            0x05: lambda: a[0] < NUM_DIGITS or a[0] == ALL_DIGITS,
+            0x07: lambda: a[0] < REGISTERS,
+            0x08: lambda: a[0] < REGISTERS,
+            0x09: lambda: a[0] < REGISTERS,
+            0x0A: lambda: a[0] < REGISTERS and (a[1] | a[2] << 8) > 0,
+            0x0B: lambda: a[0] < REGISTERS and a[1] <= 3,
+            0x0D: lambda: a[0] < REGISTERS,
+            0x0E: lambda: a[0] < REGISTERS,
+        }.get(op, lambda: True)
+        if not valid():
+            return "operand", offset
+        offset += OP_SIZES[op]
+    offset = 0
+    while offset < len(code):
+        op = code[offset]
+        if op in (0x0C, 0x0D, 0x0E):
+            target = code[offset + OP_SIZES[op] - 2] | code[offset + OP_SIZES[op] - 1] << 8
+            if target not in starts:
+                return "jump", offset
+        offset += OP_SIZES[op]
+    return None, 0
+
+
+class Machine:
+    """Emulates AnimationVM, including the per-tick budget and how waits are timed.
+
+    An authoring aid for previewing scripts with `run`, kept in step with src/animvm.cpp by hand. It is not a
+    reference for the firmware: the interpreter itself is tested on the host by test/test_animvm.
+    """
+
+    def __init__(self, script, budget=DEFAULT_BUDGET, seconds_of_day=0, seed=0x9E3779B9):
+        if script[:2] != MAGIC or script[2] != VERSION:
+            raise ValueError("bad header")
+        self.code = script[4:]
+        error, offset = validate(self.code)
+        if error:
+            raise ValueError("invalid script: %s at offset %d" % (error, offset))
+        self.budget = budget
+        self.seconds_of_day = seconds_of_day
+        self.state = seed | 1
+        self.running = True
+        self.pc = 0
+        self.registers = [0] * REGISTERS
+        self.frame = [0] * NUM_DIGITS
+        self.levels = [255] * NUM_DIGITS
+        self.waiting = False
+        self.resume = 0
+        self.wait_ms = 0
+        self.ticks = self.instructions = self.budget_hits = 0
+
+    def read_time(self, field, now):
+        total_ms = (self.seconds_of_day * 1000 + now) % 86400000
+        seconds = total_ms // 1000
+        return [seconds // 3600, seconds // 60 % 60, seconds % 60, total_ms // 10 % 100][field]
+
+    def update(self, now):
+        if not self.running:
+            return
+        if self.waiting:
+            if now - self.resume < self.wait_ms:
+                return
+            self.resume += self.wait_ms
+            if now - self.resume > MAX_CATCHUP_MS:
+                self.resume = now
+            self.waiting = False
+        self.ticks += 1
+        remaining = self.budget
+        while self.running and not self.waiting:
+            if remaining == 0:
+                self.budget_hits += 1
+                break
+            remaining -= 1
+            self.instructions += 1
+            self.step(now)
+
+    def step(self, now):
+        if self.pc >= len(self.code):
+            self.running = False
+            return
+        code, pc, regs = self.code, self.pc, self.registers
+        op = code[pc]
+        a = code[pc + 1:pc + OP_SIZES[op]]
+        u16 = lambda i: a[i] | a[i + 1] << 8
+        next_pc = pc + OP_SIZES[op]
+        if op == 0x00:
+            self.running = False
+            return
+        elif op == 0x01:
+            self.frame = list(a)
+        elif op == 0x02:
+            self.frame[a[0]] = a[1]
+        elif op == 0x03:
+            self.frame[a[0]] = regs[a[1]] & 0xFF
+        elif op == 0x04:
+            value = regs[a[1]] % 100
+            self.frame[a[0]:a[0] + 2] = render_text("%02d" % value)[:2]
+        elif op == 0x05:
+            for i in (range(NUM_DIGITS) if a[0] == ALL_DIGITS else [a[0]]):
+                self.levels[i] = a[1]
+        elif op in (0x06, 0x07):
+            self.wait_ms = u16(0) if op == 0x06 else regs[a[0]]
+            self.waiting = True
+            if now - self.resume > MAX_CATCHUP_MS:
+                self.resume = now
+        elif op == 0x08:
+            regs[a[0]] = u16(1)
+        elif op == 0x09:
+            regs[a[0]] = (regs[a[0]] + (a[1] - 256 if a[1] > 127 else a[1])) & 0xFFFF
+        elif op == 0x0A:
+            s = self.state
+            s ^= (s << 13) & 0xFFFFFFFF
+            s ^= s >> 17
+            s ^= (s << 5) & 0xFFFFFFFF
+            self.state = s
+            regs[a[0]] = ((s & 0xFFFF) * u16(1)) >> 16
+        elif op == 0x0B:
+            regs[a[0]] = self.read_time(a[1], now)
+        elif op == 0x0C:
+            next_pc = u16(0)
+        elif op == 0x0D:
+            regs[a[0]] = (regs[a[0]] - 1) & 0xFFFF
+            if regs[a[0]] != 0:
+                next_pc = u16(1)
+        elif op == 0x0E:
+            if regs[a[0]] == 0:
+                next_pc = u16(1)
+        self.pc = next_pc
+
+
+def describe(frame):
+    """Best-effort text for a frame: the first character with each mask, '?' for anything else."""
+    names = {}
+    for ch, mask in CHAR_MAP.items():
+        names.setdefault(mask, ch)
+    text = ""
+    for mask in frame:
+        text += names.get(mask & 0x7F, "?") + ("." if mask & 0x80 and mask != 0x80 else "")
+    return text
+
+
+def read_script(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if data[:2] == MAGIC:
+        return data
+    return assemble(data.decode("utf-8"))
+
+
+def compile_cmd(args):
+    script = read_script(args.source)
+    if args.hex:
+        print(script.hex())
+    else:
+        output = args.output or args.source.rsplit(".", 1)[0] + ".bin"
+        with open(output, "wb") as f:
+            f.write(script)
+        print("%s: %d bytes of code" % (output, len(script) - 4))
+    return 0
+
+
+def run_cmd(args):
+    hours, minutes, seconds = (int(part) for part in args.time.split(":"))
+    machine = Machine(read_script(args.source), args.budget, hours * 3600 + minutes * 60 + seconds)
+    shown = None
+    for now in range(0, args.ms + 1, args.tick):
+        machine.update(now)
+        state = (tuple(machine.frame), tuple(machine.levels))
+        if state != shown:
+            shown = state
+            levels = "" if set(machine.levels) == {255} else "  levels=" + ",".join(map(str, machine.levels))
+            masks = " ".join("%02x" % m for m in machine.frame)
+            print("%7d ms  [%-8s]  %s%s" % (now, describe(machine.frame), masks, levels))
+        if not machine.running:
+            print("%7d ms  end" % now)
+            break
+    print("ticks=%d instructions=%d budget_hits=%d" % (machine.ticks, machine.instructions, machine.budget_hits))
+    return 0
+
+
+def upload_cmd(args):
+    fields = {"script": read_script(args.source).hex()}
+    if args.stop:
+        fields["action"] = "stop"
+    request = urllib.request.Request("http://%s/api/animation" % args.host, urllib.parse.urlencode(fields).encode())
+    try:
+        with urllib.request.urlopen(request, timeout=10) as response:
+            print(response.read().decode())
+    except urllib.error.HTTPError as error:
+        print("%d %s" % (error.code, error.read().decode()))
+        return 1
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("compile", help="compile a script to bytecode")
+    p.add_argument("source")
+    p.add_argument("-o", "--output", help="output file (default: source with .bin)")
+    p.add_argument("--hex", action="store_true", help="print the script as hex instead of writing a file")
+
+    p = sub.add_parser("run", help="run a script in the emulator and print the frames")
+    p.add_argument("source", help="script text or compiled .bin")
+    p.add_argument("--ms", type=int, default=5000, help="time to emulate")
+    p.add_argument("--tick", type=int, default=1, help="ms between updates (the clock updates about once per ms)")
+    p.add_argument("--budget", type=int, default=DEFAULT_BUDGET, help="instructions per update")
+    p.add_argument("--time", default="00:00:00", help="local time at the start, HH:MM:SS")
+
+    p = sub.add_parser("upload", help="compile and upload a script; it is stored and started")
+    p.add_argument("source")
+    p.add_argument("host")
+    p.add_argument("--stop", action="store_true", help="store the script without starting it")
+
+    args = parser.parse_args()
+    try:
+        return {"compile": compile_cmd, "run": run_cmd, "upload": upload_cmd}[args.command](args)
+    except (CompileError, ValueError, OSError) as error:
+        print("error: %s" % error, file=sys.stderr)
+        return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())
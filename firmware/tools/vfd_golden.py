@@ -0,0 +1,69 @@
+#!/usr/bin/env python3
+"""Display regression check: runs the host emulator's scenes against the golden matrices.
+
+Each scene below is run through the emulator (lib/vfd_emulator, built by `pio run -e native`) with --expect
+against its brightness matrix in lib/vfd_emulator/golden. A segment that drifts by more than the tolerance
+fails the check, so a change to the multiplexer, the renderers or the pin mapping that alters what the tube
+shows is caught on the host. After an intended change, --update rewrites the goldens from the current build.
+
+Examples:
+  pio run -e native && tools/vfd_golden.py
+  tools/vfd_golden.py --program ./vfd_emulator stalled_digit
+  tools/vfd_golden.py --update
+"""
+
+import argparse
+import os
+import subprocess
+import sys
+
+FIRMWARE_DIR = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+GOLDEN_DIR = os.path.join(FIRMWARE_DIR, "lib", "vfd_emulator", "golden")
+DEFAULT_PROGRAM = os.path.join(FIRMWARE_DIR, ".pio", "build", "native", "program")
+
+# Scene name (and golden file name) to emulator arguments
+SCENES = {
+    "clock": ["--clock", "12:34:56"],
+    "dimmed_digit": ["--text", "88888888", "--digit", "3:64"],
+    "stalled_digit": ["--text", "88888888", "--stall", "7:3000", "--ms", "3000", "--window", "1000"],
+}
+
+
+def run_scene(program, name, update, tolerance):
+    golden = os.path.join(GOLDEN_DIR, name + ".txt")
+    command = [program, "--no-terminal"] + SCENES[name]
+    command += ["--matrix", golden] if update else ["--expect", golden, "--tolerance", str(tolerance)]
+    result = subprocess.run(command, stdout=subprocess.PIPE, stderr=subprocess.STDOUT, universal_newlines=True)
+    return result.returncode, result.stdout.strip()
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument("scenes", nargs="*", metavar="scene",
+                        help="scenes to run (default all: %s)" % ", ".join(sorted(SCENES)))
+    parser.add_argument("--program", default=DEFAULT_PROGRAM, help="emulator binary (default: the native build)")
+    parser.add_argument("--tolerance", type=float, default=0.02, help="allowed difference per segment")
+    parser.add_argument("--update", action="store_true", help="rewrite the goldens instead of comparing")
+    args = parser.parse_args()
+    for name in args.scenes:
+        if name not in SCENES:
+            parser.error("unknown scene %r" % name)
+
+    if not os.path.exists(args.program):
+        print("%s not found; build it with: pio run -e native" % args.program, file=sys.stderr)
+        return 2
+
+    failed = 0
+    for name in args.scenes or sorted(SCENES):
+        status, output = run_scene(args.program, name, args.update, args.tolerance)
+        print("%-14s %s" % (name, "ok" if status == 0 else "FAILED"))
+        if status != 0 or args.update:
+            print("  " + output.replace("\n", "\n  "))
+        if status != 0:
+            failed += 1
+
+    return 1 if failed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,137 @@
+#!/usr/bin/env python3
+"""Heap report and steady-state allocation check for the VFD clock (see src/heapprofile.h).
+
+Allocation counts and call sites need firmware built with -DHEAP_PROFILE and the --wrap linker flags from
+platformio.ini; the free heap history is always available. Call sites are return addresses in the firmware;
+with --elf they are resolved to functions and source lines with addr2line. A site in String's buffer code stands
+for every String that grows; `guard --abort` panics at the first violation, so the serial backtrace shows which.
+
+`guard` is the test: it arms the clock's allocation guard, leaves the clock alone for a while and fails if
+anything on the loop task allocated outside the exempt web, network and settings work.
+
+Examples:
+  vfd_heap.py report 192.168.1.50 --elf .pio/build/seeed_xiao_esp32c3/firmware.elf
+  vfd_heap.py guard 192.168.1.50 --seconds 600 --elf .pio/build/seeed_xiao_esp32c3/firmware.elf
+"""
+
+import argparse
+import json
+import subprocess
+import sys
+import time
+import urllib.error
+import urllib.parse
+import urllib.request
+
+DEFAULT_ADDR2LINE = "riscv32-esp-elf-addr2line"
+
+
+class HeapError(Exception):
+    pass
+
+
+def request(host, data=None):
+    url = "http://%s/api/heap" % host
+    body = urllib.parse.urlencode(data).encode() if data is not None else None
+    try:
+        with urllib.request.urlopen(url, data=body, timeout=10) as response:
+            return json.load(response)
+    except urllib.error.HTTPError as error:
+        detail = error.read().decode(errors="replace")
+        raise HeapError("%s: %d %s" % (url, error.code, detail))
+
+
+def resolve(addresses, elf, addr2line):
+    """Maps each address to 'function at file:line', or to itself without an ELF file."""
+    names = {address: "" for address in addresses}
+    if not elf or not addresses:
+        return names
+    try:
+        output = subprocess.run([addr2line, "-f", "-C", "-p", "-e", elf] + list(addresses), check=True,
+                                capture_output=True, text=True).stdout
+    except (OSError, subprocess.CalledProcessError) as error:
+        print("warning: addr2line failed: %s" % error, file=sys.stderr)
+        return names
+    for address, line in zip(addresses, output.splitlines()):
+        names[address] = line.strip()
+    return names
+
+
+def report_cmd(args):
+    heap = request(args.host)
+    print("free %d bytes, largest block %d (lowest sampled %d), lowest free %d" %
+          (heap["freeHeap"], heap["largestFreeBlock"], heap["lowestLargestFreeBlock"], heap["minFreeHeap"]))
+
+    if heap["tracking"]:
+        print("%d allocations (%d bytes, %d failed), %d frees; loop task: %d allocations, %d bytes" %
+              (heap["allocations"], heap["bytes"], heap["failures"], heap["frees"], heap["loopAllocations"],
+               heap["loopBytes"]))
+        sites = sorted(heap["sites"], key=lambda site: site["count"], reverse=True)[:args.top]
+        names = resolve([site["address"] for site in sites], args.elf, args.addr2line)
+        print("\n%10s %10s  call site" % ("count", "bytes"))
+        for site in sites:
+            print("%10d %10d  %s %s" % (site["count"], site["bytes"], site["address"], names[site["address"]]))
+        other = heap["otherSites"]
+        if other["count"]:
+            print("%10d %10d  (other sites)" % (other["count"], other["bytes"]))
+    else:
+        print("allocation tracking is not compiled in (build with -DHEAP_PROFILE)")
+
+    if heap["history"]:
+        print("\n%8s %10s %10s %12s" % ("uptime", "free", "largest", "allocations"))
+        for sample in heap["history"]:
+            print("%7dm %10d %10d %12d" % (sample["uptimeS"] // 60, sample["freeHeap"], sample["largestFreeBlock"],
+                                           sample["allocations"]))
+    return 0
+
+
+def guard_cmd(args):
+    heap = request(args.host, {"action": "guard", "abort": "1" if args.abort else "0"})
+    start_allocations = heap["loopAllocations"]
+    print("guard armed; leave the clock alone for %d s" % args.seconds)
+    time.sleep(args.seconds)
+
+    heap = request(args.host)
+    if not args.keep:
+        request(args.host, {"action": "disarm"})
+
+    guard = heap["guard"]
+    print("loop task: %d allocations while armed (exempt work included)" % (heap["loopAllocations"] - start_allocations))
+    if guard["violations"] == 0:
+        print("PASS: no allocation on the loop task in steady state")
+        return 0
+
+    print("FAIL: %d allocations on the loop task in steady state" % guard["violations"])
+    names = resolve([site["address"] for site in guard["sites"]], args.elf, args.addr2line)
+    for site in guard["sites"]:
+        print("  %6d bytes from %s %s" % (site["size"], site["address"], names[site["address"]]))
+    return 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    for name, help_text in (("report", "show the heap history and the top allocation sites"),
+                            ("guard", "fail if the loop task allocates in steady state")):
+        p = sub.add_parser(name, help=help_text)
+        p.add_argument("host")
+        p.add_argument("--elf", help="firmware.elf to resolve call sites")
+        p.add_argument("--addr2line", default=DEFAULT_ADDR2LINE, help="addr2line of the RISC-V toolchain")
+        if name == "report":
+            p.add_argument("--top", type=int, default=15, help="call sites to list")
+        else:
+            p.add_argument("--seconds", type=int, default=300, help="how long to watch")
+            p.add_argument("--abort", action="store_true", help="panic at the first violation (backtrace on serial)")
+            p.add_argument("--keep", action="store_true", help="leave the guard armed afterwards")
+
+    args = parser.parse_args()
+    try:
+        return {"report": report_cmd, "guard": guard_cmd}[args.command](args)
+    except (HeapError, OSError, ValueError, KeyError) as error:
+        print("error: %s" % error, file=sys.stderr)
+        return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main())
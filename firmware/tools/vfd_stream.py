@@ -0,0 +1,330 @@
+#!/usr/bin/env python3
+"""Host-side sender for the VFD clock UDP frame stream (see src/framestream.h for the packet layout).
+
+Examples:
+  vfd_stream.py send 192.168.1.50 --effect spinner --fps 60
+  vfd_stream.py send 192.168.1.50 --effect text --text "ALERT" --brightness 128
+  vfd_stream.py listen --port 4210
+  vfd_stream.py loopback --frames 600 --fps 120
+  vfd_stream.py record show.vfr --effect marquee --text "WORKERS UNITE" --fps 10 --seconds 60
+  vfd_stream.py dump show.vfr
+"""
+
+import argparse
+import socket
+import struct
+import sys
+import threading
+import time
+
+MAGIC = b"VF"
+VERSION = 1
+HEADER = struct.Struct("<2sBBIIB")
+FLAG_BRIGHTNESS = 0x01
+FLAG_NEW_STREAM = 0x02
+DEFAULT_PORT = 4210
+NUM_DIGITS = 8
+RECORDING_MAGIC = b"VR"
+RECORDING_VERSION = 1
+
+# Same segment map as src/segmentfont.h (bit 0 = A ... bit 6 = G, bit 7 = H/period)
+CHAR_MAP = {
+    "0": 0x3F, "1": 0x06, "2": 0x5B, "3": 0x4F, "4": 0x66, "5": 0x6D, "6": 0x7D, "7": 0x07,
+    "8": 0x7F, "9": 0x6F, "A": 0x77, "B": 0x7C, "C": 0x39, "D": 0x5E, "E": 0x79, "F": 0x71,
+    "G": 0x3D, "H": 0x76, "I": 0x30, "J": 0x1E, "K": 0x76, "L": 0x38, "M": 0x15, "N": 0x37,
+    "O": 0x3F, "P": 0x73, "Q": 0x67, "R": 0x33, "S": 0x6D, "T": 0x78, "U": 0x3E, "V": 0x1E,
+    "W": 0x2A, "X": 0x76, "Y": 0x6E, "Z": 0x5B, " ": 0x00, "-": 0x40, "_": 0x08, ".": 0x80,
+}
+
+
+def render_strip(text):
+    """Render text to segment masks, folding '.' into the previous digit like setDisplayText()."""
+    masks = []
+    for ch in text.upper():
+        if ch == "." and masks and not masks[-1] & 0x80:
+            masks[-1] |= 0x80
+            continue
+        masks.append(CHAR_MAP.get(ch, 0))
+    return masks
+
+
+def render_text(text, digits=NUM_DIGITS):
+    masks = render_strip(text)[:digits]
+    return masks + [0] * (digits - len(masks))
+
+
+def encode(sequence, timestamp_ms, masks, brightness=None, new_stream=False):
+    flags = (FLAG_BRIGHTNESS if brightness is not None else 0) | (FLAG_NEW_STREAM if new_stream else 0)
+    packet = HEADER.pack(MAGIC, VERSION, flags, sequence & 0xFFFFFFFF, timestamp_ms & 0xFFFFFFFF, len(masks))
+    packet += bytes(masks)
+    if brightness is not None:
+        packet += bytes([brightness])
+    return packet
+
+
+def decode(packet):
+    """Return (flags, sequence, timestamp, masks, brightness) or raise ValueError."""
+    if len(packet) < HEADER.size:
+        raise ValueError("short packet")
+    magic, version, flags, sequence, timestamp, count = HEADER.unpack_from(packet)
+    if magic != MAGIC or version != VERSION:
+        raise ValueError("bad magic/version")
+    end = HEADER.size + count
+    if count == 0 or len(packet) < end + (1 if flags & FLAG_BRIGHTNESS else 0):
+        raise ValueError("bad digit count")
+    brightness = packet[end] if flags & FLAG_BRIGHTNESS else None
+    return flags, sequence, timestamp, list(packet[HEADER.size:end]), brightness
+
+
+def encode_recording(frames, digits=NUM_DIGITS, end_ms=None):
+    """Delta-encode (time_ms, masks, brightness) tuples into a recording file (see src/recording.h).
+
+    Like FrameRecorder::stop(), the file ends with a hold record that keeps the last frame shown until end_ms
+    (default: the last frame's time), so trailing unchanged frames still count towards the length of the show.
+    """
+    data = bytearray(RECORDING_MAGIC + bytes([RECORDING_VERSION, digits]))
+    shown = [None] * digits
+    shown_brightness = None
+    last_time = 0
+    frame_time = None
+
+    def varint(value):
+        out = bytearray()
+        while True:
+            out.append((value & 0x7F) | (0x80 if value > 0x7F else 0))
+            value >>= 7
+            if not value:
+                return out
+
+    for time_ms, masks, brightness in frames:
+        frame_time = time_ms
+        delay = time_ms - last_time
+        if brightness is not None and brightness != shown_brightness:
+            data += varint(delay) + bytes([0, brightness])
+            shown_brightness = brightness
+            delay = 0
+            last_time = time_ms
+        mask = 0
+        changed = bytearray()
+        for i, segments in enumerate(masks[:digits]):
+            if segments != shown[i]:
+                mask |= 1 << i
+                changed.append(segments)
+                shown[i] = segments
+        if mask:
+            data += varint(delay) + bytes([mask]) + changed
+            last_time = time_ms
+    if frame_time is not None:
+        hold_until = frame_time if end_ms is None else max(end_ms, frame_time)
+        data += varint(hold_until - last_time) + bytes([1, shown[0]])
+    return bytes(data)
+
+
+def decode_recording(data):
+    """Yield (time_ms, masks, brightness) for every record; masks is the whole frame after the record."""
+    if len(data) < 4 or data[:2] != RECORDING_MAGIC or data[2] != RECORDING_VERSION or not 1 <= data[3] <= 8:
+        raise ValueError("not a recording")
+    digits = data[3]
+    masks = [0] * digits
+    brightness = None
+    time_ms = 0
+    pos = 4
+    while pos < len(data):
+        delay = shift = 0
+        while True:
+            if pos >= len(data):
+                raise ValueError("truncated record at offset %d" % pos)
+            byte = data[pos]
+            pos += 1
+            delay |= (byte & 0x7F) << shift
+            shift += 7
+            if not byte & 0x80:
+                break
+        if pos >= len(data):
+            raise ValueError("truncated record at offset %d" % pos)
+        mask = data[pos]
+        pos += 1
+        count = 1 if mask == 0 else bin(mask).count("1")
+        if pos + count > len(data):
+            raise ValueError("truncated record at offset %d" % pos)
+        payload = data[pos:pos + count]
+        pos += count
+        time_ms += delay
+        if mask == 0:
+            brightness = payload[0]
+        else:
+            changed = iter(payload)
+            for i in range(8):
+                if mask & (1 << i):
+                    value = next(changed)
+                    if i < digits:
+                        masks[i] = value
+        yield time_ms, list(masks), brightness
+
+
+def effect_frames(args):
+    """Yield segment frames for the selected effect, forever."""
+    n = 0
+    if args.effect == "text":
+        masks = render_text(args.text)
+        while True:
+            yield masks
+    elif args.effect == "spinner":
+        ring = [0x01, 0x02, 0x04, 0x08, 0x10, 0x20]
+        while True:
+            yield [ring[(n + i) % len(ring)] for i in range(NUM_DIGITS)]
+            n += 1
+    elif args.effect == "counter":
+        while True:
+            yield render_text("%08d" % (n % 100000000))
+            n += 1
+    elif args.effect == "marquee":
+        strip = render_strip(" " * NUM_DIGITS + args.text + " " * NUM_DIGITS)
+        while True:
+            offset = (n // max(1, args.fps // 10)) % (len(strip) - NUM_DIGITS + 1)
+            yield strip[offset:offset + NUM_DIGITS]
+            n += 1
+
+
+def send(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    interval = 1.0 / args.fps
+    start = time.monotonic()
+    sequence = args.start_sequence
+    frames = effect_frames(args)
+    count = 0
+    while args.count == 0 or count < args.count:
+        now_ms = int((time.monotonic() - start) * 1000)
+        packet = encode(sequence, now_ms, next(frames), args.brightness, new_stream=(count == 0))
+        sock.sendto(packet, (args.host, args.port))
+        sequence += 1
+        count += 1
+        # Schedule against the start time so the frame rate does not drift
+        delay = start + count * interval - time.monotonic()
+        if delay > 0:
+            time.sleep(delay)
+    return 0
+
+
+def listen(args):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind((args.bind, args.port))
+    print("listening on %s:%d" % (args.bind, args.port))
+    while True:
+        packet, addr = sock.recvfrom(2048)
+        try:
+            flags, sequence, timestamp, masks, brightness = decode(packet)
+        except ValueError as error:
+            print("%s: invalid packet (%s)" % (addr[0], error))
+            continue
+        print("%s seq=%d ts=%d flags=%#x brightness=%s masks=%s" % (
+            addr[0], sequence, timestamp, flags, brightness, " ".join("%02x" % m for m in masks)))
+
+
+def loopback(args):
+    """Send frames to a local listener and check framing, ordering and loss."""
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("127.0.0.1", 0))
+    sock.settimeout(1.0)
+    args.host, args.port = sock.getsockname()
+    args.count = args.frames
+    args.start_sequence = 0xFFFFFFFF - args.frames // 2  # Exercise sequence wrap-around
+
+    received = []
+    errors = []
+
+    def receiver():
+        while len(received) + len(errors) < args.frames:
+            try:
+                packet, _ = sock.recvfrom(2048)
+            except socket.timeout:
+                return
+            try:
+                received.append(decode(packet))
+            except ValueError as error:
+                errors.append(str(error))
+
+    thread = threading.Thread(target=receiver)
+    thread.start()
+    started = time.monotonic()
+    send(args)
+    elapsed = time.monotonic() - started
+    thread.join()
+
+    reordered = 0
+    for previous, current in zip(received, received[1:]):
+        if (current[1] - previous[1]) & 0xFFFFFFFF != 1:
+            reordered += 1
+    lost = args.frames - len(received) - len(errors)
+    print("sent=%d received=%d invalid=%d lost=%d out_of_order=%d rate=%.1f fps" % (
+        args.frames, len(received), len(errors), lost, reordered, args.frames / elapsed))
+    return 0 if not errors and lost == 0 and reordered == 0 else 1
+
+
+def record(args):
+    """Render an effect into a recording file for playback from the clock's flash."""
+    frames = effect_frames(args)
+    count = args.fps * args.seconds
+    data = encode_recording(((n * 1000 // args.fps, next(frames), args.brightness) for n in range(count)),
+                            end_ms=count * 1000 // args.fps)
+    with open(args.output, "wb") as f:
+        f.write(data)
+    print("%s: %d frames, %d bytes (%.1f bytes per frame)" % (args.output, count, len(data), len(data) / max(1, count)))
+    print("upload with: curl -F file=@%s http://<clock-ip>/api/recording/upload" % args.output)
+    return 0
+
+
+def dump(args):
+    with open(args.file, "rb") as f:
+        data = f.read()
+    records = 0
+    for time_ms, masks, brightness in decode_recording(data):
+        records += 1
+        print("%8d ms  %s%s" % (time_ms, " ".join("%02x" % m for m in masks),
+                                "" if brightness is None else "  brightness=%d" % brightness))
+    print("%d records, %d bytes" % (records, len(data)))
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    def add_effect_args(p):
+        p.add_argument("--effect", choices=["text", "spinner", "counter", "marquee"], default="spinner")
+        p.add_argument("--text", default="HELLO")
+        p.add_argument("--fps", type=int, default=60)
+        p.add_argument("--brightness", type=int, choices=range(256), metavar="0-255")
+
+    p = sub.add_parser("send", help="stream frames to a clock")
+    p.add_argument("host")
+    p.add_argument("--port", type=int, default=DEFAULT_PORT)
+    p.add_argument("--count", type=int, default=0, help="frames to send (0 = forever)")
+    p.add_argument("--start-sequence", type=int, default=0)
+    add_effect_args(p)
+
+    p = sub.add_parser("listen", help="decode and print received frames")
+    p.add_argument("--bind", default="0.0.0.0")
+    p.add_argument("--port", type=int, default=DEFAULT_PORT)
+
+    p = sub.add_parser("loopback", help="send frames over localhost and verify them")
+    p.add_argument("--frames", type=int, default=600)
+    add_effect_args(p)
+
+    p = sub.add_parser("record", help="render an effect into a recording file")
+    p.add_argument("output")
+    p.add_argument("--seconds", type=int, default=10)
+    add_effect_args(p)
+
+    p = sub.add_parser("dump", help="print the frames of a recording file")
+    p.add_argument("file")
+
+    args = parser.parse_args()
+    try:
+        return {"send": send, "listen": listen, "loopback": loopback, "record": record, "dump": dump}[args.command](args)
+    except KeyboardInterrupt:
+        return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,187 @@
+#!/usr/bin/env python3
+"""Download and convert the VFD clock trace buffer (see src/trace.h; the firmware must be built with -DTRACE).
+
+The clock records begin/end events of the multiplex, the SPI writes, the ADC reads, the boost regulator and
+the web server, plus an instant event each time a digit is lit. This tool turns the binary dump into Chrome
+trace event JSON for chrome://tracing or ui.perfetto.dev: the calls go on one track and the lit digits on
+another, so a digit that stayed lit too long lines up with the call that held the loop.
+
+Examples:
+  vfd_trace.py fetch 192.168.1.50 -o trace.json
+  vfd_trace.py convert trace.bin -o trace.json
+  vfd_trace.py slow trace.bin --over 1500
+  curl -d trigger=2000 http://192.168.1.50/api/trace    # keep the events leading up to a 2 ms digit
+"""
+
+import argparse
+import json
+import struct
+import sys
+import urllib.error
+import urllib.request
+
+TRACE_VERSION = 1
+DIGIT_BLANK = 0xFFFF
+PHASE_BEGIN, PHASE_END, PHASE_INSTANT = 0, 1, 2
+CALLS_TID = 1
+DIGITS_TID = 2
+
+
+class TraceError(Exception):
+    pass
+
+
+class Trace:
+    def __init__(self, names, overwritten, events):
+        self.names = names
+        self.overwritten = overwritten
+        self.events = events   # (time_us, name, phase, argument), time unwrapped and starting at 0
+
+
+def parse(data):
+    if len(data) < 4 or data[0:2] != b"VT":
+        raise TraceError("not a trace dump")
+    if data[2] != TRACE_VERSION:
+        raise TraceError("unsupported trace version %d" % data[2])
+
+    offset = 4
+    names = []
+    for _ in range(data[3]):
+        end = data.index(b"\0", offset)
+        names.append(data[offset:end].decode())
+        offset = end + 1
+
+    overwritten, count = struct.unpack_from("<II", data, offset)
+    offset += 8
+    if len(data) - offset < count * 8:
+        raise TraceError("dump is cut short: %d of %d events" % ((len(data) - offset) // 8, count))
+
+    events = []
+    base = None
+    previous = 0
+    high = 0
+    for time_us, event_id, phase, argument in struct.iter_unpack("<IBBH", data[offset:offset + count * 8]):
+        # Timestamps are the low 32 bits of esp_timer; the buffer spans far less than a wrap
+        if base is not None and time_us < previous:
+            high += 1 << 32
+        previous = time_us
+        time_us += high
+        if base is None:
+            base = time_us
+        name = names[event_id] if event_id < len(names) else "event %d" % event_id
+        events.append((time_us - base, name, phase, argument))
+    return Trace(names, overwritten, events)
+
+
+def lit_periods(trace):
+    """Yields (start_us, end_us, position) for every digit that was lit."""
+    lit = None
+    for time_us, name, phase, argument in trace.events:
+        if phase != PHASE_INSTANT or name != "digit":
+            continue
+        if lit is not None:
+            yield lit[0], time_us, lit[1]
+        lit = (time_us, argument) if argument != DIGIT_BLANK else None
+
+
+def calls(trace):
+    """Yields (start_us, end_us, name) for every matched begin/end pair; unmatched ends are dropped."""
+    open_calls = {}
+    for time_us, name, phase, argument in trace.events:
+        if phase == PHASE_BEGIN:
+            open_calls.setdefault(name, []).append(time_us)
+        elif phase == PHASE_END and open_calls.get(name):
+            yield open_calls[name].pop(), time_us, name
+
+
+def to_chrome(trace):
+    events = [
+        {"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "VFD clock"}},
+        {"name": "thread_name", "ph": "M", "pid": 1, "tid": CALLS_TID, "args": {"name": "loop"}},
+        {"name": "thread_name", "ph": "M", "pid": 1, "tid": DIGITS_TID, "args": {"name": "lit digit"}},
+    ]
+    for start, end, name in calls(trace):
+        events.append({"name": name, "ph": "X", "ts": start, "dur": end - start, "pid": 1, "tid": CALLS_TID})
+    for start, end, position in lit_periods(trace):
+        events.append({"name": "digit %d" % position, "ph": "X", "ts": start, "dur": end - start, "pid": 1,
+                       "tid": DIGITS_TID, "args": {"position": position, "lit_us": end - start}})
+    return {"traceEvents": events, "displayTimeUnit": "ms", "otherData": {"overwritten": trace.overwritten}}
+
+
+def read_input(source):
+    if source.startswith("http://"):
+        try:
+            with urllib.request.urlopen(source, timeout=10) as response:
+                return response.read()
+        except urllib.error.HTTPError as error:
+            raise TraceError("%s: %d (is the firmware built with -DTRACE?)" % (source, error.code))
+    with open(source, "rb") as f:
+        return f.read()
+
+
+def write_chrome(trace, output):
+    with open(output, "w") as f:
+        json.dump(to_chrome(trace), f)
+    span = trace.events[-1][0] if trace.events else 0
+    print("%d events over %.1f ms (%d overwritten) -> %s" % (len(trace.events), span / 1000.0, trace.overwritten,
+                                                            output))
+
+
+def fetch_cmd(args):
+    data = read_input("http://%s/trace.bin" % args.host)
+    if args.raw:
+        with open(args.raw, "wb") as f:
+            f.write(data)
+    write_chrome(parse(data), args.output)
+    return 0
+
+
+def convert_cmd(args):
+    write_chrome(parse(read_input(args.source)), args.output)
+    return 0
+
+
+def slow_cmd(args):
+    trace = parse(read_input(args.source))
+    all_calls = list(calls(trace))
+    found = 0
+    for start, end, position in lit_periods(trace):
+        if end - start < args.over:
+            continue
+        found += 1
+        print("digit %d lit %d us at %.3f ms" % (position, end - start, start / 1000.0))
+        for call_start, call_end, name in all_calls:
+            if call_start < end and call_end > start and name != "writeToMAX6921":
+                print("  %-22s %6d us at %.3f ms" % (name, call_end - call_start, call_start / 1000.0))
+    if found == 0:
+        print("no digit was lit for %d us or longer" % args.over)
+    return 0
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+
+    p = sub.add_parser("fetch", help="download the trace from a clock and convert it")
+    p.add_argument("host")
+    p.add_argument("-o", "--output", default="trace.json", help="Chrome trace JSON file")
+    p.add_argument("--raw", help="also keep the binary dump in this file")
+
+    p = sub.add_parser("convert", help="convert a downloaded trace.bin")
+    p.add_argument("source", help="trace.bin or http://<clock-ip>/trace.bin")
+    p.add_argument("-o", "--output", default="trace.json", help="Chrome trace JSON file")
+
+    p = sub.add_parser("slow", help="list digits lit too long and the calls that ran meanwhile")
+    p.add_argument("source", help="trace.bin or http://<clock-ip>/trace.bin")
+    p.add_argument("--over", type=int, default=1500, help="lit time in us to report (a slot is 1000 us)")
+
+    args = parser.parse_args()
+    try:
+        return {"fetch": fetch_cmd, "convert": convert_cmd, "slow": slow_cmd}[args.command](args)
+    except (TraceError, ValueError, OSError, struct.error) as error:
+        print("error: %s" % error, file=sys.stderr)
+        return 1
+
+
+if __name__ == "__main__":
+    sys.exit(main())